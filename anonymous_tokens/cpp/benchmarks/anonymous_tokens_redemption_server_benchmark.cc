@@ -0,0 +1,398 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Verifier throughput and latency for requests built by
+// AnonymousTokensRedemptionClient with a 2048-bit key, by batch size and
+// number of distinct public metadata values per request (0 for a key without
+// public metadata support).
+//
+// BM_ProcessRequest redeems fresh tokens with AnonymousTokensRedemptionServer,
+// on the calling thread or on a pool of 4 workers and the calling thread, and
+// reports requests per second and latency quantiles. Every token is redeemed
+// once; when all tokens have been redeemed, the spent tokens are expired
+// outside of the timed region and the requests are replayed.
+// BM_ProcessReplayedRequest redeems tokens that are all spent already.
+// BM_PerTokenVerifiers is the loop the server replaces: one verifier per
+// token, derived from the key if it has public metadata support, one masked
+// message copy and one Verify per token. Neither caches derived keys, so
+// derivation is part of every request.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:anonymous_tokens_redemption_server_benchmark
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_redemption_client.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_rsa_bssa_client.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/server/anonymous_tokens_redemption_server.h"
+#include "anonymous_tokens/cpp/server/anonymous_tokens_rsa_bssa_server.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr absl::string_view kUseCase = "TEST_USE_CASE";
+// Key version 1 has no public metadata support, key version 2 has.
+constexpr int64_t kKeyVersionWithoutMetadata = 1;
+constexpr int64_t kKeyVersionWithMetadata = 2;
+constexpr int kNumPoolThreads = 4;
+// Tokens issued per number of public metadata values.
+constexpr int kNumTokens = 1024;
+
+IssuerKeyConfig MakeConfig(const std::pair<RSAPublicKey, RSAPrivateKey>& keys,
+                           int64_t key_version, bool public_metadata_support) {
+  IssuerKeyConfig config;
+  config.private_key = keys.second;
+  config.public_key.set_use_case(std::string(kUseCase));
+  config.public_key.set_key_version(key_version);
+  config.public_key.set_serialized_public_key(keys.first.SerializeAsString());
+  config.public_key.set_sig_hash_type(AT_HASH_TYPE_SHA384);
+  config.public_key.set_mask_gen_function(AT_MGF_SHA384);
+  config.public_key.set_salt_length(kSaltLengthInBytes48);
+  config.public_key.set_key_size(keys.first.n().size());
+  config.public_key.set_message_mask_type(AT_MESSAGE_MASK_CONCAT);
+  config.public_key.set_message_mask_size(kRsaMessageMaskSizeInBytes32);
+  config.public_key.set_public_metadata_support(public_metadata_support);
+  return config;
+}
+
+ReloadableIssuerKeyring* GetKeyring() {
+  static ReloadableIssuerKeyring* const kKeyring = [] {
+    auto keys_1 = GetStrongRsaKeys2048();
+    auto keys_2 = GetAnotherStrongRsaKeys2048();
+    if (!keys_1.ok() || !keys_2.ok()) {
+      return static_cast<ReloadableIssuerKeyring*>(nullptr);
+    }
+    const std::vector<IssuerKeyConfig> configs = {
+        MakeConfig(*keys_1, kKeyVersionWithoutMetadata, false),
+        MakeConfig(*keys_2, kKeyVersionWithMetadata, true)};
+    auto keyring = ReloadableIssuerKeyring::New(configs);
+    return keyring.ok() ? keyring->release() : nullptr;
+  }();
+  return kKeyring;
+}
+
+ThreadPool* GetThreadPool() {
+  static ThreadPool* const kThreadPool =
+      ThreadPool::New(kNumPoolThreads).value().release();
+  return kThreadPool;
+}
+
+int64_t KeyVersionFor(int num_metadata_values) {
+  return num_metadata_values > 0 ? kKeyVersionWithMetadata
+                                 : kKeyVersionWithoutMetadata;
+}
+
+// Issues kNumTokens tokens whose public metadata cycles through
+// 'num_metadata_values' values.
+absl::StatusOr<std::vector<RSABlindSignatureTokenWithInput>> IssueTokens(
+    int num_metadata_values) {
+  ReloadableIssuerKeyring::Snapshot keyring = GetKeyring()->Acquire();
+  const IssuerKey* key =
+      keyring->FindByVersion(kUseCase, KeyVersionFor(num_metadata_values));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::unique_ptr<AnonymousTokensRsaBssaClient> client,
+      AnonymousTokensRsaBssaClient::Create(key->public_key()));
+  std::vector<PlaintextMessageWithPublicMetadata> inputs(kNumTokens);
+  for (int i = 0; i < kNumTokens; ++i) {
+    inputs[i].set_plaintext_message(absl::StrCat("message ", i));
+    if (num_metadata_values > 0) {
+      inputs[i].set_public_metadata(
+          absl::StrCat("metadata ", i % num_metadata_values));
+    }
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignRequest request,
+                               client->CreateRequest(inputs));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::unique_ptr<AnonymousTokensRsaBssaServer> issuer,
+      AnonymousTokensRsaBssaServer::New(GetKeyring(), {}));
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignResponse response,
+                               issuer->ProcessRequest(request));
+  return client->ProcessResponse(response);
+}
+
+// Splits the tokens with 'num_metadata_values' public metadata values into
+// redemption requests of 'batch_size' tokens, and checks that the client
+// accepts the server's response to the first one. Tokens are issued once per
+// number of public metadata values.
+absl::StatusOr<std::vector<AnonymousTokensRedemptionRequest>> MakeRequests(
+    int batch_size, int num_metadata_values) {
+  using Tokens = std::vector<RSABlindSignatureTokenWithInput>;
+  static auto* const kTokens = new absl::flat_hash_map<int, Tokens>;
+  auto issued = kTokens->find(num_metadata_values);
+  if (issued == kTokens->end()) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(Tokens tokens,
+                                 IssueTokens(num_metadata_values));
+    issued = kTokens->emplace(num_metadata_values, std::move(tokens)).first;
+  }
+  const Tokens& tokens = issued->second;
+  std::vector<AnonymousTokensRedemptionRequest> requests;
+  std::unique_ptr<AnonymousTokensRedemptionClient> first_client;
+  for (int begin = 0; begin + batch_size <= kNumTokens; begin += batch_size) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        std::unique_ptr<AnonymousTokensRedemptionClient> client,
+        AnonymousTokensRedemptionClient::Create(
+            TEST_USE_CASE, KeyVersionFor(num_metadata_values)));
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        AnonymousTokensRedemptionRequest request,
+        client->CreateAnonymousTokensRedemptionRequest(
+            {tokens.begin() + begin, tokens.begin() + begin + batch_size}));
+    requests.push_back(std::move(request));
+    if (first_client == nullptr) {
+      first_client = std::move(client);
+    }
+  }
+
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::unique_ptr<SpentTokenStore> spent_tokens,
+                               SpentTokenStore::New({}));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::unique_ptr<AnonymousTokensRedemptionServer> server,
+      AnonymousTokensRedemptionServer::New(
+          GetKeyring(), {{std::string(kUseCase), spent_tokens.get()}}, {}));
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensRedemptionResponse response,
+                               server->ProcessRequest(requests[0]));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::vector<RSABlindSignatureRedemptionResult> results,
+      first_client->ProcessAnonymousTokensRedemptionResponse(response));
+  for (const RSABlindSignatureRedemptionResult& result : results) {
+    if (!result.redeemed()) {
+      return absl::InternalError("A fresh token was not redeemed.");
+    }
+  }
+  return requests;
+}
+
+void SetLatencyCounters(benchmark::State& state,
+                        const LatencyHistogram& latencies) {
+  const LatencyHistogram::Snapshot snapshot = latencies.GetSnapshot();
+  const auto micros = [](absl::Duration d) {
+    return absl::ToDoubleMicroseconds(d);
+  };
+  state.counters["requests_per_s"] =
+      benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["p50_us"] = micros(snapshot.Quantile(0.5));
+  state.counters["p99_us"] = micros(snapshot.Quantile(0.99));
+  state.counters["max_us"] = micros(snapshot.max);
+}
+
+// Args: batch size, number of public metadata values, whether the thread pool
+// is used.
+void BM_ProcessRequest(benchmark::State& state) {
+  auto requests = MakeRequests(state.range(0), state.range(1));
+  if (!requests.ok()) {
+    state.SkipWithError(std::string(requests.status().message()).c_str());
+    return;
+  }
+  const int64_t key_version = KeyVersionFor(state.range(1));
+  std::unique_ptr<SpentTokenStore> spent_tokens =
+      SpentTokenStore::New({}).value();
+  AnonymousTokensRedemptionServer::Options options;
+  if (state.range(2) != 0) {
+    options.thread_pool = GetThreadPool();
+  }
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      AnonymousTokensRedemptionServer::New(
+          GetKeyring(), {{std::string(kUseCase), spent_tokens.get()}},
+          std::move(options))
+          .value();
+  LatencyHistogram latencies;
+  size_t next = 0;
+  for (auto _ : state) {
+    if (next == requests->size()) {
+      state.PauseTiming();
+      spent_tokens->ExpireKeyVersion(key_version);
+      next = 0;
+      state.ResumeTiming();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    absl::StatusOr<AnonymousTokensRedemptionResponse> response =
+        server->ProcessRequest((*requests)[next++]);
+    latencies.Record(
+        absl::FromChrono(std::chrono::steady_clock::now() - start));
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  SetLatencyCounters(state, latencies);
+}
+BENCHMARK(BM_ProcessRequest)
+    ->ArgNames({"batch", "metadata", "pool"})
+    ->ArgsProduct({{1, 32, 256}, {0, 1, 8}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+// Args: batch size.
+void BM_ProcessReplayedRequest(benchmark::State& state) {
+  auto requests = MakeRequests(state.range(0), 0);
+  if (!requests.ok()) {
+    state.SkipWithError(std::string(requests.status().message()).c_str());
+    return;
+  }
+  std::unique_ptr<SpentTokenStore> spent_tokens =
+      SpentTokenStore::New({}).value();
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      AnonymousTokensRedemptionServer::New(
+          GetKeyring(), {{std::string(kUseCase), spent_tokens.get()}}, {})
+          .value();
+  for (const AnonymousTokensRedemptionRequest& request : *requests) {
+    if (!server->ProcessRequest(request).ok()) {
+      state.SkipWithError("Redeeming the tokens failed.");
+      return;
+    }
+  }
+  LatencyHistogram latencies;
+  size_t next = 0;
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    absl::StatusOr<AnonymousTokensRedemptionResponse> response =
+        server->ProcessRequest((*requests)[next]);
+    latencies.Record(
+        absl::FromChrono(std::chrono::steady_clock::now() - start));
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(response);
+    next = (next + 1) % requests->size();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  SetLatencyCounters(state, latencies);
+}
+BENCHMARK(BM_ProcessReplayedRequest)
+    ->ArgName("batch")
+    ->Arg(32)
+    ->Arg(256)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+absl::StatusOr<AnonymousTokensRedemptionResponse> RedeemWithPerTokenVerifiers(
+    const IssuerKeyring& keyring,
+    const AnonymousTokensRedemptionRequest& request,
+    SpentTokenStore* spent_tokens) {
+  AnonymousTokensRedemptionResponse response;
+  for (const auto& token : request.anonymous_tokens_to_redeem()) {
+    const IssuerKey* key =
+        keyring.FindByVersion(token.use_case(), token.key_version());
+    if (key == nullptr) {
+      return absl::InvalidArgumentError("Unknown key.");
+    }
+    auto* result = response.add_anonymous_token_redemption_results();
+    result->set_use_case(token.use_case());
+    result->set_key_version(token.key_version());
+    result->set_public_metadata(token.public_metadata());
+    result->set_serialized_unblinded_token(token.serialized_unblinded_token());
+    result->set_plaintext_message(token.plaintext_message());
+    result->set_message_mask(token.message_mask());
+    RsaSsaPssVerifier* verifier = key->verifier();
+    std::unique_ptr<RsaSsaPssVerifier> derived_verifier;
+    if (key->key_deriver() != nullptr) {
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          const EVP_MD* sig_hash,
+          ProtoHashTypeToEVPDigest(key->public_key().sig_hash_type()));
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          const EVP_MD* mgf1_hash,
+          ProtoMaskGenFunctionToEVPDigest(
+              key->public_key().mask_gen_function()));
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          derived_verifier,
+          RsaSsaPssVerifier::New(key->public_key().salt_length(), sig_hash,
+                                 mgf1_hash, key->rsa_public_key(),
+                                 /*use_rsa_public_exponent=*/false,
+                                 token.public_metadata()));
+      verifier = derived_verifier.get();
+    }
+    if (verifier
+            ->Verify(token.serialized_unblinded_token(),
+                     MaskMessageConcat(token.message_mask(),
+                                       token.plaintext_message()))
+            .ok()) {
+      const bool fresh = spent_tokens->CheckAndInsert(
+          token.key_version(), token.serialized_unblinded_token());
+      result->set_verified(fresh);
+      result->set_double_spent(!fresh);
+    }
+  }
+  return response;
+}
+
+// Args: batch size, number of public metadata values.
+void BM_PerTokenVerifiers(benchmark::State& state) {
+  auto requests = MakeRequests(state.range(0), state.range(1));
+  if (!requests.ok()) {
+    state.SkipWithError(std::string(requests.status().message()).c_str());
+    return;
+  }
+  const int64_t key_version = KeyVersionFor(state.range(1));
+  std::unique_ptr<SpentTokenStore> spent_tokens =
+      SpentTokenStore::New({}).value();
+  LatencyHistogram latencies;
+  size_t next = 0;
+  for (auto _ : state) {
+    if (next == requests->size()) {
+      state.PauseTiming();
+      spent_tokens->ExpireKeyVersion(key_version);
+      next = 0;
+      state.ResumeTiming();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    ReloadableIssuerKeyring::Snapshot keyring = GetKeyring()->Acquire();
+    absl::StatusOr<AnonymousTokensRedemptionResponse> response =
+        RedeemWithPerTokenVerifiers(*keyring, (*requests)[next++],
+                                    spent_tokens.get());
+    latencies.Record(
+        absl::FromChrono(std::chrono::steady_clock::now() - start));
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  SetLatencyCounters(state, latencies);
+}
+BENCHMARK(BM_PerTokenVerifiers)
+    ->ArgNames({"batch", "metadata"})
+    ->ArgsProduct({{1, 32, 256}, {0, 1, 8}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
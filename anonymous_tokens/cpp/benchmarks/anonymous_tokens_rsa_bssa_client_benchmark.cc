@@ -0,0 +1,156 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Full AnonymousTokensRsaBssaClient round trip: creating the client and the
+// sign request, signing every blinded message with an RsaBlindSigner and
+// processing the response, for several key sizes, hash functions, batch sizes
+// and with and without public metadata.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:anonymous_tokens_rsa_bssa_client_benchmark
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_rsa_bssa_client.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/shared/proto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr absl::string_view kUseCase = "TEST_USE_CASE";
+constexpr absl::string_view kPublicMetadata = "metadata";
+
+struct RoundTripFixture {
+  RSABlindSignaturePublicKey public_key;
+  std::unique_ptr<RsaBlindSigner> signer;
+  std::vector<PlaintextMessageWithPublicMetadata> inputs;
+};
+
+// The salt is as long as the digest, as recommended for RSA-PSS.
+absl::StatusOr<RoundTripFixture> MakeFixture(int key_size_bits, int hash_bits,
+                                             int batch_size,
+                                             bool use_public_metadata) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(auto keys, GetStrongRsaKeys(key_size_bits));
+  RoundTripFixture fixture;
+  fixture.public_key.set_use_case(std::string(kUseCase));
+  fixture.public_key.set_key_version(1);
+  fixture.public_key.set_serialized_public_key(keys.first.SerializeAsString());
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      *fixture.public_key.mutable_key_validity_start_time(),
+      TimeToProto(absl::Now() - absl::Minutes(100)));
+  if (hash_bits == 256) {
+    fixture.public_key.set_sig_hash_type(AT_HASH_TYPE_SHA256);
+    fixture.public_key.set_mask_gen_function(AT_MGF_SHA256);
+    fixture.public_key.set_salt_length(32);
+  } else {
+    fixture.public_key.set_sig_hash_type(AT_HASH_TYPE_SHA384);
+    fixture.public_key.set_mask_gen_function(AT_MGF_SHA384);
+    fixture.public_key.set_salt_length(kSaltLengthInBytes48);
+  }
+  fixture.public_key.set_key_size(key_size_bits / 8);
+  fixture.public_key.set_message_mask_type(AT_MESSAGE_MASK_CONCAT);
+  fixture.public_key.set_message_mask_size(kRsaMessageMaskSizeInBytes32);
+  fixture.public_key.set_public_metadata_support(use_public_metadata);
+
+  std::optional<absl::string_view> public_metadata;
+  if (use_public_metadata) {
+    public_metadata = kPublicMetadata;
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      fixture.signer,
+      RsaBlindSigner::New(keys.second, /*use_rsa_public_exponent=*/false,
+                          public_metadata));
+  for (int i = 0; i < batch_size; ++i) {
+    PlaintextMessageWithPublicMetadata input;
+    input.set_plaintext_message(absl::StrCat("message ", i));
+    if (use_public_metadata) {
+      input.set_public_metadata(std::string(kPublicMetadata));
+    }
+    fixture.inputs.push_back(std::move(input));
+  }
+  return fixture;
+}
+
+absl::StatusOr<AnonymousTokensSignResponse> Sign(
+    const AnonymousTokensSignRequest& request, const RsaBlindSigner& signer) {
+  AnonymousTokensSignResponse response;
+  for (const auto& request_token : request.blinded_tokens()) {
+    auto* response_token = response.add_anonymous_tokens();
+    response_token->set_use_case(request_token.use_case());
+    response_token->set_key_version(request_token.key_version());
+    response_token->set_public_metadata(request_token.public_metadata());
+    response_token->set_serialized_blinded_message(
+        request_token.serialized_token());
+    response_token->set_do_not_use_rsa_public_exponent(true);
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        *response_token->mutable_serialized_token(),
+        signer.Sign(request_token.serialized_token()));
+  }
+  return response;
+}
+
+absl::Status RoundTrip(const RoundTripFixture& fixture) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      auto client, AnonymousTokensRsaBssaClient::Create(fixture.public_key));
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignRequest request,
+                               client->CreateRequest(fixture.inputs));
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignResponse response,
+                               Sign(request, *fixture.signer));
+  ANON_TOKENS_ASSIGN_OR_RETURN(auto tokens, client->ProcessResponse(response));
+  benchmark::DoNotOptimize(tokens);
+  return absl::OkStatus();
+}
+
+// Args: key size in bits, digest size in bits, batch size, whether public
+// metadata is used.
+void BM_RoundTrip(benchmark::State& state) {
+  auto fixture = MakeFixture(state.range(0), state.range(1), state.range(2),
+                             state.range(3) != 0);
+  if (!fixture.ok()) {
+    state.SkipWithError(std::string(fixture.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    absl::Status status = RoundTrip(*fixture);
+    if (!status.ok()) {
+      state.SkipWithError(std::string(status.message()).c_str());
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(2));
+}
+
+BENCHMARK(BM_RoundTrip)
+    ->ArgNames({"key_bits", "hash_bits", "batch", "metadata"})
+    ->ArgsProduct({{2048, 3072, 4096}, {256, 384}, {1, 32}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,218 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Issuer throughput for requests built by AnonymousTokensRsaBssaClient with a
+// 2048-bit key, by batch size and number of distinct public metadata values
+// per request (0 for a key without public metadata support).
+//
+// BM_ProcessRequest signs with AnonymousTokensRsaBssaServer, on the calling
+// thread or on a pool of 4 workers and the calling thread. BM_PerTokenSigners
+// is the loop the server replaces: one signer per token, built from the key
+// deriver if the key has public metadata support, and one Sign per token.
+// Neither caches derived keys, so derivation is part of every request.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:anonymous_tokens_rsa_bssa_server_benchmark
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_rsa_bssa_client.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/server/anonymous_tokens_rsa_bssa_server.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr absl::string_view kUseCase = "TEST_USE_CASE";
+// Key version 1 has no public metadata support, key version 2 has.
+constexpr int64_t kKeyVersionWithoutMetadata = 1;
+constexpr int64_t kKeyVersionWithMetadata = 2;
+constexpr int kNumPoolThreads = 4;
+
+IssuerKeyConfig MakeConfig(const std::pair<RSAPublicKey, RSAPrivateKey>& keys,
+                           int64_t key_version, bool public_metadata_support) {
+  IssuerKeyConfig config;
+  config.private_key = keys.second;
+  config.public_key.set_use_case(std::string(kUseCase));
+  config.public_key.set_key_version(key_version);
+  config.public_key.set_serialized_public_key(keys.first.SerializeAsString());
+  config.public_key.set_sig_hash_type(AT_HASH_TYPE_SHA384);
+  config.public_key.set_mask_gen_function(AT_MGF_SHA384);
+  config.public_key.set_salt_length(kSaltLengthInBytes48);
+  config.public_key.set_key_size(keys.first.n().size());
+  config.public_key.set_message_mask_type(AT_MESSAGE_MASK_CONCAT);
+  config.public_key.set_message_mask_size(kRsaMessageMaskSizeInBytes32);
+  config.public_key.set_public_metadata_support(public_metadata_support);
+  return config;
+}
+
+ReloadableIssuerKeyring* GetKeyring() {
+  static ReloadableIssuerKeyring* const kKeyring = [] {
+    auto keys_1 = GetStrongRsaKeys2048();
+    auto keys_2 = GetAnotherStrongRsaKeys2048();
+    if (!keys_1.ok() || !keys_2.ok()) {
+      return static_cast<ReloadableIssuerKeyring*>(nullptr);
+    }
+    const std::vector<IssuerKeyConfig> configs = {
+        MakeConfig(*keys_1, kKeyVersionWithoutMetadata, false),
+        MakeConfig(*keys_2, kKeyVersionWithMetadata, true)};
+    auto keyring = ReloadableIssuerKeyring::New(configs);
+    return keyring.ok() ? keyring->release() : nullptr;
+  }();
+  return kKeyring;
+}
+
+ThreadPool* GetThreadPool() {
+  static ThreadPool* const kThreadPool =
+      ThreadPool::New(kNumPoolThreads).value().release();
+  return kThreadPool;
+}
+
+// Builds a request of 'batch_size' tokens whose public metadata cycles through
+// 'num_metadata_values' values, and checks that the client accepts the
+// server's response to it.
+absl::StatusOr<AnonymousTokensSignRequest> MakeRequest(
+    int batch_size, int num_metadata_values) {
+  ReloadableIssuerKeyring::Snapshot keyring = GetKeyring()->Acquire();
+  const IssuerKey* key = keyring->FindByVersion(
+      kUseCase, num_metadata_values > 0 ? kKeyVersionWithMetadata
+                                        : kKeyVersionWithoutMetadata);
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::unique_ptr<AnonymousTokensRsaBssaClient> client,
+      AnonymousTokensRsaBssaClient::Create(key->public_key()));
+  std::vector<PlaintextMessageWithPublicMetadata> inputs(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    inputs[i].set_plaintext_message(absl::StrCat("message ", i));
+    if (num_metadata_values > 0) {
+      inputs[i].set_public_metadata(
+          absl::StrCat("metadata ", i % num_metadata_values));
+    }
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignRequest request,
+                               client->CreateRequest(inputs));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::unique_ptr<AnonymousTokensRsaBssaServer> server,
+      AnonymousTokensRsaBssaServer::New(GetKeyring(), {}));
+  ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignResponse response,
+                               server->ProcessRequest(request));
+  ANON_TOKENS_RETURN_IF_ERROR(client->ProcessResponse(response).status());
+  return request;
+}
+
+// Args: batch size, number of public metadata values, whether the thread pool
+// is used.
+void BM_ProcessRequest(benchmark::State& state) {
+  auto request = MakeRequest(state.range(0), state.range(1));
+  if (!request.ok()) {
+    state.SkipWithError(std::string(request.status().message()).c_str());
+    return;
+  }
+  AnonymousTokensRsaBssaServer::Options options;
+  if (state.range(2) != 0) {
+    options.thread_pool = GetThreadPool();
+  }
+  std::unique_ptr<AnonymousTokensRsaBssaServer> server =
+      AnonymousTokensRsaBssaServer::New(GetKeyring(), std::move(options))
+          .value();
+  for (auto _ : state) {
+    absl::StatusOr<AnonymousTokensSignResponse> response =
+        server->ProcessRequest(*request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ProcessRequest)
+    ->ArgNames({"batch", "metadata", "pool"})
+    ->ArgsProduct({{1, 32, 256}, {0, 1, 8}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+absl::StatusOr<AnonymousTokensSignResponse> SignWithPerTokenSigners(
+    const IssuerKeyring& keyring, const AnonymousTokensSignRequest& request) {
+  AnonymousTokensSignResponse response;
+  for (const auto& request_token : request.blinded_tokens()) {
+    const IssuerKey* key = keyring.FindByVersion(request_token.use_case(),
+                                                 request_token.key_version());
+    if (key == nullptr) {
+      return absl::InvalidArgumentError("Unknown key.");
+    }
+    auto* response_token = response.add_anonymous_tokens();
+    response_token->set_use_case(request_token.use_case());
+    response_token->set_key_version(request_token.key_version());
+    response_token->set_public_metadata(request_token.public_metadata());
+    response_token->set_serialized_blinded_message(
+        request_token.serialized_token());
+    response_token->set_do_not_use_rsa_public_exponent(true);
+    const RsaBlindSigner* signer = key->signer();
+    std::unique_ptr<RsaBlindSigner> derived_signer;
+    if (key->key_deriver() != nullptr) {
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          derived_signer, RsaBlindSigner::New(*key->key_deriver(),
+                                              request_token.public_metadata()));
+      signer = derived_signer.get();
+    }
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        *response_token->mutable_serialized_token(),
+        signer->Sign(request_token.serialized_token()));
+  }
+  return response;
+}
+
+// Args: batch size, number of public metadata values.
+void BM_PerTokenSigners(benchmark::State& state) {
+  auto request = MakeRequest(state.range(0), state.range(1));
+  if (!request.ok()) {
+    state.SkipWithError(std::string(request.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    ReloadableIssuerKeyring::Snapshot keyring = GetKeyring()->Acquire();
+    absl::StatusOr<AnonymousTokensSignResponse> response =
+        SignWithPerTokenSigners(*keyring, *request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PerTokenSigners)
+    ->ArgNames({"batch", "metadata"})
+    ->ArgsProduct({{1, 32, 256}, {0, 1, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,147 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// End-to-end blind/sign/unblind throughput and heap allocations per token.
+// Allocations are counted through operator new and BoringSSL's
+// OPENSSL_memory_alloc hook, so both C++ and BIGNUM/BN_CTX allocations show
+// up in the allocs_per_token counter.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:blind_sign_unblind_benchmark
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/digest.h>
+
+namespace {
+
+std::atomic<uint64_t> num_allocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+extern "C" {
+
+void* OPENSSL_memory_alloc(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size);
+}
+void OPENSSL_memory_free(void* ptr) { std::free(ptr); }
+size_t OPENSSL_memory_get_size(void* ptr) { return malloc_usable_size(ptr); }
+
+}  // extern "C"
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kSaltLength = 48;
+constexpr absl::string_view kMessage = "message to sign";
+constexpr absl::string_view kPublicMetadata = "metadata";
+
+std::optional<absl::string_view> MetadataForArg(int64_t use_metadata) {
+  if (use_metadata == 0) return std::nullopt;
+  return kPublicMetadata;
+}
+
+void ReportAllocations(benchmark::State& state, uint64_t start) {
+  state.counters["allocs_per_token"] = benchmark::Counter(
+      static_cast<double>(num_allocations.load() - start),
+      benchmark::Counter::kAvgIterations);
+}
+
+// Args: whether public metadata is used.
+void BM_BlindSignUnblind(benchmark::State& state) {
+  const std::optional<absl::string_view> public_metadata =
+      MetadataForArg(state.range(0));
+  auto keys = GetStrongRsaKeys2048();
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  auto key_context = RsaBlindingKeyContext::New(
+      keys->first.n(), keys->first.e(), EVP_sha384(), EVP_sha384(),
+      kSaltLength, /*use_rsa_public_exponent=*/false);
+  auto signer = RsaBlindSigner::New(
+      keys->second, /*use_rsa_public_exponent=*/false, public_metadata);
+  if (!key_context.ok() || !signer.ok()) {
+    state.SkipWithError("Setup failed.");
+    return;
+  }
+
+  const uint64_t start = num_allocations.load();
+  for (auto _ : state) {
+    auto blinder = RsaBlinder::New(*key_context, public_metadata);
+    auto blinded = (*blinder)->Blind(kMessage);
+    auto blind_signature = (*signer)->Sign(*blinded);
+    auto signature = (*blinder)->Unblind(*blind_signature);
+    if (!signature.ok()) {
+      state.SkipWithError(std::string(signature.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(signature);
+  }
+  ReportAllocations(state, start);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Cost of deriving the signing key for a public metadata value.
+void BM_NewSignerWithPublicMetadata(benchmark::State& state) {
+  auto keys = GetStrongRsaKeys2048();
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  const uint64_t start = num_allocations.load();
+  for (auto _ : state) {
+    auto signer = RsaBlindSigner::New(
+        keys->second, /*use_rsa_public_exponent=*/false, kPublicMetadata);
+    benchmark::DoNotOptimize(signer);
+  }
+  ReportAllocations(state, start);
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_BlindSignUnblind)
+    ->ArgName("metadata")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_NewSignerWithPublicMetadata)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace anonymous_tokens
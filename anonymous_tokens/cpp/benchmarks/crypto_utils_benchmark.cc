@@ -0,0 +1,193 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Cost of deriving the public and private keys for a public metadata value as
+// the key size and the metadata length grow, from the signing key alone and
+// with an RsaPrivateKeyDeriver, and of hashing a message with each supported
+// hash function.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:crypto_utils_benchmark
+
+#include <cstdint>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/digest.h>
+
+namespace anonymous_tokens {
+namespace {
+
+// Returns the hash function with a digest of 'bits' bits.
+const EVP_MD* HashForArg(int64_t bits) {
+  switch (bits) {
+    case 256:
+      return EVP_sha256();
+    case 384:
+      return EVP_sha384();
+    default:
+      return EVP_sha512();
+  }
+}
+
+// Args: key size in bits, public metadata size in bytes.
+void BM_ComputeExponentWithPublicMetadata(benchmark::State& state) {
+  const std::string public_metadata(state.range(1), 'm');
+  auto keys = GetStrongRsaKeys(state.range(0));
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  auto n = StringToBignum(keys->first.n());
+  if (!n.ok()) {
+    state.SkipWithError(std::string(n.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto exponent = ComputeExponentWithPublicMetadata(**n, public_metadata);
+    benchmark::DoNotOptimize(exponent);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Args: key size in bits, public metadata size in bytes.
+void BM_CreatePublicKeyWithPublicMetadata(benchmark::State& state) {
+  const std::string public_metadata(state.range(1), 'm');
+  auto keys = GetStrongRsaKeys(state.range(0));
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto public_key = CreatePublicKeyRSAWithPublicMetadata(
+        keys->first.n(), keys->first.e(), public_metadata,
+        /*use_rsa_public_exponent=*/false);
+    benchmark::DoNotOptimize(public_key);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// CreatePrivateKeyWithPublicMetadata is internal to RsaBlindSigner, so this
+// measures RsaBlindSigner::New, which is dominated by it.
+//
+// Args: key size in bits, public metadata size in bytes.
+void BM_CreatePrivateKeyWithPublicMetadata(benchmark::State& state) {
+  const std::string public_metadata(state.range(1), 'm');
+  auto keys = GetStrongRsaKeys(state.range(0));
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto signer = RsaBlindSigner::New(
+        keys->second, /*use_rsa_public_exponent=*/false, public_metadata);
+    benchmark::DoNotOptimize(signer);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// RsaBlindSigner::New with an RsaPrivateKeyDeriver that was set up once for
+// the signing key, to compare with BM_CreatePrivateKeyWithPublicMetadata.
+//
+// Args: key size in bits, public metadata size in bytes.
+void BM_CreatePrivateKeyWithKeyDeriver(benchmark::State& state) {
+  const std::string public_metadata(state.range(1), 'm');
+  auto keys = GetStrongRsaKeys(state.range(0));
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  auto key_deriver = RsaPrivateKeyDeriver::New(
+      keys->second, /*use_rsa_public_exponent=*/false);
+  if (!key_deriver.ok()) {
+    state.SkipWithError(std::string(key_deriver.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto signer = RsaBlindSigner::New(**key_deriver, public_metadata);
+    benchmark::DoNotOptimize(signer);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// RsaPrivateKeyDeriver::Derive alone, without the signer setup.
+//
+// Args: key size in bits, public metadata size in bytes.
+void BM_RsaPrivateKeyDeriverDerive(benchmark::State& state) {
+  const std::string public_metadata(state.range(1), 'm');
+  auto keys = GetStrongRsaKeys(state.range(0));
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  auto key_deriver = RsaPrivateKeyDeriver::New(
+      keys->second, /*use_rsa_public_exponent=*/false);
+  if (!key_deriver.ok()) {
+    state.SkipWithError(std::string(key_deriver.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto private_key = (*key_deriver)->Derive(public_metadata);
+    benchmark::DoNotOptimize(private_key);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Args: digest size in bits, message size in bytes.
+void BM_ComputeHash(benchmark::State& state) {
+  const EVP_MD* hasher = HashForArg(state.range(0));
+  const std::string message(state.range(1), 'm');
+  for (auto _ : state) {
+    auto digest = ComputeHash(message, *hasher);
+    benchmark::DoNotOptimize(digest);
+  }
+  state.SetBytesProcessed(state.iterations() * message.size());
+}
+
+BENCHMARK(BM_ComputeExponentWithPublicMetadata)
+    ->ArgNames({"key_bits", "metadata_bytes"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 32, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_CreatePublicKeyWithPublicMetadata)
+    ->ArgNames({"key_bits", "metadata_bytes"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 32, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_CreatePrivateKeyWithPublicMetadata)
+    ->ArgNames({"key_bits", "metadata_bytes"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 32, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_CreatePrivateKeyWithKeyDeriver)
+    ->ArgNames({"key_bits", "metadata_bytes"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 32, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_RsaPrivateKeyDeriverDerive)
+    ->ArgNames({"key_bits", "metadata_bytes"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 32, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_ComputeHash)
+    ->ArgNames({"hash_bits", "message_bytes"})
+    ->ArgsProduct({{256, 384, 512}, {32, 1024, 16384}});
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,96 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Cost of hashing a message with public metadata when the encoded message is
+// materialized with EncodeMessagePublicMetadata compared to when it is fed to
+// the hash incrementally, and the same for a whole RsaBlinder::Blind call.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:message_hash_benchmark
+
+#include <cstdint>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include <openssl/digest.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kSaltLength = 48;
+constexpr absl::string_view kPublicMetadata = "metadata";
+
+// Args: message size in bytes.
+void BM_HashEncodedMessage(benchmark::State& state) {
+  const std::string message(state.range(0), 'm');
+  for (auto _ : state) {
+    auto digest = ComputeHash(
+        EncodeMessagePublicMetadata(message, kPublicMetadata), *EVP_sha384());
+    benchmark::DoNotOptimize(digest);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Args: message size in bytes.
+void BM_HashMessageIncrementally(benchmark::State& state) {
+  const std::string message(state.range(0), 'm');
+  for (auto _ : state) {
+    auto digest = ComputeMessageHash(message, kPublicMetadata, *EVP_sha384());
+    benchmark::DoNotOptimize(digest);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Args: message size in bytes.
+void BM_NewBlinderAndBlind(benchmark::State& state) {
+  const TestRsaPublicKey public_key = GetStrongTestRsaKeyPair2048().first;
+  auto key_context = RsaBlindingKeyContext::New(
+      public_key.n, public_key.e, EVP_sha384(), EVP_sha384(), kSaltLength,
+      /*use_rsa_public_exponent=*/false);
+  if (!key_context.ok()) {
+    state.SkipWithError(std::string(key_context.status().message()).c_str());
+    return;
+  }
+  const std::string message(state.range(0), 'm');
+  for (auto _ : state) {
+    auto blinder = RsaBlinder::New(*key_context, kPublicMetadata);
+    auto blinded = (*blinder)->Blind(message);
+    benchmark::DoNotOptimize(blinded);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_HashEncodedMessage)
+    ->ArgName("message_bytes")
+    ->RangeMultiplier(8)
+    ->Range(32, 1 << 20);
+
+BENCHMARK(BM_HashMessageIncrementally)
+    ->ArgName("message_bytes")
+    ->RangeMultiplier(8)
+    ->Range(32, 1 << 20);
+
+BENCHMARK(BM_NewBlinderAndBlind)
+    ->ArgName("message_bytes")
+    ->RangeMultiplier(8)
+    ->Range(32, 1 << 20)
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,187 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Latency of serving a request from a ReloadableIssuerKeyring (acquiring a
+// snapshot, finding the signing key, signing one blinded message and verifying
+// one token) from several threads, while another thread reloads the keyring
+// every few milliseconds. Comparing the quantiles with and without reloads
+// shows whether rotation makes requests wait.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:reloadable_issuer_keyring_benchmark
+
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/digest.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr absl::string_view kUseCase = "TEST_USE_CASE";
+
+// Keys, a blinded message and a token shared by all benchmarks.
+struct Fixture {
+  std::vector<IssuerKeyConfig> keys;
+  std::unique_ptr<ReloadableIssuerKeyring> keyring;
+  std::string blinded_message;
+  // A token of the newest key, which FindSigningKey returns.
+  std::string token;
+  std::string message;
+};
+
+IssuerKeyConfig MakeConfig(const std::pair<RSAPublicKey, RSAPrivateKey>& keys,
+                           int64_t key_version) {
+  IssuerKeyConfig config;
+  config.private_key = keys.second;
+  config.public_key.set_use_case(std::string(kUseCase));
+  config.public_key.set_key_version(key_version);
+  config.public_key.set_serialized_public_key(keys.first.SerializeAsString());
+  config.public_key.set_sig_hash_type(AT_HASH_TYPE_SHA384);
+  config.public_key.set_mask_gen_function(AT_MGF_SHA384);
+  config.public_key.set_salt_length(kSaltLengthInBytes48);
+  config.public_key.set_key_size(keys.first.n().size());
+  config.public_key.set_message_mask_type(AT_MESSAGE_MASK_NO_MASK);
+  return config;
+}
+
+absl::StatusOr<std::unique_ptr<Fixture>> MakeFixture() {
+  auto fixture = std::make_unique<Fixture>();
+  ANON_TOKENS_ASSIGN_OR_RETURN(auto keys_1, GetStrongRsaKeys2048());
+  ANON_TOKENS_ASSIGN_OR_RETURN(auto keys_2, GetAnotherStrongRsaKeys2048());
+  fixture->keys = {MakeConfig(keys_1, 1), MakeConfig(keys_2, 2)};
+  ANON_TOKENS_ASSIGN_OR_RETURN(fixture->keyring,
+                               ReloadableIssuerKeyring::New(fixture->keys));
+
+  std::mt19937_64 generator(0);
+  std::uniform_int_distribution<int> distr_u8(0, 255);
+  fixture->blinded_message =
+      RandomString(keys_2.first.n().size(), &distr_u8, &generator);
+  fixture->blinded_message[0] = 0;
+  fixture->message = "message";
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::string encoded_message,
+      EncodeMessageForTests(fixture->message, keys_2.first, EVP_sha384(),
+                            EVP_sha384(), kSaltLengthInBytes48));
+  ReloadableIssuerKeyring::Snapshot snapshot = fixture->keyring->Acquire();
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      fixture->token,
+      snapshot->FindByVersion(kUseCase, 2)->signer()->Sign(encoded_message));
+  return fixture;
+}
+
+Fixture* GetFixture() {
+  static Fixture* const kFixture = [] {
+    auto fixture = MakeFixture();
+    return fixture.ok() ? fixture->release() : nullptr;
+  }();
+  return kFixture;
+}
+
+// Signs the blinded message and verifies the token with the current signing
+// key.
+absl::Status ServeRequest(const Fixture& fixture) {
+  ReloadableIssuerKeyring::Snapshot snapshot = fixture.keyring->Acquire();
+  const IssuerKey* key = snapshot->FindSigningKey(kUseCase, absl::Now());
+  if (key == nullptr) {
+    return absl::NotFoundError("No signing key.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::string signature,
+                               key->signer()->Sign(fixture.blinded_message));
+  benchmark::DoNotOptimize(signature);
+  return key->verifier()->Verify(fixture.token, fixture.message);
+}
+
+// Arg: milliseconds between reloads, or 0 for no reloads.
+void BM_ServeRequestWhileReloading(benchmark::State& state) {
+  Fixture* fixture = GetFixture();
+  if (fixture == nullptr) {
+    state.SkipWithError("Creating the keyring failed.");
+    return;
+  }
+  const absl::Duration reload_interval = absl::Milliseconds(state.range(0));
+  std::atomic<bool> stop_reloading{false};
+  std::atomic<int64_t> num_reloads{0};
+  std::thread reloader;
+  // One reloader per benchmark run, owned by its first thread.
+  if (state.thread_index() == 0 && reload_interval > absl::ZeroDuration()) {
+    reloader = std::thread([&] {
+      while (!stop_reloading.load()) {
+        absl::SleepFor(reload_interval);
+        if (fixture->keyring->Reload(fixture->keys).ok()) {
+          num_reloads.fetch_add(1);
+        }
+      }
+    });
+  }
+
+  LatencyHistogram latencies;
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    absl::Status status = ServeRequest(*fixture);
+    latencies.Record(
+        absl::FromChrono(std::chrono::steady_clock::now() - start));
+    if (!status.ok()) {
+      state.SkipWithError(status.ToString().c_str());
+      break;
+    }
+  }
+
+  if (reloader.joinable()) {
+    stop_reloading = true;
+    reloader.join();
+    state.counters["reloads"] = num_reloads.load();
+  }
+  const LatencyHistogram::Snapshot snapshot = latencies.GetSnapshot();
+  const auto micros = [](absl::Duration d) {
+    return absl::ToDoubleMicroseconds(d);
+  };
+  state.counters["p50_us"] = benchmark::Counter(
+      micros(snapshot.Quantile(0.5)), benchmark::Counter::kAvgThreads);
+  state.counters["p99_us"] = benchmark::Counter(
+      micros(snapshot.Quantile(0.99)), benchmark::Counter::kAvgThreads);
+  state.counters["max_us"] = benchmark::Counter(
+      micros(snapshot.max), benchmark::Counter::kAvgThreads);
+}
+BENCHMARK(BM_ServeRequestWhileReloading)
+    ->ArgName("reload_ms")
+    ->Arg(0)
+    ->Arg(50)
+    ->Arg(5)
+    ->Threads(1)
+    ->Threads(4)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
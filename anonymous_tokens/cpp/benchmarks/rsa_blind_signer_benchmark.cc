@@ -0,0 +1,146 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput of RsaBlindSigner::SignBatch, which signs with an
+// RsaBatchSigningEngine, compared to calling RsaBlindSigner::Sign in a loop,
+// with the signing key itself and with a key derived from public metadata.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:rsa_blind_signer_benchmark
+//
+// BoringSSL picks its modular exponentiation kernels by CPU feature. To
+// compare feature levels on one machine, mask features with the
+// OPENSSL_ia32cap environment variable, whose layout is described in
+// BoringSSL's crypto/cpu_intel.c, e.g. OPENSSL_ia32cap=':~0x20' turns off
+// AVX2, and compare the reports.
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+// Returns 'count' random strings of 'size' bytes that are smaller than any
+// modulus of that size, i.e. valid inputs to RSA_sign_raw.
+std::vector<std::string> RandomBlindedData(size_t count, size_t size) {
+  std::mt19937_64 generator(0);
+  std::uniform_int_distribution<int> distr_u8(0, 255);
+  std::vector<std::string> blinded_data;
+  blinded_data.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    std::string data = RandomString(size, &distr_u8, &generator);
+    data[0] = 0;
+    blinded_data.push_back(std::move(data));
+  }
+  return blinded_data;
+}
+
+struct SignerFixture {
+  std::unique_ptr<RsaBlindSigner> signer;
+  std::vector<std::string> blinded_data;
+};
+
+SignerFixture MakeFixture(benchmark::State& state, int key_size_bits,
+                          size_t batch_size, bool use_public_metadata) {
+  SignerFixture fixture;
+  auto keys = GetStrongRsaKeys(key_size_bits);
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return fixture;
+  }
+  std::optional<absl::string_view> public_metadata;
+  if (use_public_metadata) {
+    public_metadata = "metadata";
+  }
+  auto signer = RsaBlindSigner::New(
+      keys->second, /*use_rsa_public_exponent=*/false, public_metadata);
+  if (!signer.ok()) {
+    state.SkipWithError(std::string(signer.status().message()).c_str());
+    return fixture;
+  }
+  fixture.signer = *std::move(signer);
+  fixture.blinded_data =
+      RandomBlindedData(batch_size, keys->first.n().size());
+  return fixture;
+}
+
+// Args: key size in bits, batch size, whether public metadata is used.
+void BM_SignLoop(benchmark::State& state) {
+  const size_t batch_size = state.range(1);
+  SignerFixture fixture =
+      MakeFixture(state, state.range(0), batch_size, state.range(2) != 0);
+  if (fixture.signer == nullptr) return;
+  for (auto _ : state) {
+    for (const std::string& blinded_data : fixture.blinded_data) {
+      auto signature = fixture.signer->Sign(blinded_data);
+      benchmark::DoNotOptimize(signature);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+// Args: key size in bits, batch size, whether public metadata is used, number
+// of worker threads (0 signs on the calling thread only).
+void BM_SignBatch(benchmark::State& state) {
+  const size_t batch_size = state.range(1);
+  const int num_threads = state.range(3);
+  SignerFixture fixture =
+      MakeFixture(state, state.range(0), batch_size, state.range(2) != 0);
+  if (fixture.signer == nullptr) return;
+  std::unique_ptr<ThreadPool> thread_pool;
+  if (num_threads > 0) {
+    auto pool = ThreadPool::New(num_threads);
+    if (!pool.ok()) {
+      state.SkipWithError(std::string(pool.status().message()).c_str());
+      return;
+    }
+    thread_pool = *std::move(pool);
+  }
+  std::vector<absl::string_view> blinded_data(fixture.blinded_data.begin(),
+                                              fixture.blinded_data.end());
+  for (auto _ : state) {
+    auto batch = fixture.signer->SignBatch(blinded_data, thread_pool.get());
+    benchmark::DoNotOptimize(batch);
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+BENCHMARK(BM_SignLoop)
+    ->ArgNames({"key_bits", "batch", "metadata"})
+    ->ArgsProduct({{2048, 4096}, {64}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_SignBatch)
+    ->ArgNames({"key_bits", "batch", "metadata", "threads"})
+    ->ArgsProduct({{2048, 4096}, {64}, {0, 1}, {0, 1, 3, 7, 15}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
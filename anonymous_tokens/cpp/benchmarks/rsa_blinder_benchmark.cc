@@ -0,0 +1,175 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-token RsaBlinder setup cost when the per-key state is rebuilt for every
+// blinder compared to sharing one RsaBlindingKeyContext, and when N blinders
+// are created one by one compared to with a single batch inversion.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:rsa_blinder_benchmark
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include <openssl/digest.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kSaltLength = 48;
+constexpr absl::string_view kPublicMetadata = "metadata";
+
+TestRsaPublicKey GetPublicKeyForSize(int key_size_bits) {
+  switch (key_size_bits) {
+    case 2048:
+      return GetStrongTestRsaKeyPair2048().first;
+    case 3072:
+      return GetStrongTestRsaKeyPair3072().first;
+    default:
+      return GetStrongTestRsaKeyPair4096().first;
+  }
+}
+
+std::optional<absl::string_view> MetadataForArg(int64_t use_metadata) {
+  if (use_metadata == 0) return std::nullopt;
+  return kPublicMetadata;
+}
+
+// Args: key size in bits, whether public metadata is used.
+void BM_NewBlinderFromKeyStrings(benchmark::State& state) {
+  const TestRsaPublicKey public_key = GetPublicKeyForSize(state.range(0));
+  const std::optional<absl::string_view> public_metadata =
+      MetadataForArg(state.range(1));
+  for (auto _ : state) {
+    auto blinder = RsaBlinder::New(public_key.n, public_key.e, EVP_sha384(),
+                                   EVP_sha384(), kSaltLength,
+                                   /*use_rsa_public_exponent=*/false,
+                                   public_metadata);
+    benchmark::DoNotOptimize(blinder);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Args: key size in bits, whether public metadata is used.
+void BM_NewBlinderFromKeyContext(benchmark::State& state) {
+  const TestRsaPublicKey public_key = GetPublicKeyForSize(state.range(0));
+  const std::optional<absl::string_view> public_metadata =
+      MetadataForArg(state.range(1));
+  auto key_context = RsaBlindingKeyContext::New(
+      public_key.n, public_key.e, EVP_sha384(), EVP_sha384(), kSaltLength,
+      /*use_rsa_public_exponent=*/false);
+  if (!key_context.ok()) {
+    state.SkipWithError(std::string(key_context.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto blinder = RsaBlinder::New(*key_context, public_metadata);
+    benchmark::DoNotOptimize(blinder);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Args: key size in bits, whether public metadata is used.
+void BM_NewBlinderAndBlindFromKeyContext(benchmark::State& state) {
+  const TestRsaPublicKey public_key = GetPublicKeyForSize(state.range(0));
+  const std::optional<absl::string_view> public_metadata =
+      MetadataForArg(state.range(1));
+  auto key_context = RsaBlindingKeyContext::New(
+      public_key.n, public_key.e, EVP_sha384(), EVP_sha384(), kSaltLength,
+      /*use_rsa_public_exponent=*/false);
+  if (!key_context.ok()) {
+    state.SkipWithError(std::string(key_context.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto blinder = RsaBlinder::New(*key_context, public_metadata);
+    auto blinded = (*blinder)->Blind("message to blind");
+    benchmark::DoNotOptimize(blinded);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Args: key size in bits, number of blinders.
+void BM_NewBlindersIndividually(benchmark::State& state) {
+  const TestRsaPublicKey public_key = GetPublicKeyForSize(state.range(0));
+  auto key_context = RsaBlindingKeyContext::New(
+      public_key.n, public_key.e, EVP_sha384(), EVP_sha384(), kSaltLength,
+      /*use_rsa_public_exponent=*/false);
+  if (!key_context.ok()) {
+    state.SkipWithError(std::string(key_context.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    for (int64_t i = 0; i < state.range(1); ++i) {
+      auto blinder = RsaBlinder::New(*key_context);
+      benchmark::DoNotOptimize(blinder);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+// Args: key size in bits, number of blinders.
+void BM_NewBlindersBatch(benchmark::State& state) {
+  const TestRsaPublicKey public_key = GetPublicKeyForSize(state.range(0));
+  auto key_context = RsaBlindingKeyContext::New(
+      public_key.n, public_key.e, EVP_sha384(), EVP_sha384(), kSaltLength,
+      /*use_rsa_public_exponent=*/false);
+  if (!key_context.ok()) {
+    state.SkipWithError(std::string(key_context.status().message()).c_str());
+    return;
+  }
+  const std::vector<std::optional<std::string>> public_metadata(
+      state.range(1));
+  for (auto _ : state) {
+    auto blinders = RsaBlinder::NewBatch(*key_context, public_metadata);
+    benchmark::DoNotOptimize(blinders);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+BENCHMARK(BM_NewBlinderFromKeyStrings)
+    ->ArgNames({"key_bits", "metadata"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_NewBlinderFromKeyContext)
+    ->ArgNames({"key_bits", "metadata"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_NewBlinderAndBlindFromKeyContext)
+    ->ArgNames({"key_bits", "metadata"})
+    ->ArgsProduct({{2048, 3072, 4096}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_NewBlindersIndividually)
+    ->ArgNames({"key_bits", "n"})
+    ->ArgsProduct({{2048, 4096}, benchmark::CreateRange(1, 1024, 2)})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_NewBlindersBatch)
+    ->ArgNames({"key_bits", "n"})
+    ->ArgsProduct({{2048, 4096}, benchmark::CreateRange(1, 1024, 2)})
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace anonymous_tokens
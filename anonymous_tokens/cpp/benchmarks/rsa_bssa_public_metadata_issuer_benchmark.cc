@@ -0,0 +1,255 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Issuer throughput for Privacy Pass token type DA7A with a 2048-bit key, on
+// marshaled ExtendedTokenRequests built by
+// PrivacyPassRsaBssaPublicMetadataClient, by batch size and number of distinct
+// extension values per batch.
+//
+// BM_IssueTokens issues tokens with PrivacyPassRsaBssaPublicMetadataIssuer, on
+// the calling thread or on a pool of 4 workers and the calling thread. Its
+// signers are cached across batches, as in a long-running issuer.
+// BM_PerRequestSigner is the loop the issuer replaces, as in the DA7A server
+// demo: per request, unmarshal the request, validate and re-encode the
+// extensions, derive the private key for them and sign.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:rsa_bssa_public_metadata_issuer_benchmark
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/privacy_pass/rsa_bssa_public_metadata_client.h"
+#include "anonymous_tokens/cpp/privacy_pass/rsa_bssa_public_metadata_issuer.h"
+#include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/base.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kNumPoolThreads = 4;
+// Requests built per number of extension values.
+constexpr int kNumRequests = 1024;
+// A multiple of the expiration timestamp precision, which all extensions are
+// validated against.
+const absl::Time kNow = absl::FromUnixSeconds(1'700'000'100);
+
+const std::pair<RSAPublicKey, RSAPrivateKey>& GetKeys() {
+  static const auto* const kKeys = new std::pair<RSAPublicKey, RSAPrivateKey>(
+      GetStrongRsaKeys2048().value());
+  return *kKeys;
+}
+
+ReloadableIssuerKeyring* GetKeyring() {
+  static ReloadableIssuerKeyring* const kKeyring = [] {
+    const std::vector<IssuerKeyConfig> configs = {
+        MakeIssuerKeyConfig(GetKeys(), "TEST_USE_CASE", 1,
+                            /*public_metadata_support=*/true,
+                            AT_MESSAGE_MASK_NO_MASK)
+            .value()};
+    return ReloadableIssuerKeyring::New(configs).value().release();
+  }();
+  return kKeyring;
+}
+
+ThreadPool* GetThreadPool() {
+  static ThreadPool* const kThreadPool =
+      ThreadPool::New(kNumPoolThreads).value().release();
+  return kThreadPool;
+}
+
+absl::StatusOr<Extensions> MakeExtensions(int index) {
+  ExpirationTimestamp expiration_timestamp;
+  expiration_timestamp.timestamp_precision = kFifteenMinutesInSeconds;
+  expiration_timestamp.timestamp =
+      absl::ToUnixSeconds(kNow) + (index + 1) * kFifteenMinutesInSeconds;
+  GeoHint geo_hint;
+  geo_hint.geo_hint = "US,US-AL,ALABASTER";
+  ServiceType service_type;
+  service_type.service_type_id = ServiceType::kChromeIpBlinding;
+  Extensions extensions;
+  for (const auto& extension :
+       {expiration_timestamp.AsExtension(), geo_hint.AsExtension(),
+        service_type.AsExtension()}) {
+    ANON_TOKENS_RETURN_IF_ERROR(extension.status());
+    extensions.extensions.push_back(*extension);
+  }
+  return extensions;
+}
+
+std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> NewIssuer(
+    ThreadPool* thread_pool) {
+  PrivacyPassRsaBssaPublicMetadataIssuer::Options options;
+  options.thread_pool = thread_pool;
+  options.clock = [] { return kNow; };
+  return PrivacyPassRsaBssaPublicMetadataIssuer::New(GetKeyring(),
+                                                     std::move(options))
+      .value();
+}
+
+// Builds kNumRequests marshaled requests whose extensions cycle through
+// 'num_extension_values' values, and checks that the client accepts the
+// issuer's response to the first one. Requests are built once per number of
+// extension values.
+absl::StatusOr<const std::vector<std::string>*> MakeRequests(
+    int num_extension_values) {
+  static auto* const kRequests =
+      new absl::flat_hash_map<int, std::vector<std::string>>;
+  auto built = kRequests->find(num_extension_values);
+  if (built != kRequests->end()) {
+    return &built->second;
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      bssl::UniquePtr<RSA> rsa_public_key,
+      CreatePublicKeyRSA(GetKeys().first.n(), GetKeys().first.e()));
+  const std::string token_key_id = GetKeyring()
+                                       ->Acquire()
+                                       ->FindByVersion("TEST_USE_CASE", 1)
+                                       ->token_key_id();
+  std::vector<std::string> requests;
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataClient> first_client;
+  for (int i = 0; i < kNumRequests; ++i) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(Extensions extensions,
+                                 MakeExtensions(i % num_extension_values));
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        std::unique_ptr<PrivacyPassRsaBssaPublicMetadataClient> client,
+        PrivacyPassRsaBssaPublicMetadataClient::Create(*rsa_public_key));
+    std::string nonce(32, 'n');
+    nonce[30] = static_cast<char>(i >> 8);
+    nonce[31] = static_cast<char>(i);
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        ExtendedTokenRequest request,
+        client->CreateTokenRequest("challenge", nonce, token_key_id,
+                                   extensions));
+    ANON_TOKENS_ASSIGN_OR_RETURN(std::string marshaled,
+                                 MarshalExtendedTokenRequest(request));
+    requests.push_back(std::move(marshaled));
+    if (first_client == nullptr) {
+      first_client = std::move(client);
+    }
+  }
+
+  const std::vector<absl::string_view> first = {requests[0]};
+  std::vector<absl::StatusOr<std::string>> responses =
+      NewIssuer(nullptr)->IssueTokens(first);
+  ANON_TOKENS_RETURN_IF_ERROR(responses[0].status());
+  ANON_TOKENS_RETURN_IF_ERROR(
+      first_client->FinalizeToken(*responses[0]).status());
+  return &kRequests->emplace(num_extension_values, std::move(requests))
+              .first->second;
+}
+
+// Args: batch size, number of extension values, whether the thread pool is
+// used.
+void BM_IssueTokens(benchmark::State& state) {
+  const size_t batch_size = state.range(0);
+  auto requests = MakeRequests(state.range(1));
+  if (!requests.ok()) {
+    state.SkipWithError(std::string(requests.status().message()).c_str());
+    return;
+  }
+  const std::vector<absl::string_view> views((*requests)->begin(),
+                                             (*requests)->end());
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer =
+      NewIssuer(state.range(2) != 0 ? GetThreadPool() : nullptr);
+  size_t begin = 0;
+  for (auto _ : state) {
+    if (begin + batch_size > views.size()) {
+      begin = 0;
+    }
+    std::vector<absl::StatusOr<std::string>> responses = issuer->IssueTokens(
+        absl::MakeConstSpan(views).subspan(begin, batch_size));
+    if (!responses[0].ok()) {
+      state.SkipWithError(std::string(responses[0].status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(responses);
+    begin += batch_size;
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_IssueTokens)
+    ->ArgNames({"batch", "extensions", "pool"})
+    ->ArgsProduct({{1, 32, 256}, {1, 8}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+absl::StatusOr<std::string> IssueWithPerRequestSigner(
+    absl::string_view marshaled_request) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      ExtendedTokenRequest request,
+      UnmarshalExtendedTokenRequest(marshaled_request));
+  ANON_TOKENS_RETURN_IF_ERROR(
+      ValidateExtensionsValues(request.extensions, kNow));
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::string encoded_extensions,
+                               EncodeExtensions(request.extensions));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(GetKeys().second, /*use_rsa_public_exponent=*/false,
+                          encoded_extensions));
+  return signer->Sign(request.request.blinded_token_request);
+}
+
+// Args: batch size, number of extension values.
+void BM_PerRequestSigner(benchmark::State& state) {
+  const size_t batch_size = state.range(0);
+  auto requests = MakeRequests(state.range(1));
+  if (!requests.ok()) {
+    state.SkipWithError(std::string(requests.status().message()).c_str());
+    return;
+  }
+  size_t begin = 0;
+  for (auto _ : state) {
+    if (begin + batch_size > (*requests)->size()) {
+      begin = 0;
+    }
+    for (size_t i = begin; i < begin + batch_size; ++i) {
+      absl::StatusOr<std::string> response =
+          IssueWithPerRequestSigner((**requests)[i]);
+      if (!response.ok()) {
+        state.SkipWithError(std::string(response.status().message()).c_str());
+        return;
+      }
+      benchmark::DoNotOptimize(response);
+    }
+    begin += batch_size;
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_PerRequestSigner)
+    ->ArgNames({"batch", "extensions"})
+    ->ArgsProduct({{1, 32, 256}, {1, 8}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
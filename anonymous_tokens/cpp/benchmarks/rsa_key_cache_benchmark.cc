@@ -0,0 +1,158 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Latency of creating a public metadata RsaBlindSigner and signing one token,
+// or creating an RsaSsaPssVerifier, with and without an RsaKeyCache, when
+// metadata values follow a Zipfian distribution (a few hot extension encodings
+// and a long tail).
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:rsa_key_cache_benchmark
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/strings/str_cat.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/digest.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr double kZipfExponent = 1.1;
+
+// Returns a distribution over [0, n) with P(k) proportional to 1/(k+1)^s.
+std::discrete_distribution<size_t> ZipfDistribution(size_t n, double s) {
+  std::vector<double> weights(n);
+  for (size_t k = 0; k < n; ++k) {
+    weights[k] = 1.0 / std::pow(static_cast<double>(k + 1), s);
+  }
+  return std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
+
+// Args: number of distinct metadata values, cache capacity (0 disables the
+// cache).
+void BM_NewSignerAndSignZipfian(benchmark::State& state) {
+  const size_t num_metadata = state.range(0);
+  const size_t capacity = state.range(1);
+  auto keys = GetStrongRsaKeys2048();
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  const RSAPrivateKey& private_key = keys->second;
+  std::unique_ptr<RsaKeyCache> cache;
+  if (capacity > 0) {
+    cache = *RsaKeyCache::New(capacity);
+  }
+
+  std::vector<std::string> metadata(num_metadata);
+  for (size_t i = 0; i < num_metadata; ++i) {
+    metadata[i] = absl::StrCat("extensions-", i);
+  }
+  std::mt19937_64 generator(0);
+  std::uniform_int_distribution<int> distr_u8(0, 255);
+  std::string blinded_data =
+      RandomString(private_key.n().size(), &distr_u8, &generator);
+  blinded_data[0] = 0;
+  std::discrete_distribution<size_t> zipf =
+      ZipfDistribution(num_metadata, kZipfExponent);
+
+  for (auto _ : state) {
+    auto signer =
+        RsaBlindSigner::New(private_key, /*use_rsa_public_exponent=*/false,
+                            metadata[zipf(generator)], cache.get());
+    if (!signer.ok()) {
+      state.SkipWithError(std::string(signer.status().message()).c_str());
+      return;
+    }
+    auto signature = (*signer)->Sign(blinded_data);
+    benchmark::DoNotOptimize(signature);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (cache != nullptr) {
+    RsaKeyCacheStats stats = cache->GetStats();
+    state.counters["hit_rate"] =
+        static_cast<double>(stats.hits) / (stats.hits + stats.misses);
+    state.counters["evictions"] = stats.evictions;
+  }
+}
+
+// Args: number of distinct metadata values, cache capacity (0 disables the
+// cache).
+void BM_NewVerifierZipfian(benchmark::State& state) {
+  const size_t num_metadata = state.range(0);
+  const size_t capacity = state.range(1);
+  auto keys = GetStrongRsaKeys2048();
+  if (!keys.ok()) {
+    state.SkipWithError(std::string(keys.status().message()).c_str());
+    return;
+  }
+  const RSAPublicKey& public_key = keys->first;
+  std::unique_ptr<RsaKeyCache> cache;
+  if (capacity > 0) {
+    cache = *RsaKeyCache::New(capacity);
+  }
+
+  std::vector<std::string> metadata(num_metadata);
+  for (size_t i = 0; i < num_metadata; ++i) {
+    metadata[i] = absl::StrCat("extensions-", i);
+  }
+  std::mt19937_64 generator(0);
+  std::discrete_distribution<size_t> zipf =
+      ZipfDistribution(num_metadata, kZipfExponent);
+
+  for (auto _ : state) {
+    auto verifier = RsaSsaPssVerifier::New(
+        kSaltLengthInBytes48, EVP_sha384(), EVP_sha384(), public_key,
+        /*use_rsa_public_exponent=*/false, metadata[zipf(generator)],
+        cache.get());
+    if (!verifier.ok()) {
+      state.SkipWithError(std::string(verifier.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(verifier);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (cache != nullptr) {
+    RsaKeyCacheStats stats = cache->GetStats();
+    state.counters["hit_rate"] =
+        static_cast<double>(stats.hits) / (stats.hits + stats.misses);
+    state.counters["evictions"] = stats.evictions;
+  }
+}
+
+BENCHMARK(BM_NewSignerAndSignZipfian)
+    ->ArgNames({"metadata_values", "capacity"})
+    ->ArgsProduct({{100, 10000}, {0, 64, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_NewVerifierZipfian)
+    ->ArgNames({"metadata_values", "capacity"})
+    ->ArgsProduct({{100, 10000}, {0, 64, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,133 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Token verification throughput of RsaSsaPssVerifier::VerifyBatch at several
+// thread counts compared to calling RsaSsaPssVerifier::Verify in a loop.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:rsa_ssa_pss_verifier_benchmark
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/digest.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kSaltLength = 48;
+constexpr size_t kBatchSize = 1024;
+constexpr absl::string_view kMessage = "token message";
+constexpr absl::string_view kPublicMetadata = "metadata";
+
+struct VerifierFixture {
+  std::unique_ptr<RsaSsaPssVerifier> verifier;
+  std::string token;
+};
+
+absl::StatusOr<VerifierFixture> MakeFixture(int key_size_bits) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(auto keys, GetStrongRsaKeys(key_size_bits));
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<RSA> private_key,
+                               AnonymousTokensRSAPrivateKeyToRSA(keys.second));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::string encoded_message,
+      EncodeMessageForTests(
+          EncodeMessagePublicMetadata(kMessage, kPublicMetadata), keys.first,
+          EVP_sha384(), EVP_sha384(), kSaltLength));
+  VerifierFixture fixture;
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      fixture.token,
+      TestSignWithPublicMetadata(encoded_message, kPublicMetadata,
+                                 *private_key,
+                                 /*use_rsa_public_exponent=*/false));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      fixture.verifier,
+      RsaSsaPssVerifier::New(kSaltLength, EVP_sha384(), EVP_sha384(),
+                             keys.first, /*use_rsa_public_exponent=*/false,
+                             kPublicMetadata));
+  return fixture;
+}
+
+// Args: key size in bits.
+void BM_VerifyLoop(benchmark::State& state) {
+  auto fixture = MakeFixture(state.range(0));
+  if (!fixture.ok()) {
+    state.SkipWithError(std::string(fixture.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    for (size_t i = 0; i < kBatchSize; ++i) {
+      auto status = fixture->verifier->Verify(fixture->token, kMessage);
+      benchmark::DoNotOptimize(status);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+// Args: key size in bits, total number of verifying threads including the
+// calling thread.
+void BM_VerifyBatch(benchmark::State& state) {
+  const int num_threads = state.range(1);
+  auto fixture = MakeFixture(state.range(0));
+  if (!fixture.ok()) {
+    state.SkipWithError(std::string(fixture.status().message()).c_str());
+    return;
+  }
+  std::unique_ptr<ThreadPool> thread_pool;
+  if (num_threads > 1) {
+    auto pool = ThreadPool::New(num_threads - 1);
+    if (!pool.ok()) {
+      state.SkipWithError(std::string(pool.status().message()).c_str());
+      return;
+    }
+    thread_pool = *std::move(pool);
+  }
+  const std::vector<absl::string_view> tokens(kBatchSize, fixture->token);
+  const std::vector<absl::string_view> messages(kBatchSize, kMessage);
+  for (auto _ : state) {
+    auto batch =
+        fixture->verifier->VerifyBatch(tokens, messages, thread_pool.get());
+    benchmark::DoNotOptimize(batch);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+BENCHMARK(BM_VerifyLoop)
+    ->ArgNames({"key_bits"})
+    ->ArgsProduct({{2048, 4096}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_VerifyBatch)
+    ->ArgNames({"key_bits", "threads"})
+    ->ArgsProduct({{2048, 4096}, {1, 4, 16, 64}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
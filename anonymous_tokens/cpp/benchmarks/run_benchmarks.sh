@@ -0,0 +1,45 @@
+#!/bin/bash
+# Copyright 2023 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Builds all benchmarks in optimized mode and runs them, writing one Google
+# Benchmark JSON report per binary to OUTPUT_DIR. Extra arguments are passed to
+# every benchmark, e.g. --benchmark_filter or --benchmark_repetitions.
+#
+# Run from the workspace root with:
+#   anonymous_tokens/cpp/benchmarks/run_benchmarks.sh OUTPUT_DIR [ARGS...]
+
+set -euo pipefail
+
+if [[ $# -lt 1 ]]; then
+  echo "Usage: $0 OUTPUT_DIR [BENCHMARK_ARGS...]" >&2
+  exit 1
+fi
+readonly output_dir="$1"
+shift
+readonly package="anonymous_tokens/cpp/benchmarks"
+
+mkdir -p "${output_dir}"
+bazel build -c opt "//${package}:all"
+readonly bin_dir="$(bazel info -c opt bazel-bin)/${package}"
+
+for source in "${package}"/*_benchmark.cc; do
+  name="$(basename "${source}" .cc)"
+  echo "Running ${name}" >&2
+  # Benchmarks read test keys relative to the workspace root.
+  "${bin_dir}/${name}" \
+      --benchmark_out="${output_dir}/${name}.json" \
+      --benchmark_out_format=json \
+      "$@"
+done
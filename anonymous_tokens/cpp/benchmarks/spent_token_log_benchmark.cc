@@ -0,0 +1,167 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Startup time and write throughput of SpentTokenLog.
+//
+// BM_Open opens a log of 1M or 8M records with a checkpointed index, which
+// maps the files without reading records, or without an index, which rebuilds
+// it from every record and bounds the cost of recovering from a crash long
+// after the last checkpoint. The files are in the page cache, so this does
+// not include reading them from disk.
+//
+// BM_CheckAndInsert appends new tokens from several threads, either waiting
+// for each record to be durable, where concurrent inserts share one
+// fdatasync, or without syncing.
+//
+// Files are created in $TEST_TMPDIR, or /tmp if it is not set; fdatasync only
+// costs what it costs on a real disk if that directory is on one.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:spent_token_log_benchmark
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/server/spent_token_log.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+namespace anonymous_tokens {
+namespace {
+
+const absl::Time kExpiration = absl::FromUnixSeconds(2000000000);
+
+uint64_t SplitMix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Fingerprint of the i-th token.
+SpentTokenHash TokenHash(uint64_t i) {
+  return {SplitMix64(2 * i), SplitMix64(2 * i + 1)};
+}
+
+std::string LogPath(absl::string_view name) {
+  const char* directory = std::getenv("TEST_TMPDIR");
+  return absl::StrCat(directory != nullptr ? directory : "/tmp",
+                      "/spent_token_log_benchmark_", name);
+}
+
+void RemoveLog(const std::string& path) {
+  std::remove(path.c_str());
+  std::remove(absl::StrCat(path, ".index").c_str());
+}
+
+// Returns the path of a checkpointed log with tokens [0, num_records).
+std::string GetFilledLog(int64_t num_records) {
+  const std::string path = LogPath(absl::StrCat("filled_", num_records));
+  RemoveLog(path);
+  SpentTokenLog::Options options;
+  options.capacity = num_records;
+  options.sync_on_insert = false;
+  std::unique_ptr<SpentTokenLog> log =
+      SpentTokenLog::Open(path, options).value();
+  for (int64_t i = 0; i < num_records; ++i) {
+    log->CheckAndInsert(TokenHash(i), 1, kExpiration).value();
+  }
+  return path;
+}
+
+// Args: number of records, whether the index is removed before opening.
+void BM_Open(benchmark::State& state) {
+  const int64_t num_records = state.range(0);
+  const bool rebuild_index = state.range(1) != 0;
+  const std::string path = GetFilledLog(num_records);
+  const std::string index_path = absl::StrCat(path, ".index");
+  SpentTokenLog::Options options;
+  options.capacity = num_records;
+  for (auto _ : state) {
+    if (rebuild_index) {
+      state.PauseTiming();
+      std::remove(index_path.c_str());
+      state.ResumeTiming();
+    }
+    auto log = SpentTokenLog::Open(path, options);
+    if (!log.ok() || (*log)->size() != num_records) {
+      state.SkipWithError("Opening the log failed.");
+      break;
+    }
+    // Closing checkpoints, which is not part of startup.
+    state.PauseTiming();
+    log->reset();
+    state.ResumeTiming();
+  }
+  state.counters["records_per_second"] = benchmark::Counter(
+      static_cast<double>(num_records) * state.iterations(),
+      benchmark::Counter::kIsRate);
+  RemoveLog(path);
+}
+BENCHMARK(BM_Open)
+    ->ArgNames({"records", "rebuild_index"})
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// Shared by the threads of one BM_CheckAndInsert run.
+SpentTokenLog* insert_log = nullptr;
+std::atomic<uint64_t> next_token{0};
+
+// Arg: whether each insert waits for its record to be durable.
+void OpenInsertLog(const benchmark::State& state) {
+  const std::string path = LogPath("inserts");
+  RemoveLog(path);
+  SpentTokenLog::Options options;
+  options.capacity = int64_t{1} << 25;
+  options.sync_on_insert = state.range(0) != 0;
+  insert_log = SpentTokenLog::Open(path, options).value().release();
+}
+
+void CloseInsertLog(const benchmark::State&) {
+  delete insert_log;
+  insert_log = nullptr;
+  RemoveLog(LogPath("inserts"));
+}
+
+void BM_CheckAndInsert(benchmark::State& state) {
+  for (auto _ : state) {
+    auto inserted = insert_log->CheckAndInsert(
+        TokenHash(next_token.fetch_add(1)), 1, kExpiration);
+    if (!inserted.ok() || !*inserted) {
+      state.SkipWithError("Inserting failed.");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CheckAndInsert)
+    ->ArgName("sync")
+    ->Arg(1)
+    ->Arg(0)
+    ->Threads(1)
+    ->Threads(4)
+    ->Threads(16)
+    ->Threads(64)
+    ->Setup(OpenInsertLog)
+    ->Teardown(CloseInsertLog)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
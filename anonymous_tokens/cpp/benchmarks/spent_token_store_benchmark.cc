@@ -0,0 +1,127 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput of SpentTokenStore when it already holds 1M or 100M tokens of one
+// key version, for
+// - redeeming new tokens (CheckAndInsert returns true),
+// - detecting double spends (CheckAndInsert returns false) and
+// - lookups of spent tokens (Contains),
+// from several threads. Fingerprints are generated directly, so SHA-256 of
+// the tokens is not included. The 100M store needs about 2 GiB.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:spent_token_store_benchmark
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <benchmark/benchmark.h>
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int64_t kKeyVersion = 1;
+
+enum Operation { kLookup = 0, kDoubleSpend = 1, kInsertNew = 2 };
+
+uint64_t SplitMix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Fingerprint of the i-th token.
+SpentTokenHash TokenHash(uint64_t i) {
+  return {SplitMix64(2 * i), SplitMix64(2 * i + 1)};
+}
+
+// New tokens are numbered from here, so they never collide with the tokens
+// that the store was filled with.
+std::atomic<uint64_t> next_new_token{uint64_t{1} << 40};
+
+// Returns a store holding at least the tokens [0, num_tokens). The store of
+// the previous size is freed first, so only one large store is alive at a
+// time.
+SpentTokenStore* GetFilledStore(int64_t num_tokens) {
+  static int64_t filled_tokens = -1;
+  static std::unique_ptr<SpentTokenStore>* const store =
+      new std::unique_ptr<SpentTokenStore>();
+  if (filled_tokens != num_tokens) {
+    store->reset();
+    SpentTokenStore::Options options;
+    // Tables are powers of two, which leaves room for the tokens that the
+    // benchmark inserts.
+    options.expected_tokens_per_key_version = num_tokens;
+    *store = SpentTokenStore::New(options).value();
+    for (int64_t i = 0; i < num_tokens; ++i) {
+      (*store)->CheckAndInsert(kKeyVersion, TokenHash(i));
+    }
+    filled_tokens = num_tokens;
+  }
+  return store->get();
+}
+
+// Args: number of tokens in the store, Operation.
+void BM_SpentTokenStore(benchmark::State& state) {
+  const int64_t num_tokens = state.range(0);
+  const auto operation = static_cast<Operation>(state.range(1));
+  static SpentTokenStore* store;
+  // The other threads wait at the start of the loop until the store is filled.
+  if (state.thread_index() == 0) {
+    store = GetFilledStore(num_tokens);
+  }
+  uint64_t rng = SplitMix64(state.thread_index());
+  bool ok = true;
+  for (auto _ : state) {
+    rng = SplitMix64(rng);
+    switch (operation) {
+      case kInsertNew:
+        ok = store->CheckAndInsert(kKeyVersion,
+                                   TokenHash(next_new_token.fetch_add(1)));
+        break;
+      case kDoubleSpend:
+        ok = !store->CheckAndInsert(kKeyVersion, TokenHash(rng % num_tokens));
+        break;
+      case kLookup:
+        ok = store->Contains(kKeyVersion, TokenHash(rng % num_tokens));
+        break;
+    }
+    if (!ok) {
+      break;
+    }
+  }
+  if (!ok) {
+    state.SkipWithError("Unexpected result.");
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    state.counters["bytes_per_token"] =
+        static_cast<double>(store->memory_usage()) / store->size();
+  }
+}
+BENCHMARK(BM_SpentTokenStore)
+    ->ArgNames({"tokens", "op"})
+    // Inserts run last for each size, as they add tokens to the store.
+    ->ArgsProduct({{1 << 20, 100000000}, {kLookup, kDoubleSpend, kInsertNew}})
+    ->Threads(1)
+    ->Threads(4)
+    ->Threads(16)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,88 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time to generate a strong RSA key, and a single safe prime, per modulus size
+// and number of searching threads. The search time is geometrically
+// distributed, so a handful of iterations only gives a rough mean; pass
+// --benchmark_repetitions for tighter numbers.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:strong_rsa_key_generator_benchmark
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+#include "anonymous_tokens/cpp/crypto/strong_rsa_key_generator.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+
+namespace anonymous_tokens {
+namespace {
+
+// Returns a pool that, together with the calling thread, searches with
+// 'num_threads' threads, or nullptr when the calling thread searches alone.
+std::unique_ptr<ThreadPool> MakeThreadPool(benchmark::State& state,
+                                           int num_threads) {
+  if (num_threads <= 1) {
+    return nullptr;
+  }
+  auto thread_pool = ThreadPool::New(num_threads - 1);
+  if (!thread_pool.ok()) {
+    state.SkipWithError(thread_pool.status().ToString().c_str());
+    return nullptr;
+  }
+  return *std::move(thread_pool);
+}
+
+void BM_GenerateSafePrime(benchmark::State& state) {
+  const int bits = state.range(0);
+  std::unique_ptr<ThreadPool> thread_pool =
+      MakeThreadPool(state, state.range(1));
+  for (auto _ : state) {
+    auto prime = GenerateSafePrime(bits, thread_pool.get());
+    if (!prime.ok()) {
+      state.SkipWithError(prime.status().ToString().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(prime);
+  }
+}
+BENCHMARK(BM_GenerateSafePrime)
+    ->ArgNames({"bits", "threads"})
+    ->ArgsProduct({{1024, 1536, 2048}, {1, 2, 4, 8}})
+    ->Iterations(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kSecond);
+
+void BM_GenerateStrongRsaKeys(benchmark::State& state) {
+  const int modulus_bits = state.range(0);
+  std::unique_ptr<ThreadPool> thread_pool =
+      MakeThreadPool(state, state.range(1));
+  for (auto _ : state) {
+    auto keys = GenerateStrongRsaKeys(modulus_bits, thread_pool.get());
+    if (!keys.ok()) {
+      state.SkipWithError(keys.status().ToString().c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(keys);
+  }
+}
+BENCHMARK(BM_GenerateStrongRsaKeys)
+    ->ArgNames({"modulus_bits", "threads"})
+    ->ArgsProduct({{2048, 3072, 4096}, {1, 2, 4, 8}})
+    ->Iterations(2)
+    ->UseRealTime()
+    ->Unit(benchmark::kSecond);
+
+}  // namespace
+}  // namespace anonymous_tokens
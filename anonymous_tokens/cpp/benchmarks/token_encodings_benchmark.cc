@@ -0,0 +1,82 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Cost of encoding and decoding Privacy Pass extended token requests as the
+// size of their extensions grows.
+//
+// Run with:
+//   bazel run -c opt //anonymous_tokens/cpp/benchmarks:token_encodings_benchmark
+
+#include <cstdint>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
+
+namespace anonymous_tokens {
+namespace {
+
+// Returns a request with a single extension of 'extension_size' bytes.
+ExtendedTokenRequest MakeExtendedTokenRequest(int64_t extension_size) {
+  ExtendedTokenRequest request;
+  request.request.truncated_token_key_id = 0x7f;
+  request.request.blinded_token_request =
+      std::string(kDA7ABlindedTokenRequestSizeInBytes, 'b');
+  request.extensions.extensions.push_back(
+      Extension{/*extension_type=*/0x5E6D,
+                /*extension_value=*/std::string(extension_size, 'e')});
+  return request;
+}
+
+// Args: extension size in bytes.
+void BM_MarshalExtendedTokenRequest(benchmark::State& state) {
+  const ExtendedTokenRequest request = MakeExtendedTokenRequest(state.range(0));
+  for (auto _ : state) {
+    auto encoded = MarshalExtendedTokenRequest(request);
+    benchmark::DoNotOptimize(encoded);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Args: extension size in bytes.
+void BM_UnmarshalExtendedTokenRequest(benchmark::State& state) {
+  auto encoded =
+      MarshalExtendedTokenRequest(MakeExtendedTokenRequest(state.range(0)));
+  if (!encoded.ok()) {
+    state.SkipWithError(std::string(encoded.status().message()).c_str());
+    return;
+  }
+  for (auto _ : state) {
+    auto request = UnmarshalExtendedTokenRequest(*encoded);
+    benchmark::DoNotOptimize(request);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_MarshalExtendedTokenRequest)
+    ->ArgName("extension_bytes")
+    ->Arg(0)
+    ->Arg(32)
+    ->Arg(1024)
+    ->Arg(16384);
+
+BENCHMARK(BM_UnmarshalExtendedTokenRequest)
+    ->ArgName("extension_bytes")
+    ->Arg(0)
+    ->Arg(32)
+    ->Arg(1024)
+    ->Arg(16384);
+
+}  // namespace
+}  // namespace anonymous_tokens
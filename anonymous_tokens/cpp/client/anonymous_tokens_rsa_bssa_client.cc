@@ -26,6 +26,7 @@
 #include "absl/time/time.h"
 #include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
 #include "anonymous_tokens/cpp/shared/proto_utils.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
@@ -89,14 +90,38 @@ absl::Status ValidityChecksForClientCreation(
 }  // namespace
 
 AnonymousTokensRsaBssaClient::AnonymousTokensRsaBssaClient(
-    const RSABlindSignaturePublicKey& public_key)
-    : public_key_(public_key) {}
+    const RSABlindSignaturePublicKey& public_key,
+    std::shared_ptr<const RsaBlindingKeyContext> key_context)
+    : public_key_(public_key), key_context_(std::move(key_context)) {}
 
 absl::StatusOr<std::unique_ptr<AnonymousTokensRsaBssaClient>>
 AnonymousTokensRsaBssaClient::Create(
     const RSABlindSignaturePublicKey& public_key) {
   ANON_TOKENS_RETURN_IF_ERROR(ValidityChecksForClientCreation(public_key));
-  return absl::WrapUnique(new AnonymousTokensRsaBssaClient(public_key));
+
+  RSAPublicKey rsa_public_key_proto;
+  if (!rsa_public_key_proto.ParseFromString(
+          public_key.serialized_public_key())) {
+    return absl::InvalidArgumentError("Public key is malformed.");
+  }
+  // Owned by BoringSSL.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const EVP_MD* sig_hash,
+      ProtoHashTypeToEVPDigest(public_key.sig_hash_type()));
+  // Owned by BoringSSL.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const EVP_MD* mgf1_hash,
+      ProtoMaskGenFunctionToEVPDigest(public_key.mask_gen_function()));
+  // The per-key blinding state is computed once and shared by every request
+  // created with this client.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      RsaBlindingKeyContext::New(
+          rsa_public_key_proto.n(), rsa_public_key_proto.e(), sig_hash,
+          mgf1_hash, public_key.salt_length(),
+          /*use_rsa_public_exponent=*/false));
+  return absl::WrapUnique(
+      new AnonymousTokensRsaBssaClient(public_key, std::move(key_context)));
 }
 
 absl::StatusOr<AnonymousTokensSignRequest>
@@ -109,40 +134,31 @@ AnonymousTokensRsaBssaClient::CreateRequest(
         "Blind signature request already created.");
   }
 
-  RSAPublicKey rsa_public_key_proto;
-  if (!rsa_public_key_proto.ParseFromString(
-          public_key_.serialized_public_key())) {
-    return absl::InvalidArgumentError("Public key is malformed.");
+  std::vector<std::optional<std::string>> public_metadata(inputs.size());
+  if (public_key_.public_metadata_support()) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      // Empty public metadata is a valid value.
+      public_metadata[i] = inputs[i].public_metadata();
+    }
   }
+  // Generate RSA blinders. Creating them together lets the blinding factors
+  // share a single modular inversion.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::vector<std::unique_ptr<RsaBlinder>> rsa_bssa_blinders,
+      RsaBlinder::NewBatch(key_context_, public_metadata));
 
   AnonymousTokensSignRequest request;
-  for (const PlaintextMessageWithPublicMetadata& input : inputs) {
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const PlaintextMessageWithPublicMetadata& input = inputs[i];
     // Generate nonce and masked message. For more details, see
     // https://datatracker.ietf.org/doc/draft-irtf-cfrg-rsa-blind-signatures/
     ANON_TOKENS_ASSIGN_OR_RETURN(std::string mask, GenerateMask(public_key_));
     std::string masked_message =
         MaskMessageConcat(mask, input.plaintext_message());
 
-    std::optional<std::string> public_metadata = std::nullopt;
-    if (public_key_.public_metadata_support()) {
-      // Empty public metadata is a valid value.
-      public_metadata = input.public_metadata();
-    }
     const bool use_rsa_public_exponent = false;
-    // Owned by BoringSSL.
-    ANON_TOKENS_ASSIGN_OR_RETURN(
-        const EVP_MD* sig_hash,
-        ProtoHashTypeToEVPDigest(public_key_.sig_hash_type()));
-    // Owned by BoringSSL.
-    ANON_TOKENS_ASSIGN_OR_RETURN(
-        const EVP_MD* mgf1_hash,
-        ProtoMaskGenFunctionToEVPDigest(public_key_.mask_gen_function()));
-    // Generate RSA blinder.
-    ANON_TOKENS_ASSIGN_OR_RETURN(
-        auto rsa_bssa_blinder,
-        RsaBlinder::New(rsa_public_key_proto.n(), rsa_public_key_proto.e(),
-                        sig_hash, mgf1_hash, public_key_.salt_length(),
-                        use_rsa_public_exponent, public_metadata));
+    std::unique_ptr<RsaBlinder> rsa_bssa_blinder =
+        std::move(rsa_bssa_blinders[i]);
     ANON_TOKENS_ASSIGN_OR_RETURN(const std::string blinded_message,
                                  rsa_bssa_blinder->Blind(masked_message));
 
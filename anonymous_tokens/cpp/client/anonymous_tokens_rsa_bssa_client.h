@@ -24,6 +24,7 @@
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
 
 namespace anonymous_tokens {
@@ -85,10 +86,13 @@ class AnonymousTokensRsaBssaClient {
     std::unique_ptr<RsaBlinder> rsa_blinder;
   };
 
-  explicit AnonymousTokensRsaBssaClient(
-      const RSABlindSignaturePublicKey& public_key);
+  AnonymousTokensRsaBssaClient(
+      const RSABlindSignaturePublicKey& public_key,
+      std::shared_ptr<const RsaBlindingKeyContext> key_context);
 
   const RSABlindSignaturePublicKey public_key_;
+  // Per-key blinding state shared by the blinders of all inputs.
+  const std::shared_ptr<const RsaBlindingKeyContext> key_context_;
   absl::flat_hash_map<std::string, BlindingInfo> blinding_info_map_;
 };
 
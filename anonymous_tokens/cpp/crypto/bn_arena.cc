@@ -0,0 +1,84 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include <openssl/bn.h>
+
+namespace anonymous_tokens {
+namespace {
+
+// Enough for the few arenas a thread holds at a time. BIGNUMs beyond this are
+// freed instead of pooled.
+constexpr size_t kMaxPooledBigNums = 32;
+
+std::vector<bssl::UniquePtr<BIGNUM>>& ThreadBigNumPool() {
+  thread_local std::vector<bssl::UniquePtr<BIGNUM>> pool = [] {
+    std::vector<bssl::UniquePtr<BIGNUM>> pool;
+    pool.reserve(kMaxPooledBigNums);
+    return pool;
+  }();
+  return pool;
+}
+
+}  // namespace
+
+absl::StatusOr<BnArena> BnArena::New() {
+  bssl::UniquePtr<BN_CTX> ctx(BN_CTX_new());
+  if (ctx == nullptr) {
+    return absl::InternalError("BN_CTX_new failed.");
+  }
+  return BnArena(std::move(ctx));
+}
+
+BnArena::BnArena(bssl::UniquePtr<BN_CTX> ctx) : ctx_(std::move(ctx)) {}
+
+BnArena::BnArena(BnArena&& other)
+    : ctx_(std::move(other.ctx_)), bignums_(std::move(other.bignums_)) {
+  other.bignums_.clear();
+}
+
+BnArena::~BnArena() {
+  std::vector<bssl::UniquePtr<BIGNUM>>& pool = ThreadBigNumPool();
+  for (bssl::UniquePtr<BIGNUM>& bn : bignums_) {
+    BN_clear(bn.get());
+    if (pool.size() < kMaxPooledBigNums) {
+      pool.push_back(std::move(bn));
+    }
+  }
+}
+
+absl::StatusOr<BIGNUM*> BnArena::NewBigNum() {
+  std::vector<bssl::UniquePtr<BIGNUM>>& pool = ThreadBigNumPool();
+  bssl::UniquePtr<BIGNUM> bn;
+  if (!pool.empty()) {
+    bn = std::move(pool.back());
+    pool.pop_back();
+  } else {
+    bn.reset(BN_new());
+    if (bn == nullptr) {
+      return absl::InternalError("BN_new failed.");
+    }
+  }
+  bignums_.push_back(std::move(bn));
+  return bignums_.back().get();
+}
+
+}  // namespace anonymous_tokens
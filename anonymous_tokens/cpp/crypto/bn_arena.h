@@ -0,0 +1,67 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_BN_ARENA_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_BN_ARENA_H_
+
+#include "absl/container/inlined_vector.h"
+#include "absl/status/statusor.h"
+#include <openssl/base.h>
+#include <openssl/bn.h>
+
+namespace anonymous_tokens {
+
+// Scratch space for one big number operation.
+//
+// BIGNUMs returned by NewBigNum come from a per-thread pool. When the arena is
+// destroyed they are zeroized with BN_clear, which wipes their whole buffer,
+// and returned to the pool of the current thread with that buffer still
+// allocated. Repeating an operation on a thread therefore reuses them instead
+// of allocating them again.
+//
+// The BN_CTX returned by ctx() is created for the arena and freed with it. The
+// scratch BIGNUMs that BoringSSL functions take from it cannot be zeroized
+// individually, but BoringSSL zeroizes the memory it frees, so an arena may
+// hold private key material and blinding factors.
+//
+// A BnArena must be destroyed on the thread that created it. BIGNUMs obtained
+// from it must not outlive it; results that escape a function should still be
+// allocated with the NewBigNum in crypto_utils.h.
+class BnArena {
+ public:
+  static absl::StatusOr<BnArena> New();
+
+  BnArena(BnArena&& other);
+  BnArena& operator=(BnArena&& other) = delete;
+  BnArena(const BnArena&) = delete;
+  BnArena& operator=(const BnArena&) = delete;
+
+  ~BnArena();
+
+  // Returns a temporary BIGNUM that is zeroized when the arena is destroyed.
+  absl::StatusOr<BIGNUM*> NewBigNum();
+
+  BN_CTX& ctx() const { return *ctx_; }
+
+ private:
+  // Use New to construct.
+  explicit BnArena(bssl::UniquePtr<BN_CTX> ctx);
+
+  bssl::UniquePtr<BN_CTX> ctx_;
+  absl::InlinedVector<bssl::UniquePtr<BIGNUM>, 8> bignums_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_BN_ARENA_H_
@@ -0,0 +1,88 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
+
+#include <thread>
+#include <utility>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/statusor.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include <openssl/bn.h>
+
+namespace anonymous_tokens {
+namespace {
+
+TEST(BnArenaTest, ReusesBigNumsOnSameThread) {
+  BIGNUM* first_bn;
+  {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnArena arena, BnArena::New());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(first_bn, arena.NewBigNum());
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnArena arena, BnArena::New());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BIGNUM * bn, arena.NewBigNum());
+  EXPECT_EQ(bn, first_bn);
+}
+
+TEST(BnArenaTest, NestedArenasUseDistinctContextsAndBigNums) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnArena outer, BnArena::New());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BIGNUM * outer_bn, outer.NewBigNum());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnArena inner, BnArena::New());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BIGNUM * inner_bn, inner.NewBigNum());
+  EXPECT_NE(&outer.ctx(), &inner.ctx());
+  EXPECT_NE(outer_bn, inner_bn);
+}
+
+TEST(BnArenaTest, OtherThreadsUseOtherBigNums) {
+  BIGNUM* released_bn;
+  {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnArena arena, BnArena::New());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(released_bn, arena.NewBigNum());
+  }
+  BIGNUM* other_bn = nullptr;
+  std::thread thread([&other_bn] {
+    absl::StatusOr<BnArena> other_arena = BnArena::New();
+    if (!other_arena.ok()) return;
+    absl::StatusOr<BIGNUM*> bn = other_arena->NewBigNum();
+    if (bn.ok()) other_bn = *bn;
+  });
+  thread.join();
+  EXPECT_NE(other_bn, nullptr);
+  EXPECT_NE(other_bn, released_bn);
+}
+
+TEST(BnArenaTest, BigNumsAreZeroizedOnRelease) {
+  BIGNUM* bn;
+  BIGNUM* moved_bn;
+  {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnArena arena, BnArena::New());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bn, arena.NewBigNum());
+    ASSERT_EQ(BN_set_word(bn, 0x5ec2e7), 1);
+
+    // Moving the arena transfers the BIGNUMs to be zeroized.
+    BnArena moved_arena = std::move(arena);
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(moved_bn, moved_arena.NewBigNum());
+    ASSERT_EQ(BN_lshift(moved_bn, bn, 1024), 1);
+    EXPECT_FALSE(BN_is_zero(bn));
+    EXPECT_FALSE(BN_is_zero(moved_bn));
+  }
+  // The BIGNUMs are owned by the pool of this thread, so they are still valid.
+  EXPECT_TRUE(BN_is_zero(bn));
+  EXPECT_TRUE(BN_is_zero(moved_bn));
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -17,9 +17,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <initializer_list>
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -28,9 +32,14 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
+#include <openssl/bn.h>
 #include <openssl/bytestring.h>
+#include <openssl/digest.h>
 #include <openssl/err.h>
 #include <openssl/hkdf.h>
 #include <openssl/mem.h>
@@ -113,6 +122,70 @@ absl::StatusOr<std::string> MarshalRsaPublicKey(const RSA* rsa) {
   return rsa_public_key_str;
 }
 
+// Returns the encoding of "msg" followed by 4 bytes representing the public
+// metadata length, which EncodeMessagePublicMetadata puts in front of the
+// public metadata.
+std::array<char, 7> EncodePublicMetadataHeader(size_t public_metadata_size) {
+  return {'m',
+          's',
+          'g',
+          static_cast<char>((public_metadata_size >> 24) & 0xFF),
+          static_cast<char>((public_metadata_size >> 16) & 0xFF),
+          static_cast<char>((public_metadata_size >> 8) & 0xFF),
+          static_cast<char>((public_metadata_size >> 0) & 0xFF)};
+}
+
+// Verifies that 'signature' is a PSS signature of the message with digest
+// 'message_digest'.
+absl::Status RsaBlindSignatureVerifyDigest(
+    const int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
+    const absl::string_view signature, const absl::string_view message_digest,
+    RSA* rsa_public_key) {
+  const int hash_size = EVP_MD_size(sig_hash);
+  // Make sure the size of the digest is correct.
+  if (message_digest.size() != hash_size) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Size of the digest doesn't match the one "
+                     "of the hashing algorithm; expected ",
+                     hash_size, " got ", message_digest.size()));
+  }
+  // Make sure the size of the signature is correct.
+  const int rsa_modulus_size = BN_num_bytes(RSA_get0_n(rsa_public_key));
+  if (signature.size() != rsa_modulus_size) {
+    return absl::InvalidArgumentError(
+        "Signature size not equal to modulus size.");
+  }
+
+  std::string recovered_message_digest(rsa_modulus_size, 0);
+  ScopedLatencyTimer mod_exp_timer(LatencyStage::kVerifyModExp);
+  int recovered_message_digest_size = RSA_public_decrypt(
+      /*flen=*/signature.size(),
+      /*from=*/reinterpret_cast<const uint8_t*>(signature.data()),
+      /*to=*/
+      reinterpret_cast<uint8_t*>(recovered_message_digest.data()),
+      /*rsa=*/rsa_public_key,
+      /*padding=*/RSA_NO_PADDING);
+  mod_exp_timer.Stop();
+  if (recovered_message_digest_size != rsa_modulus_size) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid signature size (likely an incorrect key is "
+                     "used); expected ",
+                     rsa_modulus_size, " got ", recovered_message_digest_size,
+                     ": ", GetSslErrors()));
+  }
+  ScopedLatencyTimer pss_timer(LatencyStage::kPssVerify);
+  if (RSA_verify_PKCS1_PSS_mgf1(
+          rsa_public_key,
+          reinterpret_cast<const uint8_t*>(message_digest.data()), sig_hash,
+          mgf1_hash,
+          reinterpret_cast<const uint8_t*>(recovered_message_digest.data()),
+          salt_length) != kBsslSuccess) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("PSS padding verification failed: ", GetSslErrors()));
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace
 
 absl::StatusOr<BnCtxPtr> GetAndStartBigNumCtx() {
@@ -176,20 +249,19 @@ std::string MaskMessageConcat(absl::string_view mask,
   return absl::StrCat(mask, message);
 }
 
+void MaskMessageConcat(absl::string_view mask, absl::string_view message,
+                       std::string* output) {
+  absl::StrAppend(output, mask, message);
+}
+
 std::string EncodeMessagePublicMetadata(absl::string_view message,
                                         absl::string_view public_metadata) {
   // Prepend encoding of "msg" followed by 4 bytes representing public metadata
-  // length.
-  std::string tag = "msg";
-  std::vector<uint8_t> buffer(tag.begin(), tag.end());
-  buffer.push_back((public_metadata.size() >> 24) & 0xFF);
-  buffer.push_back((public_metadata.size() >> 16) & 0xFF);
-  buffer.push_back((public_metadata.size() >> 8) & 0xFF);
-  buffer.push_back((public_metadata.size() >> 0) & 0xFF);
-
-  // Finally append public metadata and then the message to the output.
-  std::string encoding(buffer.begin(), buffer.end());
-  return absl::StrCat(encoding, public_metadata, message);
+  // length, then append public metadata and then the message to the output.
+  const std::array<char, 7> header =
+      EncodePublicMetadataHeader(public_metadata.size());
+  return absl::StrCat(absl::string_view(header.data(), header.size()),
+                      public_metadata, message);
 }
 
 absl::StatusOr<bssl::UniquePtr<BIGNUM>> GetRsaSqrtTwo(int x) {
@@ -278,6 +350,78 @@ absl::StatusOr<std::string> ComputeHash(absl::string_view input,
   return digest;
 }
 
+absl::StatusOr<MessageHasher> MessageHasher::New(const EVP_MD& hasher) {
+  bssl::UniquePtr<EVP_MD_CTX> md_ctx(EVP_MD_CTX_new());
+  if (md_ctx == nullptr ||
+      EVP_DigestInit_ex(md_ctx.get(), &hasher, /*impl=*/nullptr) !=
+          kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Openssl internal error computing hash: ", GetSslErrors()));
+  }
+  return MessageHasher(hasher, std::move(md_ctx));
+}
+
+MessageHasher::MessageHasher(const EVP_MD& hasher,
+                             bssl::UniquePtr<EVP_MD_CTX> md_ctx)
+    : hasher_(&hasher), md_ctx_(std::move(md_ctx)) {}
+
+absl::Status MessageHasher::Update(absl::string_view input) {
+  if (finalized_) {
+    if (EVP_DigestInit_ex(md_ctx_.get(), hasher_, /*impl=*/nullptr) !=
+        kBsslSuccess) {
+      return absl::InternalError(absl::StrCat(
+          "Openssl internal error computing hash: ", GetSslErrors()));
+    }
+    finalized_ = false;
+  }
+  if (EVP_DigestUpdate(md_ctx_.get(), input.data(), input.size()) !=
+      kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Openssl internal error computing hash: ", GetSslErrors()));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MessageHasher::UpdatePublicMetadataPrefix(
+    absl::string_view public_metadata) {
+  const std::array<char, 7> header =
+      EncodePublicMetadataHeader(public_metadata.size());
+  ANON_TOKENS_RETURN_IF_ERROR(
+      Update(absl::string_view(header.data(), header.size())));
+  return Update(public_metadata);
+}
+
+absl::StatusOr<std::string> MessageHasher::Finalize() {
+  std::string digest;
+  digest.resize(EVP_MAX_MD_SIZE);
+
+  // Hashing the empty string after a previous Finalize needs a fresh context.
+  ANON_TOKENS_RETURN_IF_ERROR(Update(""));
+  uint32_t digest_length = 0;
+  if (EVP_DigestFinal_ex(md_ctx_.get(), reinterpret_cast<uint8_t*>(&digest[0]),
+                         &digest_length) != kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Openssl internal error computing hash: ", GetSslErrors()));
+  }
+  // The context is only reinitialized if the hasher is used again.
+  finalized_ = true;
+  digest.resize(digest_length);
+  return digest;
+}
+
+absl::StatusOr<std::string> ComputeMessageHash(
+    absl::string_view message,
+    std::optional<absl::string_view> public_metadata, const EVP_MD& hasher) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(MessageHasher message_hasher,
+                               MessageHasher::New(hasher));
+  if (public_metadata.has_value()) {
+    ANON_TOKENS_RETURN_IF_ERROR(
+        message_hasher.UpdatePublicMetadataPrefix(*public_metadata));
+  }
+  ANON_TOKENS_RETURN_IF_ERROR(message_hasher.Update(message));
+  return message_hasher.Finalize();
+}
+
 absl::StatusOr<bssl::UniquePtr<RSA>> CreatePrivateKeyRSA(
     const absl::string_view rsa_modulus,
     const absl::string_view public_exponent,
@@ -383,6 +527,7 @@ absl::StatusOr<bssl::UniquePtr<BIGNUM>> ComputeCarmichaelLcm(
 
 absl::StatusOr<bssl::UniquePtr<BIGNUM>> ComputeExponentWithPublicMetadata(
     const BIGNUM& n, absl::string_view public_metadata) {
+  ScopedLatencyTimer timer(LatencyStage::kDeriveExponent);
   // Check modulus length.
   if (BN_num_bits(&n) % 2 == 1) {
     return absl::InvalidArgumentError(
@@ -432,10 +577,10 @@ ComputeExponentWithPublicMetadataAndPublicExponent(
   ANON_TOKENS_ASSIGN_OR_RETURN(
       bssl::UniquePtr<BIGNUM> md_exp,
       ComputeExponentWithPublicMetadata(n, public_metadata));
-  ANON_TOKENS_ASSIGN_OR_RETURN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
   // new_e=e*md_exp
   ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> new_e, NewBigNum());
-  if (BN_mul(new_e.get(), md_exp.get(), &e, bn_ctx.get()) != kBsslSuccess) {
+  if (BN_mul(new_e.get(), md_exp.get(), &e, &arena.ctx()) != kBsslSuccess) {
     return absl::InternalError(
         absl::StrCat("Unable to multiply e with md_exp: ", GetSslErrors()));
   }
@@ -448,47 +593,265 @@ absl::Status RsaBlindSignatureVerify(const int salt_length,
                                      const absl::string_view signature,
                                      const absl::string_view message,
                                      RSA* rsa_public_key) {
+  ScopedLatencyTimer hash_timer(LatencyStage::kHashMessage);
   ANON_TOKENS_ASSIGN_OR_RETURN(std::string message_digest,
                                ComputeHash(message, *sig_hash));
-  const int hash_size = EVP_MD_size(sig_hash);
-  // Make sure the size of the digest is correct.
-  if (message_digest.size() != hash_size) {
-    return absl::InvalidArgumentError(
-        absl::StrCat("Size of the digest doesn't match the one "
-                     "of the hashing algorithm; expected ",
-                     hash_size, " got ", message_digest.size()));
+  hash_timer.Stop();
+  return RsaBlindSignatureVerifyDigest(salt_length, sig_hash, mgf1_hash,
+                                       signature, message_digest,
+                                       rsa_public_key);
+}
+
+absl::Status RsaBlindSignatureVerify(
+    const int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
+    const absl::string_view signature, const absl::string_view message,
+    const std::optional<absl::string_view> public_metadata,
+    RSA* rsa_public_key) {
+  ScopedLatencyTimer hash_timer(LatencyStage::kHashMessage);
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::string message_digest,
+      ComputeMessageHash(message, public_metadata, *sig_hash));
+  hash_timer.Stop();
+  return RsaBlindSignatureVerifyDigest(salt_length, sig_hash, mgf1_hash,
+                                       signature, message_digest,
+                                       rsa_public_key);
+}
+
+namespace {
+
+// Hashes the concatenation of 'inputs' with 'md' into 'out', which must have
+// room for EVP_MD_size(md) bytes.
+absl::Status HashInto(EVP_MD_CTX& md_ctx, const EVP_MD& md,
+                      std::initializer_list<absl::string_view> inputs,
+                      uint8_t* out) {
+  if (EVP_DigestInit_ex(&md_ctx, &md, /*impl=*/nullptr) != kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Openssl internal error computing hash: ", GetSslErrors()));
   }
-  // Make sure the size of the signature is correct.
-  const int rsa_modulus_size = BN_num_bytes(RSA_get0_n(rsa_public_key));
+  for (absl::string_view input : inputs) {
+    if (EVP_DigestUpdate(&md_ctx, input.data(), input.size()) !=
+        kBsslSuccess) {
+      return absl::InternalError(absl::StrCat(
+          "Openssl internal error computing hash: ", GetSslErrors()));
+    }
+  }
+  if (EVP_DigestFinal_ex(&md_ctx, out, /*s=*/nullptr) != kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Openssl internal error computing hash: ", GetSslErrors()));
+  }
+  return absl::OkStatus();
+}
+
+absl::string_view AsStringView(const uint8_t* data, size_t size) {
+  return absl::string_view(reinterpret_cast<const char*>(data), size);
+}
+
+// XORs MGF1(seed) into out[0, out_len), as specified in
+// https://www.rfc-editor.org/rfc/rfc8017#appendix-B.2.1.
+absl::Status XorMgf1Mask(EVP_MD_CTX& md_ctx, const EVP_MD& mgf1_hash,
+                         absl::string_view seed, uint8_t* out,
+                         size_t out_len) {
+  const size_t hash_len = EVP_MD_size(&mgf1_hash);
+  uint8_t mask[EVP_MAX_MD_SIZE];
+  for (uint32_t counter = 0; out_len > 0; ++counter) {
+    const uint8_t counter_bytes[4] = {static_cast<uint8_t>(counter >> 24),
+                                      static_cast<uint8_t>(counter >> 16),
+                                      static_cast<uint8_t>(counter >> 8),
+                                      static_cast<uint8_t>(counter)};
+    ANON_TOKENS_RETURN_IF_ERROR(HashInto(
+        md_ctx, mgf1_hash,
+        {seed, AsStringView(counter_bytes, sizeof(counter_bytes))}, mask));
+    const size_t len = std::min(hash_len, out_len);
+    for (size_t i = 0; i < len; ++i) {
+      out[i] ^= mask[i];
+    }
+    out += len;
+    out_len -= len;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status PssPaddingError() {
+  return absl::InvalidArgumentError("PSS padding verification failed.");
+}
+
+// EMSA-PSS-VERIFY as specified in
+// https://www.rfc-editor.org/rfc/rfc8017#section-9.1.2, following BoringSSL's
+// RSA_verify_PKCS1_PSS_mgf1 but decoding the data block into 'db' instead of
+// a freshly allocated buffer. 'em' holds RSA_size(rsa) bytes.
+absl::Status VerifyPssPadding(const RSA& rsa, const uint8_t* m_hash,
+                              const EVP_MD& sig_hash, const EVP_MD& mgf1_hash,
+                              const uint8_t* em, int salt_length, uint8_t* db,
+                              EVP_MD_CTX& md_ctx) {
+  const size_t hash_len = EVP_MD_size(&sig_hash);
+  if (salt_length == -1) {
+    salt_length = hash_len;
+  } else if (salt_length < -2) {
+    return absl::InvalidArgumentError("Invalid salt length.");
+  }
+
+  const unsigned ms_bits = (BN_num_bits(RSA_get0_n(&rsa)) - 1) & 0x7;
+  size_t em_len = RSA_size(&rsa);
+  if (em[0] & (0xFF << ms_bits)) {
+    return PssPaddingError();
+  }
+  if (ms_bits == 0) {
+    ++em;
+    --em_len;
+  }
+  if (em_len < hash_len + 2 ||
+      (salt_length >= 0 &&
+       em_len < hash_len + static_cast<size_t>(salt_length) + 2) ||
+      em[em_len - 1] != 0xbc) {
+    return PssPaddingError();
+  }
+
+  const size_t masked_db_len = em_len - hash_len - 1;
+  const uint8_t* h = em + masked_db_len;
+  std::copy(em, em + masked_db_len, db);
+  ANON_TOKENS_RETURN_IF_ERROR(XorMgf1Mask(
+      md_ctx, mgf1_hash, AsStringView(h, hash_len), db, masked_db_len));
+  if (ms_bits != 0) {
+    db[0] &= 0xFF >> (8 - ms_bits);
+  }
+  size_t i = 0;
+  while (i < masked_db_len - 1 && db[i] == 0) {
+    ++i;
+  }
+  if (db[i++] != 0x01 ||
+      (salt_length >= 0 &&
+       masked_db_len - i != static_cast<size_t>(salt_length))) {
+    return PssPaddingError();
+  }
+
+  static constexpr uint8_t kZeroes[8] = {0};
+  uint8_t h_prime[EVP_MAX_MD_SIZE];
+  ANON_TOKENS_RETURN_IF_ERROR(
+      HashInto(md_ctx, sig_hash,
+               {AsStringView(kZeroes, sizeof(kZeroes)),
+                AsStringView(m_hash, hash_len),
+                AsStringView(db + i, masked_db_len - i)},
+               h_prime));
+  if (CRYPTO_memcmp(h_prime, h, hash_len) != 0) {
+    return PssPaddingError();
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<RsaVerifyScratch> NewRsaVerifyScratch() {
+  RsaVerifyScratch scratch;
+  scratch.bn_ctx.reset(BN_CTX_new());
+  scratch.signature.reset(BN_new());
+  scratch.encoded_message.reset(BN_new());
+  scratch.md_ctx.reset(EVP_MD_CTX_new());
+  if (!scratch.bn_ctx || !scratch.signature || !scratch.encoded_message ||
+      !scratch.md_ctx) {
+    return absl::InternalError(
+        "Allocating buffers failed when called from NewRsaVerifyScratch.");
+  }
+  return scratch;
+}
+
+absl::Status RsaBlindSignatureVerifyWithScratch(
+    const int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
+    const absl::string_view signature, const absl::string_view message_prefix,
+    const absl::string_view message, const RSA& rsa_public_key,
+    const BN_MONT_CTX& mont_n, RsaVerifyScratch& scratch) {
+  const size_t rsa_modulus_size = RSA_size(&rsa_public_key);
   if (signature.size() != rsa_modulus_size) {
     return absl::InvalidArgumentError(
         "Signature size not equal to modulus size.");
   }
+  // Holds EM and the data block decoded from it, which is shorter than EM.
+  if (scratch.buffer.size() < 2 * rsa_modulus_size) {
+    scratch.buffer.resize(2 * rsa_modulus_size);
+  }
+  uint8_t* const em = scratch.buffer.data();
+  uint8_t* const db = em + rsa_modulus_size;
 
-  std::string recovered_message_digest(rsa_modulus_size, 0);
-  int recovered_message_digest_size = RSA_public_decrypt(
-      /*flen=*/signature.size(),
-      /*from=*/reinterpret_cast<const uint8_t*>(signature.data()),
-      /*to=*/
-      reinterpret_cast<uint8_t*>(recovered_message_digest.data()),
-      /*rsa=*/rsa_public_key,
-      /*padding=*/RSA_NO_PADDING);
-  if (recovered_message_digest_size != rsa_modulus_size) {
-    return absl::InvalidArgumentError(
-        absl::StrCat("Invalid signature size (likely an incorrect key is "
-                     "used); expected ",
-                     rsa_modulus_size, " got ", recovered_message_digest_size,
-                     ": ", GetSslErrors()));
+  uint8_t message_digest[EVP_MAX_MD_SIZE];
+  ScopedLatencyTimer hash_timer(LatencyStage::kHashMessage);
+  ANON_TOKENS_RETURN_IF_ERROR(HashInto(*scratch.md_ctx, *sig_hash,
+                                       {message_prefix, message},
+                                       message_digest));
+  hash_timer.Stop();
+
+  // Recover EM = s^e mod n. This is what RSA_public_decrypt with
+  // RSA_NO_PADDING does, minus its per-call allocations.
+  if (BN_bin2bn(reinterpret_cast<const uint8_t*>(signature.data()),
+                signature.size(), scratch.signature.get()) == nullptr) {
+    return absl::InternalError("BN_bin2bn failed.");
   }
-  if (RSA_verify_PKCS1_PSS_mgf1(
-          rsa_public_key, reinterpret_cast<const uint8_t*>(&message_digest[0]),
-          sig_hash, mgf1_hash,
-          reinterpret_cast<const uint8_t*>(recovered_message_digest.data()),
-          salt_length) != kBsslSuccess) {
+  if (BN_ucmp(scratch.signature.get(), RSA_get0_n(&rsa_public_key)) >= 0) {
     return absl::InvalidArgumentError(
-        absl::StrCat("PSS padding verification failed: ", GetSslErrors()));
+        "Signature is not smaller than the modulus.");
+  }
+  ScopedLatencyTimer mod_exp_timer(LatencyStage::kVerifyModExp);
+  if (BN_mod_exp_mont(scratch.encoded_message.get(), scratch.signature.get(),
+                      RSA_get0_e(&rsa_public_key), RSA_get0_n(&rsa_public_key),
+                      scratch.bn_ctx.get(), &mont_n) != kBsslSuccess ||
+      BN_bn2bin_padded(em, rsa_modulus_size, scratch.encoded_message.get()) !=
+          kBsslSuccess) {
+    return absl::InternalError(
+        "BN_mod_exp_mont failed when called from "
+        "RsaBlindSignatureVerifyWithScratch.");
   }
-  return absl::OkStatus();
+  mod_exp_timer.Stop();
+  ScopedLatencyTimer pss_timer(LatencyStage::kPssVerify);
+  return VerifyPssPadding(rsa_public_key, message_digest, *sig_hash,
+                          *mgf1_hash, em, salt_length, db, *scratch.md_ctx);
+}
+
+absl::StatusOr<bool> RsaScreenSignatures(
+    const absl::Span<const RsaScreeningItem> items, const BIGNUM& e,
+    const BIGNUM& n, const BN_MONT_CTX& mont_n) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * signature_product, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * message_product, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * recovered_product, arena.NewBigNum());
+  BN_CTX* bn_ctx = &arena.ctx();
+  if (BN_to_montgomery(signature_product, BN_value_one(), &mont_n, bn_ctx) !=
+          kBsslSuccess ||
+      BN_copy(message_product, signature_product) == nullptr) {
+    return absl::InternalError("BN_to_montgomery failed.");
+  }
+  for (int bit = kRsaScreeningExponentBits - 1; bit >= 0; --bit) {
+    if (BN_mod_mul_montgomery(signature_product, signature_product,
+                              signature_product, &mont_n,
+                              bn_ctx) != kBsslSuccess ||
+        BN_mod_mul_montgomery(message_product, message_product,
+                              message_product, &mont_n,
+                              bn_ctx) != kBsslSuccess) {
+      return absl::InternalError("BN_mod_mul_montgomery failed.");
+    }
+    for (const RsaScreeningItem& item : items) {
+      if (((item.exponent >> bit) & 1) == 0) {
+        continue;
+      }
+      if (BN_mod_mul_montgomery(signature_product, signature_product,
+                                item.signature.get(), &mont_n,
+                                bn_ctx) != kBsslSuccess ||
+          BN_mod_mul_montgomery(message_product, message_product,
+                                item.message.get(), &mont_n,
+                                bn_ctx) != kBsslSuccess) {
+        return absl::InternalError("BN_mod_mul_montgomery failed.");
+      }
+    }
+  }
+  if (BN_from_montgomery(signature_product, signature_product, &mont_n,
+                         bn_ctx) != kBsslSuccess ||
+      BN_from_montgomery(message_product, message_product, &mont_n,
+                         bn_ctx) != kBsslSuccess) {
+    return absl::InternalError("BN_from_montgomery failed.");
+  }
+  if (BN_mod_exp_mont(recovered_product, signature_product, &e, &n, bn_ctx,
+                      &mont_n) != kBsslSuccess) {
+    return absl::InternalError(
+        "BN_mod_exp_mont failed when called from RsaScreenSignatures.");
+  }
+  return BN_cmp(recovered_product, message_product) == 0;
 }
 
 absl::StatusOr<std::string> RsaSsaPssPublicKeyToDerEncoding(const RSA* rsa) {
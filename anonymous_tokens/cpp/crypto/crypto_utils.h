@@ -16,13 +16,17 @@
 #define ANONYMOUS_TOKENS_CPP_CRYPTO_CRYPTO_UTILS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include <openssl/base.h>
 #include <openssl/bn.h>
 #include <openssl/evp.h>
@@ -94,6 +98,11 @@ std::string GetSslErrors();
 std::string MaskMessageConcat(absl::string_view mask,
                                                   absl::string_view message);
 
+// Appends the masked message that MaskMessageConcat returns to 'output', so
+// that the masked messages of many tokens can share one buffer.
+void MaskMessageConcat(absl::string_view mask, absl::string_view message,
+                       std::string* output);
+
 // Encode Message and Public Metadata using steps in
 // https://datatracker.ietf.org/doc/draft-amjad-cfrg-partially-blind-rsa/
 //
@@ -114,6 +123,44 @@ absl::StatusOr<bssl::UniquePtr<BIGNUM>> ComputePowerOfTwo(
 absl::StatusOr<std::string> ComputeHash(
     absl::string_view input, const EVP_MD& hasher);
 
+// Incrementally hashes an input that is the concatenation of several strings,
+// so that the input never needs to be copied into one buffer.
+class MessageHasher {
+ public:
+  static absl::StatusOr<MessageHasher> New(const EVP_MD& hasher);
+
+  MessageHasher(MessageHasher&&) = default;
+  MessageHasher& operator=(MessageHasher&&) = default;
+
+  // Appends 'input' to the hashed data.
+  absl::Status Update(absl::string_view input);
+
+  // Appends everything EncodeMessagePublicMetadata puts in front of the
+  // message, i.e. "msg", the 4-byte length of 'public_metadata' and
+  // 'public_metadata' itself.
+  absl::Status UpdatePublicMetadataPrefix(absl::string_view public_metadata);
+
+  // Returns the digest of the data appended so far. The hasher may then be
+  // reused to hash a new input.
+  absl::StatusOr<std::string> Finalize();
+
+ private:
+  // Use New to construct.
+  MessageHasher(const EVP_MD& hasher, bssl::UniquePtr<EVP_MD_CTX> md_ctx);
+
+  const EVP_MD* hasher_;
+  bssl::UniquePtr<EVP_MD_CTX> md_ctx_;
+  // Whether md_ctx_ must be reinitialized before it is updated.
+  bool finalized_ = false;
+};
+
+// Computes ComputeHash(EncodeMessagePublicMetadata(message, *public_metadata),
+// hasher), or ComputeHash(message, hasher) if 'public_metadata' is not set,
+// without materializing the encoded message.
+absl::StatusOr<std::string> ComputeMessageHash(
+    absl::string_view message,
+    std::optional<absl::string_view> public_metadata, const EVP_MD& hasher);
+
 // Computes the Carmichael LCM given phi(p) and phi(q) where N = p*q is a safe
 // RSA modulus.
 absl::StatusOr<bssl::UniquePtr<BIGNUM>>
@@ -205,6 +252,65 @@ absl::Status RsaBlindSignatureVerify(
     absl::string_view signature, absl::string_view message,
     RSA* rsa_public_key);
 
+// Same as RsaBlindSignatureVerify for the message
+// EncodeMessagePublicMetadata(message, *public_metadata), or 'message' if
+// 'public_metadata' is not set, but without materializing the encoding.
+// 'rsa_public_key' must contain the public exponent derived from
+// 'public_metadata'.
+absl::Status RsaBlindSignatureVerify(
+    int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
+    absl::string_view signature, absl::string_view message,
+    std::optional<absl::string_view> public_metadata, RSA* rsa_public_key);
+
+// Buffers reused across calls to RsaBlindSignatureVerifyWithScratch. Once they
+// have grown to the modulus size of the keys they are used with, verification
+// performs no heap allocations. A scratch object must only be used by one
+// thread at a time.
+struct RsaVerifyScratch {
+  bssl::UniquePtr<BN_CTX> bn_ctx;
+  bssl::UniquePtr<BIGNUM> signature;
+  bssl::UniquePtr<BIGNUM> encoded_message;
+  bssl::UniquePtr<EVP_MD_CTX> md_ctx;
+  // The encoded message EM, followed by room for the unmasked data block DB.
+  std::vector<uint8_t> buffer;
+};
+
+absl::StatusOr<RsaVerifyScratch> NewRsaVerifyScratch();
+
+// Same as RsaBlindSignatureVerify for the message message_prefix || message,
+// but without concatenating the two and using only the buffers in 'scratch'.
+// Passing the output of EncodeMessagePublicMetadata("", public_metadata) as
+// 'message_prefix' verifies a public metadata signature over 'message'.
+//
+// 'mont_n' must be a Montgomery context for the modulus of 'rsa_public_key'.
+absl::Status RsaBlindSignatureVerifyWithScratch(
+    int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
+    absl::string_view signature, absl::string_view message_prefix,
+    absl::string_view message, const RSA& rsa_public_key,
+    const BN_MONT_CTX& mont_n, RsaVerifyScratch& scratch);
+
+// Bit length of the random exponents candidate signatures are screened with.
+inline constexpr int kRsaScreeningExponentBits = 64;
+
+// A candidate RSA signature s of the value m, both in Montgomery form, with
+// the random exponent r it is screened with.
+struct RsaScreeningItem {
+  bssl::UniquePtr<BIGNUM> signature;
+  bssl::UniquePtr<BIGNUM> message;
+  uint64_t exponent;
+};
+
+// Returns whether (prod s^r)^e == prod m^r mod n over all 'items'. If any s is
+// not the e-th root of its m, this fails except with probability about 2^-64,
+// or 1/2 if s is off by a factor of order two such as n - s. Both products
+// share one square-and-multiply pass over the bits of all exponents, so the
+// cost is dominated by a single exponentiation with e for the whole batch.
+//
+// 'mont_n' must be a Montgomery context for 'n'.
+absl::StatusOr<bool> RsaScreenSignatures(
+    absl::Span<const RsaScreeningItem> items, const BIGNUM& e, const BIGNUM& n,
+    const BN_MONT_CTX& mont_n);
+
 // This method outputs a DER encoding of RSASSA-PSS (RSA Signature Scheme with
 // Appendix - Probabilistic Signature Scheme) Public Key as described here
 // https://datatracker.ietf.org/doc/html/rfc3447.html using the object
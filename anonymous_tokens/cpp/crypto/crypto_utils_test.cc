@@ -15,6 +15,7 @@
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -22,6 +23,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/strings/escaping.h"
+#include "absl/strings/string_view.h"
 #include "anonymous_tokens/cpp/testing/utils.h"
 #include <openssl/base.h>
 #include <openssl/rsa.h>
@@ -153,6 +155,49 @@ TEST_P(ComputeHashTest, ComputesHash) {
 INSTANTIATE_TEST_SUITE_P(ComputeHashTests, ComputeHashTest,
                          testing::ValuesIn(GetComputeHashTestParams()));
 
+TEST(AnonymousTokensCryptoUtilsTest, ComputeMessageHashMatchesComputeHash) {
+  const std::string large_message(1 << 16, 'a');
+  for (absl::string_view message : {absl::string_view(""),
+                                    absl::string_view("message"),
+                                    absl::string_view(large_message)}) {
+    for (absl::string_view public_metadata : {"", "metadata"}) {
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+          std::string expected_digest,
+          ComputeHash(EncodeMessagePublicMetadata(message, public_metadata),
+                      *EVP_sha384()));
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+          std::string digest,
+          ComputeMessageHash(message, public_metadata, *EVP_sha384()));
+      EXPECT_EQ(digest, expected_digest);
+    }
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string expected_digest,
+                                     ComputeHash(message, *EVP_sha384()));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string digest,
+        ComputeMessageHash(message, std::nullopt, *EVP_sha384()));
+    EXPECT_EQ(digest, expected_digest);
+  }
+}
+
+TEST(AnonymousTokensCryptoUtilsTest, MessageHasherIsReusableAfterFinalize) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(MessageHasher hasher,
+                                   MessageHasher::New(*EVP_sha256()));
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(hasher.Update("Hello ").ok());
+    ASSERT_TRUE(hasher.Update("World!").ok());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string digest, hasher.Finalize());
+    EXPECT_EQ(digest, *ComputeHash("Hello World!", *EVP_sha256()));
+  }
+}
+
+TEST(AnonymousTokensCryptoUtilsTest, MaskMessageConcatAppendsToOutput) {
+  std::string output = "prefix";
+  MaskMessageConcat("mask", "message", &output);
+  EXPECT_EQ(output, "prefix" + MaskMessageConcat("mask", "message"));
+  MaskMessageConcat("", "", &output);
+  EXPECT_EQ(output, "prefixmaskmessage");
+}
+
 TEST(PublicMetadataCryptoUtilsInternalTest, PublicMetadataHashWithHKDF) {
   ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnCtxPtr ctx, GetAndStartBigNumCtx());
   ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<BIGNUM> max_value,
@@ -0,0 +1,310 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_batch_signing_engine.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include <openssl/bn.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+namespace {
+
+// With public exponents of at most this many bits, inputs are signed with
+// RSA_sign_raw: its check of s^e == x then costs fewer multiplications than
+// the share of a signature in RsaScreenSignatures.
+constexpr int kMaxExponentBitsSignedOneByOne = kRsaScreeningExponentBits;
+
+// Sets 'r' to 'a' mod m, where m is the modulus of 'mont', in time
+// independent of 'a' and m. As in BoringSSL's RSA implementation, a Montgomery
+// reduction yields a R^-1 mod m, and a Montgomery multiplication by R^2 takes
+// that back out of the Montgomery domain. 'a' must be smaller than m R.
+bool ReduceWithMontgomery(BIGNUM* r, const BIGNUM& a, const BN_MONT_CTX& mont,
+                          BN_CTX& bn_ctx) {
+  return BN_from_montgomery(r, &a, &mont, &bn_ctx) == kBsslSuccess &&
+         BN_to_montgomery(r, r, &mont, &bn_ctx) == kBsslSuccess;
+}
+
+}  // namespace
+
+RsaBatchSigningEngine::RsaBatchSigningEngine(
+    bssl::UniquePtr<RSA> private_key, bool sign_with_rsa_sign_raw,
+    bssl::UniquePtr<BN_MONT_CTX> mont_n, bssl::UniquePtr<BN_MONT_CTX> mont_p,
+    bssl::UniquePtr<BN_MONT_CTX> mont_q,
+    bssl::UniquePtr<BIGNUM> q_inverse_mont, bssl::UniquePtr<BIGNUM> q_mont)
+    : private_key_(std::move(private_key)),
+      modulus_size_(RSA_size(private_key_.get())),
+      sign_with_rsa_sign_raw_(sign_with_rsa_sign_raw),
+      mont_n_(std::move(mont_n)),
+      mont_p_(std::move(mont_p)),
+      mont_q_(std::move(mont_q)),
+      q_inverse_mont_(std::move(q_inverse_mont)),
+      q_mont_(std::move(q_mont)) {}
+
+absl::StatusOr<std::unique_ptr<RsaBatchSigningEngine>>
+RsaBatchSigningEngine::New(RSA& private_key) {
+  const BIGNUM* p = RSA_get0_p(&private_key);
+  const BIGNUM* q = RSA_get0_q(&private_key);
+  const BIGNUM* crt = RSA_get0_iqmp(&private_key);
+  if (RSA_get0_n(&private_key) == nullptr ||
+      RSA_get0_e(&private_key) == nullptr || p == nullptr || q == nullptr ||
+      RSA_get0_dmp1(&private_key) == nullptr ||
+      RSA_get0_dmq1(&private_key) == nullptr || crt == nullptr) {
+    return absl::InvalidArgumentError(
+        "RsaBatchSigningEngine requires a private key with CRT parameters.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  BN_CTX* bn_ctx = &arena.ctx();
+  bssl::UniquePtr<BN_MONT_CTX> mont_n(
+      BN_MONT_CTX_new_for_modulus(RSA_get0_n(&private_key), bn_ctx));
+  // The primes are secret, so their contexts are set up in constant time.
+  bssl::UniquePtr<BN_MONT_CTX> mont_p(BN_MONT_CTX_new_consttime(p, bn_ctx));
+  bssl::UniquePtr<BN_MONT_CTX> mont_q(BN_MONT_CTX_new_consttime(q, bn_ctx));
+  if (mont_n == nullptr || mont_p == nullptr || mont_q == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("Creating Montgomery contexts failed: ", GetSslErrors()));
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> q_inverse_mont,
+                               NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> q_mont, NewBigNum());
+  if (BN_to_montgomery(q_inverse_mont.get(), crt, mont_p.get(), bn_ctx) !=
+          kBsslSuccess ||
+      BN_to_montgomery(q_mont.get(), q, mont_n.get(), bn_ctx) !=
+          kBsslSuccess) {
+    return absl::InternalError("BN_to_montgomery failed.");
+  }
+  // The Montgomery reductions of the CRT need each prime to be smaller than
+  // the Montgomery radix of the other, which primes of the same length are.
+  const bool sign_with_rsa_sign_raw =
+      BN_num_bits(RSA_get0_e(&private_key)) <=
+          kMaxExponentBitsSignedOneByOne ||
+      BN_num_bits(p) != BN_num_bits(q);
+  RSA_up_ref(&private_key);
+  return absl::WrapUnique(new RsaBatchSigningEngine(
+      bssl::UniquePtr<RSA>(&private_key), sign_with_rsa_sign_raw,
+      std::move(mont_n), std::move(mont_p), std::move(mont_q),
+      std::move(q_inverse_mont), std::move(q_mont)));
+}
+
+absl::Status RsaBatchSigningEngine::SignBatch(
+    const absl::Span<const absl::string_view> inputs,
+    const absl::Span<uint8_t* const> outputs,
+    const absl::Span<absl::Status> statuses) const {
+  if (outputs.size() != inputs.size() || statuses.size() != inputs.size()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Got ", inputs.size(), " inputs, ", outputs.size(), " outputs and ",
+        statuses.size(), " statuses."));
+  }
+  const absl::Status status = ComputeSignatures(inputs, outputs, statuses);
+  // RSA_sign_raw may leave a partial result behind when it fails, so the
+  // output of every input that failed is cleared.
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (!status.ok() || !statuses[i].ok()) {
+      std::fill_n(outputs[i], modulus_size_, 0);
+    }
+  }
+  return status;
+}
+
+absl::Status RsaBatchSigningEngine::ComputeSignatures(
+    const absl::Span<const absl::string_view> inputs,
+    const absl::Span<uint8_t* const> outputs,
+    const absl::Span<absl::Status> statuses) const {
+  const BIGNUM& n = *RSA_get0_n(private_key_.get());
+  const BIGNUM& e = *RSA_get0_e(private_key_.get());
+  const BIGNUM& p = *RSA_get0_p(private_key_.get());
+  const BIGNUM& q = *RSA_get0_q(private_key_.get());
+
+  // Parses the inputs and rejects those that are not smaller than n, so that
+  // they fail the same way on both paths below.
+  std::vector<RsaScreeningItem> items;
+  // indices[j] is the index in the batch of items[j].
+  std::vector<size_t> indices;
+  items.reserve(inputs.size());
+  indices.reserve(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs[i].size() != modulus_size_) {
+      statuses[i] = absl::InvalidArgumentError(
+          absl::StrCat("Expected input size = ", modulus_size_,
+                       " actual input size = ", inputs[i].size(), " bytes."));
+      continue;
+    }
+    RsaScreeningItem item{
+        bssl::UniquePtr<BIGNUM>(BN_new()),
+        bssl::UniquePtr<BIGNUM>(
+            BN_bin2bn(reinterpret_cast<const uint8_t*>(inputs[i].data()),
+                      inputs[i].size(), nullptr)),
+        /*exponent=*/0};
+    if (item.signature == nullptr || item.message == nullptr) {
+      return absl::InternalError("BN_new failed.");
+    }
+    if (BN_ucmp(item.message.get(), &n) >= 0) {
+      statuses[i] =
+          absl::InvalidArgumentError("Input is not smaller than the modulus.");
+      continue;
+    }
+    items.push_back(std::move(item));
+    indices.push_back(i);
+  }
+  if (items.empty()) {
+    return absl::OkStatus();
+  }
+  if (sign_with_rsa_sign_raw_) {
+    for (const size_t i : indices) {
+      statuses[i] = SignWithRsaSignRaw(inputs[i], outputs[i]);
+    }
+    return absl::OkStatus();
+  }
+
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  BN_CTX* bn_ctx = &arena.ctx();
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * r, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * blinding, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * unblinding, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * blinded, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * m_p, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * m_q, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * h, arena.NewBigNum());
+
+  // Sets 'blinding' to r^e R mod n and 'unblinding' to r^-1 R mod n, i.e.
+  // both in the Montgomery domain. An r of 1 doesn't blind.
+  int is_not_invertible = 0;
+  if (BN_rand_range_ex(r, 2, &n) != kBsslSuccess ||
+      BN_mod_exp_mont(blinding, r, &e, &n, bn_ctx, mont_n_.get()) !=
+          kBsslSuccess ||
+      BN_to_montgomery(blinding, blinding, mont_n_.get(), bn_ctx) !=
+          kBsslSuccess ||
+      BN_mod_inverse_blinded(unblinding, &is_not_invertible, r, mont_n_.get(),
+                             bn_ctx) != kBsslSuccess ||
+      BN_to_montgomery(unblinding, unblinding, mont_n_.get(), bn_ctx) !=
+          kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Computing the blinding factor failed, is_not_invertible = ",
+        is_not_invertible));
+  }
+
+  for (RsaScreeningItem& item : items) {
+    {
+      ScopedLatencyTimer timer(LatencyStage::kSignModExp);
+      // Computes s = ((x r^e)^d mod n) r^-1 with the CRT and Garner's
+      // recombination (x r^e)^d = m_q + q ((m_p - m_q) q^-1 mod p). As in
+      // BoringSSL's RSA_sign_raw, every step that involves p or q runs in
+      // time independent of the values: the reductions are Montgomery
+      // reductions and the recombination only uses Montgomery
+      // multiplications and the fixed-width BN_mod_*_quick. Since
+      // h = (m_p - m_q) q^-1 mod p < p, h q is smaller than n and is computed
+      // as a Montgomery multiplication modulo n, and h q + m_q < n.
+      if (BN_mod_mul_montgomery(blinded, item.message.get(), blinding,
+                                mont_n_.get(), bn_ctx) != kBsslSuccess ||
+          !ReduceWithMontgomery(m_p, *blinded, *mont_p_, *bn_ctx) ||
+          BN_mod_exp_mont_consttime(m_p, m_p, RSA_get0_dmp1(private_key_.get()),
+                                    &p, bn_ctx,
+                                    mont_p_.get()) != kBsslSuccess ||
+          !ReduceWithMontgomery(m_q, *blinded, *mont_q_, *bn_ctx) ||
+          BN_mod_exp_mont_consttime(m_q, m_q, RSA_get0_dmq1(private_key_.get()),
+                                    &q, bn_ctx,
+                                    mont_q_.get()) != kBsslSuccess ||
+          !ReduceWithMontgomery(h, *m_q, *mont_p_, *bn_ctx) ||
+          BN_mod_sub_quick(h, m_p, h, &p) != kBsslSuccess ||
+          BN_mod_mul_montgomery(h, h, q_inverse_mont_.get(), mont_p_.get(),
+                                bn_ctx) != kBsslSuccess ||
+          BN_mod_mul_montgomery(blinded, h, q_mont_.get(), mont_n_.get(),
+                                bn_ctx) != kBsslSuccess ||
+          BN_mod_add_quick(blinded, blinded, m_q, &n) != kBsslSuccess ||
+          BN_mod_mul_montgomery(item.signature.get(), blinded, unblinding,
+                                mont_n_.get(), bn_ctx) != kBsslSuccess) {
+        return absl::InternalError(absl::StrCat(
+            "Computing the signature failed when called from "
+            "RsaBatchSigningEngine::SignBatch: ",
+            GetSslErrors()));
+      }
+    }
+    // The next input is blinded with the square of this blinding factor.
+    if (BN_mod_mul_montgomery(blinding, blinding, blinding, mont_n_.get(),
+                              bn_ctx) != kBsslSuccess ||
+        BN_mod_mul_montgomery(unblinding, unblinding, unblinding,
+                              mont_n_.get(), bn_ctx) != kBsslSuccess ||
+        BN_to_montgomery(item.signature.get(), item.signature.get(),
+                         mont_n_.get(), bn_ctx) != kBsslSuccess ||
+        BN_to_montgomery(item.message.get(), item.message.get(),
+                         mont_n_.get(), bn_ctx) != kBsslSuccess) {
+      return absl::InternalError("Montgomery multiplication failed.");
+    }
+    if (RAND_bytes(reinterpret_cast<uint8_t*>(&item.exponent),
+                   sizeof(item.exponent)) != kBsslSuccess) {
+      return absl::InternalError("RAND_bytes failed.");
+    }
+  }
+
+  ANON_TOKENS_ASSIGN_OR_RETURN(const bool passed,
+                               RsaScreenSignatures(items, e, n, *mont_n_));
+  if (!passed) {
+    // If a signature was faulty, releasing it could leak the factors of n, so
+    // none of them leaves the engine and every input of the batch is signed
+    // again.
+    for (const size_t i : indices) {
+      statuses[i] = SignWithRsaSignRaw(inputs[i], outputs[i]);
+    }
+    return absl::OkStatus();
+  }
+  for (size_t j = 0; j < items.size(); ++j) {
+    if (BN_from_montgomery(items[j].signature.get(), items[j].signature.get(),
+                           mont_n_.get(), bn_ctx) != kBsslSuccess ||
+        BN_bn2bin_padded(outputs[indices[j]], modulus_size_,
+                         items[j].signature.get()) != kBsslSuccess) {
+      return absl::InternalError("Serializing the signature failed.");
+    }
+    statuses[indices[j]] = absl::OkStatus();
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RsaBatchSigningEngine::SignWithRsaSignRaw(
+    const absl::string_view input, uint8_t* output) const {
+  ScopedLatencyTimer timer(LatencyStage::kSignModExp);
+  size_t out_len;
+  if (RSA_sign_raw(
+          /*rsa=*/private_key_.get(), /*out_len=*/&out_len,
+          /*out=*/output,
+          /*max_out=*/modulus_size_,
+          /*in=*/reinterpret_cast<const uint8_t*>(input.data()),
+          /*in_len=*/input.size(),
+          /*padding=*/RSA_NO_PADDING) != kBsslSuccess ||
+      out_len != modulus_size_) {
+    return absl::InternalError(
+        "RSA_sign_raw failed when called from RsaBatchSigningEngine.");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,115 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BATCH_SIGNING_ENGINE_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BATCH_SIGNING_ENGINE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include <openssl/base.h>
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+// Computes raw RSA signatures x^d mod n of many inputs under one private key.
+// The results are bit-exact with RSA_sign_raw with RSA_NO_PADDING, since the
+// e-th root of x mod n is unique, but the per-signature overhead is lower:
+//
+//  - The Montgomery contexts of n, p and q and q^-1 mod p are computed once
+//    per key.
+//  - One blinding factor r is drawn per batch. Item i is blinded with
+//    r^(2^i), whose e-th power and inverse are obtained by squaring the
+//    previous ones, as BN_BLINDING does between refreshes.
+//  - RSA_sign_raw protects against fault attacks on the CRT by checking
+//    s^e == x for every signature. With the full-size exponents derived from
+//    public metadata, that check costs more than the signature itself. Here
+//    all signatures of a batch are checked at once with RsaScreenSignatures
+//    instead. If the check fails, the whole batch is signed again with
+//    RSA_sign_raw.
+//
+// The modular exponentiations themselves are BoringSSL's constant-time
+// BN_mod_exp_mont_consttime, which already dispatches to the vectorized RSAZ
+// kernels on CPUs that support them, and the rest of the CRT is constant-time
+// as in RSA_sign_raw. Keys with a small public exponent, for which
+// RSA_sign_raw's own check is cheap, and keys whose primes differ in length
+// are signed with RSA_sign_raw.
+//
+// An engine is immutable after construction and may be used from several
+// threads at once.
+class RsaBatchSigningEngine {
+ public:
+  // 'private_key' must include its CRT parameters. The engine keeps its own
+  // reference to it.
+  static absl::StatusOr<std::unique_ptr<RsaBatchSigningEngine>> New(
+      RSA& private_key);
+
+  RsaBatchSigningEngine(const RsaBatchSigningEngine&) = delete;
+  RsaBatchSigningEngine& operator=(const RsaBatchSigningEngine&) = delete;
+
+  // Signs every element of 'inputs', which must be RSA_size bytes long each,
+  // and writes its signature to the RSA_size bytes at outputs[i]. statuses[i]
+  // is set to the outcome for input i: an input that is not smaller than the
+  // modulus only fails its own entry. A non-OK return value means that the
+  // batch as a whole could not be signed. No signature is written before the
+  // whole batch has passed the fault check, and the outputs of failed inputs
+  // are set to zero.
+  absl::Status SignBatch(absl::Span<const absl::string_view> inputs,
+                         absl::Span<uint8_t* const> outputs,
+                         absl::Span<absl::Status> statuses) const;
+
+  // Size of inputs and signatures in bytes.
+  size_t modulus_size() const { return modulus_size_; }
+
+ private:
+  // Use New to construct.
+  RsaBatchSigningEngine(bssl::UniquePtr<RSA> private_key,
+                        bool sign_with_rsa_sign_raw,
+                        bssl::UniquePtr<BN_MONT_CTX> mont_n,
+                        bssl::UniquePtr<BN_MONT_CTX> mont_p,
+                        bssl::UniquePtr<BN_MONT_CTX> mont_q,
+                        bssl::UniquePtr<BIGNUM> q_inverse_mont,
+                        bssl::UniquePtr<BIGNUM> q_mont);
+
+  // SignBatch without the clearing of failed outputs.
+  absl::Status ComputeSignatures(absl::Span<const absl::string_view> inputs,
+                                 absl::Span<uint8_t* const> outputs,
+                                 absl::Span<absl::Status> statuses) const;
+
+  // Signs 'input' with RSA_sign_raw.
+  absl::Status SignWithRsaSignRaw(absl::string_view input,
+                                  uint8_t* output) const;
+
+  const bssl::UniquePtr<RSA> private_key_;
+  const size_t modulus_size_;
+  // Whether all inputs are signed with RSA_sign_raw.
+  const bool sign_with_rsa_sign_raw_;
+  const bssl::UniquePtr<BN_MONT_CTX> mont_n_;
+  const bssl::UniquePtr<BN_MONT_CTX> mont_p_;
+  const bssl::UniquePtr<BN_MONT_CTX> mont_q_;
+  // q^-1 R mod p, i.e. the CRT coefficient in the Montgomery domain of p.
+  const bssl::UniquePtr<BIGNUM> q_inverse_mont_;
+  // q R mod n, to multiply by q in the Montgomery domain of n.
+  const bssl::UniquePtr<BIGNUM> q_mont_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BATCH_SIGNING_ENGINE_H_
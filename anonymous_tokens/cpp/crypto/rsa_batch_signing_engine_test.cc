@@ -0,0 +1,192 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_batch_signing_engine.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+// Returns the key with the full-size public exponent derived from
+// 'public_metadata', as RsaBlindSigner uses it.
+absl::StatusOr<bssl::UniquePtr<RSA>> DerivePrivateKey(
+    const RSA &key, absl::string_view public_metadata) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      bssl::UniquePtr<BIGNUM> e,
+      ComputeExponentWithPublicMetadata(*RSA_get0_n(&key), public_metadata));
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> phi_p, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> phi_q, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> d, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> dp, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> dq, NewBigNum());
+  if (!BN_sub(phi_p.get(), RSA_get0_p(&key), BN_value_one()) ||
+      !BN_sub(phi_q.get(), RSA_get0_q(&key), BN_value_one())) {
+    return absl::InternalError("BN_sub failed.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      bssl::UniquePtr<BIGNUM> lcm,
+      ComputeCarmichaelLcm(*phi_p, *phi_q, *bn_ctx));
+  if (!BN_mod_inverse(d.get(), e.get(), lcm.get(), bn_ctx.get()) ||
+      !BN_mod(dp.get(), d.get(), phi_p.get(), bn_ctx.get()) ||
+      !BN_mod(dq.get(), d.get(), phi_q.get(), bn_ctx.get())) {
+    return absl::InternalError("Computing the private exponent failed.");
+  }
+  bssl::UniquePtr<RSA> derived_key(RSA_new_private_key_large_e(
+      RSA_get0_n(&key), e.get(), d.get(), RSA_get0_p(&key), RSA_get0_q(&key),
+      dp.get(), dq.get(), RSA_get0_iqmp(&key)));
+  if (derived_key == nullptr) {
+    return absl::InternalError("RSA_new_private_key_large_e failed.");
+  }
+  return derived_key;
+}
+
+// Params: key size in bits, whether the public exponent is derived from
+// public metadata.
+class RsaBatchSigningEngineTest
+    : public ::testing::TestWithParam<std::tuple<int, bool>> {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        auto keys, GetStrongRsaKeys(std::get<0>(GetParam())));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        private_key_, AnonymousTokensRSAPrivateKeyToRSA(keys.second));
+    if (std::get<1>(GetParam())) {
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+          private_key_, DerivePrivateKey(*private_key_, "metadata"));
+    }
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        engine_, RsaBatchSigningEngine::New(*private_key_));
+    generator_.seed(0);
+  }
+
+  // Returns a random input that is smaller than the modulus.
+  std::string RandomInput() {
+    std::string input =
+        RandomString(engine_->modulus_size(), &distr_u8_, &generator_);
+    input[0] = 0;
+    return input;
+  }
+
+  std::string SignWithRsaSignRaw(absl::string_view input) {
+    std::string signature(RSA_size(private_key_.get()), 0);
+    size_t out_len;
+    EXPECT_EQ(RSA_sign_raw(private_key_.get(), &out_len,
+                           reinterpret_cast<uint8_t *>(&signature[0]),
+                           signature.size(),
+                           reinterpret_cast<const uint8_t *>(input.data()),
+                           input.size(), RSA_NO_PADDING),
+              1);
+    return signature;
+  }
+
+  bssl::UniquePtr<RSA> private_key_;
+  std::unique_ptr<RsaBatchSigningEngine> engine_;
+  std::mt19937_64 generator_;
+  std::uniform_int_distribution<int> distr_u8_ =
+      std::uniform_int_distribution<int>{0, 255};
+};
+
+TEST_P(RsaBatchSigningEngineTest, MatchesRsaSignRaw) {
+  constexpr int kBatchSize = 9;
+  std::vector<std::string> inputs;
+  for (int i = 0; i < kBatchSize; ++i) {
+    inputs.push_back(RandomInput());
+  }
+  std::vector<absl::string_view> input_views(inputs.begin(), inputs.end());
+  std::vector<std::string> signatures(kBatchSize,
+                                      std::string(engine_->modulus_size(), 0));
+  std::vector<uint8_t *> outputs;
+  for (std::string &signature : signatures) {
+    outputs.push_back(reinterpret_cast<uint8_t *>(&signature[0]));
+  }
+  std::vector<absl::Status> statuses(kBatchSize);
+
+  ASSERT_TRUE(
+      engine_->SignBatch(input_views, outputs, absl::MakeSpan(statuses)).ok());
+  for (int i = 0; i < kBatchSize; ++i) {
+    ASSERT_TRUE(statuses[i].ok()) << statuses[i];
+    EXPECT_EQ(signatures[i], SignWithRsaSignRaw(inputs[i])) << i;
+  }
+}
+
+TEST_P(RsaBatchSigningEngineTest, InvalidInputsOnlyFailTheirOwnEntry) {
+  const std::string valid = RandomInput();
+  const std::string too_large(engine_->modulus_size(), '\xff');
+  const std::string too_short = valid.substr(1);
+  std::vector<absl::string_view> inputs = {valid, too_large, too_short, valid};
+  std::vector<std::string> signatures(
+      inputs.size(), std::string(engine_->modulus_size(), 'x'));
+  std::vector<uint8_t *> outputs;
+  for (std::string &signature : signatures) {
+    outputs.push_back(reinterpret_cast<uint8_t *>(&signature[0]));
+  }
+  std::vector<absl::Status> statuses(inputs.size());
+
+  ASSERT_TRUE(
+      engine_->SignBatch(inputs, outputs, absl::MakeSpan(statuses)).ok());
+  EXPECT_TRUE(statuses[0].ok());
+  EXPECT_EQ(statuses[1].code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(statuses[2].code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_TRUE(statuses[3].ok());
+  EXPECT_EQ(signatures[0], SignWithRsaSignRaw(valid));
+  EXPECT_EQ(signatures[3], signatures[0]);
+  // The outputs of failed inputs are cleared.
+  EXPECT_EQ(signatures[1], std::string(engine_->modulus_size(), 0));
+  EXPECT_EQ(signatures[2], std::string(engine_->modulus_size(), 0));
+}
+
+TEST_P(RsaBatchSigningEngineTest, RejectsMismatchedSpans) {
+  const std::string input = RandomInput();
+  std::vector<absl::string_view> inputs = {input, input};
+  std::string signature(engine_->modulus_size(), 0);
+  std::vector<uint8_t *> outputs = {reinterpret_cast<uint8_t *>(&signature[0])};
+  std::vector<absl::Status> statuses(inputs.size());
+
+  EXPECT_EQ(engine_->SignBatch(inputs, outputs, absl::MakeSpan(statuses))
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_TRUE(engine_->SignBatch({}, {}, {}).ok());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RsaBatchSigningEngineTest, RsaBatchSigningEngineTest,
+    ::testing::Combine(::testing::Values(2048, 4096),
+                       /*derived_exponent*/ ::testing::Bool()));
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -19,22 +19,49 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_batch_signing_engine.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
 #include <openssl/rsa.h>
 
 namespace anonymous_tokens {
 namespace {
 
+// Ranges of fewer valid inputs than this are signed one by one with
+// RSA_sign_raw rather than with the RsaBatchSigningEngine, whose blinding
+// factor and fault check only pay off when shared by several signatures.
+constexpr size_t kMinInputsForBatchSigningEngine = 2;
+
+// Checks that 'blinded_data' is a non-empty input of 'mod_size' bytes.
+absl::Status CheckBlindedDataSize(const absl::string_view blinded_data,
+                                  const size_t mod_size) {
+  if (blinded_data.empty() || blinded_data.data() == nullptr) {
+    return absl::InvalidArgumentError("blinded_data string is empty.");
+  }
+  if (blinded_data.size() != mod_size) {
+    return absl::InternalError(absl::StrCat(
+        "Expected blind data size = ", mod_size,
+        " actual blind data size = ", blinded_data.size(), " bytes."));
+  }
+  return absl::OkStatus();
+}
+
 absl::StatusOr<bssl::UniquePtr<RSA>> CreatePrivateKeyWithPublicMetadata(
     const absl::string_view rsa_modulus_str,
     const absl::string_view rsa_public_exponent_str,
@@ -42,6 +69,7 @@ absl::StatusOr<bssl::UniquePtr<RSA>> CreatePrivateKeyWithPublicMetadata(
     const absl::string_view rsa_crt_str,
     const absl::string_view public_metadata,
     const bool use_rsa_public_exponent) {
+  ScopedLatencyTimer timer(LatencyStage::kDerivePrivateKey);
   // Convert RSA modulus n (=p*q) to BIGNUM.
   ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> rsa_modulus,
                                StringToBignum(rsa_modulus_str));
@@ -67,49 +95,49 @@ absl::StatusOr<bssl::UniquePtr<RSA>> CreatePrivateKeyWithPublicMetadata(
   ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> rsa_q,
                                StringToBignum(rsa_q_str));
 
+  // The private intermediate values live in a per-thread arena and are
+  // zeroized when this function returns. RSA_new_private_key_large_e copies
+  // them into the new key.
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  BN_CTX* bn_ctx = &arena.ctx();
+
   // Compute phi(p) = p-1 and phi(q) = q-1.
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> phi_p, NewBigNum());
-  if (BN_sub(phi_p.get(), rsa_p.get(), BN_value_one()) != 1) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * phi_p, arena.NewBigNum());
+  if (BN_sub(phi_p, rsa_p.get(), BN_value_one()) != 1) {
     return absl::InternalError(
         absl::StrCat("Unable to compute phi(p): ", GetSslErrors()));
   }
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> phi_q, NewBigNum());
-  if (BN_sub(phi_q.get(), rsa_q.get(), BN_value_one()) != 1) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * phi_q, arena.NewBigNum());
+  if (BN_sub(phi_q, rsa_q.get(), BN_value_one()) != 1) {
     return absl::InternalError(
         absl::StrCat("Unable to compute phi(q): ", GetSslErrors()));
   }
 
-  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
-  if (!bn_ctx) {
-    return absl::InternalError("BN_CTX_new failed.");
-  }
   // Compute lcm(phi(p), phi(q)).
   ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> lcm,
                                ComputeCarmichaelLcm(*phi_p, *phi_q, *bn_ctx));
 
   // Compute the new private exponent derived_rsa_d.
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> derived_rsa_d,
-                               NewBigNum());
-  if (!BN_mod_inverse(derived_rsa_d.get(), derived_rsa_e.get(), lcm.get(),
-                      bn_ctx.get())) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * derived_rsa_d, arena.NewBigNum());
+  if (!BN_mod_inverse(derived_rsa_d, derived_rsa_e.get(), lcm.get(), bn_ctx)) {
     return absl::InternalError(
         absl::StrCat("Could not compute private exponent d: ", GetSslErrors()));
   }
 
   // Compute new_dpm1 = derived_rsa_d mod p-1.
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> new_dpm1, NewBigNum());
-  BN_mod(new_dpm1.get(), derived_rsa_d.get(), phi_p.get(), bn_ctx.get());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * new_dpm1, arena.NewBigNum());
+  BN_mod(new_dpm1, derived_rsa_d, phi_p, bn_ctx);
   // Compute new_dqm1 = derived_rsa_d mod q-1.
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> new_dqm1, NewBigNum());
-  BN_mod(new_dqm1.get(), derived_rsa_d.get(), phi_q.get(), bn_ctx.get());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * new_dqm1, arena.NewBigNum());
+  BN_mod(new_dqm1, derived_rsa_d, phi_q, bn_ctx);
   // Convert crt to BIGNUM.
   ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> rsa_crt,
                                StringToBignum(rsa_crt_str));
 
   // Create private key derived from given key and public metadata.
   bssl::UniquePtr<RSA> derived_private_key(RSA_new_private_key_large_e(
-      rsa_modulus.get(), derived_rsa_e.get(), derived_rsa_d.get(), rsa_p.get(),
-      rsa_q.get(), new_dpm1.get(), new_dqm1.get(), rsa_crt.get()));
+      rsa_modulus.get(), derived_rsa_e.get(), derived_rsa_d, rsa_p.get(),
+      rsa_q.get(), new_dpm1, new_dqm1, rsa_crt.get()));
   if (!derived_private_key.get()) {
     return absl::InternalError(
         absl::StrCat("RSA_new_private_key_large_e failed: ", GetSslErrors()));
@@ -120,14 +148,16 @@ absl::StatusOr<bssl::UniquePtr<RSA>> CreatePrivateKeyWithPublicMetadata(
 
 }  // namespace
 
-RsaBlindSigner::RsaBlindSigner(std::optional<absl::string_view> public_metadata,
-                               bssl::UniquePtr<RSA> rsa_private_key)
+RsaBlindSigner::RsaBlindSigner(
+    std::optional<absl::string_view> public_metadata,
+    bssl::UniquePtr<RSA> rsa_private_key)
     : public_metadata_(public_metadata),
       rsa_private_key_(std::move(rsa_private_key)) {}
 
 absl::StatusOr<std::unique_ptr<RsaBlindSigner>> RsaBlindSigner::New(
     const RSAPrivateKey& signing_key, const bool use_rsa_public_exponent,
-    std::optional<absl::string_view> public_metadata) {
+    std::optional<absl::string_view> public_metadata,
+    RsaKeyCache* derived_key_cache) {
   bssl::UniquePtr<RSA> rsa_private_key;
   if (!public_metadata.has_value()) {
     // The RSA modulus and exponent are checked as part of the conversion to
@@ -139,35 +169,135 @@ absl::StatusOr<std::unique_ptr<RsaBlindSigner>> RsaBlindSigner::New(
     // exponent using the public metadata.
     //
     // Empty string is a valid public metadata value.
+    auto derive = [&]() {
+      return CreatePrivateKeyWithPublicMetadata(
+          signing_key.n(), signing_key.e(), signing_key.p(), signing_key.q(),
+          signing_key.crt(), *public_metadata, use_rsa_public_exponent);
+    };
+    if (derived_key_cache == nullptr) {
+      ANON_TOKENS_ASSIGN_OR_RETURN(rsa_private_key, derive());
+    } else {
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          const std::string cache_key,
+          DerivedPrivateKeyCacheKey(signing_key.n(), signing_key.e(),
+                                    use_rsa_public_exponent,
+                                    *public_metadata));
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          rsa_private_key, derived_key_cache->GetOrCreate(cache_key, derive));
+    }
+  }
+  return NewForPrivateKey(public_metadata, std::move(rsa_private_key));
+}
+
+absl::StatusOr<std::unique_ptr<RsaBlindSigner>> RsaBlindSigner::New(
+    const RsaPrivateKeyDeriver& key_deriver,
+    const absl::string_view public_metadata, RsaKeyCache* derived_key_cache) {
+  bssl::UniquePtr<RSA> rsa_private_key;
+  auto derive = [&]() { return key_deriver.Derive(public_metadata); };
+  if (derived_key_cache == nullptr) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(rsa_private_key, derive());
+  } else {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        const std::string cache_key,
+        DerivedPrivateKeyCacheKey(key_deriver.modulus(),
+                                  key_deriver.public_exponent(),
+                                  key_deriver.use_rsa_public_exponent(),
+                                  public_metadata));
     ANON_TOKENS_ASSIGN_OR_RETURN(
-        rsa_private_key,
-        CreatePrivateKeyWithPublicMetadata(
-            signing_key.n(), signing_key.e(), signing_key.p(), signing_key.q(),
-            signing_key.crt(), *public_metadata, use_rsa_public_exponent));
+        rsa_private_key, derived_key_cache->GetOrCreate(cache_key, derive));
   }
+  return NewForPrivateKey(public_metadata, std::move(rsa_private_key));
+}
+
+absl::StatusOr<std::unique_ptr<RsaBlindSigner>>
+RsaBlindSigner::NewForPrivateKey(
+    std::optional<absl::string_view> public_metadata,
+    bssl::UniquePtr<RSA> rsa_private_key) {
   return absl::WrapUnique(
       new RsaBlindSigner(public_metadata, std::move(rsa_private_key)));
 }
 
+absl::StatusOr<const RsaBatchSigningEngine*>
+RsaBlindSigner::GetBatchSigningEngine() const {
+  absl::MutexLock lock(&batch_signing_engine_mutex_);
+  // A failure is not kept: the next batch tries to build the engine again.
+  if (batch_signing_engine_ == nullptr) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(batch_signing_engine_,
+                                 RsaBatchSigningEngine::New(*rsa_private_key_));
+  }
+  return batch_signing_engine_.get();
+}
+
 absl::StatusOr<std::string> RsaBlindSigner::Sign(
     const absl::string_view blinded_data) const {
-  if (blinded_data.empty() || blinded_data.data() == nullptr) {
-    return absl::InvalidArgumentError("blinded_data string is empty.");
+  std::string signature(RSA_size(rsa_private_key_.get()), 0);
+  ANON_TOKENS_RETURN_IF_ERROR(
+      SignInto(blinded_data, reinterpret_cast<uint8_t*>(&signature[0])));
+  return signature;
+}
+
+absl::StatusOr<BlindSignatureBatch> RsaBlindSigner::SignBatch(
+    const absl::Span<const absl::string_view> blinded_data,
+    ThreadPool* thread_pool) const {
+  // The engine is only needed if some range can have enough valid inputs.
+  const RsaBatchSigningEngine* engine = nullptr;
+  if (blinded_data.size() >= kMinInputsForBatchSigningEngine) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(engine, GetBatchSigningEngine());
   }
 
-  int mod_size = RSA_size(rsa_private_key_.get());
-  if (blinded_data.size() != mod_size) {
-    return absl::InternalError(absl::StrCat(
-        "Expected blind data size = ", mod_size,
-        " actual blind data size = ", blinded_data.size(), " bytes."));
+  BlindSignatureBatch batch;
+  batch.signature_size = RSA_size(rsa_private_key_.get());
+  batch.signatures.resize(blinded_data.size() * batch.signature_size);
+  batch.statuses.resize(blinded_data.size());
+
+  uint8_t* const signatures =
+      reinterpret_cast<uint8_t*>(batch.signatures.data());
+  auto sign_range = [&](size_t begin, size_t end) {
+    std::vector<absl::string_view> inputs;
+    std::vector<uint8_t*> outputs;
+    std::vector<size_t> indices;
+    for (size_t i = begin; i < end; ++i) {
+      batch.statuses[i] =
+          CheckBlindedDataSize(blinded_data[i], batch.signature_size);
+      if (batch.statuses[i].ok()) {
+        inputs.push_back(blinded_data[i]);
+        outputs.push_back(signatures + i * batch.signature_size);
+        indices.push_back(i);
+      }
+    }
+    if (engine == nullptr || inputs.size() < kMinInputsForBatchSigningEngine) {
+      for (const size_t i : indices) {
+        batch.statuses[i] =
+            SignInto(blinded_data[i], signatures + i * batch.signature_size);
+      }
+      return;
+    }
+    std::vector<absl::Status> statuses(inputs.size());
+    const absl::Status status =
+        engine->SignBatch(inputs, outputs, absl::MakeSpan(statuses));
+    for (size_t j = 0; j < indices.size(); ++j) {
+      batch.statuses[indices[j]] = status.ok() ? statuses[j] : status;
+    }
+  };
+  if (thread_pool == nullptr) {
+    sign_range(0, blinded_data.size());
+  } else {
+    thread_pool->ParallelFor(blinded_data.size(), sign_range);
   }
+  return batch;
+}
+
+absl::Status RsaBlindSigner::SignInto(const absl::string_view blinded_data,
+                                      uint8_t* signature) const {
+  const size_t mod_size = RSA_size(rsa_private_key_.get());
+  ANON_TOKENS_RETURN_IF_ERROR(CheckBlindedDataSize(blinded_data, mod_size));
 
-  std::string signature(mod_size, 0);
   // Compute a raw RSA signature.
+  ScopedLatencyTimer timer(LatencyStage::kSignModExp);
   size_t out_len;
   if (RSA_sign_raw(
           /*rsa=*/rsa_private_key_.get(), /*out_len=*/&out_len,
-          /*out=*/reinterpret_cast<uint8_t*>(&signature[0]),
+          /*out=*/signature,
           /*max_out=*/mod_size,
           /*in=*/reinterpret_cast<const uint8_t*>(&blinded_data[0]),
           /*in_len=*/mod_size,
@@ -175,13 +305,12 @@ absl::StatusOr<std::string> RsaBlindSigner::Sign(
     return absl::InternalError(
         "RSA_sign_raw failed when called from RsaBlindSigner::Sign");
   }
-  if (out_len != mod_size || out_len != signature.size()) {
+  if (out_len != mod_size) {
     return absl::InternalError(absl::StrCat(
-        "Expected value of out_len and signature.size() = ", mod_size,
-        " bytes, actual value of out_len and signature.size() = ", out_len,
-        " and ", signature.size(), " bytes."));
+        "Expected value of out_len = ", mod_size,
+        " bytes, actual value of out_len = ", out_len, " bytes."));
   }
-  return signature;
+  return absl::OkStatus();
 }
 
 }  // namespace anonymous_tokens
@@ -15,17 +15,46 @@
 #ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLIND_SIGNER_H_
 #define ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLIND_SIGNER_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "anonymous_tokens/cpp/crypto/blind_signer.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_batch_signing_engine.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
 
 namespace anonymous_tokens {
 
+// Output of RsaBlindSigner::SignBatch.
+//
+// All signatures are stored back to back in one contiguous buffer: the
+// signature for input i occupies bytes
+// [i * signature_size, (i + 1) * signature_size) of 'signatures' and is only
+// meaningful if statuses[i] is OK.
+struct BlindSignatureBatch {
+  // Returns the signature for input i.
+  absl::string_view signature(size_t i) const {
+    return absl::string_view(signatures).substr(i * signature_size,
+                                                signature_size);
+  }
+
+  size_t signature_size = 0;
+  std::string signatures;
+  std::vector<absl::Status> statuses;
+};
+
 // The RSA SSA (Signature Schemes with Appendix) using PSS (Probabilistic
 // Signature Scheme) encoding is defined at
 // https://tools.ietf.org/html/rfc8017#section-8.1). This implementation uses
@@ -46,24 +75,77 @@ class RsaBlindSigner : public BlindSigner {
   //
   // Setting "use_rsa_public_exponent" to true is deprecated. All new users
   // should set it to false.
+  //
+  // If 'derived_key_cache' is not null, private keys derived from public
+  // metadata are looked up in and added to it, keyed by the signing key and
+  // the public metadata. The signer keeps its own reference to the key, so the
+  // cache only needs to outlive this call.
   static absl::StatusOr<std::unique_ptr<RsaBlindSigner>> New(
       const RSAPrivateKey& signing_key, bool use_rsa_public_exponent,
-      std::optional<absl::string_view> public_metadata = std::nullopt);
+      std::optional<absl::string_view> public_metadata = std::nullopt,
+      RsaKeyCache* derived_key_cache = nullptr);
+
+  // Same as the above with public metadata and the signing key of
+  // 'key_deriver', which derives the private key for 'public_metadata' at a
+  // fraction of the cost of deriving it from the signing key alone. Issuers
+  // that see many public metadata values should keep one RsaPrivateKeyDeriver
+  // per signing key.
+  static absl::StatusOr<std::unique_ptr<RsaBlindSigner>> New(
+      const RsaPrivateKeyDeriver& key_deriver,
+      absl::string_view public_metadata,
+      RsaKeyCache* derived_key_cache = nullptr);
 
   // Computes the signature for 'blinded_data'.
   absl::StatusOr<std::string> Sign(
       absl::string_view blinded_data) const override;
 
+  // Computes the signatures for all elements of 'blinded_data'.
+  //
+  // The output buffer is allocated once for the whole batch. Inputs are
+  // independent of each other: an invalid input only fails its own entry in
+  // the returned statuses.
+  //
+  // If 'thread_pool' is not null, the batch is split across its workers and
+  // the calling thread. Otherwise all inputs are signed on the calling thread.
+  // Either way, the inputs of each thread are signed together by an
+  // RsaBatchSigningEngine, with results identical to those of Sign.
+  //
+  // Returns an error, and signs nothing, only if the RsaBatchSigningEngine of
+  // the signer cannot be built. All other failures are reported per input.
+  absl::StatusOr<BlindSignatureBatch> SignBatch(
+      absl::Span<const absl::string_view> blinded_data,
+      ThreadPool* thread_pool = nullptr) const;
+
  private:
+  // Returns the signer for 'rsa_private_key', which was derived from
+  // 'public_metadata' if that is set.
+  static absl::StatusOr<std::unique_ptr<RsaBlindSigner>> NewForPrivateKey(
+      std::optional<absl::string_view> public_metadata,
+      bssl::UniquePtr<RSA> rsa_private_key);
+
   // Use New to construct.
   RsaBlindSigner(std::optional<absl::string_view> public_metadata,
                  bssl::UniquePtr<RSA> rsa_private_key);
 
+  // Returns the engine that signs the inputs of SignBatch, which is built on
+  // first use: most signers never sign a batch.
+  absl::StatusOr<const RsaBatchSigningEngine*> GetBatchSigningEngine() const;
+
+  // Computes the signature for 'blinded_data' and writes it to 'signature',
+  // which must have room for RSA_size(rsa_private_key_) bytes.
+  absl::Status SignInto(absl::string_view blinded_data,
+                        uint8_t* signature) const;
+
   const std::optional<std::string> public_metadata_;
 
   // In case public metadata is passed to RsaBlindSigner::New, rsa_private_key_
   // will be initialized using RSA_new_private_key_large_e method.
   const bssl::UniquePtr<RSA> rsa_private_key_;
+
+  mutable absl::Mutex batch_signing_engine_mutex_;
+  // Signs the inputs of SignBatch with rsa_private_key_.
+  mutable std::unique_ptr<RsaBatchSigningEngine> batch_signing_engine_
+      ABSL_GUARDED_BY(batch_signing_engine_mutex_);
 };
 
 }  // namespace anonymous_tokens
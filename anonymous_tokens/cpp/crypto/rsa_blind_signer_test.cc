@@ -18,15 +18,20 @@
 #include <random>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
 #include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
 #include "anonymous_tokens/cpp/testing/proto_utils.h"
 #include "anonymous_tokens/cpp/testing/utils.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
@@ -113,6 +118,73 @@ TEST_P(RsaBlindSignerTest, SignerFails) {
               ::testing::HasSubstr("verification failed"));
 }
 
+TEST_P(RsaBlindSignerTest, SignBatchMatchesSign) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(private_key_, /*use_rsa_public_exponent=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(/*num_threads=*/3));
+  const int sig_size = public_key_.n().size();
+  std::vector<std::string> messages;
+  for (int i = 0; i < 7; ++i) {
+    messages.push_back(RandomString(sig_size, &distr_u8_, &generator_));
+    // Keep the input below the modulus.
+    messages.back()[0] = 0;
+  }
+  std::vector<absl::string_view> blinded_data(messages.begin(),
+                                              messages.end());
+
+  for (ThreadPool *pool : {static_cast<ThreadPool *>(nullptr),
+                           thread_pool.get()}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BlindSignatureBatch batch,
+                                     signer->SignBatch(blinded_data, pool));
+    ASSERT_EQ(batch.statuses.size(), messages.size());
+    EXPECT_EQ(batch.signature_size, sig_size);
+    EXPECT_EQ(batch.signatures.size(), messages.size() * sig_size);
+    for (size_t i = 0; i < messages.size(); ++i) {
+      ASSERT_TRUE(batch.statuses[i].ok()) << batch.statuses[i];
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string expected,
+                                       signer->Sign(messages[i]));
+      EXPECT_EQ(batch.signature(i), expected);
+    }
+  }
+}
+
+TEST_P(RsaBlindSignerTest, SignBatchReportsPerItemStatus) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(private_key_, /*use_rsa_public_exponent=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(/*num_threads=*/2));
+  std::string valid =
+      RandomString(public_key_.n().size(), &distr_u8_, &generator_);
+  valid[0] = 0;
+  std::vector<absl::string_view> blinded_data = {valid, "too short", "",
+                                                 valid};
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      BlindSignatureBatch batch,
+      signer->SignBatch(blinded_data, thread_pool.get()));
+  ASSERT_EQ(batch.statuses.size(), blinded_data.size());
+  EXPECT_TRUE(batch.statuses[0].ok());
+  EXPECT_EQ(batch.statuses[1].code(), absl::StatusCode::kInternal);
+  EXPECT_THAT(batch.statuses[1].message(),
+              ::testing::HasSubstr("Expected blind data size"));
+  EXPECT_EQ(batch.statuses[2].code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_TRUE(batch.statuses[3].ok());
+  EXPECT_EQ(batch.signature(0), batch.signature(3));
+}
+
+TEST_P(RsaBlindSignerTest, SignBatchOfNothingIsEmpty) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(private_key_, /*use_rsa_public_exponent=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BlindSignatureBatch batch,
+                                   signer->SignBatch({}));
+  EXPECT_TRUE(batch.signatures.empty());
+  EXPECT_TRUE(batch.statuses.empty());
+}
+
 INSTANTIATE_TEST_SUITE_P(RsaBlindSignerTest, RsaBlindSignerTest,
                          ::testing::Values(&GetStrongRsaKeys2048,
                                            &GetAnotherStrongRsaKeys2048,
@@ -171,6 +243,77 @@ TEST_P(RsaBlindSignerTestWithPublicMetadata, SignerWorksWithPublicMetadata) {
   EXPECT_TRUE(verifier->Verify(potentially_insecure_signature, message).ok());
 }
 
+TEST_P(RsaBlindSignerTestWithPublicMetadata, SignerWorksWithDerivedKeyCache) {
+  absl::string_view message = "Hello World!";
+  absl::string_view public_metadata = "pubmd!";
+  std::string augmented_message =
+      EncodeMessagePublicMetadata(message, public_metadata);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string encoded_message,
+      EncodeMessageForTests(augmented_message, public_key_, sig_hash_,
+                            mgf1_hash_, salt_length_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(/*capacity=*/4));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto verifier,
+      RsaSsaPssVerifier::New(salt_length_, sig_hash_, mgf1_hash_, public_key_,
+                             use_rsa_public_exponent_, public_metadata));
+  for (int i = 0; i < 2; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::unique_ptr<RsaBlindSigner> signer,
+        RsaBlindSigner::New(private_key_, use_rsa_public_exponent_,
+                            public_metadata, cache.get()));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string potentially_insecure_signature,
+                                     signer->Sign(encoded_message));
+    EXPECT_TRUE(
+        verifier->Verify(potentially_insecure_signature, message).ok());
+  }
+  // A different metadata value must not be served from the cache.
+  ASSERT_TRUE(RsaBlindSigner::New(private_key_, use_rsa_public_exponent_,
+                                  "other", cache.get())
+                  .ok());
+
+  RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.size, 2);
+}
+
+TEST_P(RsaBlindSignerTestWithPublicMetadata,
+       SignerWorksWithPrivateKeyDeriver) {
+  absl::string_view message = "Hello World!";
+  absl::string_view public_metadata = "pubmd!";
+  std::string augmented_message =
+      EncodeMessagePublicMetadata(message, public_metadata);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string encoded_message,
+      EncodeMessageForTests(augmented_message, public_key_, sig_hash_,
+                            mgf1_hash_, salt_length_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaPrivateKeyDeriver> key_deriver,
+      RsaPrivateKeyDeriver::New(private_key_, use_rsa_public_exponent_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(/*capacity=*/4));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(*key_deriver, public_metadata, cache.get()));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string potentially_insecure_signature,
+                                   signer->Sign(encoded_message));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto verifier,
+      RsaSsaPssVerifier::New(salt_length_, sig_hash_, mgf1_hash_, public_key_,
+                             use_rsa_public_exponent_, public_metadata));
+  EXPECT_TRUE(verifier->Verify(potentially_insecure_signature, message).ok());
+
+  // Keys derived either way share their cache entries.
+  ASSERT_TRUE(RsaBlindSigner::New(private_key_, use_rsa_public_exponent_,
+                                  public_metadata, cache.get())
+                  .ok());
+  RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+}
+
 TEST_P(RsaBlindSignerTestWithPublicMetadata,
        SignerWorksWithEmptyPublicMetadata) {
   absl::string_view message = "Hello World!";
@@ -250,6 +393,36 @@ TEST_P(RsaBlindSignerTestWithPublicMetadata,
               ::testing::HasSubstr("verification failed"));
 }
 
+TEST_P(RsaBlindSignerTestWithPublicMetadata, SignBatchMatchesSign) {
+  absl::string_view public_metadata = "pubmd!";
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(private_key_, use_rsa_public_exponent_,
+                          public_metadata));
+  std::vector<std::string> encoded_messages;
+  for (int i = 0; i < 5; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string encoded_message,
+        EncodeMessageForTests(
+            EncodeMessagePublicMetadata(absl::StrCat("message ", i),
+                                        public_metadata),
+            public_key_, sig_hash_, mgf1_hash_, salt_length_));
+    encoded_messages.push_back(std::move(encoded_message));
+  }
+  std::vector<absl::string_view> blinded_data(encoded_messages.begin(),
+                                              encoded_messages.end());
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BlindSignatureBatch batch,
+                                   signer->SignBatch(blinded_data));
+  ASSERT_EQ(batch.statuses.size(), encoded_messages.size());
+  for (size_t i = 0; i < encoded_messages.size(); ++i) {
+    ASSERT_TRUE(batch.statuses[i].ok()) << batch.statuses[i];
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string expected,
+                                     signer->Sign(encoded_messages[i]));
+    EXPECT_EQ(batch.signature(i), expected);
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     RsaBlindSignerTestWithPublicMetadata, RsaBlindSignerTestWithPublicMetadata,
     ::testing::Combine(
@@ -274,6 +447,26 @@ TEST(IetfRsaBlindSignerTest,
   }
 }
 
+TEST(IetfRsaBlindSignerTest,
+     IetfRsaBlindSignaturesWithPublicMetadataTestVectorsWithKeyDeriver) {
+  auto test_vectors = GetIetfRsaBlindSignatureWithPublicMetadataTestVectors();
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      const auto test_key,
+      GetIetfRsaBlindSignatureWithPublicMetadataTestKeys());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaPrivateKeyDeriver> key_deriver,
+      RsaPrivateKeyDeriver::New(test_key.second,
+                                /*use_rsa_public_exponent=*/true));
+  for (const auto &test_vector : test_vectors) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::unique_ptr<RsaBlindSigner> signer,
+        RsaBlindSigner::New(*key_deriver, test_vector.public_metadata));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string blind_signature,
+                                     signer->Sign(test_vector.blinded_message));
+    EXPECT_EQ(blind_signature, test_vector.blinded_signature);
+  }
+}
+
 TEST(IetfRsaBlindSignerTest,
      IetfPartiallyBlindRsaSignaturesNoPublicExponentTestVectorsSuccess) {
   auto test_vectors =
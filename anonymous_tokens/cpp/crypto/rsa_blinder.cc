@@ -14,7 +14,9 @@
 
 #include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -23,9 +25,15 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_factor_pool.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
+#include <openssl/bn.h>
 #include <openssl/digest.h>
 #include <openssl/rsa.h>
 
@@ -36,81 +44,89 @@ absl::StatusOr<std::unique_ptr<RsaBlinder>> RsaBlinder::New(
     const EVP_MD* signature_hash_function, const EVP_MD* mgf1_hash_function,
     int salt_length, const bool use_rsa_public_exponent,
     std::optional<absl::string_view> public_metadata) {
-  bssl::UniquePtr<RSA> rsa_public_key;
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      RsaBlindingKeyContext::New(rsa_modulus, rsa_public_exponent,
+                                 signature_hash_function, mgf1_hash_function,
+                                 salt_length, use_rsa_public_exponent));
+  return New(std::move(key_context), public_metadata);
+}
 
-  if (!public_metadata.has_value()) {
-    ANON_TOKENS_ASSIGN_OR_RETURN(
-        rsa_public_key, CreatePublicKeyRSA(rsa_modulus, rsa_public_exponent));
-  } else {
-    // If public metadata is passed, RsaBlinder will compute a new public
-    // exponent using the public metadata.
-    //
-    // Empty string is a valid public metadata value.
-    ANON_TOKENS_ASSIGN_OR_RETURN(
-        rsa_public_key, CreatePublicKeyRSAWithPublicMetadata(
-                            rsa_modulus, rsa_public_exponent, *public_metadata,
-                            use_rsa_public_exponent));
+absl::StatusOr<std::unique_ptr<RsaBlinder>> RsaBlinder::New(
+    std::shared_ptr<const RsaBlindingKeyContext> key_context,
+    std::optional<absl::string_view> public_metadata) {
+  if (key_context == nullptr) {
+    return absl::InvalidArgumentError("Key context must not be null.");
   }
+  // If public metadata is passed, the key context derives a new public
+  // exponent using the public metadata.
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<RSA> rsa_public_key,
+                               key_context->GetPublicKey(public_metadata));
 
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> r, NewBigNum());
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> r_inv_mont, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  // r^e is computed in Blind, where it is only needed once.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      RsaBlindingFactor factor,
+      NewRsaBlindingFactor(*key_context, /*e=*/nullptr, arena.ctx()));
 
-  // Limit r between [2, n) so that an r of 1 never happens. An r of 1 doesn't
-  // blind.
-  if (BN_rand_range_ex(r.get(), 2, RSA_get0_n(rsa_public_key.get())) !=
-      kBsslSuccess) {
-    return absl::InternalError(
-        "BN_rand_range_ex failed when called from RsaBlinder::New.");
-  }
+  return absl::WrapUnique(new RsaBlinder(std::move(key_context),
+                                         public_metadata,
+                                         std::move(rsa_public_key),
+                                         std::move(factor)));
+}
 
-  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
-  if (!bn_ctx) {
-    return absl::InternalError("BN_CTX_new failed.");
-  }
+absl::StatusOr<std::unique_ptr<RsaBlinder>> RsaBlinder::New(
+    RsaBlindingFactorPool& pool) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(RsaBlindingFactor factor, pool.Take());
+  return absl::WrapUnique(new RsaBlinder(pool.key_context(),
+                                         pool.public_metadata(),
+                                         pool.GetPublicKey(),
+                                         std::move(factor)));
+}
 
-  bssl::UniquePtr<BN_MONT_CTX> bn_mont_ctx(BN_MONT_CTX_new_for_modulus(
-      RSA_get0_n(rsa_public_key.get()), bn_ctx.get()));
-  if (!bn_mont_ctx) {
-    return absl::InternalError("BN_MONT_CTX_new_for_modulus failed.");
+absl::StatusOr<std::vector<std::unique_ptr<RsaBlinder>>> RsaBlinder::NewBatch(
+    std::shared_ptr<const RsaBlindingKeyContext> key_context,
+    absl::Span<const std::optional<std::string>> public_metadata) {
+  if (key_context == nullptr) {
+    return absl::InvalidArgumentError("Key context must not be null.");
   }
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::vector<RsaBlindingFactor> factors,
+      NewRsaBlindingFactors(*key_context, /*e=*/nullptr,
+                            public_metadata.size(), arena.ctx()));
 
-  // We wish to compute r^-1 in the Montgomery domain, or r^-1 R mod n. This is
-  // can be done with BN_mod_inverse_blinded followed by BN_to_montgomery, but
-  // it is equivalent and slightly more efficient to first compute r R^-1 mod n
-  // with BN_from_montgomery, and then inverting that to give r^-1 R mod n.
-  int is_r_not_invertible = 0;
-  if (BN_from_montgomery(r_inv_mont.get(), r.get(), bn_mont_ctx.get(),
-                         bn_ctx.get()) != kBsslSuccess ||
-      BN_mod_inverse_blinded(r_inv_mont.get(), &is_r_not_invertible,
-                             r_inv_mont.get(), bn_mont_ctx.get(),
-                             bn_ctx.get()) != kBsslSuccess) {
-    return absl::InternalError(
-        absl::StrCat("BN_mod_inverse failed when called from RsaBlinder::New, "
-                     "is_r_not_invertible = ",
-                     is_r_not_invertible));
+  std::vector<std::unique_ptr<RsaBlinder>> blinders;
+  blinders.reserve(public_metadata.size());
+  for (size_t i = 0; i < public_metadata.size(); ++i) {
+    bssl::UniquePtr<RSA> rsa_public_key;
+    if (i > 0 && public_metadata[i] == public_metadata[i - 1]) {
+      // Requests usually carry the same public metadata for every message, so
+      // avoid deriving the same public key again.
+      RSA* previous_key = blinders.back()->rsa_public_key_.get();
+      RSA_up_ref(previous_key);
+      rsa_public_key.reset(previous_key);
+    } else {
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          rsa_public_key, key_context->GetPublicKey(public_metadata[i]));
+    }
+    blinders.push_back(absl::WrapUnique(
+        new RsaBlinder(key_context, public_metadata[i],
+                       std::move(rsa_public_key), std::move(factors[i]))));
   }
-
-  return absl::WrapUnique(new RsaBlinder(
-      salt_length, public_metadata, signature_hash_function, mgf1_hash_function,
-      std::move(rsa_public_key), std::move(r), std::move(r_inv_mont),
-      std::move(bn_mont_ctx)));
+  return blinders;
 }
 
-RsaBlinder::RsaBlinder(int salt_length,
-                       std::optional<absl::string_view> public_metadata,
-                       const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
-                       bssl::UniquePtr<RSA> rsa_public_key,
-                       bssl::UniquePtr<BIGNUM> r,
-                       bssl::UniquePtr<BIGNUM> r_inv_mont,
-                       bssl::UniquePtr<BN_MONT_CTX> mont_n)
-    : salt_length_(salt_length),
+RsaBlinder::RsaBlinder(
+    std::shared_ptr<const RsaBlindingKeyContext> key_context,
+    std::optional<absl::string_view> public_metadata,
+    bssl::UniquePtr<RSA> rsa_public_key, RsaBlindingFactor factor)
+    : key_context_(std::move(key_context)),
       public_metadata_(public_metadata),
-      sig_hash_(sig_hash),
-      mgf1_hash_(mgf1_hash),
       rsa_public_key_(std::move(rsa_public_key)),
-      r_(std::move(r)),
-      r_inv_mont_(std::move(r_inv_mont)),
-      mont_n_(std::move(mont_n)),
+      r_(std::move(factor.r)),
+      r_e_mont_(std::move(factor.r_e_mont)),
+      r_inv_mont_(std::move(factor.r_inv_mont)),
       blinder_state_(RsaBlinder::BlinderState::kCreated) {}
 
 absl::StatusOr<std::string> RsaBlinder::Blind(const absl::string_view message) {
@@ -119,18 +135,20 @@ absl::StatusOr<std::string> RsaBlinder::Blind(const absl::string_view message) {
     return absl::FailedPreconditionError(
         "RsaBlinder is in wrong state to blind message.");
   }
-  std::string augmented_message(message);
-  if (public_metadata_.has_value()) {
-    augmented_message = EncodeMessagePublicMetadata(message, *public_metadata_);
-  }
-  ANON_TOKENS_ASSIGN_OR_RETURN(std::string digest_str,
-                               ComputeHash(augmented_message, *sig_hash_));
+  // Hash the message and the public metadata encoding without copying the
+  // message into a single augmented message.
+  ScopedLatencyTimer hash_timer(LatencyStage::kHashMessage);
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::string digest_str,
+      ComputeMessageHash(message, public_metadata_,
+                         *key_context_->sig_hash()));
+  hash_timer.Stop();
   std::vector<uint8_t> digest(digest_str.begin(), digest_str.end());
 
   // Construct the PSS padded message, using the same workflow as BoringSSL's
   // RSA_sign_pss_mgf1 for processing the message (but not signing the message):
   // google3/third_party/openssl/boringssl/src/crypto/fipsmodule/rsa/rsa.c?l=557
-  if (digest.size() != EVP_MD_size(sig_hash_)) {
+  if (digest.size() != EVP_MD_size(key_context_->sig_hash())) {
     return absl::InternalError("Invalid input message length.");
   }
 
@@ -143,32 +161,26 @@ absl::StatusOr<std::string> RsaBlinder::Blind(const absl::string_view message) {
   // used. |salt_len| specifies the expected salt length in bytes. If |salt_len|
   // is -1, then the salt length is the same as the hash length. If -2, then the
   // salt length is maximal given the size of |rsa|. If unsure, use -1.
+  ScopedLatencyTimer pss_timer(LatencyStage::kPssEncode);
   if (RSA_padding_add_PKCS1_PSS_mgf1(
           /*rsa=*/rsa_public_key_.get(), /*EM=*/padded.data(),
-          /*mHash=*/digest.data(), /*Hash=*/sig_hash_, /*mgf1Hash=*/mgf1_hash_,
-          /*sLen=*/salt_length_) != kBsslSuccess) {
+          /*mHash=*/digest.data(), /*Hash=*/key_context_->sig_hash(),
+          /*mgf1Hash=*/key_context_->mgf1_hash(),
+          /*sLen=*/key_context_->salt_length()) != kBsslSuccess) {
     return absl::InternalError(
         "RSA_padding_add_PKCS1_PSS_mgf1 failed when called from "
         "RsaBlinder::Blind");
   }
+  pss_timer.Stop();
 
-  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
-  if (!bn_ctx) {
-    return absl::InternalError("BN_CTX_new failed.");
-  }
-
-  std::string encoded_message(padded.begin(), padded.end());
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> encoded_message_bn,
-                               StringToBignum(encoded_message));
-
-  // Take `r^e mod n`. This is an equivalent operation to RSA_encrypt, without
-  // extra encode/decode trips.
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> rE, NewBigNum());
-  if (BN_mod_exp_mont(rE.get(), r_.get(), RSA_get0_e(rsa_public_key_.get()),
-                      RSA_get0_n(rsa_public_key_.get()), bn_ctx.get(),
-                      mont_n_.get()) != kBsslSuccess) {
+  // All intermediate values live in a per-thread arena and are zeroized when
+  // this call returns.
+  ScopedLatencyTimer mod_exp_timer(LatencyStage::kBlindModExp);
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * encoded_message_bn, arena.NewBigNum());
+  if (BN_bin2bn(padded.data(), padded.size(), encoded_message_bn) == nullptr) {
     return absl::InternalError(
-        "BN_mod_exp_mont failed when called from RsaBlinder::Blind.");
+        absl::StrCat("Function BN_bin2bn failed: ", GetSslErrors()));
   }
 
   // Do `encoded_message*r^e mod n`.
@@ -178,23 +190,39 @@ absl::StatusOr<std::string> RsaBlinder::Blind(const absl::string_view message) {
   // However, this is equivalent to ModMulMontgomery(m, ToMontgomery(r^e)).
   // Each BN_mod_mul_montgomery removes a factor of R, so by having only one
   // input in the Montgomery domain, we save a To/FromMontgomery pair.
-  //
-  // Internally, BN_mod_exp_mont actually computes r^e in the Montgomery domain
-  // and converts it out, but there is no public API for this, so we perform an
-  // extra conversion.
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> multiplication_res,
-                               NewBigNum());
-  if (BN_to_montgomery(multiplication_res.get(), rE.get(), mont_n_.get(),
-                       bn_ctx.get()) != kBsslSuccess ||
-      BN_mod_mul_montgomery(multiplication_res.get(), encoded_message_bn.get(),
-                            multiplication_res.get(), mont_n_.get(),
-                            bn_ctx.get()) != kBsslSuccess) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * multiplication_res, arena.NewBigNum());
+  const BIGNUM* r_e_mont = r_e_mont_.get();
+  if (r_e_mont == nullptr) {
+    // Take `r^e mod n`. This is an equivalent operation to RSA_encrypt, without
+    // extra encode/decode trips.
+    //
+    // Internally, BN_mod_exp_mont actually computes r^e in the Montgomery
+    // domain and converts it out, but there is no public API for this, so we
+    // perform an extra conversion.
+    if (BN_mod_exp_mont(multiplication_res, r_.get(),
+                        RSA_get0_e(rsa_public_key_.get()),
+                        RSA_get0_n(rsa_public_key_.get()), &arena.ctx(),
+                        &key_context_->mont_n()) != kBsslSuccess ||
+        BN_to_montgomery(multiplication_res, multiplication_res,
+                         &key_context_->mont_n(),
+                         &arena.ctx()) != kBsslSuccess) {
+      return absl::InternalError(
+          "BN_mod_exp_mont failed when called from RsaBlinder::Blind.");
+    }
+    r_e_mont = multiplication_res;
+  }
+  if (BN_mod_mul_montgomery(multiplication_res, encoded_message_bn, r_e_mont,
+                            &key_context_->mont_n(),
+                            &arena.ctx()) != kBsslSuccess) {
     return absl::InternalError(
         "BN_mod_mul failed when called from RsaBlinder::Blind.");
   }
+  mod_exp_timer.Stop();
 
+  ScopedLatencyTimer serialize_timer(LatencyStage::kSerialize);
   absl::StatusOr<std::string> blinded_msg =
       BignumToString(*multiplication_res, padded_len);
+  serialize_timer.Stop();
 
   // Update RsaBlinder state to kBlinded
   blinder_state_ = RsaBlinder::BlinderState::kBlinded;
@@ -217,15 +245,15 @@ absl::StatusOr<std::string> RsaBlinder::Unblind(
         " actual blind signature size = ", blind_signature.size(), " bytes."));
   }
 
-  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
-  if (!bn_ctx) {
-    return absl::InternalError("BN_CTX_new failed.");
+  ScopedLatencyTimer mod_mul_timer(LatencyStage::kUnblindModMul);
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * signed_big_num, arena.NewBigNum());
+  if (BN_bin2bn(reinterpret_cast<const uint8_t*>(blind_signature.data()),
+                blind_signature.size(), signed_big_num) == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("Function BN_bin2bn failed: ", GetSslErrors()));
   }
-
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> signed_big_num,
-                               StringToBignum(blind_signature));
-  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> unblinded_sig_big,
-                               NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * unblinded_sig_big, arena.NewBigNum());
   // Do `signed_message*r^-1 mod n`.
   //
   // To avoid leaking side channels, we use Montgomery reduction. This would be
@@ -233,26 +261,27 @@ absl::StatusOr<std::string> RsaBlinder::Unblind(
   // However, this is equivalent to ModMulMontgomery(m, ToMontgomery(r^-1)).
   // Each BN_mod_mul_montgomery removes a factor of R, so by having only one
   // input in the Montgomery domain, we save a To/FromMontgomery pair.
-  if (BN_mod_mul_montgomery(unblinded_sig_big.get(), signed_big_num.get(),
-                            r_inv_mont_.get(), mont_n_.get(),
-                            bn_ctx.get()) != kBsslSuccess) {
+  if (BN_mod_mul_montgomery(unblinded_sig_big, signed_big_num,
+                            r_inv_mont_.get(), &key_context_->mont_n(),
+                            &arena.ctx()) != kBsslSuccess) {
     return absl::InternalError(
         "BN_mod_mul failed when called from RsaBlinder::Unblind.");
   }
+  mod_mul_timer.Stop();
+  ScopedLatencyTimer serialize_timer(LatencyStage::kSerialize);
   absl::StatusOr<std::string> unblinded_signed_message =
       BignumToString(*unblinded_sig_big, /*output_len=*/mod_size);
+  serialize_timer.Stop();
   blinder_state_ = RsaBlinder::BlinderState::kUnblinded;
   return unblinded_signed_message;
 }
 
 absl::Status RsaBlinder::Verify(absl::string_view signature,
                                 absl::string_view message) {
-  std::string augmented_message(message);
-  if (public_metadata_.has_value()) {
-    augmented_message = EncodeMessagePublicMetadata(message, *public_metadata_);
-  }
-  return RsaBlindSignatureVerify(salt_length_, sig_hash_, mgf1_hash_, signature,
-                                 augmented_message, rsa_public_key_.get());
+  return RsaBlindSignatureVerify(
+      key_context_->salt_length(), key_context_->sig_hash(),
+      key_context_->mgf1_hash(), signature, message, public_metadata_,
+      rsa_public_key_.get());
 }
 
 }  // namespace anonymous_tokens
@@ -20,12 +20,16 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "anonymous_tokens/cpp/crypto/blinder.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_factor_pool.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
 
 namespace anonymous_tokens {
 
@@ -49,6 +53,26 @@ class RsaBlinder : public Blinder {
       int salt_length, bool use_rsa_public_exponent,
       std::optional<absl::string_view> public_metadata = std::nullopt);
 
+  // Creates a blinder that reuses the per-key state in 'key_context'. Only the
+  // blinding factor r and its inverse are computed per blinder, so this is the
+  // preferred constructor when blinding several messages under one key.
+  static absl::StatusOr<std::unique_ptr<RsaBlinder>> New(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      std::optional<absl::string_view> public_metadata = std::nullopt);
+
+  // Creates a blinder for the key and public metadata of 'pool', using a
+  // blinding factor taken from it. Blind then costs a single modular
+  // multiplication on top of the message encoding.
+  static absl::StatusOr<std::unique_ptr<RsaBlinder>> New(
+      RsaBlindingFactorPool& pool);
+
+  // Creates one blinder per entry of 'public_metadata', inverting all of the
+  // blinding factors at once with NewRsaBlindingFactors. This is cheaper than
+  // calling New repeatedly when several messages are blinded under one key.
+  static absl::StatusOr<std::vector<std::unique_ptr<RsaBlinder>>> NewBatch(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      absl::Span<const std::optional<std::string>> public_metadata);
+
   // Blind `message` using n and e derived from an RSA public key and the public
   // metadata if applicable.
   //
@@ -69,25 +93,23 @@ class RsaBlinder : public Blinder {
 
  private:
   // Use `New` to construct
-  RsaBlinder(int salt_length, std::optional<absl::string_view> public_metadata,
-             const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
-             bssl::UniquePtr<RSA> rsa_public_key, bssl::UniquePtr<BIGNUM> r,
-             bssl::UniquePtr<BIGNUM> r_inv_mont,
-             bssl::UniquePtr<BN_MONT_CTX> mont_n);
+  RsaBlinder(std::shared_ptr<const RsaBlindingKeyContext> key_context,
+             std::optional<absl::string_view> public_metadata,
+             bssl::UniquePtr<RSA> rsa_public_key, RsaBlindingFactor factor);
 
-  const int salt_length_;
+  const std::shared_ptr<const RsaBlindingKeyContext> key_context_;
   std::optional<std::string> public_metadata_;
-  const EVP_MD* sig_hash_;   // Owned by BoringSSL.
-  const EVP_MD* mgf1_hash_;  // Owned by BoringSSL.
 
   // If public metadata was passed to RsaBlinder::New, rsa_public_key_ will
   // will be initialized using RSA_new_public_key_large_e method.
   const bssl::UniquePtr<RSA> rsa_public_key_;
 
+  // Not set if r_e_mont_ is set.
   const bssl::UniquePtr<BIGNUM> r_;
+  // r^e mod n in the Montgomery domain, if precomputed.
+  const bssl::UniquePtr<BIGNUM> r_e_mont_;
   // r^-1 mod n in the Montgomery domain
   const bssl::UniquePtr<BIGNUM> r_inv_mont_;
-  const bssl::UniquePtr<BN_MONT_CTX> mont_n_;
 
   BlinderState blinder_state_;
 };
@@ -15,16 +15,21 @@
 #include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
 #include "anonymous_tokens/cpp/testing/utils.h"
 #include <openssl/base.h>
 #include <openssl/digest.h>
@@ -227,6 +232,50 @@ TEST_P(RsaBlinderTest, InvalidVerificationKey) {
               absl::StatusCode::kInvalidArgument);
 }
 
+TEST_P(RsaBlinderTest, BlindersSharingKeyContextWork) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      RsaBlindingKeyContext::New(rsa_blinder_test_params_.public_key.n,
+                                 rsa_blinder_test_params_.public_key.e,
+                                 rsa_blinder_test_params_.sig_hash,
+                                 rsa_blinder_test_params_.mgf1_hash,
+                                 rsa_blinder_test_params_.salt_length,
+                                 /*use_rsa_public_exponent=*/true));
+  EXPECT_EQ(key_context->modulus_size(),
+            rsa_blinder_test_params_.public_key.n.size());
+
+  std::vector<std::unique_ptr<RsaBlinder>> blinders;
+  std::vector<std::string> blinded_messages;
+  for (int i = 0; i < 3; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaBlinder> blinder,
+                                     RsaBlinder::New(key_context));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string blinded_message,
+        blinder->Blind(absl::StrCat("Hello World ", i)));
+    blinders.push_back(std::move(blinder));
+    blinded_messages.push_back(std::move(blinded_message));
+  }
+  // Each blinder draws its own blinding factor.
+  EXPECT_NE(blinded_messages[0], blinded_messages[1]);
+
+  for (int i = 0; i < 3; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string blinded_signature,
+        TestSign(blinded_messages[i], rsa_key_.get()));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                     blinders[i]->Unblind(blinded_signature));
+    EXPECT_TRUE(
+        blinders[i]->Verify(signature, absl::StrCat("Hello World ", i)).ok());
+  }
+}
+
+TEST(RsaBlinderKeyContextTest, NullKeyContextFails) {
+  EXPECT_EQ(RsaBlinder::New(std::shared_ptr<const RsaBlindingKeyContext>())
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 INSTANTIATE_TEST_SUITE_P(RsaBlinderTest, RsaBlinderTest,
                          testing::Values(CreateDefaultTestKeyParameters(),
                                          CreateShorterTestKeyParameters(),
@@ -297,6 +346,45 @@ TEST_P(RsaBlinderWithPublicMetadataTest,
   EXPECT_TRUE(blinder->Verify(signature, message).ok());
 }
 
+TEST_P(RsaBlinderWithPublicMetadataTest, ReportsStageLatencies) {
+  const absl::string_view message = "Hello World!";
+  const absl::string_view public_metadata = "pubmd!";
+  HistogramLatencySink sink;
+  SetLatencySink(&sink);
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlinder> blinder,
+      RsaBlinder::New(rsa_blinder_test_params_.public_key.n,
+                      rsa_blinder_test_params_.public_key.e,
+                      rsa_blinder_test_params_.sig_hash,
+                      rsa_blinder_test_params_.mgf1_hash,
+                      rsa_blinder_test_params_.salt_length,
+                      use_rsa_public_exponent_, public_metadata));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string blinded_message,
+                                   blinder->Blind(message));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string blinded_signature,
+      TestSignWithPublicMetadata(blinded_message, public_metadata, *rsa_key_,
+                                 use_rsa_public_exponent_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                   blinder->Unblind(blinded_signature));
+  EXPECT_TRUE(blinder->Verify(signature, message).ok());
+  SetLatencySink(nullptr);
+
+  const LatencySnapshot snapshot = sink.GetSnapshot();
+  auto count = [&snapshot](LatencyStage stage) {
+    return snapshot.stages[static_cast<int>(stage)].count;
+  };
+  EXPECT_GE(count(LatencyStage::kDeriveExponent), 1);
+  EXPECT_EQ(count(LatencyStage::kHashMessage), 2);
+  EXPECT_EQ(count(LatencyStage::kPssEncode), 1);
+  EXPECT_EQ(count(LatencyStage::kBlindModExp), 1);
+  EXPECT_EQ(count(LatencyStage::kUnblindModMul), 1);
+  EXPECT_EQ(count(LatencyStage::kSerialize), 2);
+  EXPECT_EQ(count(LatencyStage::kVerifyModExp), 1);
+  EXPECT_EQ(count(LatencyStage::kPssVerify), 1);
+}
+
 TEST_P(RsaBlinderWithPublicMetadataTest,
        BlindSignUnblindWithEmptyPublicMetadataEnd2EndTest) {
   const absl::string_view message = "Hello World!";
@@ -430,6 +518,62 @@ TEST_P(RsaBlinderWithPublicMetadataTest, NoPublicMetadataInBlinding) {
               ::testing::HasSubstr("verification failed"));
 }
 
+TEST_P(RsaBlinderWithPublicMetadataTest,
+       BlindersSharingKeyContextWithDifferentPublicMetadata) {
+  const absl::string_view message = "Hello World!";
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      RsaBlindingKeyContext::New(rsa_blinder_test_params_.public_key.n,
+                                 rsa_blinder_test_params_.public_key.e,
+                                 rsa_blinder_test_params_.sig_hash,
+                                 rsa_blinder_test_params_.mgf1_hash,
+                                 rsa_blinder_test_params_.salt_length,
+                                 use_rsa_public_exponent_));
+  for (absl::string_view public_metadata : {"pubmd!", "", "other"}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::unique_ptr<RsaBlinder> blinder,
+        RsaBlinder::New(key_context, public_metadata));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string blinded_message,
+                                     blinder->Blind(message));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string blinded_signature,
+        TestSignWithPublicMetadata(blinded_message, public_metadata, *rsa_key_,
+                                   use_rsa_public_exponent_));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                     blinder->Unblind(blinded_signature));
+    EXPECT_TRUE(blinder->Verify(signature, message).ok());
+  }
+}
+
+TEST_P(RsaBlinderWithPublicMetadataTest, NewBatchBlindersWork) {
+  const absl::string_view message = "Hello World!";
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      RsaBlindingKeyContext::New(rsa_blinder_test_params_.public_key.n,
+                                 rsa_blinder_test_params_.public_key.e,
+                                 rsa_blinder_test_params_.sig_hash,
+                                 rsa_blinder_test_params_.mgf1_hash,
+                                 rsa_blinder_test_params_.salt_length,
+                                 use_rsa_public_exponent_));
+  const std::vector<std::optional<std::string>> public_metadata = {
+      "pubmd!", "pubmd!", "", "other", "other"};
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::vector<std::unique_ptr<RsaBlinder>> blinders,
+      RsaBlinder::NewBatch(key_context, public_metadata));
+  ASSERT_EQ(blinders.size(), public_metadata.size());
+  for (size_t i = 0; i < blinders.size(); ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string blinded_message,
+                                     blinders[i]->Blind(message));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string blinded_signature,
+        TestSignWithPublicMetadata(blinded_message, *public_metadata[i],
+                                   *rsa_key_, use_rsa_public_exponent_));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                     blinders[i]->Unblind(blinded_signature));
+    EXPECT_TRUE(blinders[i]->Verify(signature, message).ok());
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     RsaBlinderWithPublicMetadataTest, RsaBlinderWithPublicMetadataTest,
     testing::Combine(testing::Values(GetStrongTestRsaKeyPair2048(),
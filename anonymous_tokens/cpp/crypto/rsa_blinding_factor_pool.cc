@@ -0,0 +1,296 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_factor_pool.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+namespace {
+
+// Samples r from [2, n).
+absl::StatusOr<bssl::UniquePtr<BIGNUM>> SampleBlindingFactor(
+    const RsaBlindingKeyContext& key_context) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> r, NewBigNum());
+  // Limit r between [2, n) so that an r of 1 never happens. An r of 1 doesn't
+  // blind.
+  if (BN_rand_range_ex(r.get(), 2, &key_context.n()) != kBsslSuccess) {
+    return absl::InternalError(
+        "BN_rand_range_ex failed when called from SampleBlindingFactor.");
+  }
+  return r;
+}
+
+// Sets factor.r_e_mont to r^e R mod n and drops factor.r.
+absl::Status PrecomputeBlindingFactorPower(
+    const RsaBlindingKeyContext& key_context, const BIGNUM& e, BN_CTX& bn_ctx,
+    RsaBlindingFactor& factor) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(factor.r_e_mont, NewBigNum());
+  if (BN_mod_exp_mont(factor.r_e_mont.get(), factor.r.get(), &e,
+                      &key_context.n(), &bn_ctx,
+                      &key_context.mont_n()) != kBsslSuccess ||
+      BN_to_montgomery(factor.r_e_mont.get(), factor.r_e_mont.get(),
+                       &key_context.mont_n(), &bn_ctx) != kBsslSuccess) {
+    return absl::InternalError(
+        "Computing r^e failed when called from "
+        "PrecomputeBlindingFactorPower.");
+  }
+  factor.r.reset();
+  return absl::OkStatus();
+}
+
+// Sets 'inverse' to x^-1 R mod n, i.e. the inverse of 'x' in the Montgomery
+// domain.
+absl::Status InverseMontgomery(const RsaBlindingKeyContext& key_context,
+                               const BIGNUM& x, BN_CTX& bn_ctx,
+                               BIGNUM& inverse) {
+  // We wish to compute x^-1 in the Montgomery domain, or x^-1 R mod n. This
+  // can be done with BN_mod_inverse_blinded followed by BN_to_montgomery, but
+  // it is equivalent and slightly more efficient to first compute x R^-1 mod n
+  // with BN_from_montgomery, and then inverting that to give x^-1 R mod n.
+  int is_not_invertible = 0;
+  if (BN_from_montgomery(&inverse, &x, &key_context.mont_n(), &bn_ctx) !=
+          kBsslSuccess ||
+      BN_mod_inverse_blinded(&inverse, &is_not_invertible, &inverse,
+                             &key_context.mont_n(), &bn_ctx) != kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "BN_mod_inverse failed when called from InverseMontgomery, "
+        "is_not_invertible = ",
+        is_not_invertible));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<RsaBlindingFactor> NewRsaBlindingFactor(
+    const RsaBlindingKeyContext& key_context, const BIGNUM* e,
+    BN_CTX& bn_ctx) {
+  RsaBlindingFactor factor;
+  ANON_TOKENS_ASSIGN_OR_RETURN(factor.r, SampleBlindingFactor(key_context));
+  ANON_TOKENS_ASSIGN_OR_RETURN(factor.r_inv_mont, NewBigNum());
+  ANON_TOKENS_RETURN_IF_ERROR(InverseMontgomery(key_context, *factor.r, bn_ctx,
+                                                *factor.r_inv_mont));
+  if (e != nullptr) {
+    ANON_TOKENS_RETURN_IF_ERROR(
+        PrecomputeBlindingFactorPower(key_context, *e, bn_ctx, factor));
+  }
+  return factor;
+}
+
+absl::StatusOr<std::vector<RsaBlindingFactor>> NewRsaBlindingFactors(
+    const RsaBlindingKeyContext& key_context, const BIGNUM* e,
+    const size_t count, BN_CTX& bn_ctx) {
+  std::vector<RsaBlindingFactor> factors(count);
+  if (count == 0) {
+    return factors;
+  }
+  const BN_MONT_CTX& mont_n = key_context.mont_n();
+
+  // Each Montgomery multiplication removes a factor of R, so prefix[i] holds
+  // r_0 * ... * r_i * R^-i mod n.
+  std::vector<bssl::UniquePtr<BIGNUM>> prefix(count);
+  for (size_t i = 0; i < count; ++i) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(factors[i].r,
+                                 SampleBlindingFactor(key_context));
+    ANON_TOKENS_ASSIGN_OR_RETURN(prefix[i], NewBigNum());
+    if (i == 0) {
+      if (BN_copy(prefix[i].get(), factors[i].r.get()) == nullptr) {
+        return absl::InternalError("BN_copy failed.");
+      }
+    } else if (BN_mod_mul_montgomery(prefix[i].get(), prefix[i - 1].get(),
+                                     factors[i].r.get(), &mont_n,
+                                     &bn_ctx) != kBsslSuccess) {
+      return absl::InternalError(
+          "BN_mod_mul_montgomery failed when called from "
+          "NewRsaBlindingFactors.");
+    }
+  }
+
+  // The product of the r_i is itself uniformly random, so inverting it with
+  // BN_mod_inverse_blinded hides every r_i just as inverting them one by one
+  // does.
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> inverse, NewBigNum());
+  ANON_TOKENS_RETURN_IF_ERROR(
+      InverseMontgomery(key_context, *prefix[count - 1], bn_ctx, *inverse));
+
+  // Walk back down, keeping inverse = (r_0 * ... * r_i)^-1 * R^(i + 1) mod n.
+  // Multiplying it by prefix[i - 1] leaves r_i^-1 R, and multiplying it by r_i
+  // drops r_i from the product. prefix[i] is no longer needed at that point
+  // and is reused for r_i^-1 R.
+  for (size_t i = count - 1; i > 0; --i) {
+    if (BN_mod_mul_montgomery(prefix[i].get(), inverse.get(),
+                              prefix[i - 1].get(), &mont_n,
+                              &bn_ctx) != kBsslSuccess ||
+        BN_mod_mul_montgomery(inverse.get(), inverse.get(),
+                              factors[i].r.get(), &mont_n,
+                              &bn_ctx) != kBsslSuccess) {
+      return absl::InternalError(
+          "BN_mod_mul_montgomery failed when called from "
+          "NewRsaBlindingFactors.");
+    }
+    factors[i].r_inv_mont = std::move(prefix[i]);
+  }
+  factors[0].r_inv_mont = std::move(inverse);
+
+  if (e != nullptr) {
+    for (RsaBlindingFactor& factor : factors) {
+      ANON_TOKENS_RETURN_IF_ERROR(
+          PrecomputeBlindingFactorPower(key_context, *e, bn_ctx, factor));
+    }
+  }
+  return factors;
+}
+
+absl::StatusOr<std::unique_ptr<RsaBlindingFactorPool>>
+RsaBlindingFactorPool::New(
+    std::shared_ptr<const RsaBlindingKeyContext> key_context,
+    std::optional<absl::string_view> public_metadata, const Options& options) {
+  if (key_context == nullptr) {
+    return absl::InvalidArgumentError("Key context must not be null.");
+  } else if (options.capacity == 0) {
+    return absl::InvalidArgumentError("Pool capacity must be positive.");
+  } else if (options.low_water_mark > options.capacity) {
+    return absl::InvalidArgumentError(
+        "Low-water mark must not exceed the pool capacity.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<RSA> rsa_public_key,
+                               key_context->GetPublicKey(public_metadata));
+  return absl::WrapUnique(
+      new RsaBlindingFactorPool(std::move(key_context), public_metadata,
+                                std::move(rsa_public_key), options));
+}
+
+RsaBlindingFactorPool::RsaBlindingFactorPool(
+    std::shared_ptr<const RsaBlindingKeyContext> key_context,
+    std::optional<absl::string_view> public_metadata,
+    bssl::UniquePtr<RSA> rsa_public_key, const Options& options)
+    : key_context_(std::move(key_context)),
+      public_metadata_(public_metadata),
+      rsa_public_key_(std::move(rsa_public_key)),
+      capacity_(options.capacity),
+      low_water_mark_(options.low_water_mark) {
+  if (options.start_refill_thread) {
+    refill_thread_ = std::thread(&RsaBlindingFactorPool::RefillLoop, this);
+  }
+}
+
+RsaBlindingFactorPool::~RsaBlindingFactorPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  if (refill_thread_.joinable()) {
+    refill_thread_.join();
+  }
+}
+
+absl::StatusOr<RsaBlindingFactor> RsaBlindingFactorPool::ComputeFactor(
+    BN_CTX& bn_ctx) const {
+  return NewRsaBlindingFactor(*key_context_, RSA_get0_e(rsa_public_key_.get()),
+                              bn_ctx);
+}
+
+absl::StatusOr<RsaBlindingFactor> RsaBlindingFactorPool::Take() {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!factors_.empty()) {
+      RsaBlindingFactor factor = std::move(factors_.front());
+      factors_.pop_front();
+      ++stats_.pool_hits;
+      return factor;
+    }
+    ++stats_.pool_misses;
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  return ComputeFactor(arena.ctx());
+}
+
+absl::Status RsaBlindingFactorPool::Refill() {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  while (true) {
+    {
+      absl::MutexLock lock(&mutex_);
+      if (stopping_ || factors_.size() >= capacity_) {
+        return absl::OkStatus();
+      }
+    }
+    // Factors are computed without holding the lock so that Take is never
+    // blocked behind a modular exponentiation.
+    ANON_TOKENS_ASSIGN_OR_RETURN(RsaBlindingFactor factor,
+                                 ComputeFactor(arena.ctx()));
+    absl::MutexLock lock(&mutex_);
+    if (factors_.size() < capacity_) {
+      factors_.push_back(std::move(factor));
+    }
+  }
+}
+
+bool RsaBlindingFactorPool::NeedsRefillOrStopping() const {
+  return stopping_ || factors_.size() < low_water_mark_ || factors_.empty();
+}
+
+void RsaBlindingFactorPool::RefillLoop() {
+  while (true) {
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(
+          this, &RsaBlindingFactorPool::NeedsRefillOrStopping));
+      if (stopping_) {
+        return;
+      }
+    }
+    if (!Refill().ok()) {
+      // Failures are transient (e.g. allocation); Take computes factors inline
+      // in the meantime.
+      absl::MutexLock lock(&mutex_);
+      mutex_.AwaitWithTimeout(
+          absl::Condition(&stopping_), absl::Milliseconds(100));
+    }
+  }
+}
+
+bssl::UniquePtr<RSA> RsaBlindingFactorPool::GetPublicKey() const {
+  RSA_up_ref(rsa_public_key_.get());
+  return bssl::UniquePtr<RSA>(rsa_public_key_.get());
+}
+
+RsaBlindingFactorPoolStats RsaBlindingFactorPool::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  RsaBlindingFactorPoolStats stats = stats_;
+  stats.size = factors_.size();
+  return stats;
+}
+
+}  // namespace anonymous_tokens
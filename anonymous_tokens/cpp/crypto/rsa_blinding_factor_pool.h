@@ -0,0 +1,155 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLINDING_FACTOR_POOL_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLINDING_FACTOR_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include <openssl/base.h>
+
+namespace anonymous_tokens {
+
+// A random blinding factor r for one RSA public key (n, e), in the form used
+// by RsaBlinder.
+struct RsaBlindingFactor {
+  // r itself. Not set if r_e_mont is set, since r is then no longer needed.
+  bssl::UniquePtr<BIGNUM> r;
+  // r^e R mod n, i.e. r^e in the Montgomery domain. Not set if r^e has not
+  // been precomputed.
+  bssl::UniquePtr<BIGNUM> r_e_mont;
+  // r^-1 R mod n, i.e. r^-1 in the Montgomery domain.
+  bssl::UniquePtr<BIGNUM> r_inv_mont;
+};
+
+// Samples r from [2, n) and computes its inverse in the Montgomery domain.
+//
+// If 'e' is not null, r^e is precomputed as well and r is dropped.
+absl::StatusOr<RsaBlindingFactor> NewRsaBlindingFactor(
+    const RsaBlindingKeyContext& key_context, const BIGNUM* e, BN_CTX& bn_ctx);
+
+// Same as calling NewRsaBlindingFactor 'count' times, but all inverses are
+// computed with a single modular inversion and 3 * (count - 1) Montgomery
+// multiplications (Montgomery's simultaneous inversion trick).
+absl::StatusOr<std::vector<RsaBlindingFactor>> NewRsaBlindingFactors(
+    const RsaBlindingKeyContext& key_context, const BIGNUM* e, size_t count,
+    BN_CTX& bn_ctx);
+
+// Counters describing how an RsaBlindingFactorPool is used.
+struct RsaBlindingFactorPoolStats {
+  // Factors handed out from the pool.
+  uint64_t pool_hits = 0;
+  // Factors computed on the calling thread because the pool was empty.
+  uint64_t pool_misses = 0;
+  // Factors currently in the pool.
+  size_t size = 0;
+};
+
+// A pool of precomputed blinding factors (r^e and r^-1, both in the
+// Montgomery domain) for one public key and public metadata value.
+//
+// Neither value depends on the message being blinded, so they can be computed
+// ahead of time. Blinding a message with a pooled factor costs a single
+// Montgomery multiplication instead of a modular exponentiation and
+// inversion, which keeps client latency low when a burst of token requests
+// arrives.
+//
+// An optional background thread refills the pool up to its capacity whenever
+// it drops below the low-water mark. RsaBlindingFactorPool is thread-safe.
+class RsaBlindingFactorPool {
+ public:
+  struct Options {
+    // Maximum number of precomputed factors.
+    size_t capacity = 64;
+    // The refill thread is woken up once fewer factors than this remain.
+    size_t low_water_mark = 16;
+    // If false, the pool is only filled by explicit calls to Refill.
+    bool start_refill_thread = true;
+  };
+
+  // Creates a pool for the public key in 'key_context', derived from
+  // 'public_metadata' if set. The pool is empty until the refill thread or a
+  // call to Refill fills it.
+  static absl::StatusOr<std::unique_ptr<RsaBlindingFactorPool>> New(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      std::optional<absl::string_view> public_metadata,
+      const Options& options);
+
+  // Stops and joins the refill thread.
+  ~RsaBlindingFactorPool();
+
+  RsaBlindingFactorPool(const RsaBlindingFactorPool&) = delete;
+  RsaBlindingFactorPool& operator=(const RsaBlindingFactorPool&) = delete;
+
+  // Returns a precomputed blinding factor, or computes one on the calling
+  // thread if the pool is empty. Every factor is handed out at most once.
+  absl::StatusOr<RsaBlindingFactor> Take();
+
+  // Fills the pool up to its capacity on the calling thread.
+  absl::Status Refill();
+
+  // Returns a new reference to the public key the factors are computed for.
+  bssl::UniquePtr<RSA> GetPublicKey() const;
+
+  const std::shared_ptr<const RsaBlindingKeyContext>& key_context() const {
+    return key_context_;
+  }
+  const std::optional<std::string>& public_metadata() const {
+    return public_metadata_;
+  }
+
+  RsaBlindingFactorPoolStats GetStats() const;
+
+ private:
+  // Use New to construct.
+  RsaBlindingFactorPool(
+      std::shared_ptr<const RsaBlindingKeyContext> key_context,
+      std::optional<absl::string_view> public_metadata,
+      bssl::UniquePtr<RSA> rsa_public_key, const Options& options);
+
+  absl::StatusOr<RsaBlindingFactor> ComputeFactor(BN_CTX& bn_ctx) const;
+  bool NeedsRefillOrStopping() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RefillLoop();
+
+  const std::shared_ptr<const RsaBlindingKeyContext> key_context_;
+  const std::optional<std::string> public_metadata_;
+  // Public key derived from public_metadata_, if set.
+  const bssl::UniquePtr<RSA> rsa_public_key_;
+  const size_t capacity_;
+  const size_t low_water_mark_;
+
+  mutable absl::Mutex mutex_;
+  std::deque<RsaBlindingFactor> factors_ ABSL_GUARDED_BY(mutex_);
+  RsaBlindingFactorPoolStats stats_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  std::thread refill_thread_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLINDING_FACTOR_POOL_H_
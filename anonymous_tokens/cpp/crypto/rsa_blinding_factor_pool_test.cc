@@ -0,0 +1,207 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_factor_pool.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include <openssl/bn.h>
+#include <openssl/digest.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kSaltLength = 48;
+
+class RsaBlindingFactorPoolTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const auto [public_key, private_key] = GetStrongTestRsaKeyPair2048();
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        rsa_key_,
+        CreatePrivateKeyRSA(private_key.n, private_key.e, private_key.d,
+                            private_key.p, private_key.q, private_key.dp,
+                            private_key.dq, private_key.crt));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        key_context_,
+        RsaBlindingKeyContext::New(public_key.n, public_key.e, EVP_sha384(),
+                                   EVP_sha384(), kSaltLength,
+                                   /*use_rsa_public_exponent=*/false));
+  }
+
+  bssl::UniquePtr<RSA> rsa_key_;
+  std::shared_ptr<const RsaBlindingKeyContext> key_context_;
+};
+
+TEST_F(RsaBlindingFactorPoolTest, BatchInversionMatchesEachFactor) {
+  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
+  ASSERT_NE(bn_ctx, nullptr);
+  for (size_t count : {0, 1, 2, 7}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::vector<RsaBlindingFactor> factors,
+        NewRsaBlindingFactors(*key_context_, /*e=*/nullptr, count, *bn_ctx));
+    ASSERT_EQ(factors.size(), count);
+    for (const RsaBlindingFactor& factor : factors) {
+      ASSERT_NE(factor.r, nullptr);
+      ASSERT_NE(factor.r_inv_mont, nullptr);
+      // r * (r^-1 R) * R^-1 = 1 mod n.
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<BIGNUM> product,
+                                       NewBigNum());
+      ASSERT_EQ(BN_mod_mul_montgomery(product.get(), factor.r.get(),
+                                      factor.r_inv_mont.get(),
+                                      &key_context_->mont_n(), bn_ctx.get()),
+                1);
+      EXPECT_TRUE(BN_is_one(product.get()));
+    }
+  }
+}
+
+TEST_F(RsaBlindingFactorPoolTest, InvalidOptionsFail) {
+  RsaBlindingFactorPool::Options options;
+  options.capacity = 0;
+  options.low_water_mark = 0;
+  EXPECT_EQ(
+      RsaBlindingFactorPool::New(key_context_, std::nullopt, options)
+          .status()
+          .code(),
+      absl::StatusCode::kInvalidArgument);
+
+  options.capacity = 4;
+  options.low_water_mark = 5;
+  EXPECT_EQ(
+      RsaBlindingFactorPool::New(key_context_, std::nullopt, options)
+          .status()
+          .code(),
+      absl::StatusCode::kInvalidArgument);
+
+  EXPECT_EQ(RsaBlindingFactorPool::New(nullptr, std::nullopt, {})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(RsaBlindingFactorPoolTest, RefillAndTakeUpdateStats) {
+  RsaBlindingFactorPool::Options options;
+  options.capacity = 3;
+  options.low_water_mark = 1;
+  options.start_refill_thread = false;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindingFactorPool> pool,
+      RsaBlindingFactorPool::New(key_context_, std::nullopt, options));
+  EXPECT_EQ(pool->GetStats().size, 0);
+
+  ASSERT_TRUE(pool->Refill().ok());
+  EXPECT_EQ(pool->GetStats().size, 3);
+
+  for (int i = 0; i < 4; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(RsaBlindingFactor factor, pool->Take());
+    EXPECT_EQ(factor.r, nullptr);
+    EXPECT_NE(factor.r_e_mont, nullptr);
+    EXPECT_NE(factor.r_inv_mont, nullptr);
+  }
+  const RsaBlindingFactorPoolStats stats = pool->GetStats();
+  EXPECT_EQ(stats.pool_hits, 3);
+  EXPECT_EQ(stats.pool_misses, 1);
+  EXPECT_EQ(stats.size, 0);
+}
+
+TEST_F(RsaBlindingFactorPoolTest, BlindersFromPoolWork) {
+  const absl::string_view message = "Hello World!";
+  RsaBlindingFactorPool::Options options;
+  options.capacity = 2;
+  options.low_water_mark = 0;
+  options.start_refill_thread = false;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindingFactorPool> pool,
+      RsaBlindingFactorPool::New(key_context_, std::nullopt, options));
+  ASSERT_TRUE(pool->Refill().ok());
+
+  // The last blinder is created from a pool miss.
+  for (int i = 0; i < 3; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaBlinder> blinder,
+                                     RsaBlinder::New(*pool));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string blinded_message,
+                                     blinder->Blind(message));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string blinded_signature,
+        TestSign(blinded_message, rsa_key_.get()));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                     blinder->Unblind(blinded_signature));
+    EXPECT_TRUE(blinder->Verify(signature, message).ok());
+  }
+}
+
+TEST_F(RsaBlindingFactorPoolTest, BlindersFromPoolWithPublicMetadataWork) {
+  const absl::string_view message = "Hello World!";
+  for (absl::string_view public_metadata : {"pubmd!", ""}) {
+    RsaBlindingFactorPool::Options options;
+    options.capacity = 1;
+    options.low_water_mark = 0;
+    options.start_refill_thread = false;
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::unique_ptr<RsaBlindingFactorPool> pool,
+        RsaBlindingFactorPool::New(key_context_, public_metadata, options));
+    ASSERT_TRUE(pool->Refill().ok());
+
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaBlinder> blinder,
+                                     RsaBlinder::New(*pool));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string blinded_message,
+                                     blinder->Blind(message));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string blinded_signature,
+        TestSignWithPublicMetadata(blinded_message, public_metadata, *rsa_key_,
+                                   /*use_rsa_public_exponent=*/false));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                     blinder->Unblind(blinded_signature));
+    EXPECT_TRUE(blinder->Verify(signature, message).ok());
+  }
+}
+
+TEST_F(RsaBlindingFactorPoolTest, RefillThreadFillsPool) {
+  RsaBlindingFactorPool::Options options;
+  options.capacity = 4;
+  options.low_water_mark = 2;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindingFactorPool> pool,
+      RsaBlindingFactorPool::New(key_context_, std::nullopt, options));
+
+  const absl::Time deadline = absl::Now() + absl::Seconds(30);
+  while (pool->GetStats().size < options.capacity && absl::Now() < deadline) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  EXPECT_EQ(pool->GetStats().size, options.capacity);
+
+  // Destroying the pool while the refill thread is running must not hang.
+  ASSERT_TRUE(pool->Take().ok());
+  pool.reset();
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,101 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_blinding_key_context.h"
+
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+absl::StatusOr<std::shared_ptr<const RsaBlindingKeyContext>>
+RsaBlindingKeyContext::New(const absl::string_view rsa_modulus,
+                           const absl::string_view rsa_public_exponent,
+                           const EVP_MD* signature_hash_function,
+                           const EVP_MD* mgf1_hash_function,
+                           const int salt_length,
+                           const bool use_rsa_public_exponent) {
+  if (signature_hash_function == nullptr || mgf1_hash_function == nullptr) {
+    return absl::InvalidArgumentError("Hash functions must be set.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> n,
+                               StringToBignum(rsa_modulus));
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> e,
+                               StringToBignum(rsa_public_exponent));
+
+  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
+  if (!bn_ctx) {
+    return absl::InternalError("BN_CTX_new failed.");
+  }
+  bssl::UniquePtr<BN_MONT_CTX> mont_n(
+      BN_MONT_CTX_new_for_modulus(n.get(), bn_ctx.get()));
+  if (!mont_n) {
+    return absl::InternalError("BN_MONT_CTX_new_for_modulus failed.");
+  }
+
+  absl::StatusOr<bssl::UniquePtr<RSA>> standard_key =
+      bssl::UniquePtr<RSA>(RSA_new_public_key(n.get(), e.get()));
+  if (*standard_key == nullptr) {
+    standard_key = absl::InternalError(
+        absl::StrCat("RSA_new_public_key failed: ", GetSslErrors()));
+  }
+
+  return std::shared_ptr<const RsaBlindingKeyContext>(new RsaBlindingKeyContext(
+      std::move(n), std::move(e), std::move(mont_n), std::move(standard_key),
+      signature_hash_function, mgf1_hash_function, salt_length,
+      use_rsa_public_exponent));
+}
+
+RsaBlindingKeyContext::RsaBlindingKeyContext(
+    bssl::UniquePtr<BIGNUM> n, bssl::UniquePtr<BIGNUM> e,
+    bssl::UniquePtr<BN_MONT_CTX> mont_n,
+    absl::StatusOr<bssl::UniquePtr<RSA>> standard_key, const EVP_MD* sig_hash,
+    const EVP_MD* mgf1_hash, const int salt_length,
+    const bool use_rsa_public_exponent)
+    : n_(std::move(n)),
+      e_(std::move(e)),
+      mont_n_(std::move(mont_n)),
+      modulus_size_(BN_num_bytes(n_.get())),
+      standard_key_(std::move(standard_key)),
+      sig_hash_(sig_hash),
+      mgf1_hash_(mgf1_hash),
+      salt_length_(salt_length),
+      use_rsa_public_exponent_(use_rsa_public_exponent) {}
+
+absl::StatusOr<bssl::UniquePtr<RSA>> RsaBlindingKeyContext::GetPublicKey(
+    const std::optional<absl::string_view> public_metadata) const {
+  if (public_metadata.has_value()) {
+    // Empty string is a valid public metadata value.
+    return CreatePublicKeyRSAWithPublicMetadata(
+        *n_, *e_, *public_metadata, use_rsa_public_exponent_);
+  }
+  if (!standard_key_.ok()) {
+    return standard_key_.status();
+  }
+  RSA* rsa = standard_key_->get();
+  RSA_up_ref(rsa);
+  return bssl::UniquePtr<RSA>(rsa);
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,98 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLINDING_KEY_CONTEXT_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLINDING_KEY_CONTEXT_H_
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include <openssl/base.h>
+
+namespace anonymous_tokens {
+
+// Per-key state needed to blind messages under one RSA public key: the parsed
+// modulus and exponent, the Montgomery context for the modulus and the
+// resolved hash functions.
+//
+// Building this state is independent of the message being blinded, so it is
+// computed once per public key and shared by every RsaBlinder created for
+// that key. The context is immutable and safe to use from multiple threads.
+class RsaBlindingKeyContext {
+ public:
+  // If "use_rsa_public_exponent" is set to false, the public exponent is not
+  // used in any computations for blinders created with public metadata.
+  //
+  // Setting "use_rsa_public_exponent" to true is deprecated. All new users
+  // should set it to false.
+  static absl::StatusOr<std::shared_ptr<const RsaBlindingKeyContext>> New(
+      absl::string_view rsa_modulus, absl::string_view rsa_public_exponent,
+      const EVP_MD* signature_hash_function, const EVP_MD* mgf1_hash_function,
+      int salt_length, bool use_rsa_public_exponent);
+
+  RsaBlindingKeyContext(const RsaBlindingKeyContext&) = delete;
+  RsaBlindingKeyContext& operator=(const RsaBlindingKeyContext&) = delete;
+
+  // Returns the RSA public key used to blind messages with 'public_metadata'.
+  //
+  // Without public metadata this is a new reference to the standard public
+  // key. With public metadata (including an empty string) the public exponent
+  // is derived from the metadata.
+  absl::StatusOr<bssl::UniquePtr<RSA>> GetPublicKey(
+      std::optional<absl::string_view> public_metadata) const;
+
+  const BIGNUM& n() const { return *n_; }
+  const BIGNUM& e() const { return *e_; }
+  // Montgomery context for n.
+  const BN_MONT_CTX& mont_n() const { return *mont_n_; }
+  // Size of the modulus in bytes.
+  size_t modulus_size() const { return modulus_size_; }
+
+  const EVP_MD* sig_hash() const { return sig_hash_; }
+  const EVP_MD* mgf1_hash() const { return mgf1_hash_; }
+  int salt_length() const { return salt_length_; }
+  bool use_rsa_public_exponent() const { return use_rsa_public_exponent_; }
+
+ private:
+  // Use New to construct.
+  RsaBlindingKeyContext(bssl::UniquePtr<BIGNUM> n, bssl::UniquePtr<BIGNUM> e,
+                        bssl::UniquePtr<BN_MONT_CTX> mont_n,
+                        absl::StatusOr<bssl::UniquePtr<RSA>> standard_key,
+                        const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
+                        int salt_length, bool use_rsa_public_exponent);
+
+  const bssl::UniquePtr<BIGNUM> n_;
+  const bssl::UniquePtr<BIGNUM> e_;
+  const bssl::UniquePtr<BN_MONT_CTX> mont_n_;
+  const size_t modulus_size_;
+
+  // The key used without public metadata. Public metadata keys do not depend
+  // on e, so an e that RSA_new_public_key rejects is only reported once a
+  // blinder without public metadata is requested.
+  const absl::StatusOr<bssl::UniquePtr<RSA>> standard_key_;
+
+  const EVP_MD* sig_hash_;   // Owned by BoringSSL.
+  const EVP_MD* mgf1_hash_;  // Owned by BoringSSL.
+  const int salt_length_;
+  const bool use_rsa_public_exponent_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_BLINDING_KEY_CONTEXT_H_
@@ -0,0 +1,181 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/functional/function_ref.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include <openssl/digest.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+// Returns the big-endian encoding 'number' without leading zero bytes, so
+// that all encodings of a number, e.g. with and without padding to RSA_size,
+// are equal.
+absl::string_view StripLeadingZeros(absl::string_view number) {
+  const size_t first_nonzero = number.find_first_not_of('\0');
+  return first_nonzero == absl::string_view::npos
+             ? absl::string_view()
+             : number.substr(first_nonzero);
+}
+
+// Returns the cache key of the key of 'kind' derived from the RSA key (n, e)
+// and 'public_metadata'. The base key is identified by a SHA-256 fingerprint
+// of the numbers n, and e if 'use_rsa_public_exponent' is true, which keeps
+// keys short for large moduli.
+absl::StatusOr<std::string> DerivedKeyCacheKey(
+    const absl::string_view kind, absl::string_view n, absl::string_view e,
+    const bool use_rsa_public_exponent,
+    const absl::string_view public_metadata) {
+  n = StripLeadingZeros(n);
+  e = StripLeadingZeros(e);
+  ANON_TOKENS_ASSIGN_OR_RETURN(MessageHasher hasher,
+                               MessageHasher::New(*EVP_sha256()));
+  // Length prefixes keep the encoding of the base key unambiguous.
+  ANON_TOKENS_RETURN_IF_ERROR(hasher.Update(absl::StrCat(n.size(), ":")));
+  ANON_TOKENS_RETURN_IF_ERROR(hasher.Update(n));
+  if (use_rsa_public_exponent) {
+    ANON_TOKENS_RETURN_IF_ERROR(hasher.Update(absl::StrCat(e.size(), ":")));
+    ANON_TOKENS_RETURN_IF_ERROR(hasher.Update(e));
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::string fingerprint, hasher.Finalize());
+  return absl::StrCat(kind, use_rsa_public_exponent ? "-e:" : ":",
+                      fingerprint, public_metadata);
+}
+
+// Returns a new reference to 'rsa'.
+bssl::UniquePtr<RSA> ShareRsa(RSA* rsa) {
+  RSA_up_ref(rsa);
+  return bssl::UniquePtr<RSA>(rsa);
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<RsaKeyCache>> RsaKeyCache::New(
+    const size_t capacity) {
+  Options options;
+  options.capacity = capacity;
+  return New(options);
+}
+
+absl::StatusOr<std::unique_ptr<RsaKeyCache>> RsaKeyCache::New(
+    const Options& options) {
+  if (options.capacity == 0) {
+    return absl::InvalidArgumentError("RsaKeyCache capacity must be positive.");
+  }
+  if (options.ttl <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError("RsaKeyCache TTL must be positive.");
+  }
+  return absl::WrapUnique(new RsaKeyCache(options));
+}
+
+RsaKeyCache::RsaKeyCache(const Options& options)
+    : capacity_(options.capacity),
+      ttl_(options.ttl),
+      clock_(options.clock) {}
+
+absl::Time RsaKeyCache::Now() const {
+  return clock_ ? clock_() : absl::Now();
+}
+
+absl::StatusOr<bssl::UniquePtr<RSA>> RsaKeyCache::GetOrCreate(
+    const absl::string_view key,
+    absl::FunctionRef<absl::StatusOr<bssl::UniquePtr<RSA>>()> create) {
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      if (Now() < it->second->expiration) {
+        ++stats_.hits;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return ShareRsa(it->second->rsa.get());
+      }
+      ++stats_.expirations;
+      std::list<Entry>::iterator entry = it->second;
+      index_.erase(it);
+      entries_.erase(entry);
+    }
+    ++stats_.misses;
+  }
+
+  // Key derivation is slow, so it runs without the lock. Concurrent misses on
+  // the same key may derive it more than once; only the first result is kept.
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<RSA> rsa, create());
+  if (rsa == nullptr) {
+    return absl::InternalError("RsaKeyCache: created RSA key is null.");
+  }
+
+  const absl::Time now = Now();
+  absl::MutexLock lock(&mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end() && now < it->second->expiration) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return ShareRsa(it->second->rsa.get());
+  }
+  if (it != index_.end()) {
+    // Expired while 'create' was running; replace it with the fresh key.
+    std::list<Entry>::iterator entry = it->second;
+    index_.erase(it);
+    entries_.erase(entry);
+  } else if (entries_.size() >= capacity_) {
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+    ++stats_.evictions;
+  }
+  entries_.push_front(Entry{std::string(key), ShareRsa(rsa.get()), now + ttl_});
+  // The index refers to the key stored in the list node, which is stable.
+  index_.emplace(entries_.front().key, entries_.begin());
+  return rsa;
+}
+
+RsaKeyCacheStats RsaKeyCache::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  RsaKeyCacheStats stats = stats_;
+  stats.size = entries_.size();
+  return stats;
+}
+
+absl::StatusOr<std::string> DerivedPublicKeyCacheKey(
+    const absl::string_view n, const absl::string_view e,
+    const bool use_rsa_public_exponent,
+    const absl::string_view public_metadata) {
+  return DerivedKeyCacheKey("pk", n, e, use_rsa_public_exponent,
+                            public_metadata);
+}
+
+absl::StatusOr<std::string> DerivedPrivateKeyCacheKey(
+    const absl::string_view n, const absl::string_view e,
+    const bool use_rsa_public_exponent,
+    const absl::string_view public_metadata) {
+  return DerivedKeyCacheKey("sk", n, e, use_rsa_public_exponent,
+                            public_metadata);
+}
+
+}  // namespace anonymous_tokens
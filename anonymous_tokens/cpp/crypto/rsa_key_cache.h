@@ -0,0 +1,132 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_KEY_CACHE_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_KEY_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include <openssl/base.h>
+
+namespace anonymous_tokens {
+
+// Counters describing the effectiveness of an RsaKeyCache.
+struct RsaKeyCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  // Entries dropped because their TTL had passed when they were looked up.
+  uint64_t expirations = 0;
+  size_t size = 0;
+};
+
+// A thread-safe, size-bounded LRU cache of RSA keys.
+//
+// Deriving an RSA key from public metadata is expensive (HKDF, modular
+// inversions), while traffic usually reuses a small set of metadata values.
+// The cache maps an opaque caller-chosen key, e.g. an encoding of the base key
+// and the public metadata, to the derived RSA object. Cached RSA objects are
+// shared with callers through BoringSSL reference counting, so an eviction
+// never invalidates a key that is still in use.
+class RsaKeyCache {
+ public:
+  struct Options {
+    // Maximum number of cached keys. Must be positive.
+    size_t capacity = 1024;
+    // Entries older than this are derived again on their next lookup.
+    absl::Duration ttl = absl::InfiniteDuration();
+    // Returns the current time. Defaults to absl::Now.
+    std::function<absl::Time()> clock;
+  };
+
+  // Creates a cache holding at most 'capacity' keys that never expire.
+  // 'capacity' must be positive.
+  static absl::StatusOr<std::unique_ptr<RsaKeyCache>> New(size_t capacity);
+
+  static absl::StatusOr<std::unique_ptr<RsaKeyCache>> New(
+      const Options& options);
+
+  RsaKeyCache(const RsaKeyCache&) = delete;
+  RsaKeyCache& operator=(const RsaKeyCache&) = delete;
+
+  // Returns the RSA key cached under 'key'. On a miss, runs 'create' without
+  // holding the cache lock and caches its result, evicting the least recently
+  // used entry if the cache is full. An expired entry counts as a miss. Errors
+  // returned by 'create' are passed through and not cached.
+  absl::StatusOr<bssl::UniquePtr<RSA>> GetOrCreate(
+      absl::string_view key,
+      absl::FunctionRef<absl::StatusOr<bssl::UniquePtr<RSA>>()> create);
+
+  // Returns a snapshot of the cache counters.
+  RsaKeyCacheStats GetStats() const;
+
+  size_t capacity() const { return capacity_; }
+  absl::Duration ttl() const { return ttl_; }
+
+ private:
+  struct Entry {
+    std::string key;
+    bssl::UniquePtr<RSA> rsa;
+    absl::Time expiration;
+  };
+
+  // Use New to construct.
+  explicit RsaKeyCache(const Options& options);
+
+  absl::Time Now() const;
+
+  const size_t capacity_;
+  const absl::Duration ttl_;
+  const std::function<absl::Time()> clock_;
+
+  mutable absl::Mutex mutex_;
+  // Most recently used entries are at the front.
+  std::list<Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<absl::string_view, std::list<Entry>::iterator> index_
+      ABSL_GUARDED_BY(mutex_);
+  RsaKeyCacheStats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Returns the RsaKeyCache key of the public key derived from the RSA public key
+// (n, e) and 'public_metadata'. The base key is identified by a SHA-256
+// fingerprint of the number n, and of e if 'use_rsa_public_exponent' is true,
+// which keeps keys short for large moduli. Leading zero bytes of n and e are
+// ignored, so differently padded encodings of a key share entries.
+absl::StatusOr<std::string> DerivedPublicKeyCacheKey(
+    absl::string_view n, absl::string_view e, bool use_rsa_public_exponent,
+    absl::string_view public_metadata);
+
+// Same as DerivedPublicKeyCacheKey for the private key derived from the RSA
+// signing key with modulus n and public exponent e. Private and public keys
+// never share a cache key.
+absl::StatusOr<std::string> DerivedPrivateKeyCacheKey(
+    absl::string_view n, absl::string_view e, bool use_rsa_public_exponent,
+    absl::string_view public_metadata);
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_KEY_CACHE_H_
@@ -0,0 +1,241 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+class RsaKeyCacheTest : public ::testing::Test {
+ protected:
+  // Returns a key factory that counts its invocations in 'create_calls_'.
+  auto CountingFactory() {
+    return [this]() -> absl::StatusOr<bssl::UniquePtr<RSA>> {
+      ++create_calls_;
+      const auto [public_key, private_key] = GetStrongTestRsaKeyPair2048();
+      return CreatePublicKeyRSA(public_key.n, public_key.e);
+    };
+  }
+
+  int create_calls_ = 0;
+};
+
+TEST_F(RsaKeyCacheTest, RejectsZeroCapacity) {
+  EXPECT_EQ(RsaKeyCache::New(0).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(RsaKeyCacheTest, HitReturnsSharedKey) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(4));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> first,
+                                   cache->GetOrCreate("a", CountingFactory()));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> second,
+                                   cache->GetOrCreate("a", CountingFactory()));
+  EXPECT_EQ(create_calls_, 1);
+  EXPECT_EQ(first.get(), second.get());
+
+  RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.evictions, 0);
+  EXPECT_EQ(stats.size, 1);
+}
+
+TEST_F(RsaKeyCacheTest, EvictsLeastRecentlyUsed) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(2));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> a,
+                                   cache->GetOrCreate("a", CountingFactory()));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> b,
+                                   cache->GetOrCreate("b", CountingFactory()));
+  // Touch "a" so that "b" becomes the least recently used entry.
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> c,
+                                   cache->GetOrCreate("c", CountingFactory()));
+  EXPECT_EQ(create_calls_, 3);
+
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  EXPECT_EQ(create_calls_, 3);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> b_again,
+                                   cache->GetOrCreate("b", CountingFactory()));
+  EXPECT_EQ(create_calls_, 4);
+  // The evicted key stays valid for holders of a reference.
+  EXPECT_NE(b.get(), b_again.get());
+  EXPECT_EQ(RSA_size(b.get()), RSA_size(b_again.get()));
+
+  RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.misses, 4);
+  EXPECT_EQ(stats.evictions, 2);
+  EXPECT_EQ(stats.size, 2);
+}
+
+TEST_F(RsaKeyCacheTest, ErrorsAreNotCached) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(2));
+  auto failing = []() -> absl::StatusOr<bssl::UniquePtr<RSA>> {
+    return absl::InternalError("derivation failed");
+  };
+  EXPECT_EQ(cache->GetOrCreate("a", failing).status().code(),
+            absl::StatusCode::kInternal);
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  EXPECT_EQ(create_calls_, 1);
+  EXPECT_EQ(cache->GetStats().size, 1);
+}
+
+TEST_F(RsaKeyCacheTest, RejectsNonPositiveTtl) {
+  RsaKeyCache::Options options;
+  options.ttl = absl::ZeroDuration();
+  EXPECT_EQ(RsaKeyCache::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(RsaKeyCacheTest, ExpiredEntriesAreDerivedAgain) {
+  absl::Time now = absl::UnixEpoch();
+  RsaKeyCache::Options options;
+  options.capacity = 2;
+  options.ttl = absl::Minutes(5);
+  options.clock = [&now]() { return now; };
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(options));
+
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  now += absl::Minutes(4);
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  EXPECT_EQ(create_calls_, 1);
+
+  // Hits do not extend the lifetime of an entry.
+  now += absl::Minutes(1);
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  EXPECT_EQ(create_calls_, 2);
+  ASSERT_TRUE(cache->GetOrCreate("a", CountingFactory()).ok());
+  EXPECT_EQ(create_calls_, 2);
+
+  RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.expirations, 1);
+  EXPECT_EQ(stats.evictions, 0);
+  EXPECT_EQ(stats.size, 1);
+}
+
+TEST(DerivedPublicKeyCacheKeyTest, DistinguishesKeysAndMetadata) {
+  const auto [public_key, private_key] = GetStrongTestRsaKeyPair2048();
+  const auto [other_public_key, other_private_key] =
+      GetStrongTestRsaKeyPair3072();
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string key,
+      DerivedPublicKeyCacheKey(public_key.n, public_key.e,
+                               /*use_rsa_public_exponent=*/false, "md"));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string same_key,
+      DerivedPublicKeyCacheKey(public_key.n, "ignored",
+                               /*use_rsa_public_exponent=*/false, "md"));
+  EXPECT_EQ(key, same_key);
+
+  for (const auto& [n, e, use_rsa_public_exponent, public_metadata] :
+       std::vector<std::tuple<std::string, std::string, bool, std::string>>{
+           {public_key.n, public_key.e, false, "md2"},
+           {public_key.n, public_key.e, false, ""},
+           {public_key.n, public_key.e, true, "md"},
+           {other_public_key.n, other_public_key.e, false, "md"}}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string other_key,
+        DerivedPublicKeyCacheKey(n, e, use_rsa_public_exponent,
+                                 public_metadata));
+    EXPECT_NE(key, other_key);
+  }
+}
+
+TEST(DerivedPublicKeyCacheKeyTest, IgnoresLeadingZeros) {
+  const auto [public_key, private_key] = GetStrongTestRsaKeyPair2048();
+  for (const bool use_rsa_public_exponent : {false, true}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string key,
+        DerivedPublicKeyCacheKey(public_key.n, public_key.e,
+                                 use_rsa_public_exponent, "md"));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        std::string padded_key,
+        DerivedPublicKeyCacheKey(std::string(3, '\0') + public_key.n,
+                                 std::string(2, '\0') + public_key.e,
+                                 use_rsa_public_exponent, "md"));
+    EXPECT_EQ(key, padded_key);
+  }
+}
+
+TEST(DerivedPrivateKeyCacheKeyTest, DiffersFromPublicKeyCacheKey) {
+  const auto [public_key, private_key] = GetStrongTestRsaKeyPair2048();
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string private_cache_key,
+      DerivedPrivateKeyCacheKey(public_key.n, public_key.e,
+                                /*use_rsa_public_exponent=*/false, "md"));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string padded_private_cache_key,
+      DerivedPrivateKeyCacheKey(std::string(1, '\0') + public_key.n,
+                                public_key.e,
+                                /*use_rsa_public_exponent=*/false, "md"));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string public_cache_key,
+      DerivedPublicKeyCacheKey(public_key.n, public_key.e,
+                               /*use_rsa_public_exponent=*/false, "md"));
+  EXPECT_EQ(private_cache_key, padded_private_cache_key);
+  EXPECT_NE(private_cache_key, public_cache_key);
+}
+
+TEST(RsaKeyCacheConcurrencyTest, ConcurrentLookupsAgree) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(3));
+  const auto [public_key, private_key] = GetStrongTestRsaKeyPair2048();
+  auto create = [&public_key = public_key]() {
+    return CreatePublicKeyRSA(public_key.n, public_key.e);
+  };
+  constexpr int kNumThreads = 8;
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kNumThreads, 0);
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 200; ++i) {
+        const std::string key(1, static_cast<char>('a' + (i + t) % 5));
+        absl::StatusOr<bssl::UniquePtr<RSA>> rsa =
+            cache->GetOrCreate(key, create);
+        if (!rsa.ok() || *rsa == nullptr) ++failures[t];
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  for (int t = 0; t < kNumThreads; ++t) EXPECT_EQ(failures[t], 0);
+
+  RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits + stats.misses, kNumThreads * 200);
+  EXPECT_LE(stats.size, 3);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,361 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/bn_arena.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+namespace {
+
+// Derive gives up after this many blinding factors. A factor is only rejected
+// if it shares a prime factor with e', so running out is negligibly unlikely
+// unless e' is not coprime to p'q'.
+constexpr int kMaxBlindingAttempts = 64;
+
+// Lehmer's algorithm works on the leading bits of the remainders, which have
+// to fit in an int64_t together with the cofactors.
+constexpr int kLehmerDigitBits = 62;
+
+// Sets 'out' to x a + y b.
+absl::Status LinearCombination(const BIGNUM& a, const int64_t x,
+                               const BIGNUM& b, const int64_t y,
+                               BIGNUM& scratch_a, BIGNUM& scratch_b,
+                               BIGNUM& out) {
+  if (BN_copy(&scratch_a, &a) == nullptr ||
+      BN_mul_word(&scratch_a, x < 0 ? 0 - static_cast<uint64_t>(x) : x) !=
+          kBsslSuccess ||
+      BN_copy(&scratch_b, &b) == nullptr ||
+      BN_mul_word(&scratch_b, y < 0 ? 0 - static_cast<uint64_t>(y) : y) !=
+          kBsslSuccess) {
+    return absl::InternalError("BN_mul_word failed.");
+  }
+  if (x < 0) {
+    BN_set_negative(&scratch_a, !BN_is_negative(&scratch_a));
+  }
+  if (y < 0) {
+    BN_set_negative(&scratch_b, !BN_is_negative(&scratch_b));
+  }
+  if (BN_add(&out, &scratch_a, &scratch_b) != kBsslSuccess) {
+    return absl::InternalError("BN_add failed.");
+  }
+  return absl::OkStatus();
+}
+
+// Sets 'inverse' to a^-1 mod m and returns true, or returns false if a is not
+// invertible modulo m.
+//
+// Uses Lehmer's extended Euclidean algorithm, which finds most quotients from
+// the leading 62 bits of the remainders with word-sized arithmetic and
+// applies them in batches. It is several times faster than BN_mod_inverse,
+// but runs in variable time, so 'm' must be public and 'a' blinded.
+absl::StatusOr<bool> InvertModPublic(const BIGNUM& a, const BIGNUM& m,
+                                     BnArena& arena, BIGNUM& inverse) {
+  BN_CTX* bn_ctx = &arena.ctx();
+  // Invariants: r0 == s0 a mod m and r1 == s1 a mod m.
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * r0, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * r1, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * s0, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * s1, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * next_r, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * next_s, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * scratch_a, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * scratch_b, arena.NewBigNum());
+  if (BN_copy(r0, &m) == nullptr ||
+      BN_nnmod(r1, &a, &m, bn_ctx) != kBsslSuccess) {
+    return absl::InternalError("Could not reduce the value to invert.");
+  }
+  BN_zero(s0);
+  if (BN_one(s1) != kBsslSuccess) {
+    return absl::InternalError("BN_one failed.");
+  }
+
+  while (!BN_is_zero(r1)) {
+    // [A B; C D] maps (r0, r1) to the remainders a few steps later.
+    int64_t matrix_a = 1, matrix_b = 0, matrix_c = 0, matrix_d = 1;
+    const int num_bits = BN_num_bits(r0);
+    if (num_bits > kLehmerDigitBits) {
+      const int shift = num_bits - kLehmerDigitBits;
+      if (BN_rshift(scratch_a, r0, shift) != kBsslSuccess ||
+          BN_rshift(scratch_b, r1, shift) != kBsslSuccess) {
+        return absl::InternalError("BN_rshift failed.");
+      }
+      int64_t x = BN_get_word(scratch_a);
+      int64_t y = BN_get_word(scratch_b);
+      // Knuth, TAOCP vol. 2, 4.5.2, Algorithm L: a quotient is only taken if
+      // it is the same for both bounds of the truncated remainders.
+      while (y + matrix_c > 0 && y + matrix_d > 0) {
+        const int64_t quotient = (x + matrix_a) / (y + matrix_c);
+        if (quotient != (x + matrix_b) / (y + matrix_d)) {
+          break;
+        }
+        int64_t next = matrix_a - quotient * matrix_c;
+        matrix_a = matrix_c;
+        matrix_c = next;
+        next = matrix_b - quotient * matrix_d;
+        matrix_b = matrix_d;
+        matrix_d = next;
+        next = x - quotient * y;
+        x = y;
+        y = next;
+      }
+    }
+
+    if (matrix_b == 0) {
+      // No quotient could be found from the leading bits, so this takes one
+      // step of the Euclidean algorithm with a multi-precision division.
+      if (BN_div(scratch_a, next_r, r0, r1, bn_ctx) != kBsslSuccess ||
+          BN_mul(scratch_b, scratch_a, s1, bn_ctx) != kBsslSuccess ||
+          BN_sub(next_s, s0, scratch_b) != kBsslSuccess) {
+        return absl::InternalError("Euclidean step failed.");
+      }
+      BN_swap(r0, r1);
+      BN_swap(r1, next_r);
+      BN_swap(s0, s1);
+      BN_swap(s1, next_s);
+      continue;
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(LinearCombination(
+        *r0, matrix_a, *r1, matrix_b, *scratch_a, *scratch_b, *next_r));
+    ANON_TOKENS_RETURN_IF_ERROR(LinearCombination(
+        *r0, matrix_c, *r1, matrix_d, *scratch_a, *scratch_b, *r1));
+    BN_swap(r0, next_r);
+    ANON_TOKENS_RETURN_IF_ERROR(LinearCombination(
+        *s0, matrix_a, *s1, matrix_b, *scratch_a, *scratch_b, *next_s));
+    ANON_TOKENS_RETURN_IF_ERROR(LinearCombination(
+        *s0, matrix_c, *s1, matrix_d, *scratch_a, *scratch_b, *s1));
+    BN_swap(s0, next_s);
+  }
+
+  // r0 is now gcd(a, m).
+  if (!BN_is_one(r0)) {
+    return false;
+  }
+  if (BN_nnmod(&inverse, s0, &m, bn_ctx) != kBsslSuccess) {
+    return absl::InternalError("BN_nnmod failed.");
+  }
+  return true;
+}
+
+// Sets 'inverse' to e^-1 mod m, given m_inverse = m^-1 mod e for an m > 1
+// coprime to e: m m_inverse - 1 = ke for some 0 <= k < m, so that
+// e (m - k) == 1 mod m.
+absl::Status InvertWithReciprocal(const BIGNUM& e, const BIGNUM& m,
+                                  const BIGNUM& m_inverse, BN_CTX& bn_ctx,
+                                  BIGNUM& inverse) {
+  if (BN_mul(&inverse, &m, &m_inverse, &bn_ctx) != kBsslSuccess ||
+      BN_sub_word(&inverse, 1) != kBsslSuccess ||
+      BN_div(&inverse, nullptr, &inverse, &e, &bn_ctx) != kBsslSuccess ||
+      BN_sub(&inverse, &m, &inverse) != kBsslSuccess) {
+    return absl::InternalError(
+        absl::StrCat("Could not compute the inverse of e': ", GetSslErrors()));
+  }
+  return absl::OkStatus();
+}
+
+// Sets 'exponent' to whichever of 'inverse' and 'inverse' + m is odd. For an
+// odd e and odd m, that is e^-1 mod 2m given inverse = e^-1 mod m.
+absl::Status MakeOddExponent(const BIGNUM& inverse, const BIGNUM& m,
+                             BIGNUM& exponent) {
+  if (BN_is_odd(&inverse)) {
+    if (BN_copy(&exponent, &inverse) == nullptr) {
+      return absl::InternalError("BN_copy failed.");
+    }
+  } else if (BN_add(&exponent, &inverse, &m) != kBsslSuccess) {
+    return absl::InternalError("BN_add failed.");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+RsaPrivateKeyDeriver::RsaPrivateKeyDeriver(
+    std::string modulus, std::string public_exponent,
+    const bool use_rsa_public_exponent, bssl::UniquePtr<RSA> signing_key,
+    bssl::UniquePtr<BIGNUM> half_phi_p, bssl::UniquePtr<BIGNUM> half_phi_q,
+    bssl::UniquePtr<BIGNUM> half_lcm,
+    bssl::UniquePtr<BIGNUM> half_phi_p_inverse)
+    : modulus_(std::move(modulus)),
+      public_exponent_(std::move(public_exponent)),
+      use_rsa_public_exponent_(use_rsa_public_exponent),
+      signing_key_(std::move(signing_key)),
+      half_phi_p_(std::move(half_phi_p)),
+      half_phi_q_(std::move(half_phi_q)),
+      half_lcm_(std::move(half_lcm)),
+      half_phi_p_inverse_(std::move(half_phi_p_inverse)) {}
+
+absl::StatusOr<std::unique_ptr<RsaPrivateKeyDeriver>> RsaPrivateKeyDeriver::New(
+    const RSAPrivateKey& signing_key, const bool use_rsa_public_exponent) {
+  // The key is checked for consistency as part of the conversion to
+  // bssl::UniquePtr<RSA>. Derived keys reuse its n, p, q and q^-1 mod p.
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<RSA> rsa_signing_key,
+                               AnonymousTokensRSAPrivateKeyToRSA(signing_key));
+  const BIGNUM& p = *RSA_get0_p(rsa_signing_key.get());
+  const BIGNUM& q = *RSA_get0_q(rsa_signing_key.get());
+  // (p-1)/2 and (q-1)/2 are odd iff p and q are 3 mod 4.
+  if (!BN_is_bit_set(&p, 1) || !BN_is_bit_set(&q, 1)) {
+    return absl::InvalidArgumentError(
+        "(p-1)/2 and (q-1)/2 of the signing key must be odd.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> half_phi_p,
+                               NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> half_phi_q,
+                               NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> half_lcm, NewBigNum());
+  if (BN_rshift1(half_phi_p.get(), &p) != kBsslSuccess ||
+      BN_rshift1(half_phi_q.get(), &q) != kBsslSuccess ||
+      BN_mul(half_lcm.get(), half_phi_p.get(), half_phi_q.get(),
+             bn_ctx.get()) != kBsslSuccess) {
+    return absl::InternalError(absl::StrCat(
+        "Unable to compute (p-1)/2 and (q-1)/2: ", GetSslErrors()));
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> half_phi_p_inverse,
+                               NewBigNum());
+  if (BN_mod_inverse(half_phi_p_inverse.get(), half_phi_p.get(),
+                     half_phi_q.get(), bn_ctx.get()) == nullptr) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "(p-1)/2 and (q-1)/2 of the signing key must be coprime: ",
+        GetSslErrors()));
+  }
+
+  return absl::WrapUnique(new RsaPrivateKeyDeriver(
+      signing_key.n(), signing_key.e(), use_rsa_public_exponent,
+      std::move(rsa_signing_key), std::move(half_phi_p), std::move(half_phi_q),
+      std::move(half_lcm), std::move(half_phi_p_inverse)));
+}
+
+absl::StatusOr<bssl::UniquePtr<RSA>> RsaPrivateKeyDeriver::Derive(
+    const absl::string_view public_metadata) const {
+  ScopedLatencyTimer timer(LatencyStage::kDerivePrivateKey);
+  const BIGNUM& n = *RSA_get0_n(signing_key_.get());
+  bssl::UniquePtr<BIGNUM> derived_rsa_e;
+  if (use_rsa_public_exponent_) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        derived_rsa_e,
+        ComputeExponentWithPublicMetadataAndPublicExponent(
+            n, *RSA_get0_e(signing_key_.get()), public_metadata));
+  } else {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        derived_rsa_e, ComputeExponentWithPublicMetadata(n, public_metadata));
+  }
+  const BIGNUM& e = *derived_rsa_e;
+
+  // The private values live in a per-thread arena and are zeroized when this
+  // function returns. RSA_new_private_key_large_e copies them into the new
+  // key.
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnArena arena, BnArena::New());
+  BN_CTX* bn_ctx = &arena.ctx();
+
+  // Inverts p'q'r mod e' for a random r, so that the time InvertModPublic
+  // takes does not depend on p' or q'. Then p'^-1 = (p'q'r)^-1 q'r mod e' and
+  // q'^-1 = (p'q'r)^-1 p'r mod e'.
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * r, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * blinded, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * blinded_inverse, arena.NewBigNum());
+  // A blinded value is not invertible if r shares a factor with e', in which
+  // case another r is drawn, or if p'q' does, in which case all attempts fail.
+  for (int attempt = 0;; ++attempt) {
+    if (attempt == kMaxBlindingAttempts) {
+      return absl::InternalError(
+          "Could not compute private exponent d: e' is not coprime to "
+          "lcm(p-1, q-1).");
+    }
+    if (BN_rand_range_ex(r, 1, &e) != kBsslSuccess ||
+        BN_mod_mul(blinded, half_lcm_.get(), r, &e, bn_ctx) != kBsslSuccess) {
+      return absl::InternalError(
+          absl::StrCat("Could not blind p'q': ", GetSslErrors()));
+    }
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        const bool invertible,
+        InvertModPublic(*blinded, e, arena, *blinded_inverse));
+    if (invertible) {
+      break;
+    }
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * half_phi_p_reciprocal,
+                               arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * half_phi_q_reciprocal,
+                               arena.NewBigNum());
+  if (BN_mod_mul(blinded_inverse, blinded_inverse, r, &e, bn_ctx) !=
+          kBsslSuccess ||
+      BN_mod_mul(half_phi_p_reciprocal, blinded_inverse, half_phi_q_.get(),
+                 &e, bn_ctx) != kBsslSuccess ||
+      BN_mod_mul(half_phi_q_reciprocal, blinded_inverse, half_phi_p_.get(),
+                 &e, bn_ctx) != kBsslSuccess) {
+    return absl::InternalError(
+        absl::StrCat("Could not unblind (p'q')^-1: ", GetSslErrors()));
+  }
+
+  // e'^-1 mod p' and mod q'.
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * inverse_p, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * inverse_q, arena.NewBigNum());
+  ANON_TOKENS_RETURN_IF_ERROR(InvertWithReciprocal(
+      e, *half_phi_p_, *half_phi_p_reciprocal, *bn_ctx, *inverse_p));
+  ANON_TOKENS_RETURN_IF_ERROR(InvertWithReciprocal(
+      e, *half_phi_q_, *half_phi_q_reciprocal, *bn_ctx, *inverse_q));
+
+  // d = inverse_p + p' ((inverse_q - inverse_p) p'^-1 mod q') is e'^-1 mod
+  // p'q'. Since e' is odd, d mod 2p'q' is whichever of d and d + p'q' is odd.
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * derived_rsa_d, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * crt_term, arena.NewBigNum());
+  if (BN_mod_sub(crt_term, inverse_q, inverse_p, half_phi_q_.get(), bn_ctx) !=
+          kBsslSuccess ||
+      BN_mod_mul(crt_term, crt_term, half_phi_p_inverse_.get(),
+                 half_phi_q_.get(), bn_ctx) != kBsslSuccess ||
+      BN_mul(crt_term, crt_term, half_phi_p_.get(), bn_ctx) != kBsslSuccess ||
+      BN_add(crt_term, crt_term, inverse_p) != kBsslSuccess) {
+    return absl::InternalError(
+        absl::StrCat("Could not compute private exponent d: ", GetSslErrors()));
+  }
+  ANON_TOKENS_RETURN_IF_ERROR(
+      MakeOddExponent(*crt_term, *half_lcm_, *derived_rsa_d));
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * dp, arena.NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(BIGNUM * dq, arena.NewBigNum());
+  ANON_TOKENS_RETURN_IF_ERROR(MakeOddExponent(*inverse_p, *half_phi_p_, *dp));
+  ANON_TOKENS_RETURN_IF_ERROR(MakeOddExponent(*inverse_q, *half_phi_q_, *dq));
+
+  // RSA_new_private_key_large_e is the only public BoringSSL API that builds
+  // a private key whose public exponent may be larger than 33 bits.
+  bssl::UniquePtr<RSA> derived_private_key(RSA_new_private_key_large_e(
+      &n, &e, derived_rsa_d, RSA_get0_p(signing_key_.get()),
+      RSA_get0_q(signing_key_.get()), dp, dq,
+      RSA_get0_iqmp(signing_key_.get())));
+  if (derived_private_key == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("RSA_new_private_key_large_e failed: ", GetSslErrors()));
+  }
+  return derived_private_key;
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,96 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_PRIVATE_KEY_DERIVER_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_PRIVATE_KEY_DERIVER_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/base.h>
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+// Derives the private keys for public metadata values from one strong RSA
+// signing key.
+//
+// The derived key for exponent e' only differs from the signing key in e', d
+// and the CRT exponents dp = d mod p-1 and dq = d mod q-1. New parses and
+// validates the signing key, which must have p = 2p'+1 and q = 2q'+1 for odd
+// and coprime p' and q' as the safe primes of a strong RSA key do, and
+// precomputes p', q', p'q' and p'^-1 mod q'.
+//
+// Derive never inverts modulo a secret value. One inversion modulo the public
+// e', of p'q' blinded by a random factor, yields both p'^-1 and q'^-1 mod e'.
+// For y = p'^-1 mod e', p'y - 1 = ke' with k < p', so e'^-1 mod p' = p' - k
+// costs one multiplication and one division; likewise for q'. dp and dq are
+// those inverses made odd, and d mod lcm(p-1, q-1) = d mod 2p'q' follows with
+// one CRT step modulo q'. Since both the modulus and the blinded value are
+// safe to leak, the inversion uses Lehmer's variable-time algorithm, which is
+// several times faster than BN_mod_inverse modulo lcm(p-1, q-1).
+//
+// Immutable after construction and safe to use from multiple threads.
+class RsaPrivateKeyDeriver {
+ public:
+  // Validates 'signing_key' and precomputes the values shared by all derived
+  // keys. 'use_rsa_public_exponent' has the meaning of the parameter of the
+  // same name of RsaBlindSigner::New.
+  static absl::StatusOr<std::unique_ptr<RsaPrivateKeyDeriver>> New(
+      const RSAPrivateKey& signing_key, bool use_rsa_public_exponent);
+
+  RsaPrivateKeyDeriver(const RsaPrivateKeyDeriver&) = delete;
+  RsaPrivateKeyDeriver& operator=(const RsaPrivateKeyDeriver&) = delete;
+
+  // Returns the private key for 'public_metadata'. Empty string is a valid
+  // public metadata value.
+  absl::StatusOr<bssl::UniquePtr<RSA>> Derive(
+      absl::string_view public_metadata) const;
+
+  // The modulus and public exponent of the signing key, as big-endian byte
+  // strings.
+  const std::string& modulus() const { return modulus_; }
+  const std::string& public_exponent() const { return public_exponent_; }
+  bool use_rsa_public_exponent() const { return use_rsa_public_exponent_; }
+
+ private:
+  // Use New to construct.
+  RsaPrivateKeyDeriver(std::string modulus, std::string public_exponent,
+                       bool use_rsa_public_exponent,
+                       bssl::UniquePtr<RSA> signing_key,
+                       bssl::UniquePtr<BIGNUM> half_phi_p,
+                       bssl::UniquePtr<BIGNUM> half_phi_q,
+                       bssl::UniquePtr<BIGNUM> half_lcm,
+                       bssl::UniquePtr<BIGNUM> half_phi_p_inverse);
+
+  const std::string modulus_;
+  const std::string public_exponent_;
+  const bool use_rsa_public_exponent_;
+  const bssl::UniquePtr<RSA> signing_key_;
+  // p' = (p-1)/2 and q' = (q-1)/2.
+  const bssl::UniquePtr<BIGNUM> half_phi_p_;
+  const bssl::UniquePtr<BIGNUM> half_phi_q_;
+  // p'q' = lcm(p-1, q-1)/2.
+  const bssl::UniquePtr<BIGNUM> half_lcm_;
+  // p'^-1 mod q'.
+  const bssl::UniquePtr<BIGNUM> half_phi_p_inverse_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_RSA_PRIVATE_KEY_DERIVER_H_
@@ -0,0 +1,171 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+using CreateTestKeyPairFunction =
+    absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>>();
+
+// Params: the signing key, use_rsa_public_exponent.
+class RsaPrivateKeyDeriverTest
+    : public ::testing::TestWithParam<
+          std::tuple<CreateTestKeyPairFunction *, bool>> {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys,
+                                     (*std::get<0>(GetParam()))());
+    signing_key_ = keys.second;
+    use_rsa_public_exponent_ = std::get<1>(GetParam());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        rsa_signing_key_, AnonymousTokensRSAPrivateKeyToRSA(signing_key_));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        key_deriver_,
+        RsaPrivateKeyDeriver::New(signing_key_, use_rsa_public_exponent_));
+  }
+
+  RSAPrivateKey signing_key_;
+  bool use_rsa_public_exponent_;
+  bssl::UniquePtr<RSA> rsa_signing_key_;
+  std::unique_ptr<RsaPrivateKeyDeriver> key_deriver_;
+};
+
+TEST_P(RsaPrivateKeyDeriverTest, MatchesInversionModuloLcm) {
+  const RSA &key = *rsa_signing_key_;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  bssl::UniquePtr<BIGNUM> phi_p(BN_new());
+  bssl::UniquePtr<BIGNUM> phi_q(BN_new());
+  bssl::UniquePtr<BIGNUM> gcd(BN_new());
+  bssl::UniquePtr<BIGNUM> phi_n(BN_new());
+  bssl::UniquePtr<BIGNUM> lcm(BN_new());
+  ASSERT_EQ(BN_sub(phi_p.get(), RSA_get0_p(&key), BN_value_one()), 1);
+  ASSERT_EQ(BN_sub(phi_q.get(), RSA_get0_q(&key), BN_value_one()), 1);
+  ASSERT_EQ(BN_gcd(gcd.get(), phi_p.get(), phi_q.get(), bn_ctx.get()), 1);
+  ASSERT_EQ(BN_mul(phi_n.get(), phi_p.get(), phi_q.get(), bn_ctx.get()), 1);
+  ASSERT_EQ(
+      BN_div(lcm.get(), nullptr, phi_n.get(), gcd.get(), bn_ctx.get()), 1);
+
+  for (const std::string public_metadata : {"", "metadata", "other"}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> derived_key,
+                                     key_deriver_->Derive(public_metadata));
+    bssl::UniquePtr<BIGNUM> expected_e;
+    if (use_rsa_public_exponent_) {
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+          expected_e, ComputeExponentWithPublicMetadataAndPublicExponent(
+                          *RSA_get0_n(&key), *RSA_get0_e(&key),
+                          public_metadata));
+    } else {
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+          expected_e, ComputeExponentWithPublicMetadata(*RSA_get0_n(&key),
+                                                        public_metadata));
+    }
+    bssl::UniquePtr<BIGNUM> expected_d(BN_new());
+    bssl::UniquePtr<BIGNUM> expected_dp(BN_new());
+    bssl::UniquePtr<BIGNUM> expected_dq(BN_new());
+    ASSERT_NE(BN_mod_inverse(expected_d.get(), expected_e.get(), lcm.get(),
+                             bn_ctx.get()),
+              nullptr);
+    ASSERT_EQ(BN_mod(expected_dp.get(), expected_d.get(), phi_p.get(),
+                     bn_ctx.get()),
+              1);
+    ASSERT_EQ(BN_mod(expected_dq.get(), expected_d.get(), phi_q.get(),
+                     bn_ctx.get()),
+              1);
+
+    EXPECT_EQ(BN_cmp(RSA_get0_n(derived_key.get()), RSA_get0_n(&key)), 0);
+    EXPECT_EQ(BN_cmp(RSA_get0_e(derived_key.get()), expected_e.get()), 0);
+    EXPECT_EQ(BN_cmp(RSA_get0_d(derived_key.get()), expected_d.get()), 0)
+        << public_metadata;
+    EXPECT_EQ(BN_cmp(RSA_get0_dmp1(derived_key.get()), expected_dp.get()), 0);
+    EXPECT_EQ(BN_cmp(RSA_get0_dmq1(derived_key.get()), expected_dq.get()), 0);
+    EXPECT_EQ(BN_cmp(RSA_get0_iqmp(derived_key.get()), RSA_get0_iqmp(&key)),
+              0);
+  }
+}
+
+TEST_P(RsaPrivateKeyDeriverTest, InvertsManyDerivedExponents) {
+  // Covers exponents with small factors, for which some blinding factors are
+  // not invertible and Derive has to draw others.
+  constexpr int kNumPublicMetadataValues = 100;
+  const RSA &key = *rsa_signing_key_;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  bssl::UniquePtr<BIGNUM> phi_p(BN_new());
+  bssl::UniquePtr<BIGNUM> phi_q(BN_new());
+  bssl::UniquePtr<BIGNUM> half_phi_n(BN_new());
+  bssl::UniquePtr<BIGNUM> remainder(BN_new());
+  ASSERT_EQ(BN_sub(phi_p.get(), RSA_get0_p(&key), BN_value_one()), 1);
+  ASSERT_EQ(BN_sub(phi_q.get(), RSA_get0_q(&key), BN_value_one()), 1);
+  ASSERT_EQ(
+      BN_mul(half_phi_n.get(), phi_p.get(), phi_q.get(), bn_ctx.get()), 1);
+  ASSERT_EQ(BN_rshift1(half_phi_n.get(), half_phi_n.get()), 1);
+
+  for (int i = 0; i < kNumPublicMetadataValues; ++i) {
+    const std::string public_metadata = absl::StrCat("metadata ", i);
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<RSA> derived_key,
+                                     key_deriver_->Derive(public_metadata));
+    const BIGNUM *e = RSA_get0_e(derived_key.get());
+    const BIGNUM *d = RSA_get0_d(derived_key.get());
+    const BIGNUM *dp = RSA_get0_dmp1(derived_key.get());
+    const BIGNUM *dq = RSA_get0_dmq1(derived_key.get());
+    // For strong primes, lcm(p-1, q-1) = (p-1)(q-1)/2, and d is the only value
+    // below it that inverts e modulo both p-1 and q-1.
+    EXPECT_LT(BN_cmp(d, half_phi_n.get()), 0) << public_metadata;
+    ASSERT_EQ(BN_mod(remainder.get(), d, phi_p.get(), bn_ctx.get()), 1);
+    EXPECT_EQ(BN_cmp(remainder.get(), dp), 0) << public_metadata;
+    ASSERT_EQ(BN_mod(remainder.get(), d, phi_q.get(), bn_ctx.get()), 1);
+    EXPECT_EQ(BN_cmp(remainder.get(), dq), 0) << public_metadata;
+    ASSERT_EQ(
+        BN_mod_mul(remainder.get(), e, dp, phi_p.get(), bn_ctx.get()), 1);
+    EXPECT_TRUE(BN_is_one(remainder.get())) << public_metadata;
+    ASSERT_EQ(
+        BN_mod_mul(remainder.get(), e, dq, phi_q.get(), bn_ctx.get()), 1);
+    EXPECT_TRUE(BN_is_one(remainder.get())) << public_metadata;
+  }
+}
+
+TEST_P(RsaPrivateKeyDeriverTest, ExposesSigningKeyIdentity) {
+  EXPECT_EQ(key_deriver_->modulus(), signing_key_.n());
+  EXPECT_EQ(key_deriver_->public_exponent(), signing_key_.e());
+  EXPECT_EQ(key_deriver_->use_rsa_public_exponent(), use_rsa_public_exponent_);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    RsaPrivateKeyDeriverTest, RsaPrivateKeyDeriverTest,
+    ::testing::Combine(::testing::Values(&GetStrongRsaKeys2048,
+                                         &GetAnotherStrongRsaKeys2048,
+                                         &GetStrongRsaKeys3072,
+                                         &GetStrongRsaKeys4096),
+                       /*use_rsa_public_exponent*/ ::testing::Bool()));
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -19,26 +19,48 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
 #include <openssl/bn.h>
 #include <openssl/rsa.h>
 
 namespace anonymous_tokens {
 
+namespace {
+
+// Sets the bits of batch.valid_bitmap and batch.num_valid from
+// batch.statuses.
+void FillValidBitmap(VerificationBatch& batch) {
+  batch.valid_bitmap.assign((batch.statuses.size() + 63) / 64, 0);
+  batch.num_valid = 0;
+  for (size_t i = 0; i < batch.statuses.size(); ++i) {
+    if (batch.statuses[i].ok()) {
+      batch.valid_bitmap[i / 64] |= uint64_t{1} << (i % 64);
+      ++batch.num_valid;
+    }
+  }
+}
+
+}  // namespace
+
 absl::StatusOr<std::unique_ptr<RsaSsaPssVerifier>> RsaSsaPssVerifier::New(
     const int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
     const RSAPublicKey& public_key, const bool use_rsa_public_exponent,
-    std::optional<absl::string_view> public_metadata) {
+    std::optional<absl::string_view> public_metadata,
+    RsaKeyCache* derived_key_cache) {
   bssl::UniquePtr<RSA> rsa_public_key;
 
   if (!public_metadata.has_value()) {
@@ -49,36 +71,105 @@ absl::StatusOr<std::unique_ptr<RsaSsaPssVerifier>> RsaSsaPssVerifier::New(
     // exponent using the public metadata.
     //
     // Empty string is a valid public metadata value.
-    ANON_TOKENS_ASSIGN_OR_RETURN(
-        rsa_public_key, CreatePublicKeyRSAWithPublicMetadata(
-                            public_key.n(), public_key.e(), *public_metadata,
-                            use_rsa_public_exponent));
+    auto derive = [&]() {
+      return CreatePublicKeyRSAWithPublicMetadata(
+          public_key.n(), public_key.e(), *public_metadata,
+          use_rsa_public_exponent);
+    };
+    if (derived_key_cache == nullptr) {
+      ANON_TOKENS_ASSIGN_OR_RETURN(rsa_public_key, derive());
+    } else {
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          const std::string cache_key,
+          DerivedPublicKeyCacheKey(public_key.n(), public_key.e(),
+                                   use_rsa_public_exponent, *public_metadata));
+      ANON_TOKENS_ASSIGN_OR_RETURN(
+          rsa_public_key, derived_key_cache->GetOrCreate(cache_key, derive));
+    }
   }
 
-  return absl::WrapUnique(new RsaSsaPssVerifier(salt_length, public_metadata,
-                                                sig_hash, mgf1_hash,
-                                                std::move(rsa_public_key)));
+  bssl::UniquePtr<BN_CTX> bn_ctx(BN_CTX_new());
+  if (!bn_ctx) {
+    return absl::InternalError("BN_CTX_new failed.");
+  }
+  bssl::UniquePtr<BN_MONT_CTX> mont_n(BN_MONT_CTX_new_for_modulus(
+      RSA_get0_n(rsa_public_key.get()), bn_ctx.get()));
+  if (!mont_n) {
+    return absl::InternalError("BN_MONT_CTX_new_for_modulus failed.");
+  }
+
+  return absl::WrapUnique(new RsaSsaPssVerifier(
+      salt_length, public_metadata, sig_hash, mgf1_hash,
+      std::move(rsa_public_key), std::move(mont_n)));
 }
 
 RsaSsaPssVerifier::RsaSsaPssVerifier(
     int salt_length, std::optional<absl::string_view> public_metadata,
     const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
-    bssl::UniquePtr<RSA> rsa_public_key)
+    bssl::UniquePtr<RSA> rsa_public_key, bssl::UniquePtr<BN_MONT_CTX> mont_n)
     : salt_length_(salt_length),
       public_metadata_(public_metadata),
       sig_hash_(sig_hash),
       mgf1_hash_(mgf1_hash),
-      rsa_public_key_(std::move(rsa_public_key)) {}
+      rsa_public_key_(std::move(rsa_public_key)),
+      mont_n_(std::move(mont_n)),
+      message_prefix_(public_metadata.has_value()
+                          ? EncodeMessagePublicMetadata("", *public_metadata)
+                          : "") {}
 
 absl::Status RsaSsaPssVerifier::Verify(absl::string_view unblind_token,
                                        absl::string_view message) {
-  std::string augmented_message(message);
-  if (public_metadata_.has_value()) {
-    augmented_message = EncodeMessagePublicMetadata(message, *public_metadata_);
+  thread_local absl::StatusOr<RsaVerifyScratch> scratch =
+      NewRsaVerifyScratch();
+  // An allocation failure is not kept for the life of the thread: the scratch
+  // is created again by the next call.
+  if (!scratch.ok()) {
+    scratch = NewRsaVerifyScratch();
+    if (!scratch.ok()) {
+      return scratch.status();
+    }
   }
-  return RsaBlindSignatureVerify(salt_length_, sig_hash_, mgf1_hash_,
-                                 unblind_token, augmented_message,
-                                 rsa_public_key_.get());
+  return VerifyWithScratch(unblind_token, message, *scratch);
+}
+
+absl::StatusOr<VerificationBatch> RsaSsaPssVerifier::VerifyBatch(
+    const absl::Span<const absl::string_view> unblind_tokens,
+    const absl::Span<const absl::string_view> messages,
+    ThreadPool* thread_pool) const {
+  if (unblind_tokens.size() != messages.size()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Got ", unblind_tokens.size(), " tokens but ", messages.size(),
+        " messages."));
+  }
+  VerificationBatch batch;
+  batch.statuses.resize(unblind_tokens.size());
+
+  auto verify_range = [&](size_t begin, size_t end) {
+    absl::StatusOr<RsaVerifyScratch> scratch = NewRsaVerifyScratch();
+    for (size_t i = begin; i < end; ++i) {
+      batch.statuses[i] =
+          scratch.ok()
+              ? VerifyWithScratch(unblind_tokens[i], messages[i], *scratch)
+              : scratch.status();
+    }
+  };
+  if (thread_pool == nullptr) {
+    verify_range(0, unblind_tokens.size());
+  } else {
+    thread_pool->ParallelFor(unblind_tokens.size(), verify_range);
+  }
+
+  // The bitmap is filled in afterwards since ranges may share a word.
+  FillValidBitmap(batch);
+  return batch;
+}
+
+absl::Status RsaSsaPssVerifier::VerifyWithScratch(
+    const absl::string_view unblind_token, const absl::string_view message,
+    RsaVerifyScratch& scratch) const {
+  return RsaBlindSignatureVerifyWithScratch(
+      salt_length_, sig_hash_, mgf1_hash_, unblind_token, message_prefix_,
+      message, *rsa_public_key_, *mont_n_, scratch);
 }
 
 }  // namespace anonymous_tokens
@@ -17,18 +17,37 @@
 
 #include <stdint.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
+#include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
 #include "anonymous_tokens/cpp/crypto/verifier.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
 
 namespace anonymous_tokens {
 
+// Result of RsaSsaPssVerifier::VerifyBatch.
+struct VerificationBatch {
+  // Returns whether token i verified.
+  bool valid(size_t i) const { return (valid_bitmap[i / 64] >> (i % 64)) & 1; }
+
+  // Bit i % 64 of valid_bitmap[i / 64] is set iff token i verified.
+  std::vector<uint64_t> valid_bitmap;
+  size_t num_valid = 0;
+  // OkStatus for every valid token, otherwise the reason it was rejected.
+  std::vector<absl::Status> statuses;
+};
+
 // RsaSsaPssVerifier is able to verify an unblinded token (signature) against an
 // inputted message using a public key and other input parameters.
 class RsaSsaPssVerifier : public Verifier {
@@ -43,23 +62,48 @@ class RsaSsaPssVerifier : public Verifier {
   //
   // Setting "use_rsa_public_exponent" to true is deprecated. All new users
   // should set it to false.
+  //
+  // If 'derived_key_cache' is not null, public keys derived from public
+  // metadata are looked up in and added to it, keyed by
+  // DerivedPublicKeyCacheKey. The verifier keeps its own reference to the key,
+  // so the cache only needs to outlive this call.
   static absl::StatusOr<std::unique_ptr<RsaSsaPssVerifier>> New(
       int salt_length, const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
       const RSAPublicKey& public_key, bool use_rsa_public_exponent,
-      std::optional<absl::string_view> public_metadata = std::nullopt);
+      std::optional<absl::string_view> public_metadata = std::nullopt,
+      RsaKeyCache* derived_key_cache = nullptr);
 
   // Verifies the signature.
   //
   // Returns OkStatus() on successful verification. Otherwise returns an error.
+  // Uses thread-local scratch buffers, so that verifying a valid token does not
+  // allocate once a thread has verified a token of the same key size.
   absl::Status Verify(absl::string_view unblind_token,
                       absl::string_view message) override;
 
+  // Verifies unblind_tokens[i] against messages[i] for every i. Both spans
+  // must have the same size.
+  //
+  // Every thread reuses one RsaVerifyScratch for all of its tokens. If
+  // 'thread_pool' is not null, the batch is split across its workers and the
+  // calling thread. Otherwise all tokens are verified on the calling thread.
+  absl::StatusOr<VerificationBatch> VerifyBatch(
+      absl::Span<const absl::string_view> unblind_tokens,
+      absl::Span<const absl::string_view> messages,
+      ThreadPool* thread_pool = nullptr) const;
+
  private:
   // Use `New` to construct
   RsaSsaPssVerifier(int salt_length,
                     std::optional<absl::string_view> public_metadata,
                     const EVP_MD* sig_hash, const EVP_MD* mgf1_hash,
-                    bssl::UniquePtr<RSA> rsa_public_key);
+                    bssl::UniquePtr<RSA> rsa_public_key,
+                    bssl::UniquePtr<BN_MONT_CTX> mont_n);
+
+  // Same as Verify, but only uses the buffers in 'scratch'.
+  absl::Status VerifyWithScratch(absl::string_view unblind_token,
+                                 absl::string_view message,
+                                 RsaVerifyScratch& scratch) const;
 
   const int salt_length_;
   std::optional<std::string> public_metadata_;
@@ -69,6 +113,11 @@ class RsaSsaPssVerifier : public Verifier {
   // If public metadata is passed to RsaSsaPssVerifier::New, rsa_public_key_
   // will be initialized using RSA_new_public_key_large_e method.
   const bssl::UniquePtr<RSA> rsa_public_key_;
+  // Montgomery context for the modulus of rsa_public_key_.
+  const bssl::UniquePtr<BN_MONT_CTX> mont_n_;
+  // The encoding that precedes the message when public_metadata_ is set. See
+  // EncodeMessagePublicMetadata.
+  const std::string message_prefix_;
 };
 
 }  // namespace anonymous_tokens
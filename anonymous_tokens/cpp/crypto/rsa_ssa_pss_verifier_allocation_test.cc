@@ -0,0 +1,126 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Checks that verifying a valid token does not allocate once the scratch
+// buffers have been set up. This lives in its own test binary because it
+// replaces the global operator new.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include <openssl/digest.h>
+
+namespace {
+
+std::atomic<bool> count_allocations{false};
+std::atomic<size_t> num_allocations{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+  if (count_allocations.load(std::memory_order_relaxed)) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int kNumVerifications = 100;
+
+// Returns the number of operator new calls made by 'fn'.
+template <typename Fn>
+size_t CountAllocations(Fn fn) {
+  num_allocations = 0;
+  count_allocations = true;
+  fn();
+  count_allocations = false;
+  return num_allocations;
+}
+
+TEST(RsaSsaPssVerifierAllocationTest, VerifyDoesNotAllocate) {
+  const IetfStandardRsaBlindSignatureTestVector test_vec =
+      GetIetfStandardRsaBlindSignatureTestVector();
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(const auto test_keys,
+                                   GetIetfStandardRsaBlindSignatureTestKeys());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      const auto verifier,
+      RsaSsaPssVerifier::New(kSaltLengthInBytes48, EVP_sha384(), EVP_sha384(),
+                             test_keys.first,
+                             /*use_rsa_public_exponent=*/true));
+  // Sets up this thread's scratch buffers.
+  ASSERT_TRUE(verifier->Verify(test_vec.signature, test_vec.message).ok());
+
+  bool all_ok = true;
+  EXPECT_EQ(CountAllocations([&] {
+              for (int i = 0; i < kNumVerifications; ++i) {
+                all_ok &=
+                    verifier->Verify(test_vec.signature, test_vec.message)
+                        .ok();
+              }
+            }),
+            0);
+  EXPECT_TRUE(all_ok);
+}
+
+TEST(RsaSsaPssVerifierAllocationTest, VerifyWithPublicMetadataDoesNotAllocate) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      const auto test_key,
+      GetIetfRsaBlindSignatureWithPublicMetadataTestKeys());
+  for (const auto& test_vector :
+       GetIetfPartiallyBlindRSASignatureNoPublicExponentTestVectors()) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        const auto verifier,
+        RsaSsaPssVerifier::New(kSaltLengthInBytes48, EVP_sha384(),
+                               EVP_sha384(), test_key.first,
+                               /*use_rsa_public_exponent=*/false,
+                               test_vector.public_metadata));
+    ASSERT_TRUE(
+        verifier->Verify(test_vector.signature, test_vector.message).ok());
+
+    bool all_ok = true;
+    EXPECT_EQ(CountAllocations([&] {
+                for (int i = 0; i < kNumVerifications; ++i) {
+                  all_ok &= verifier
+                                ->Verify(test_vector.signature,
+                                         test_vector.message)
+                                .ok();
+                }
+              }),
+              0);
+    EXPECT_TRUE(all_ok);
+  }
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
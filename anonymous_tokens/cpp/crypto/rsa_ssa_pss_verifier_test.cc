@@ -17,6 +17,7 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -26,6 +27,8 @@
 #include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
 #include "anonymous_tokens/cpp/testing/proto_utils.h"
 #include "anonymous_tokens/cpp/testing/utils.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
@@ -72,6 +75,58 @@ TEST(RsaSsaPssVerifier, InvalidSignature) {
               testing::HasSubstr("verification failed"));
 }
 
+TEST(RsaSsaPssVerifier, VerifyBatchMatchesVerify) {
+  const IetfStandardRsaBlindSignatureTestVector test_vec =
+      GetIetfStandardRsaBlindSignatureTestVector();
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(const auto test_keys,
+                                   GetIetfStandardRsaBlindSignatureTestKeys());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      const auto verifier,
+      RsaSsaPssVerifier::New(kSaltLengthInBytes48, EVP_sha384(), EVP_sha384(),
+                             test_keys.first,
+                             /*use_rsa_public_exponent=*/true));
+  std::string corrupted_sig = test_vec.signature;
+  corrupted_sig.replace(10, 1, "x");
+  const std::string short_sig = test_vec.signature.substr(1);
+  const std::string too_large_sig(test_vec.signature.size(), '\xff');
+  const std::vector<absl::string_view> tokens = {
+      test_vec.signature, corrupted_sig, short_sig,
+      too_large_sig,      test_vec.signature};
+  const std::vector<absl::string_view> messages = {
+      test_vec.message, test_vec.message, test_vec.message, test_vec.message,
+      "other message"};
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(/*num_threads=*/2));
+  for (ThreadPool *pool : {static_cast<ThreadPool *>(nullptr),
+                           thread_pool.get()}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        VerificationBatch batch,
+        verifier->VerifyBatch(tokens, messages, pool));
+    ASSERT_EQ(batch.statuses.size(), tokens.size());
+    EXPECT_EQ(batch.num_valid, 1);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      const absl::Status status = verifier->Verify(tokens[i], messages[i]);
+      EXPECT_EQ(batch.valid(i), status.ok()) << i;
+      EXPECT_EQ(batch.statuses[i].code(), status.code()) << i;
+    }
+  }
+}
+
+TEST(RsaSsaPssVerifier, VerifyBatchWithMismatchedSizesFails) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(const auto test_keys,
+                                   GetIetfStandardRsaBlindSignatureTestKeys());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      const auto verifier,
+      RsaSsaPssVerifier::New(kSaltLengthInBytes48, EVP_sha384(), EVP_sha384(),
+                             test_keys.first,
+                             /*use_rsa_public_exponent=*/true));
+  const std::vector<absl::string_view> tokens = {"a", "b"};
+  const std::vector<absl::string_view> messages = {"a"};
+  EXPECT_EQ(verifier->VerifyBatch(tokens, messages).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 TEST(RsaSsaPssVerifier, InvalidVerificationKey) {
   const IetfStandardRsaBlindSignatureTestVector test_vec =
       GetIetfStandardRsaBlindSignatureTestVector();
@@ -214,6 +269,44 @@ TEST_P(RsaSsaPssVerifierTestWithPublicMetadata,
   EXPECT_TRUE(verifier->Verify(potentially_insecure_signature, message).ok());
 }
 
+TEST_P(RsaSsaPssVerifierTestWithPublicMetadata,
+       VerifiersShareCachedDerivedKeys) {
+  absl::string_view message = "Hello World!";
+  absl::string_view public_metadata = "pubmd!";
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string encoded_message,
+      EncodeMessageForTests(
+          EncodeMessagePublicMetadata(message, public_metadata), public_key_,
+          sig_hash_, mgf1_hash_, salt_length_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string potentially_insecure_signature,
+      TestSignWithPublicMetadata(encoded_message, public_metadata,
+                                 *private_key_, use_rsa_public_exponent_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(/*capacity=*/4));
+  for (int i = 0; i < 3; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        auto verifier,
+        RsaSsaPssVerifier::New(salt_length_, sig_hash_, mgf1_hash_,
+                               public_key_, use_rsa_public_exponent_,
+                               public_metadata, cache.get()));
+    EXPECT_TRUE(
+        verifier->Verify(potentially_insecure_signature, message).ok());
+  }
+  // A different public metadata value must not hit the cached key.
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto other_verifier,
+      RsaSsaPssVerifier::New(salt_length_, sig_hash_, mgf1_hash_, public_key_,
+                             use_rsa_public_exponent_, "pubmd2", cache.get()));
+  EXPECT_FALSE(
+      other_verifier->Verify(potentially_insecure_signature, message).ok());
+
+  const RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.size, 2);
+}
+
 TEST_P(RsaSsaPssVerifierTestWithPublicMetadata,
        VerifierFailsToVerifyWithWrongPublicMetadata) {
   absl::string_view message = "Hello World!";
@@ -313,6 +406,50 @@ TEST_P(RsaSsaPssVerifierTestWithPublicMetadata,
   EXPECT_TRUE(verifier->Verify(potentially_insecure_signature, message).ok());
 }
 
+TEST_P(RsaSsaPssVerifierTestWithPublicMetadata,
+       VerifyBatchWorksWithPublicMetadata) {
+  absl::string_view message = "Hello World!";
+  absl::string_view public_metadata = "pubmd!";
+  std::string augmented_message =
+      EncodeMessagePublicMetadata(message, public_metadata);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string encoded_message,
+      EncodeMessageForTests(augmented_message, public_key_, sig_hash_,
+                            mgf1_hash_, salt_length_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string potentially_insecure_signature,
+      TestSignWithPublicMetadata(encoded_message, public_metadata,
+                                 *private_key_, use_rsa_public_exponent_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto verifier,
+      RsaSsaPssVerifier::New(salt_length_, sig_hash_, mgf1_hash_, public_key_,
+                             use_rsa_public_exponent_, public_metadata));
+
+  // Enough tokens to span two bitmap words, with every third one invalid.
+  constexpr size_t kNumTokens = 70;
+  std::string wrong_message = "Hello World?";
+  std::vector<absl::string_view> tokens(kNumTokens,
+                                        potentially_insecure_signature);
+  std::vector<absl::string_view> messages(kNumTokens, message);
+  for (size_t i = 0; i < kNumTokens; i += 3) {
+    messages[i] = wrong_message;
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(/*num_threads=*/3));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      VerificationBatch batch,
+      verifier->VerifyBatch(tokens, messages, thread_pool.get()));
+  ASSERT_EQ(batch.valid_bitmap.size(), 2);
+  EXPECT_EQ(batch.num_valid, kNumTokens - (kNumTokens + 2) / 3);
+  for (size_t i = 0; i < kNumTokens; ++i) {
+    EXPECT_EQ(batch.valid(i), i % 3 != 0) << i;
+    if (i % 3 == 0) {
+      EXPECT_THAT(batch.statuses[i].message(),
+                  testing::HasSubstr("verification failed"));
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     RsaSsaPssVerifierTestWithPublicMetadata,
     RsaSsaPssVerifierTestWithPublicMetadata,
@@ -0,0 +1,299 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/strong_rsa_key_generator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+namespace {
+
+// Candidates where p' or p = 2p' + 1 has an odd prime factor below this bound
+// are sieved out.
+constexpr uint32_t kSieveBound = 1 << 16;
+
+// Number of candidates p' = start + 2k, 0 <= k < kSieveWindow, sieved at once.
+constexpr size_t kSieveWindow = 1 << 14;
+
+// Returns the odd primes below kSieveBound.
+const std::vector<uint32_t>& OddSievePrimes() {
+  static const std::vector<uint32_t>* const kPrimes = [] {
+    auto* primes = new std::vector<uint32_t>();
+    std::vector<bool> composite(kSieveBound, false);
+    for (uint32_t i = 3; i < kSieveBound; i += 2) {
+      if (composite[i]) {
+        continue;
+      }
+      primes->push_back(i);
+      for (uint64_t j = uint64_t{i} * i; j < kSieveBound; j += 2 * i) {
+        composite[j] = true;
+      }
+    }
+    return primes;
+  }();
+  return *kPrimes;
+}
+
+// Returns whether 'x' passes the Fermat test to base 2, a cheap filter that
+// rejects nearly all composites before the full primality test. 'x' is a
+// secret prime candidate, so the exponentiation runs in constant time like
+// the Miller-Rabin rounds of BN_is_prime_fasttest_ex.
+absl::StatusOr<bool> PassesFermatTest(const BIGNUM& x, BN_CTX* bn_ctx) {
+  bssl::UniquePtr<BN_MONT_CTX> mont_x(BN_MONT_CTX_new_consttime(&x, bn_ctx));
+  if (mont_x == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("BN_MONT_CTX_new_consttime failed: ", GetSslErrors()));
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> x_minus_one,
+                               NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> base, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> result, NewBigNum());
+  if (BN_sub(x_minus_one.get(), &x, BN_value_one()) != 1 ||
+      BN_set_word(base.get(), 2) != 1 ||
+      BN_mod_exp_mont_consttime(result.get(), base.get(), x_minus_one.get(),
+                                &x, bn_ctx, mont_x.get()) != 1) {
+    return absl::InternalError(
+        absl::StrCat("Fermat test failed: ", GetSslErrors()));
+  }
+  return BN_is_one(result.get()) == 1;
+}
+
+absl::StatusOr<bool> IsProbablePrime(const BIGNUM& x, BN_CTX* bn_ctx) {
+  const int is_prime = BN_is_prime_fasttest_ex(
+      &x, BN_prime_checks, bn_ctx, /*do_trial_division=*/0, /*cb=*/nullptr);
+  if (is_prime < 0) {
+    return absl::InternalError(
+        absl::StrCat("Primality test failed: ", GetSslErrors()));
+  }
+  return is_prime == 1;
+}
+
+// Marks in 'composite' the offsets k at which p' = start + 2k or
+// p = 2p' + 1 is divisible by one of the sieving primes.
+absl::Status SieveWindow(const BIGNUM& start, std::vector<bool>& composite) {
+  composite.assign(kSieveWindow, false);
+  for (const uint32_t prime : OddSievePrimes()) {
+    const BN_ULONG remainder = BN_mod_word(&start, prime);
+    if (remainder == static_cast<BN_ULONG>(-1)) {
+      return absl::InternalError(
+          absl::StrCat("BN_mod_word failed: ", GetSslErrors()));
+    }
+    const uint64_t s = prime;
+    const uint64_t r = remainder;
+    const uint64_t half = (s + 1) / 2;  // 2^-1 mod s.
+    const uint64_t quarter = half * half % s;
+    // p' = 0 mod s  <=>  r + 2k = 0       <=>  k = -r / 2 mod s.
+    // p = 0 mod s   <=>  2r + 1 + 4k = 0  <=>  k = -(2r + 1) / 4 mod s.
+    const uint64_t offsets[2] = {(s - r) % s * half % s,
+                                 (s - (2 * r + 1) % s) % s * quarter % s};
+    for (const uint64_t offset : offsets) {
+      for (uint64_t k = offset; k < kSieveWindow; k += s) {
+        composite[k] = true;
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Searches windows of candidates above random starting points until it finds
+// a safe prime of 'bits' bits, or returns null once 'stop' is set.
+absl::StatusOr<bssl::UniquePtr<BIGNUM>> SearchSafePrime(
+    const int bits, const std::atomic<bool>& stop) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> start, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> half_prime,
+                               NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> prime, NewBigNum());
+  std::vector<bool> composite;
+  while (!stop.load(std::memory_order_relaxed)) {
+    // p' has bits - 1 bits with the top two set, so p has the top two set.
+    if (BN_rand(start.get(), bits - 1, BN_RAND_TOP_TWO, BN_RAND_BOTTOM_ODD) !=
+        1) {
+      return absl::InternalError(
+          absl::StrCat("BN_rand failed: ", GetSslErrors()));
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(SieveWindow(*start, composite));
+    for (size_t k = 0; k < kSieveWindow; ++k) {
+      if (composite[k]) {
+        continue;
+      }
+      if (stop.load(std::memory_order_relaxed)) {
+        return nullptr;
+      }
+      if (BN_copy(half_prime.get(), start.get()) == nullptr ||
+          BN_add_word(half_prime.get(), 2 * k) != 1 ||
+          BN_lshift1(prime.get(), half_prime.get()) != 1 ||
+          BN_add_word(prime.get(), 1) != 1) {
+        return absl::InternalError(
+            absl::StrCat("Computing the candidate failed: ", GetSslErrors()));
+      }
+      if (BN_num_bits(half_prime.get()) != bits - 1) {
+        // The window ran past the largest value of the requested size.
+        break;
+      }
+      ANON_TOKENS_ASSIGN_OR_RETURN(bool passes,
+                                   PassesFermatTest(*prime, bn_ctx.get()));
+      if (!passes) {
+        continue;
+      }
+      ANON_TOKENS_ASSIGN_OR_RETURN(passes,
+                                   IsProbablePrime(*half_prime, bn_ctx.get()));
+      if (!passes) {
+        continue;
+      }
+      ANON_TOKENS_ASSIGN_OR_RETURN(passes,
+                                   IsProbablePrime(*prime, bn_ctx.get()));
+      if (passes) {
+        return prime;
+      }
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+absl::StatusOr<bssl::UniquePtr<BIGNUM>> GenerateSafePrime(
+    const int bits, ThreadPool* thread_pool) {
+  if (bits < kMinSafePrimeBits) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Safe primes must have at least ", kMinSafePrimeBits, " bits."));
+  }
+  std::atomic<bool> stop(false);
+  absl::Mutex mutex;
+  // Guarded by 'mutex'.
+  absl::Status status;
+  bssl::UniquePtr<BIGNUM> safe_prime;
+  auto search = [&](size_t /*begin*/, size_t /*end*/) {
+    absl::StatusOr<bssl::UniquePtr<BIGNUM>> result =
+        SearchSafePrime(bits, stop);
+    absl::MutexLock lock(&mutex);
+    if (!result.ok()) {
+      status.Update(result.status());
+    } else if (*result != nullptr && safe_prime == nullptr) {
+      safe_prime = *std::move(result);
+    } else {
+      return;
+    }
+    // Either outcome ends the search of the other threads.
+    stop.store(true, std::memory_order_relaxed);
+  };
+  if (thread_pool == nullptr) {
+    search(0, 1);
+  } else {
+    // One search per worker plus one on the calling thread.
+    thread_pool->ParallelFor(thread_pool->num_threads() + 1, search);
+  }
+
+  absl::MutexLock lock(&mutex);
+  if (safe_prime != nullptr) {
+    return std::move(safe_prime);
+  }
+  return status;
+}
+
+absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GenerateStrongRsaKeys(
+    const int modulus_size_in_bits, ThreadPool* thread_pool) {
+  if (modulus_size_in_bits % 16 != 0 ||
+      modulus_size_in_bits / 2 < kMinSafePrimeBits) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Modulus size must be a multiple of 16 of at least ",
+        2 * kMinSafePrimeBits, " bits, got ", modulus_size_in_bits, "."));
+  }
+  const int prime_bits = modulus_size_in_bits / 2;
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> p,
+                               GenerateSafePrime(prime_bits, thread_pool));
+  bssl::UniquePtr<BIGNUM> q;
+  do {
+    ANON_TOKENS_ASSIGN_OR_RETURN(q, GenerateSafePrime(prime_bits, thread_pool));
+  } while (BN_cmp(p.get(), q.get()) == 0);
+
+  ANON_TOKENS_ASSIGN_OR_RETURN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> n, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> e, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> phi_p, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> phi_q, NewBigNum());
+  if (BN_mul(n.get(), p.get(), q.get(), bn_ctx.get()) != 1 ||
+      BN_set_word(e.get(), RSA_F4) != 1 ||
+      BN_sub(phi_p.get(), p.get(), BN_value_one()) != 1 ||
+      BN_sub(phi_q.get(), q.get(), BN_value_one()) != 1) {
+    return absl::InternalError(
+        absl::StrCat("Computing n, phi(p) and phi(q) failed: ",
+                     GetSslErrors()));
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> lcm,
+                               ComputeCarmichaelLcm(*phi_p, *phi_q, *bn_ctx));
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> d, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> dp, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> dq, NewBigNum());
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> crt, NewBigNum());
+  if (BN_mod_inverse(d.get(), e.get(), lcm.get(), bn_ctx.get()) == nullptr ||
+      BN_mod(dp.get(), d.get(), phi_p.get(), bn_ctx.get()) != 1 ||
+      BN_mod(dq.get(), d.get(), phi_q.get(), bn_ctx.get()) != 1 ||
+      BN_mod_inverse(crt.get(), q.get(), p.get(), bn_ctx.get()) == nullptr) {
+    return absl::InternalError(absl::StrCat(
+        "Computing the private exponents failed: ", GetSslErrors()));
+  }
+
+  const size_t modulus_bytes = modulus_size_in_bits / 8;
+  const size_t prime_bytes = modulus_bytes / 2;
+  RSAPrivateKey private_key;
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_n(),
+                               BignumToString(*n, modulus_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_e(),
+                               BignumToString(*e, modulus_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_d(),
+                               BignumToString(*d, modulus_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_p(),
+                               BignumToString(*p, prime_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_q(),
+                               BignumToString(*q, prime_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_dp(),
+                               BignumToString(*dp, prime_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_dq(),
+                               BignumToString(*dq, prime_bytes));
+  ANON_TOKENS_ASSIGN_OR_RETURN(*private_key.mutable_crt(),
+                               BignumToString(*crt, prime_bytes));
+
+  // The key is checked for consistency as part of the conversion.
+  ANON_TOKENS_RETURN_IF_ERROR(
+      CreatePrivateKeyRSA(private_key.n(), private_key.e(), private_key.d(),
+                          private_key.p(), private_key.q(), private_key.dp(),
+                          private_key.dq(), private_key.crt())
+          .status());
+
+  RSAPublicKey public_key;
+  public_key.set_n(private_key.n());
+  public_key.set_e(private_key.e());
+  return std::make_pair(std::move(public_key), std::move(private_key));
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,59 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_CRYPTO_STRONG_RSA_KEY_GENERATOR_H_
+#define ANONYMOUS_TOKENS_CPP_CRYPTO_STRONG_RSA_KEY_GENERATOR_H_
+
+#include <utility>
+
+#include "absl/status/statusor.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/base.h>
+#include <openssl/bn.h>
+
+namespace anonymous_tokens {
+
+// Safe primes shorter than this are rejected, as the sieve would mistake the
+// smallest ones for multiples of its sieving primes.
+inline constexpr int kMinSafePrimeBits = 64;
+
+// Returns a random safe prime p = 2p' + 1, with p' prime, of exactly 'bits'
+// bits whose two most significant bits are set, so that the product of two
+// such primes has exactly 2 * 'bits' bits.
+//
+// Candidates are searched in windows of consecutive values above a random
+// start. Values where p' or p has a factor below 2^16 are sieved out of each
+// window before the remaining ones are tested for primality.
+//
+// If 'thread_pool' is not null, its workers and the calling thread search
+// independent windows until one of them finds a safe prime. Otherwise the
+// calling thread searches alone.
+absl::StatusOr<bssl::UniquePtr<BIGNUM>> GenerateSafePrime(
+    int bits, ThreadPool* thread_pool = nullptr);
+
+// Returns a new strong RSA key pair with a modulus of exactly
+// 'modulus_size_in_bits' bits, i.e. one whose primes p and q are safe primes,
+// as the RSA blind signatures with public metadata protocol requires. The
+// public exponent is 65537. 'thread_pool' is used as in GenerateSafePrime.
+//
+// All values of the private key are big-endian and padded to the modulus size
+// for n, e and d and to the prime size for the others, like the example keys
+// in anonymous_tokens/testdata.
+absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GenerateStrongRsaKeys(
+    int modulus_size_in_bits, ThreadPool* thread_pool = nullptr);
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_CRYPTO_STRONG_RSA_KEY_GENERATOR_H_
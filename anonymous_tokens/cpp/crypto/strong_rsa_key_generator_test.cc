@@ -0,0 +1,126 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/crypto/strong_rsa_key_generator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+// Expects 'p' to be a safe prime of 'bits' bits with the top two bits set.
+void ExpectSafePrime(const BIGNUM &p, int bits) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  EXPECT_EQ(BN_num_bits(&p), bits);
+  EXPECT_TRUE(BN_is_bit_set(&p, bits - 2));
+  bssl::UniquePtr<BIGNUM> half(BN_new());
+  ASSERT_EQ(BN_rshift1(half.get(), &p), 1);
+  EXPECT_EQ(BN_is_prime_fasttest_ex(&p, BN_prime_checks, bn_ctx.get(),
+                                    /*do_trial_division=*/1, nullptr),
+            1);
+  EXPECT_EQ(BN_is_prime_fasttest_ex(half.get(), BN_prime_checks, bn_ctx.get(),
+                                    /*do_trial_division=*/1, nullptr),
+            1);
+}
+
+TEST(StrongRsaKeyGeneratorTest, GeneratesSafePrimes) {
+  for (int bits : {kMinSafePrimeBits, 127, 256}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<BIGNUM> p,
+                                     GenerateSafePrime(bits));
+    ExpectSafePrime(*p, bits);
+  }
+}
+
+TEST(StrongRsaKeyGeneratorTest, GeneratesSafePrimesInParallel) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(3));
+  for (int i = 0; i < 3; ++i) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        bssl::UniquePtr<BIGNUM> p, GenerateSafePrime(256, thread_pool.get()));
+    ExpectSafePrime(*p, 256);
+  }
+}
+
+TEST(StrongRsaKeyGeneratorTest, RejectsInvalidSizes) {
+  EXPECT_EQ(GenerateSafePrime(kMinSafePrimeBits - 1).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(GenerateStrongRsaKeys(1000).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(GenerateStrongRsaKeys(2 * kMinSafePrimeBits - 16).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(StrongRsaKeyGeneratorTest, GeneratedKeySignsWithPublicMetadata) {
+  constexpr int kModulusBits = 512;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(2));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto keys, GenerateStrongRsaKeys(kModulusBits, thread_pool.get()));
+  const RSAPublicKey &public_key = keys.first;
+  const RSAPrivateKey &private_key = keys.second;
+  EXPECT_EQ(public_key.n(), private_key.n());
+  EXPECT_EQ(public_key.e(), private_key.e());
+  EXPECT_EQ(private_key.n().size(), kModulusBits / 8);
+  EXPECT_EQ(private_key.p().size(), kModulusBits / 16);
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      bssl::UniquePtr<RSA> rsa_key,
+      AnonymousTokensRSAPrivateKeyToRSA(private_key));
+  EXPECT_EQ(BN_num_bits(RSA_get0_n(rsa_key.get())), kModulusBits);
+  ExpectSafePrime(*RSA_get0_p(rsa_key.get()), kModulusBits / 2);
+  ExpectSafePrime(*RSA_get0_q(rsa_key.get()), kModulusBits / 2);
+
+  // A signature under the key derived from public metadata must verify with
+  // the derived public exponent.
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaBlindSigner> signer,
+      RsaBlindSigner::New(private_key, /*use_rsa_public_exponent=*/false,
+                          "metadata"));
+  std::string input(kModulusBits / 8, '\x42');
+  input[0] = 0;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature, signer->Sign(input));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      bssl::UniquePtr<BIGNUM> derived_e,
+      ComputeExponentWithPublicMetadata(*RSA_get0_n(rsa_key.get()),
+                                        "metadata"));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(BnCtxPtr bn_ctx, GetAndStartBigNumCtx());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bssl::UniquePtr<BIGNUM> s,
+                                   StringToBignum(signature));
+  bssl::UniquePtr<BIGNUM> recovered(BN_new());
+  ASSERT_EQ(BN_mod_exp(recovered.get(), s.get(), derived_e.get(),
+                       RSA_get0_n(rsa_key.get()), bn_ctx.get()),
+            1);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string recovered_input,
+                                   BignumToString(*recovered, input.size()));
+  EXPECT_EQ(recovered_input, input);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -15,6 +15,7 @@
 #include "anonymous_tokens/cpp/privacy_pass/rsa_bssa_public_metadata_client.h"
 
 #include <memory>
+#include <string>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -22,6 +23,7 @@
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
 #include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
 #include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
 #include <openssl/base.h>
@@ -150,13 +152,30 @@ absl::StatusOr<Token> PrivacyPassRsaBssaPublicMetadataClient::FinalizeToken(
 
 absl::Status PrivacyPassRsaBssaPublicMetadataClient::Verify(
     Token token_to_verify, const absl::string_view encoded_extensions,
-    RSA& rsa_public_key) {
+    RSA& rsa_public_key, RsaKeyCache* derived_key_cache) {
   ANON_TOKENS_RETURN_IF_ERROR(CheckKeySize(rsa_public_key));
-  ANON_TOKENS_ASSIGN_OR_RETURN(
-      bssl::UniquePtr<RSA> derived_rsa_public_key,
-      CreatePublicKeyRSAWithPublicMetadata(
-          *RSA_get0_n(&rsa_public_key), *RSA_get0_e(&rsa_public_key),
-          encoded_extensions, /*use_rsa_public_exponent=*/false));
+  auto derive = [&]() {
+    return CreatePublicKeyRSAWithPublicMetadata(
+        *RSA_get0_n(&rsa_public_key), *RSA_get0_e(&rsa_public_key),
+        encoded_extensions, /*use_rsa_public_exponent=*/false);
+  };
+  bssl::UniquePtr<RSA> derived_rsa_public_key;
+  if (derived_key_cache == nullptr) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(derived_rsa_public_key, derive());
+  } else {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        const std::string rsa_modulus,
+        BignumToString(*RSA_get0_n(&rsa_public_key),
+                       RSA_size(&rsa_public_key)));
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        const std::string cache_key,
+        DerivedPublicKeyCacheKey(rsa_modulus, /*e=*/"",
+                                 /*use_rsa_public_exponent=*/false,
+                                 encoded_extensions));
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        derived_rsa_public_key,
+        derived_key_cache->GetOrCreate(cache_key, derive));
+  }
 
   // Prepare input parameters for the verification function.
   const EVP_MD* signature_hash_function = EVP_sha384();
@@ -164,13 +183,12 @@ absl::Status PrivacyPassRsaBssaPublicMetadataClient::Verify(
 
   ANON_TOKENS_ASSIGN_OR_RETURN(const std::string authenticator_input,
                                AuthenticatorInput(token_to_verify));
-  std::string augmented_message =
-      EncodeMessagePublicMetadata(authenticator_input, encoded_extensions);
 
   return RsaBlindSignatureVerify(
       kSaltLengthInBytes48, signature_hash_function, mgf1_hash_function,
       /*signature=*/token_to_verify.authenticator,
-      /*message=*/augmented_message, derived_rsa_public_key.get());
+      /*message=*/authenticator_input,
+      /*public_metadata=*/encoded_extensions, derived_rsa_public_key.get());
 }
 
 }  // namespace anonymous_tokens
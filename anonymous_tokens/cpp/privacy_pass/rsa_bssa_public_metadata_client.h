@@ -22,6 +22,7 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "anonymous_tokens/cpp/crypto/rsa_blinder.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
 #include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
 #include <openssl/base.h>
 
@@ -69,9 +70,14 @@ class PrivacyPassRsaBssaPublicMetadataClient {
   // on success and errs on verification failure.
   //
   // https://datatracker.ietf.org/doc/draft-hendrickson-privacypass-public-metadata/
+  //
+  // If 'derived_key_cache' is not null, the public key derived from the
+  // extensions is looked up in and added to it, so that tokens with the same
+  // extensions do not derive the key again.
   static absl::Status Verify(Token token_to_verify,
                              absl::string_view encoded_extensions,
-                             RSA& rsa_public_key);
+                             RSA& rsa_public_key,
+                             RsaKeyCache* derived_key_cache = nullptr);
 
   static constexpr uint16_t kTokenType = 0xDA7A;
 
@@ -22,6 +22,7 @@
 #include <gtest/gtest.h>
 #include "absl/status/statusor.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
 #include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
 #include "anonymous_tokens/cpp/testing/utils.h"
 #include <openssl/digest.h>
@@ -294,6 +295,42 @@ TEST_F(PrivacyPassRsaBssaClientTest, FinalizeTokenWithWrongClient) {
               ::testing::HasSubstr("PSS padding verification failed"));
 }
 
+TEST_F(PrivacyPassRsaBssaClientTest, VerifyWithDerivedKeyCache) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      ExtendedTokenRequest token_req,
+      client_->CreateTokenRequest(challenge_encoding_, nonce_, token_key_id_,
+                                  extensions_));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(const std::string encoded_extensions,
+                                   EncodeExtensions(token_req.extensions));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      const std::string signature,
+      TestSignWithPublicMetadata(token_req.request.blinded_token_request,
+                                 /*public_metadata=*/encoded_extensions,
+                                 *rsa_private_key_.get(),
+                                 /*use_rsa_public_exponent=*/false));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(const Token token,
+                                   client_->FinalizeToken(signature));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<RsaKeyCache> cache,
+                                   RsaKeyCache::New(/*capacity=*/4));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(PrivacyPassRsaBssaPublicMetadataClient::Verify(
+                    token, encoded_extensions, *rsa_public_key_.get(),
+                    cache.get())
+                    .ok());
+  }
+  // Tokens with other extensions must not be verified with the cached key.
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(const std::string empty_encoded_extensions,
+                                   EncodeExtensions(/*extensions=*/{}));
+  EXPECT_FALSE(PrivacyPassRsaBssaPublicMetadataClient::Verify(
+                   token, empty_encoded_extensions, *rsa_public_key_.get(),
+                   cache.get())
+                   .ok());
+
+  const RsaKeyCacheStats stats = cache->GetStats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.misses, 2);
+}
+
 TEST_F(PrivacyPassRsaBssaClientTest, VerifyWithWrongExtensions) {
   // Create token request.
   ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
@@ -0,0 +1,269 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/privacy_pass/rsa_bssa_public_metadata_issuer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
+#include "anonymous_tokens/cpp/server/batch_grouping.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+
+namespace anonymous_tokens {
+
+namespace {
+
+// The signer shared by the requests of a group.
+struct GroupSigner {
+  std::shared_ptr<const RsaBlindSigner> signer;
+  absl::Status status;
+};
+
+// DecodeExtensions only accepts the canonical encoding, so the extensions
+// that are validated are exactly the ones that the client signs over.
+absl::Status ValidateEncodedExtensions(
+    absl::string_view encoded_extensions,
+    absl::Span<uint16_t> expected_extension_types, absl::Time now) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(Extensions extensions,
+                               DecodeExtensions(encoded_extensions));
+  if (expected_extension_types.empty()) {
+    return ValidateExtensionsValues(extensions, now);
+  }
+  return ValidateExtensionsOrderAndValues(extensions, expected_extension_types,
+                                          now);
+}
+
+// Returns the only key for token type DA7A that is valid at 'now' and whose
+// token key id ends in 'truncated_token_key_id'.
+absl::StatusOr<const IssuerKey*> FindKey(const IssuerKeyring& keyring,
+                                         uint8_t truncated_token_key_id,
+                                         absl::Time now) {
+  const IssuerKey* found = nullptr;
+  for (const IssuerKey* key :
+       keyring.FindByTruncatedTokenKeyId(truncated_token_key_id)) {
+    if (key->key_deriver() == nullptr || !key->IsValidAt(now) ||
+        key->public_key().key_size() != kDA7ABlindedTokenRequestSizeInBytes) {
+      continue;
+    }
+    if (found != nullptr) {
+      return absl::FailedPreconditionError(
+          "Several valid keys match the truncated token key id.");
+    }
+    found = key;
+  }
+  if (found == nullptr) {
+    return absl::InvalidArgumentError(
+        "No valid key matches the truncated token key id.");
+  }
+  return found;
+}
+
+}  // namespace
+
+PrivacyPassRsaBssaPublicMetadataIssuer::PrivacyPassRsaBssaPublicMetadataIssuer(
+    const ReloadableIssuerKeyring* keyring, Options options)
+    : keyring_(keyring), options_(std::move(options)) {}
+
+absl::StatusOr<std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer>>
+PrivacyPassRsaBssaPublicMetadataIssuer::New(
+    const ReloadableIssuerKeyring* keyring, Options options) {
+  if (keyring == nullptr) {
+    return absl::InvalidArgumentError("Keyring cannot be null.");
+  }
+  if (!options.clock) {
+    options.clock = [] { return absl::Now(); };
+  }
+  return absl::WrapUnique(
+      new PrivacyPassRsaBssaPublicMetadataIssuer(keyring, std::move(options)));
+}
+
+size_t PrivacyPassRsaBssaPublicMetadataIssuer::num_cached_signers() const {
+  absl::MutexLock lock(&mutex_);
+  return signers_.size();
+}
+
+absl::StatusOr<std::shared_ptr<const RsaBlindSigner>>
+PrivacyPassRsaBssaPublicMetadataIssuer::GetSigner(
+    const IssuerKey& key, absl::string_view encoded_extensions,
+    const uint64_t keyring_generation) const {
+  std::string cache_key;
+  if (options_.max_cached_signers > 0) {
+    cache_key = absl::StrCat(key.token_key_id(), encoded_extensions);
+    absl::ReaderMutexLock lock(&mutex_);
+    const auto cached = signers_.find(cache_key);
+    if (signers_generation_ == keyring_generation &&
+        cached != signers_.end()) {
+      return cached->second;
+    }
+  }
+  // Signers are built outside of the lock, so a signer that several threads
+  // miss at once may be built more than once.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      std::shared_ptr<const RsaBlindSigner> signer,
+      RsaBlindSigner::New(*key.key_deriver(), encoded_extensions,
+                          options_.derived_key_cache));
+  if (options_.max_cached_signers > 0) {
+    absl::MutexLock lock(&mutex_);
+    if (keyring_generation > signers_generation_) {
+      signers_.clear();
+      signers_generation_ = keyring_generation;
+    }
+    // Signers of a batch that started before the last reload are not cached.
+    if (keyring_generation == signers_generation_) {
+      if (signers_.size() >= options_.max_cached_signers &&
+          !signers_.contains(cache_key)) {
+        signers_.erase(signers_.begin());
+      }
+      signers_.try_emplace(std::move(cache_key), signer);
+    }
+  }
+  return signer;
+}
+
+std::vector<absl::StatusOr<std::string>>
+PrivacyPassRsaBssaPublicMetadataIssuer::IssueTokens(
+    absl::Span<const absl::string_view> extended_token_requests) const {
+  const size_t num_requests = extended_token_requests.size();
+  std::vector<absl::StatusOr<std::string>> responses(num_requests);
+  const absl::Time now = options_.clock();
+  ReloadableIssuerKeyring::Snapshot keyring = keyring_->Acquire();
+  // A reload that replaces the snapshot only completes once the snapshot is
+  // released, so this never counts a reload that the snapshot predates.
+  const uint64_t keyring_generation = keyring_->num_reloads();
+  std::vector<uint16_t> expected_extension_types =
+      options_.expected_extension_types;
+
+  // Unmarshals every request and assigns it to the group of its key and
+  // encoded extensions. The extensions are not copied out of the requests, as
+  // they are only needed in their encoded form.
+  std::vector<TokenRequest> token_requests(num_requests);
+  BatchGrouping groups(num_requests);
+  absl::flat_hash_map<absl::string_view, absl::Status> extensions_statuses;
+  for (size_t i = 0; i < num_requests; ++i) {
+    const absl::string_view request = extended_token_requests[i];
+    if (request.size() < kDA7AMarshaledTokenRequestSizeInBytes) {
+      responses[i] =
+          absl::InvalidArgumentError("failed to read encoded_token_request");
+      continue;
+    }
+    absl::StatusOr<TokenRequest> token_request = UnmarshalTokenRequest(
+        request.substr(0, kDA7AMarshaledTokenRequestSizeInBytes));
+    if (!token_request.ok()) {
+      responses[i] = token_request.status();
+      continue;
+    }
+    const absl::string_view encoded_extensions =
+        request.substr(kDA7AMarshaledTokenRequestSizeInBytes);
+    const auto [extensions_status, validate] =
+        extensions_statuses.try_emplace(encoded_extensions);
+    if (validate) {
+      extensions_status->second = ValidateEncodedExtensions(
+          encoded_extensions, absl::MakeSpan(expected_extension_types), now);
+    }
+    if (!extensions_status->second.ok()) {
+      responses[i] = extensions_status->second;
+      continue;
+    }
+    absl::StatusOr<const IssuerKey*> key =
+        FindKey(*keyring, token_request->truncated_token_key_id, now);
+    if (!key.ok()) {
+      responses[i] = key.status();
+      continue;
+    }
+    token_requests[i] = *std::move(token_request);
+    groups.Add(i, *key, encoded_extensions);
+  }
+  const size_t num_positions = groups.num_positions();
+  if (num_positions == 0) {
+    return responses;
+  }
+
+  // Orders the requests by group, so that every group is a contiguous range.
+  groups.Order();
+  std::vector<absl::string_view> blinded_data(num_positions);
+  for (size_t position = 0; position < num_positions; ++position) {
+    blinded_data[position] =
+        token_requests[groups.item_at(position)].blinded_token_request;
+  }
+
+  std::vector<GroupSigner> signers(groups.num_groups());
+  ParallelFor(options_.thread_pool, signers.size(),
+              [&](size_t begin, size_t end) {
+                for (size_t g = begin; g < end; ++g) {
+                  absl::StatusOr<std::shared_ptr<const RsaBlindSigner>> signer =
+                      GetSigner(groups.key(g), groups.public_metadata(g),
+                                keyring_generation);
+                  if (signer.ok()) {
+                    signers[g].signer = *std::move(signer);
+                  } else {
+                    signers[g].status = signer.status();
+                  }
+                }
+              });
+
+  // Splits the requests of all groups evenly across the threads. Each thread
+  // signs the part of each group in its range as one batch.
+  ParallelFor(
+      options_.thread_pool, num_positions, [&](size_t begin, size_t end) {
+        groups.ForEachGroupIn(begin, end, [&](size_t g, size_t part_begin,
+                                              size_t part_end) {
+          const GroupSigner& signer = signers[g];
+          if (!signer.status.ok()) {
+            for (size_t position = part_begin; position < part_end;
+                 ++position) {
+              responses[groups.item_at(position)] = signer.status;
+            }
+            return;
+          }
+          absl::StatusOr<BlindSignatureBatch> batch =
+              signer.signer->SignBatch(absl::MakeConstSpan(blinded_data)
+                                           .subspan(part_begin,
+                                                    part_end - part_begin));
+          for (size_t position = part_begin; position < part_end;
+               ++position) {
+            absl::StatusOr<std::string>& response =
+                responses[groups.item_at(position)];
+            if (!batch.ok()) {
+              response = batch.status();
+            } else if (!batch->statuses[position - part_begin].ok()) {
+              response = batch->statuses[position - part_begin];
+            } else {
+              response = std::string(batch->signature(position - part_begin));
+            }
+          }
+        });
+      });
+  return responses;
+}
+
+}  // namespace anonymous_tokens
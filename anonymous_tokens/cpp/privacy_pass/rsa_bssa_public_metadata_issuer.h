@@ -0,0 +1,129 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_PRIVACY_PASS_RSA_BSSA_PUBLIC_METADATA_ISSUER_H_
+#define ANONYMOUS_TOKENS_CPP_PRIVACY_PASS_RSA_BSSA_PUBLIC_METADATA_ISSUER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+
+namespace anonymous_tokens {
+
+// The issuer side of Privacy Pass token type DA7A, RSA blind signatures with
+// public metadata: turns the marshaled ExtendedTokenRequests built by
+// PrivacyPassRsaBssaPublicMetadataClient into the token responses, i.e. the
+// blind signatures, that its FinalizeToken expects.
+//
+// A batch of requests is processed against one snapshot of the keyring. The
+// key of a request is the key with public metadata support whose token key id
+// ends in the request's truncated_token_key_id and that is valid at the
+// current time. The extensions of a batch are decoded and validated once per
+// distinct encoding, and requests are grouped by key and encoded extensions,
+// so that each group is signed with one signer. Signers are kept across calls
+// in a bounded cache keyed by token key id and encoded extensions, so traffic
+// that reuses a few extension values neither derives keys nor sets up signers
+// again. The cache is emptied when the keyring is reloaded, so that it does
+// not keep the keys of rotated out signers alive. Signers missing from the
+// cache are built in parallel, and the requests of all groups are then split
+// evenly across the thread pool and signed in batches.
+//
+// Thread-safe.
+class PrivacyPassRsaBssaPublicMetadataIssuer {
+ public:
+  struct Options {
+    // If set, signers are built and requests signed on its workers and the
+    // calling thread, so IssueTokens must not run on one of its workers. Must
+    // outlive the issuer.
+    ThreadPool* thread_pool = nullptr;
+    // If set, private keys derived from extensions are looked up in and added
+    // to it when a signer is not cached. Must outlive the issuer.
+    RsaKeyCache* derived_key_cache = nullptr;
+    // Maximum number of cached signers. When the cache is full, an arbitrary
+    // signer is evicted for each new one. Zero disables the cache.
+    size_t max_cached_signers = 256;
+    // If not empty, the extension types that every request must carry, in
+    // this order. Otherwise requests may carry any extensions with valid
+    // values.
+    std::vector<uint16_t> expected_extension_types;
+    // Returns the current time, which keys must be valid at and expiration
+    // extensions are checked against. Defaults to absl::Now.
+    std::function<absl::Time()> clock;
+  };
+
+  // 'keyring' must be non-null and outlive the issuer.
+  static absl::StatusOr<std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer>>
+  New(const ReloadableIssuerKeyring* keyring, Options options);
+
+  PrivacyPassRsaBssaPublicMetadataIssuer(
+      const PrivacyPassRsaBssaPublicMetadataIssuer&) = delete;
+  PrivacyPassRsaBssaPublicMetadataIssuer& operator=(
+      const PrivacyPassRsaBssaPublicMetadataIssuer&) = delete;
+
+  // Returns the marshaled token response to each of the marshaled
+  // 'extended_token_requests', in order, or the reason it was rejected.
+  //
+  // A request is rejected with InvalidArgument if it cannot be unmarshaled,
+  // its extensions are not valid or no valid key matches its truncated token
+  // key id, and with FailedPrecondition if several valid keys match it. The
+  // other requests are still signed.
+  std::vector<absl::StatusOr<std::string>> IssueTokens(
+      absl::Span<const absl::string_view> extended_token_requests) const;
+
+  // Returns the number of cached signers.
+  size_t num_cached_signers() const;
+
+ private:
+  // Use New to construct.
+  PrivacyPassRsaBssaPublicMetadataIssuer(
+      const ReloadableIssuerKeyring* keyring, Options options);
+
+  // Returns the signer for 'key' and 'encoded_extensions', from the cache or
+  // newly built. 'keyring_generation' is the number of reloads of the keyring
+  // that 'key' was found in.
+  absl::StatusOr<std::shared_ptr<const RsaBlindSigner>> GetSigner(
+      const IssuerKey& key, absl::string_view encoded_extensions,
+      uint64_t keyring_generation) const;
+
+  const ReloadableIssuerKeyring* const keyring_;
+  const Options options_;
+
+  mutable absl::Mutex mutex_;
+  // Keyed by the token key id followed by the encoded extensions.
+  mutable absl::flat_hash_map<std::string,
+                              std::shared_ptr<const RsaBlindSigner>>
+      signers_ ABSL_GUARDED_BY(mutex_);
+  // The keyring generation that the cached signers belong to.
+  mutable uint64_t signers_generation_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_PRIVACY_PASS_RSA_BSSA_PUBLIC_METADATA_ISSUER_H_
@@ -0,0 +1,352 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/privacy_pass/rsa_bssa_public_metadata_issuer.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/privacy_pass/rsa_bssa_public_metadata_client.h"
+#include "anonymous_tokens/cpp/privacy_pass/token_encodings.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/proto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/base.h>
+
+namespace anonymous_tokens {
+namespace {
+
+// A multiple of the expiration timestamp precision.
+const absl::Time kNow = absl::FromUnixSeconds(1'700'000'100);
+
+// Returns extensions that pass validation at kNow and differ by 'index'.
+Extensions ValidExtensions(int index) {
+  ExpirationTimestamp expiration_timestamp;
+  expiration_timestamp.timestamp_precision = kFifteenMinutesInSeconds;
+  expiration_timestamp.timestamp =
+      absl::ToUnixSeconds(kNow) + (index + 1) * kFifteenMinutesInSeconds;
+  GeoHint geo_hint;
+  geo_hint.geo_hint = "US,US-AL,ALABASTER";
+  Extensions extensions;
+  extensions.extensions.push_back(*expiration_timestamp.AsExtension());
+  extensions.extensions.push_back(*geo_hint.AsExtension());
+  return extensions;
+}
+
+class PrivacyPassRsaBssaPublicMetadataIssuerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keys_, GetStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        config_, MakeIssuerKeyConfig(keys_, "TEST_USE_CASE", 1,
+                                     /*public_metadata_support=*/true,
+                                     AT_MESSAGE_MASK_NO_MASK));
+    std::vector<IssuerKeyConfig> configs = {config_};
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keyring_,
+                                     ReloadableIssuerKeyring::New(configs));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        rsa_public_key_,
+        CreatePublicKeyRSA(keys_.first.n(), keys_.first.e()));
+    token_key_id_ =
+        keyring_->Acquire()->FindByVersion("TEST_USE_CASE", 1)->token_key_id();
+  }
+
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> NewIssuer(
+      PrivacyPassRsaBssaPublicMetadataIssuer::Options options = {}) {
+    options.clock = [] { return kNow; };
+    absl::StatusOr<std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer>>
+        issuer = PrivacyPassRsaBssaPublicMetadataIssuer::New(
+            keyring_.get(), std::move(options));
+    EXPECT_TRUE(issuer.ok()) << issuer.status();
+    return *std::move(issuer);
+  }
+
+  // Creates a client and the marshaled request of one token with
+  // 'extensions'.
+  void AddRequest(const Extensions &extensions) {
+    absl::StatusOr<std::unique_ptr<PrivacyPassRsaBssaPublicMetadataClient>>
+        client = PrivacyPassRsaBssaPublicMetadataClient::Create(
+            *rsa_public_key_);
+    ASSERT_TRUE(client.ok()) << client.status();
+    // Nonces must be 32 bytes.
+    std::string nonce(32, 'n');
+    nonce[30] = static_cast<char>(clients_.size() >> 8);
+    nonce[31] = static_cast<char>(clients_.size());
+    absl::StatusOr<ExtendedTokenRequest> request =
+        (*client)->CreateTokenRequest("challenge", nonce, token_key_id_,
+                                      extensions);
+    ASSERT_TRUE(request.ok()) << request.status();
+    absl::StatusOr<std::string> marshaled =
+        MarshalExtendedTokenRequest(*request);
+    ASSERT_TRUE(marshaled.ok()) << marshaled.status();
+    clients_.push_back(*std::move(client));
+    requests_.push_back(*std::move(marshaled));
+  }
+
+  std::vector<absl::string_view> RequestViews() const {
+    return std::vector<absl::string_view>(requests_.begin(), requests_.end());
+  }
+
+  // Finalizes and verifies the token of request i from 'response'.
+  absl::Status FinalizeAndVerify(size_t i, absl::string_view response,
+                                 const Extensions &extensions) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(Token token,
+                                 clients_[i]->FinalizeToken(response));
+    ANON_TOKENS_ASSIGN_OR_RETURN(std::string encoded_extensions,
+                                 EncodeExtensions(extensions));
+    return PrivacyPassRsaBssaPublicMetadataClient::Verify(
+        token, encoded_extensions, *rsa_public_key_);
+  }
+
+  std::pair<RSAPublicKey, RSAPrivateKey> keys_;
+  // Version 1 of TEST_USE_CASE, without message masks.
+  IssuerKeyConfig config_;
+  std::unique_ptr<ReloadableIssuerKeyring> keyring_;
+  bssl::UniquePtr<RSA> rsa_public_key_;
+  std::string token_key_id_;
+  std::vector<std::unique_ptr<PrivacyPassRsaBssaPublicMetadataClient>>
+      clients_;
+  std::vector<std::string> requests_;
+};
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest, NullKeyringIsRejected) {
+  EXPECT_EQ(PrivacyPassRsaBssaPublicMetadataIssuer::New(nullptr, {})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest, EmptyBatch) {
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer = NewIssuer();
+  EXPECT_TRUE(issuer->IssueTokens({}).empty());
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest, ResponsesFinalizeToTokens) {
+  for (int i = 0; i < 3; ++i) {
+    AddRequest(ValidExtensions(0));
+  }
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer = NewIssuer();
+  std::vector<absl::StatusOr<std::string>> responses =
+      issuer->IssueTokens(RequestViews());
+  ASSERT_EQ(responses.size(), 3);
+  for (size_t i = 0; i < responses.size(); ++i) {
+    ASSERT_TRUE(responses[i].ok()) << responses[i].status();
+    EXPECT_EQ(responses[i]->size(), kDA7ABlindedTokenRequestSizeInBytes);
+    EXPECT_TRUE(FinalizeAndVerify(i, *responses[i], ValidExtensions(0)).ok());
+  }
+  EXPECT_EQ(issuer->num_cached_signers(), 1);
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest,
+       SignsEachRequestWithItsExtensions) {
+  // Interleaves the extensions so that the groups are not contiguous.
+  for (int i = 0; i < 12; ++i) {
+    AddRequest(ValidExtensions(i % 4));
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(3));
+  PrivacyPassRsaBssaPublicMetadataIssuer::Options options;
+  options.thread_pool = thread_pool.get();
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer =
+      NewIssuer(std::move(options));
+  std::vector<absl::StatusOr<std::string>> responses =
+      issuer->IssueTokens(RequestViews());
+  ASSERT_EQ(responses.size(), 12);
+  for (size_t i = 0; i < responses.size(); ++i) {
+    ASSERT_TRUE(responses[i].ok()) << responses[i].status();
+    EXPECT_TRUE(
+        FinalizeAndVerify(i, *responses[i], ValidExtensions(i % 4)).ok());
+  }
+  EXPECT_EQ(issuer->num_cached_signers(), 4);
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest,
+       ParallelIssuanceMatchesSequentialIssuance) {
+  for (int i = 0; i < 40; ++i) {
+    AddRequest(ValidExtensions(i % 3));
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> thread_pool,
+                                   ThreadPool::New(4));
+  PrivacyPassRsaBssaPublicMetadataIssuer::Options options;
+  options.thread_pool = thread_pool.get();
+  std::vector<absl::StatusOr<std::string>> parallel =
+      NewIssuer(std::move(options))->IssueTokens(RequestViews());
+  std::vector<absl::StatusOr<std::string>> sequential =
+      NewIssuer()->IssueTokens(RequestViews());
+  ASSERT_EQ(parallel.size(), sequential.size());
+  for (size_t i = 0; i < parallel.size(); ++i) {
+    ASSERT_TRUE(parallel[i].ok()) << parallel[i].status();
+    ASSERT_TRUE(sequential[i].ok()) << sequential[i].status();
+    EXPECT_EQ(*parallel[i], *sequential[i]);
+  }
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest, CachesSignersAcrossCalls) {
+  AddRequest(ValidExtensions(0));
+  AddRequest(ValidExtensions(1));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<RsaKeyCache> derived_key_cache, RsaKeyCache::New(16));
+  PrivacyPassRsaBssaPublicMetadataIssuer::Options options;
+  options.derived_key_cache = derived_key_cache.get();
+  options.max_cached_signers = 2;
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer =
+      NewIssuer(std::move(options));
+  std::vector<absl::StatusOr<std::string>> first =
+      issuer->IssueTokens(RequestViews());
+  EXPECT_EQ(issuer->num_cached_signers(), 2);
+  EXPECT_EQ(derived_key_cache->GetStats().size, 2);
+  std::vector<absl::StatusOr<std::string>> second =
+      issuer->IssueTokens(RequestViews());
+  EXPECT_EQ(issuer->num_cached_signers(), 2);
+  ASSERT_EQ(second.size(), 2);
+  for (size_t i = 0; i < second.size(); ++i) {
+    ASSERT_TRUE(second[i].ok()) << second[i].status();
+    EXPECT_EQ(*second[i], *first[i]);
+  }
+
+  // A third value evicts one of the cached signers.
+  AddRequest(ValidExtensions(2));
+  std::vector<absl::StatusOr<std::string>> third =
+      issuer->IssueTokens(RequestViews());
+  EXPECT_EQ(issuer->num_cached_signers(), 2);
+  ASSERT_EQ(third.size(), 3);
+  for (size_t i = 0; i < third.size(); ++i) {
+    ASSERT_TRUE(third[i].ok()) << third[i].status();
+    EXPECT_TRUE(FinalizeAndVerify(i, *third[i], ValidExtensions(i)).ok());
+  }
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest,
+       ReloadDropsCachedSigners) {
+  AddRequest(ValidExtensions(0));
+  AddRequest(ValidExtensions(1));
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer = NewIssuer();
+  issuer->IssueTokens(RequestViews());
+  EXPECT_EQ(issuer->num_cached_signers(), 2);
+
+  std::vector<IssuerKeyConfig> configs = {config_};
+  ASSERT_TRUE(keyring_->Reload(configs).ok());
+  requests_.pop_back();
+  std::vector<absl::StatusOr<std::string>> responses =
+      issuer->IssueTokens(RequestViews());
+  EXPECT_EQ(issuer->num_cached_signers(), 1);
+  ASSERT_TRUE(responses[0].ok()) << responses[0].status();
+  EXPECT_TRUE(FinalizeAndVerify(0, *responses[0], ValidExtensions(0)).ok());
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest, ZeroCacheSizeDisablesCache) {
+  AddRequest(ValidExtensions(0));
+  PrivacyPassRsaBssaPublicMetadataIssuer::Options options;
+  options.max_cached_signers = 0;
+  std::unique_ptr<PrivacyPassRsaBssaPublicMetadataIssuer> issuer =
+      NewIssuer(std::move(options));
+  std::vector<absl::StatusOr<std::string>> responses =
+      issuer->IssueTokens(RequestViews());
+  ASSERT_TRUE(responses[0].ok()) << responses[0].status();
+  EXPECT_TRUE(FinalizeAndVerify(0, *responses[0], ValidExtensions(0)).ok());
+  EXPECT_EQ(issuer->num_cached_signers(), 0);
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest,
+       InvalidRequestsDoNotFailTheBatch) {
+  AddRequest(ValidExtensions(0));
+  // Expires after more than a week.
+  AddRequest(ValidExtensions(7 * 24 * 4));
+  AddRequest(ValidExtensions(0));
+  std::string wrong_key_id = requests_[2];
+  wrong_key_id[2] ^= 1;
+  std::string wrong_token_type = requests_[2];
+  wrong_token_type[0] ^= 1;
+  std::string trailing_data = absl::StrCat(requests_[2], "x");
+  std::vector<absl::string_view> requests = RequestViews();
+  requests.push_back(wrong_key_id);
+  requests.push_back(wrong_token_type);
+  requests.push_back(trailing_data);
+  requests.push_back(absl::string_view(requests_[0]).substr(0, 258));
+  requests.push_back(absl::string_view(requests_[0]).substr(0, 259));
+  requests.push_back("");
+
+  std::vector<absl::StatusOr<std::string>> responses =
+      NewIssuer()->IssueTokens(requests);
+  ASSERT_EQ(responses.size(), requests.size());
+  ASSERT_TRUE(responses[0].ok()) << responses[0].status();
+  EXPECT_TRUE(FinalizeAndVerify(0, *responses[0], ValidExtensions(0)).ok());
+  EXPECT_EQ(responses[1].status().code(), absl::StatusCode::kInvalidArgument);
+  ASSERT_TRUE(responses[2].ok()) << responses[2].status();
+  EXPECT_TRUE(FinalizeAndVerify(2, *responses[2], ValidExtensions(0)).ok());
+  for (size_t i = 3; i < responses.size(); ++i) {
+    EXPECT_EQ(responses[i].status().code(), absl::StatusCode::kInvalidArgument)
+        << i;
+  }
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest,
+       EnforcesExpectedExtensionTypes) {
+  AddRequest(ValidExtensions(0));
+  Extensions expiration_only = ValidExtensions(1);
+  expiration_only.extensions.pop_back();
+  AddRequest(expiration_only);
+  PrivacyPassRsaBssaPublicMetadataIssuer::Options options;
+  options.expected_extension_types = {0x0001, 0x0002};
+  std::vector<absl::StatusOr<std::string>> responses =
+      NewIssuer(std::move(options))->IssueTokens(RequestViews());
+  ASSERT_EQ(responses.size(), 2);
+  EXPECT_TRUE(responses[0].ok()) << responses[0].status();
+  EXPECT_EQ(responses[1].status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest, ExpiredKeyIsNotUsed) {
+  IssuerKeyConfig config = config_;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(*config.public_key.mutable_expiration_time(),
+                                   TimeToProto(kNow));
+  std::vector<IssuerKeyConfig> configs = {config};
+  ASSERT_TRUE(keyring_->Reload(configs).ok());
+  AddRequest(ValidExtensions(0));
+  std::vector<absl::StatusOr<std::string>> responses =
+      NewIssuer()->IssueTokens(RequestViews());
+  ASSERT_EQ(responses.size(), 1);
+  EXPECT_EQ(responses[0].status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(PrivacyPassRsaBssaPublicMetadataIssuerTest,
+       KeysWithoutMetadataAreNotUsed) {
+  IssuerKeyConfig config = config_;
+  config.public_key.set_public_metadata_support(false);
+  std::vector<IssuerKeyConfig> configs = {config};
+  ASSERT_TRUE(keyring_->Reload(configs).ok());
+  AddRequest(ValidExtensions(0));
+  std::vector<absl::StatusOr<std::string>> responses =
+      NewIssuer()->IssueTokens(RequestViews());
+  ASSERT_EQ(responses.size(), 1);
+  EXPECT_EQ(responses[0].status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,271 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/anonymous_tokens_redemption_server.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/server/batch_grouping.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+
+namespace {
+
+// Tokens are checked against the store, verified and marked spent this many at
+// a time, so that each token is marked spent soon after it is verified while
+// the verification of a chunk still shares one batch.
+constexpr size_t kChunkSize = 32;
+
+// The spent token store and verifier shared by the tokens of a group.
+struct GroupVerifier {
+  SpentTokenStore* spent_tokens = nullptr;
+  // Only set for keys with public metadata support.
+  std::unique_ptr<RsaSsaPssVerifier> derived_verifier;
+  const RsaSsaPssVerifier* verifier = nullptr;
+  absl::Status status;
+};
+
+absl::StatusOr<std::unique_ptr<RsaSsaPssVerifier>> NewDerivedVerifier(
+    const IssuerKey& key, absl::string_view public_metadata,
+    RsaKeyCache* derived_key_cache) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const EVP_MD* sig_hash,
+      ProtoHashTypeToEVPDigest(key.public_key().sig_hash_type()));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const EVP_MD* mgf1_hash,
+      ProtoMaskGenFunctionToEVPDigest(key.public_key().mask_gen_function()));
+  return RsaSsaPssVerifier::New(key.public_key().salt_length(), sig_hash,
+                                mgf1_hash, key.rsa_public_key(),
+                                /*use_rsa_public_exponent=*/false,
+                                public_metadata, derived_key_cache);
+}
+
+}  // namespace
+
+AnonymousTokensRedemptionServer::AnonymousTokensRedemptionServer(
+    const ReloadableIssuerKeyring* keyring,
+    absl::flat_hash_map<std::string, SpentTokenStore*> spent_token_stores,
+    Options options)
+    : keyring_(keyring),
+      spent_token_stores_(std::move(spent_token_stores)),
+      options_(std::move(options)) {}
+
+absl::StatusOr<std::unique_ptr<AnonymousTokensRedemptionServer>>
+AnonymousTokensRedemptionServer::New(
+    const ReloadableIssuerKeyring* keyring,
+    absl::flat_hash_map<std::string, SpentTokenStore*> spent_token_stores,
+    Options options) {
+  if (keyring == nullptr) {
+    return absl::InvalidArgumentError("Keyring cannot be null.");
+  }
+  for (const auto& [use_case, spent_tokens] : spent_token_stores) {
+    if (spent_tokens == nullptr) {
+      return absl::InvalidArgumentError(
+          "Spent token stores cannot be null.");
+    }
+  }
+  return absl::WrapUnique(new AnonymousTokensRedemptionServer(
+      keyring, std::move(spent_token_stores), std::move(options)));
+}
+
+absl::StatusOr<AnonymousTokensRedemptionResponse>
+AnonymousTokensRedemptionServer::ProcessRequest(
+    const AnonymousTokensRedemptionRequest& request) const {
+  const auto& tokens = request.anonymous_tokens_to_redeem();
+  const size_t num_tokens = tokens.size();
+  if (num_tokens == 0) {
+    return absl::InvalidArgumentError("Cannot process an empty request.");
+  }
+  ReloadableIssuerKeyring::Snapshot keyring = keyring_->Acquire();
+
+  // Fills in everything but the outcome, and assigns every token that can be
+  // verified to the group of its key and public metadata. Tokens that cannot
+  // be verified keep verified and double_spent false.
+  AnonymousTokensRedemptionResponse response;
+  response.mutable_anonymous_token_redemption_results()->Reserve(num_tokens);
+  std::vector<AnonymousTokensRedemptionResponse_AnonymousTokenRedemptionResult*>
+      results(num_tokens);
+  BatchGrouping groups(num_tokens);
+  std::vector<GroupVerifier> verifiers;
+  size_t masked_messages_size = 0;
+  for (size_t i = 0; i < num_tokens; ++i) {
+    const AnonymousTokensRedemptionRequest_AnonymousTokenToRedeem& token =
+        tokens[i];
+    results[i] = response.add_anonymous_token_redemption_results();
+    results[i]->set_use_case(token.use_case());
+    results[i]->set_key_version(token.key_version());
+    results[i]->set_public_metadata(token.public_metadata());
+    results[i]->set_serialized_unblinded_token(
+        token.serialized_unblinded_token());
+    results[i]->set_plaintext_message(token.plaintext_message());
+    results[i]->set_message_mask(token.message_mask());
+
+    const IssuerKey* key =
+        keyring->FindByVersion(token.use_case(), token.key_version());
+    const auto spent_tokens = spent_token_stores_.find(token.use_case());
+    // Masks of any other size would let clients move bytes between the mask
+    // and the message of a signed token.
+    if (key == nullptr || spent_tokens == spent_token_stores_.end() ||
+        token.serialized_unblinded_token().empty() ||
+        static_cast<int64_t>(token.message_mask().size()) !=
+            key->public_key().message_mask_size() ||
+        (key->key_deriver() == nullptr && !token.public_metadata().empty())) {
+      continue;
+    }
+    absl::string_view public_metadata;
+    if (key->key_deriver() != nullptr) {
+      public_metadata = token.public_metadata();
+    }
+    if (groups.Add(i, key, public_metadata) == verifiers.size()) {
+      verifiers.emplace_back();
+      verifiers.back().spent_tokens = spent_tokens->second;
+    }
+    if (!token.message_mask().empty()) {
+      masked_messages_size +=
+          token.message_mask().size() + token.plaintext_message().size();
+    }
+  }
+  const size_t num_positions = groups.num_positions();
+  if (num_positions == 0) {
+    return response;
+  }
+
+  // Orders the tokens by group, so that every group is a contiguous range.
+  // Masked messages are appended to one buffer that is reserved up front, so
+  // it is never reallocated and views into it stay valid. Unmasked messages
+  // are used in place.
+  groups.Order();
+  std::vector<absl::string_view> unblinded_tokens(num_positions);
+  std::vector<absl::string_view> messages(num_positions);
+  std::string masked_messages;
+  masked_messages.reserve(masked_messages_size);
+  for (size_t position = 0; position < num_positions; ++position) {
+    const AnonymousTokensRedemptionRequest_AnonymousTokenToRedeem& token =
+        tokens[groups.item_at(position)];
+    unblinded_tokens[position] = token.serialized_unblinded_token();
+    if (token.message_mask().empty()) {
+      messages[position] = token.plaintext_message();
+    } else {
+      const size_t offset = masked_messages.size();
+      MaskMessageConcat(token.message_mask(), token.plaintext_message(),
+                        &masked_messages);
+      messages[position] = absl::string_view(masked_messages)
+                               .substr(offset, masked_messages.size() - offset);
+    }
+  }
+
+  ParallelFor(options_.thread_pool, verifiers.size(),
+              [&](size_t begin, size_t end) {
+                for (size_t g = begin; g < end; ++g) {
+                  const IssuerKey& key = groups.key(g);
+                  if (key.key_deriver() == nullptr) {
+                    verifiers[g].verifier = key.verifier();
+                    continue;
+                  }
+                  absl::StatusOr<std::unique_ptr<RsaSsaPssVerifier>> verifier =
+                      NewDerivedVerifier(key, groups.public_metadata(g),
+                                         options_.derived_key_cache);
+                  if (verifier.ok()) {
+                    verifiers[g].derived_verifier = *std::move(verifier);
+                    verifiers[g].verifier = verifiers[g].derived_verifier.get();
+                  } else {
+                    verifiers[g].status = verifier.status();
+                  }
+                }
+              });
+  for (const GroupVerifier& verifier : verifiers) {
+    ANON_TOKENS_RETURN_IF_ERROR(verifier.status);
+  }
+
+  // Splits the tokens of all groups evenly across the threads. Each thread
+  // redeems the part of each group in its range chunk by chunk.
+  std::vector<absl::Status> statuses(num_positions);
+  ParallelFor(
+      options_.thread_pool, num_positions, [&](size_t begin, size_t end) {
+        std::vector<size_t> unspent;
+        std::vector<SpentTokenHash> hashes;
+        std::vector<absl::string_view> chunk_tokens;
+        std::vector<absl::string_view> chunk_messages;
+        groups.ForEachGroupIn(begin, end, [&](size_t g, size_t part_begin,
+                                              size_t part_end) {
+          const GroupVerifier& group = verifiers[g];
+          const int64_t key_version = groups.key(g).public_key().key_version();
+          for (size_t chunk_begin = part_begin; chunk_begin < part_end;
+               chunk_begin += kChunkSize) {
+            const size_t chunk_end =
+                std::min(part_end, chunk_begin + kChunkSize);
+            unspent.clear();
+            hashes.clear();
+            chunk_tokens.clear();
+            chunk_messages.clear();
+            for (size_t position = chunk_begin; position < chunk_end;
+                 ++position) {
+              const SpentTokenHash hash =
+                  HashSpentToken(unblinded_tokens[position]);
+              if (group.spent_tokens->Contains(key_version, hash)) {
+                results[groups.item_at(position)]->set_double_spent(true);
+                continue;
+              }
+              unspent.push_back(position);
+              hashes.push_back(hash);
+              chunk_tokens.push_back(unblinded_tokens[position]);
+              chunk_messages.push_back(messages[position]);
+            }
+            if (unspent.empty()) {
+              continue;
+            }
+            absl::StatusOr<VerificationBatch> batch =
+                group.verifier->VerifyBatch(chunk_tokens, chunk_messages);
+            for (size_t j = 0; j < unspent.size(); ++j) {
+              if (!batch.ok()) {
+                statuses[unspent[j]] = batch.status();
+              } else if (batch->valid(j)) {
+                const bool fresh =
+                    group.spent_tokens->CheckAndInsert(key_version, hashes[j]);
+                const size_t i = groups.item_at(unspent[j]);
+                results[i]->set_verified(fresh);
+                results[i]->set_double_spent(!fresh);
+              }
+            }
+          }
+        });
+      });
+  for (const absl::Status& status : statuses) {
+    ANON_TOKENS_RETURN_IF_ERROR(status);
+  }
+  return response;
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,103 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_ANONYMOUS_TOKENS_REDEMPTION_SERVER_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_ANONYMOUS_TOKENS_REDEMPTION_SERVER_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+
+// The verifier side of the Anonymous Tokens RSA blind signatures protocol:
+// turns the AnonymousTokensRedemptionRequest built by
+// AnonymousTokensRedemptionClient into the AnonymousTokensRedemptionResponse
+// that its ProcessAnonymousTokensRedemptionResponse expects.
+//
+// A request is processed against one snapshot of the keyring. Its tokens are
+// grouped by key and, for keys with public metadata support, by public
+// metadata, so that the verifier of each group is derived once. The masked
+// messages of all tokens are built into one buffer. The tokens of all groups
+// are then split evenly across the thread pool, and every thread streams its
+// tokens through the redemption stages in small chunks: tokens that are
+// already spent are answered from the spent-token store without an RSA
+// operation, the others are verified as one batch, and the valid ones are
+// marked spent right away.
+//
+// Thread-safe. Concurrent requests may share stores, and of all redemptions of
+// one token exactly one is verified.
+class AnonymousTokensRedemptionServer {
+ public:
+  struct Options {
+    // If set, verifiers are built and tokens redeemed on its workers and the
+    // calling thread, so ProcessRequest must not run on one of its workers.
+    // Must outlive the server.
+    ThreadPool* thread_pool = nullptr;
+    // If set, public keys derived from public metadata are looked up in and
+    // added to it. Must outlive the server.
+    RsaKeyCache* derived_key_cache = nullptr;
+  };
+
+  // 'keyring' must be non-null and outlive the server. 'spent_token_stores'
+  // maps every use case that tokens are redeemed for to the non-null store of
+  // its spent tokens, which must outlive the server.
+  static absl::StatusOr<std::unique_ptr<AnonymousTokensRedemptionServer>> New(
+      const ReloadableIssuerKeyring* keyring,
+      absl::flat_hash_map<std::string, SpentTokenStore*> spent_token_stores,
+      Options options);
+
+  AnonymousTokensRedemptionServer(const AnonymousTokensRedemptionServer&) =
+      delete;
+  AnonymousTokensRedemptionServer& operator=(
+      const AnonymousTokensRedemptionServer&) = delete;
+
+  // Redeems every token of 'request' and returns one result per token, in
+  // request order.
+  //
+  // A token is verified iff its key is in the keyring, its use case has a
+  // store, its mask has the size of the key's message masks, it only carries
+  // public metadata if the key supports it, its signature verifies and it was
+  // not spent before. Tokens that were spent before are reported as double
+  // spent and not verified. Tokens are accepted for as long as their key is in
+  // the keyring, regardless of its validity window.
+  //
+  // Fails with InvalidArgument if the request is empty. Invalid tokens do not
+  // fail the request, but internal errors do, and no partial response is
+  // returned. Tokens may have been marked spent regardless.
+  absl::StatusOr<AnonymousTokensRedemptionResponse> ProcessRequest(
+      const AnonymousTokensRedemptionRequest& request) const;
+
+ private:
+  // Use New to construct.
+  AnonymousTokensRedemptionServer(
+      const ReloadableIssuerKeyring* keyring,
+      absl::flat_hash_map<std::string, SpentTokenStore*> spent_token_stores,
+      Options options);
+
+  const ReloadableIssuerKeyring* const keyring_;
+  const absl::flat_hash_map<std::string, SpentTokenStore*> spent_token_stores_;
+  const Options options_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_ANONYMOUS_TOKENS_REDEMPTION_SERVER_H_
@@ -0,0 +1,337 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/anonymous_tokens_redemption_server.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_redemption_client.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_rsa_bssa_client.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/server/anonymous_tokens_rsa_bssa_server.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+using ::testing::SizeIs;
+
+constexpr absl::string_view kUseCase = "TEST_USE_CASE";
+
+std::vector<PlaintextMessageWithPublicMetadata> MakeInputs(
+    int num_inputs, int num_public_metadata_values) {
+  std::vector<PlaintextMessageWithPublicMetadata> inputs(num_inputs);
+  for (int i = 0; i < num_inputs; ++i) {
+    inputs[i].set_plaintext_message(absl::StrCat("message ", i));
+    if (num_public_metadata_values > 0) {
+      inputs[i].set_public_metadata(
+          absl::StrCat("metadata ", i % num_public_metadata_values));
+    }
+  }
+  return inputs;
+}
+
+class AnonymousTokensRedemptionServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_1, GetStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_2,
+                                     GetAnotherStrongRsaKeys2048());
+    // Version 1 signs without and version 2 with public metadata.
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        IssuerKeyConfig config_1,
+        MakeIssuerKeyConfig(keys_1, kUseCase, 1,
+                            /*public_metadata_support=*/false));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        IssuerKeyConfig config_2,
+        MakeIssuerKeyConfig(keys_2, kUseCase, 2,
+                            /*public_metadata_support=*/true));
+    public_key_1_ = config_1.public_key;
+    public_key_2_ = config_2.public_key;
+    std::vector<IssuerKeyConfig> configs = {std::move(config_1),
+                                            std::move(config_2)};
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keyring_,
+                                     ReloadableIssuerKeyring::New(configs));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        issuer_, AnonymousTokensRsaBssaServer::New(keyring_.get(), {}));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(spent_tokens_, SpentTokenStore::New({}));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(thread_pool_, ThreadPool::New(3));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(derived_key_cache_, RsaKeyCache::New(16));
+  }
+
+  std::unique_ptr<AnonymousTokensRedemptionServer> NewServer(
+      SpentTokenStore *spent_tokens, bool parallel = false) {
+    AnonymousTokensRedemptionServer::Options options;
+    if (parallel) {
+      options.thread_pool = thread_pool_.get();
+      options.derived_key_cache = derived_key_cache_.get();
+    }
+    auto server = AnonymousTokensRedemptionServer::New(
+        keyring_.get(), {{std::string(kUseCase), spent_tokens}},
+        std::move(options));
+    EXPECT_TRUE(server.ok()) << server.status();
+    return server.ok() ? std::move(*server) : nullptr;
+  }
+
+  // Issues a token for every input with the key 'public_key'.
+  absl::StatusOr<std::vector<RSABlindSignatureTokenWithInput>> IssueTokens(
+      const RSABlindSignaturePublicKey &public_key,
+      const std::vector<PlaintextMessageWithPublicMetadata> &inputs) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        std::unique_ptr<AnonymousTokensRsaBssaClient> client,
+        AnonymousTokensRsaBssaClient::Create(public_key));
+    ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignRequest request,
+                                 client->CreateRequest(inputs));
+    ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignResponse response,
+                                 issuer_->ProcessRequest(request));
+    return client->ProcessResponse(response);
+  }
+
+  // Redeems 'tokens' of key version 'key_version' through a redemption client.
+  absl::StatusOr<std::vector<RSABlindSignatureRedemptionResult>> Redeem(
+      const AnonymousTokensRedemptionServer &server, int64_t key_version,
+      const std::vector<RSABlindSignatureTokenWithInput> &tokens) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        std::unique_ptr<AnonymousTokensRedemptionClient> client,
+        AnonymousTokensRedemptionClient::Create(TEST_USE_CASE, key_version));
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        AnonymousTokensRedemptionRequest request,
+        client->CreateAnonymousTokensRedemptionRequest(tokens));
+    ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensRedemptionResponse response,
+                                 server.ProcessRequest(request));
+    return client->ProcessAnonymousTokensRedemptionResponse(response);
+  }
+
+  // Returns a request for 'tokens' without going through a client, for
+  // requests that clients do not build.
+  static AnonymousTokensRedemptionRequest MakeRequest(
+      int64_t key_version,
+      const std::vector<RSABlindSignatureTokenWithInput> &tokens) {
+    AnonymousTokensRedemptionRequest request;
+    for (const RSABlindSignatureTokenWithInput &token : tokens) {
+      auto *token_to_redeem = request.add_anonymous_tokens_to_redeem();
+      token_to_redeem->set_use_case(std::string(kUseCase));
+      token_to_redeem->set_key_version(key_version);
+      token_to_redeem->set_public_metadata(token.input().public_metadata());
+      token_to_redeem->set_serialized_unblinded_token(token.token().token());
+      token_to_redeem->set_plaintext_message(token.input().plaintext_message());
+      token_to_redeem->set_message_mask(token.token().message_mask());
+    }
+    return request;
+  }
+
+  RSABlindSignaturePublicKey public_key_1_;
+  RSABlindSignaturePublicKey public_key_2_;
+  std::unique_ptr<ReloadableIssuerKeyring> keyring_;
+  std::unique_ptr<AnonymousTokensRsaBssaServer> issuer_;
+  std::unique_ptr<SpentTokenStore> spent_tokens_;
+  std::unique_ptr<ThreadPool> thread_pool_;
+  std::unique_ptr<RsaKeyCache> derived_key_cache_;
+};
+
+TEST_F(AnonymousTokensRedemptionServerTest, RedeemsTokensWithoutMetadata) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens, IssueTokens(public_key_1_, MakeInputs(5, 0)));
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      NewServer(spent_tokens_.get());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto results, Redeem(*server, 1, tokens));
+  ASSERT_THAT(results, SizeIs(5));
+  for (const RSABlindSignatureRedemptionResult &result : results) {
+    EXPECT_TRUE(result.redeemed());
+    EXPECT_FALSE(result.double_spent());
+  }
+  EXPECT_EQ(spent_tokens_->size(), 5);
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, RedeemsMetadataTokensInParallel) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens, IssueTokens(public_key_2_, MakeInputs(70, 3)));
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      NewServer(spent_tokens_.get(), /*parallel=*/true);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto results, Redeem(*server, 2, tokens));
+  ASSERT_THAT(results, SizeIs(70));
+  for (const RSABlindSignatureRedemptionResult &result : results) {
+    EXPECT_TRUE(result.redeemed());
+    EXPECT_FALSE(result.double_spent());
+  }
+  EXPECT_EQ(spent_tokens_->size(), 70);
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, SecondRedemptionIsDoubleSpent) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens, IssueTokens(public_key_2_, MakeInputs(4, 2)));
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      NewServer(spent_tokens_.get());
+  ASSERT_TRUE(Redeem(*server, 2, {tokens[0], tokens[1]}).ok());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto results, Redeem(*server, 2, tokens));
+  ASSERT_THAT(results, SizeIs(4));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(results[i].redeemed(), i >= 2);
+    EXPECT_EQ(results[i].double_spent(), i < 2);
+  }
+  EXPECT_EQ(spent_tokens_->size(), 4);
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, RedeemsRepeatedTokenOnce) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens, IssueTokens(public_key_1_, MakeInputs(1, 0)));
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      NewServer(spent_tokens_.get(), /*parallel=*/true);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      AnonymousTokensRedemptionResponse response,
+      server->ProcessRequest(MakeRequest(1, {tokens[0], tokens[0]})));
+  const auto &results = response.anonymous_token_redemption_results();
+  ASSERT_THAT(results, SizeIs(2));
+  EXPECT_NE(results[0].verified(), results[1].verified());
+  EXPECT_NE(results[0].double_spent(), results[1].double_spent());
+  EXPECT_EQ(results[0].verified(), results[1].double_spent());
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, RejectsInvalidTokens) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens_1, IssueTokens(public_key_1_, MakeInputs(4, 0)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens_2, IssueTokens(public_key_2_, MakeInputs(3, 1)));
+  AnonymousTokensRedemptionRequest request = MakeRequest(1, tokens_1);
+  request.MergeFrom(MakeRequest(2, tokens_2));
+  auto *tokens = request.mutable_anonymous_tokens_to_redeem();
+  // A message that was not signed.
+  tokens->at(0).set_plaintext_message("another message");
+  // A byte moved from the message into the mask.
+  tokens->at(1).set_message_mask(
+      absl::StrCat(tokens->at(1).message_mask(), "m"));
+  tokens->at(1).set_plaintext_message(
+      tokens->at(1).plaintext_message().substr(1));
+  // Public metadata for a key without public metadata support.
+  tokens->at(2).set_public_metadata("metadata 0");
+  // An unknown key version.
+  tokens->at(3).set_key_version(3);
+  // Public metadata that was not signed.
+  tokens->at(4).set_public_metadata("metadata 1");
+  // An empty token.
+  tokens->at(5).clear_serialized_unblinded_token();
+
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      NewServer(spent_tokens_.get());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(AnonymousTokensRedemptionResponse response,
+                                   server->ProcessRequest(request));
+  const auto &results = response.anonymous_token_redemption_results();
+  ASSERT_THAT(results, SizeIs(7));
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_FALSE(results[i].verified()) << i;
+    EXPECT_FALSE(results[i].double_spent()) << i;
+    EXPECT_EQ(results[i].plaintext_message(),
+              tokens->at(i).plaintext_message());
+  }
+  EXPECT_TRUE(results[6].verified());
+  EXPECT_EQ(spent_tokens_->size(), 1);
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, ParallelMatchesSequential) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens_1, IssueTokens(public_key_1_, MakeInputs(40, 0)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens_2, IssueTokens(public_key_2_, MakeInputs(40, 5)));
+  // Interleaves the keys, spends some tokens and tampers with others.
+  AnonymousTokensRedemptionRequest request;
+  for (int i = 0; i < 40; ++i) {
+    request.MergeFrom(MakeRequest(1, {tokens_1[i]}));
+    request.MergeFrom(MakeRequest(2, {tokens_2[i]}));
+  }
+  for (int i = 0; i < 80; i += 7) {
+    request.mutable_anonymous_tokens_to_redeem(i)->set_plaintext_message("x");
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto sequential_store,
+                                   SpentTokenStore::New({}));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto parallel_store,
+                                   SpentTokenStore::New({}));
+  for (int i = 0; i < 40; i += 3) {
+    sequential_store->CheckAndInsert(1, tokens_1[i].token().token());
+    parallel_store->CheckAndInsert(1, tokens_1[i].token().token());
+  }
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      AnonymousTokensRedemptionResponse sequential,
+      NewServer(sequential_store.get())->ProcessRequest(request));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      AnonymousTokensRedemptionResponse parallel,
+      NewServer(parallel_store.get(), /*parallel=*/true)
+          ->ProcessRequest(request));
+  EXPECT_EQ(parallel.SerializeAsString(), sequential.SerializeAsString());
+  int num_verified = 0;
+  int num_double_spent = 0;
+  for (const auto &result : parallel.anonymous_token_redemption_results()) {
+    num_verified += result.verified();
+    num_double_spent += result.double_spent();
+  }
+  // 14 spent tokens, which are double spent even if tampered with, and 12
+  // tampered tokens, of which 2 were spent.
+  EXPECT_EQ(num_double_spent, 14);
+  EXPECT_EQ(num_verified, 80 - 14 - 10);
+  EXPECT_EQ(parallel_store->size(), 14 + num_verified);
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, RejectsUseCaseWithoutStore) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto tokens, IssueTokens(public_key_1_, MakeInputs(2, 0)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<AnonymousTokensRedemptionServer> server,
+      AnonymousTokensRedemptionServer::New(keyring_.get(), {}, {}));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto results, Redeem(*server, 1, tokens));
+  ASSERT_THAT(results, SizeIs(2));
+  for (const RSABlindSignatureRedemptionResult &result : results) {
+    EXPECT_FALSE(result.redeemed());
+    EXPECT_FALSE(result.double_spent());
+  }
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, FailsOnEmptyRequest) {
+  std::unique_ptr<AnonymousTokensRedemptionServer> server =
+      NewServer(spent_tokens_.get());
+  EXPECT_EQ(server->ProcessRequest({}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(AnonymousTokensRedemptionServerTest, FailsOnNullArguments) {
+  EXPECT_EQ(AnonymousTokensRedemptionServer::New(nullptr, {}, {})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(AnonymousTokensRedemptionServer::New(
+                keyring_.get(), {{std::string(kUseCase), nullptr}}, {})
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,197 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/anonymous_tokens_rsa_bssa_server.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/server/batch_grouping.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+
+namespace {
+
+// The signer shared by the blinded tokens of a group.
+struct GroupSigner {
+  // Only set for keys with public metadata support.
+  std::unique_ptr<RsaBlindSigner> derived_signer;
+  const RsaBlindSigner* signer = nullptr;
+  absl::Status status;
+};
+
+}  // namespace
+
+AnonymousTokensRsaBssaServer::AnonymousTokensRsaBssaServer(
+    const ReloadableIssuerKeyring* keyring, Options options)
+    : keyring_(keyring), options_(std::move(options)) {}
+
+absl::StatusOr<std::unique_ptr<AnonymousTokensRsaBssaServer>>
+AnonymousTokensRsaBssaServer::New(const ReloadableIssuerKeyring* keyring,
+                                  Options options) {
+  if (keyring == nullptr) {
+    return absl::InvalidArgumentError("Keyring cannot be null.");
+  }
+  if (!options.clock) {
+    options.clock = [] { return absl::Now(); };
+  }
+  return absl::WrapUnique(
+      new AnonymousTokensRsaBssaServer(keyring, std::move(options)));
+}
+
+absl::StatusOr<AnonymousTokensSignResponse>
+AnonymousTokensRsaBssaServer::ProcessRequest(
+    const AnonymousTokensSignRequest& request) const {
+  const auto& blinded_tokens = request.blinded_tokens();
+  const size_t num_tokens = blinded_tokens.size();
+  if (num_tokens == 0) {
+    return absl::InvalidArgumentError("Cannot process an empty request.");
+  }
+  const absl::Time now = options_.clock();
+  ReloadableIssuerKeyring::Snapshot keyring = keyring_->Acquire();
+
+  // Assigns every token to the group of its key and public metadata.
+  BatchGrouping groups(num_tokens);
+  for (size_t i = 0; i < num_tokens; ++i) {
+    const AnonymousTokensSignRequest_BlindedToken& blinded_token =
+        blinded_tokens[i];
+    const IssuerKey* key = keyring->FindByVersion(blinded_token.use_case(),
+                                                  blinded_token.key_version());
+    if (key == nullptr) {
+      return absl::InvalidArgumentError(
+          "Request has a token for an unknown use case and key version.");
+    } else if (!key->IsValidAt(now)) {
+      return absl::FailedPreconditionError(
+          "Key of a token is not valid at this time.");
+    } else if (blinded_token.serialized_token().empty()) {
+      return absl::InvalidArgumentError(
+          "Blinded token (serialized_token) cannot be empty.");
+    }
+    absl::string_view public_metadata;
+    if (key->key_deriver() != nullptr) {
+      if (!blinded_token.do_not_use_rsa_public_exponent()) {
+        return absl::InvalidArgumentError(
+            "Setting do_not_use_rsa_public_exponent to false is no longer "
+            "supported.");
+      }
+      public_metadata = blinded_token.public_metadata();
+    }
+    groups.Add(i, key, public_metadata);
+  }
+
+  // Orders the tokens by group, so that every group is a contiguous range.
+  groups.Order();
+  std::vector<absl::string_view> blinded_data(num_tokens);
+  for (size_t position = 0; position < num_tokens; ++position) {
+    blinded_data[position] =
+        blinded_tokens[groups.item_at(position)].serialized_token();
+  }
+
+  std::vector<GroupSigner> signers(groups.num_groups());
+  ParallelFor(options_.thread_pool, signers.size(),
+              [&](size_t begin, size_t end) {
+                for (size_t g = begin; g < end; ++g) {
+                  const IssuerKey& key = groups.key(g);
+                  if (key.key_deriver() == nullptr) {
+                    signers[g].signer = key.signer();
+                    continue;
+                  }
+                  absl::StatusOr<std::unique_ptr<RsaBlindSigner>> signer =
+                      RsaBlindSigner::New(*key.key_deriver(),
+                                          groups.public_metadata(g),
+                                          options_.derived_key_cache);
+                  if (signer.ok()) {
+                    signers[g].derived_signer = *std::move(signer);
+                    signers[g].signer = signers[g].derived_signer.get();
+                  } else {
+                    signers[g].status = signer.status();
+                  }
+                }
+              });
+
+  // Fills in everything but the signatures, and remembers where each
+  // signature goes so that the signing threads can write it in place.
+  AnonymousTokensSignResponse response;
+  response.mutable_anonymous_tokens()->Reserve(num_tokens);
+  std::vector<std::string*> signatures(num_tokens);
+  for (size_t i = 0; i < num_tokens; ++i) {
+    const AnonymousTokensSignRequest_BlindedToken& blinded_token =
+        blinded_tokens[i];
+    AnonymousTokensSignResponse_AnonymousToken* anonymous_token =
+        response.add_anonymous_tokens();
+    anonymous_token->set_use_case(blinded_token.use_case());
+    anonymous_token->set_key_version(blinded_token.key_version());
+    anonymous_token->set_public_metadata(blinded_token.public_metadata());
+    anonymous_token->set_do_not_use_rsa_public_exponent(
+        blinded_token.do_not_use_rsa_public_exponent());
+    anonymous_token->set_serialized_blinded_message(
+        blinded_token.serialized_token());
+    signatures[i] = anonymous_token->mutable_serialized_token();
+  }
+
+  // Splits the tokens of all groups evenly across the threads. Each thread
+  // signs the part of each group in its range as one batch.
+  std::vector<absl::Status> statuses(num_tokens);
+  ParallelFor(
+      options_.thread_pool, num_tokens, [&](size_t begin, size_t end) {
+        groups.ForEachGroupIn(begin, end, [&](size_t g, size_t part_begin,
+                                              size_t part_end) {
+          const GroupSigner& signer = signers[g];
+          if (!signer.status.ok()) {
+            for (size_t position = part_begin; position < part_end;
+                 ++position) {
+              statuses[groups.item_at(position)] = signer.status;
+            }
+            return;
+          }
+          absl::StatusOr<BlindSignatureBatch> batch =
+              signer.signer->SignBatch(absl::MakeConstSpan(blinded_data)
+                                           .subspan(part_begin,
+                                                    part_end - part_begin));
+          for (size_t position = part_begin; position < part_end;
+               ++position) {
+            const size_t i = groups.item_at(position);
+            statuses[i] = batch.ok() ? batch->statuses[position - part_begin]
+                                     : batch.status();
+            if (statuses[i].ok()) {
+              const absl::string_view signature =
+                  batch->signature(position - part_begin);
+              signatures[i]->assign(signature.data(), signature.size());
+            }
+          }
+        });
+      });
+  for (const absl::Status& status : statuses) {
+    ANON_TOKENS_RETURN_IF_ERROR(status);
+  }
+  return response;
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,88 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_ANONYMOUS_TOKENS_RSA_BSSA_SERVER_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_ANONYMOUS_TOKENS_RSA_BSSA_SERVER_H_
+
+#include <functional>
+#include <memory>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+
+// The issuer side of the Anonymous Tokens RSA blind signatures protocol: turns
+// the AnonymousTokensSignRequest built by AnonymousTokensRsaBssaClient into
+// the AnonymousTokensSignResponse that its ProcessResponse expects.
+//
+// A request is processed against one snapshot of the keyring. Its blinded
+// tokens are grouped by key and, for keys with public metadata support, by
+// public metadata, so that the signer of each group is derived once. Derived
+// signers are built in parallel, and the tokens of all groups are then split
+// evenly across the thread pool and signed in batches. Each signature is
+// written straight into its response token, which are in request order.
+//
+// Thread-safe.
+class AnonymousTokensRsaBssaServer {
+ public:
+  struct Options {
+    // If set, signers are built and tokens signed on its workers and the
+    // calling thread, so ProcessRequest must not run on one of its workers.
+    // Must outlive the server.
+    ThreadPool* thread_pool = nullptr;
+    // If set, private keys derived from public metadata are looked up in and
+    // added to it. Must outlive the server.
+    RsaKeyCache* derived_key_cache = nullptr;
+    // Returns the current time, which keys must be valid at. Defaults to
+    // absl::Now.
+    std::function<absl::Time()> clock;
+  };
+
+  // 'keyring' must be non-null and outlive the server.
+  static absl::StatusOr<std::unique_ptr<AnonymousTokensRsaBssaServer>> New(
+      const ReloadableIssuerKeyring* keyring, Options options);
+
+  AnonymousTokensRsaBssaServer(const AnonymousTokensRsaBssaServer&) = delete;
+  AnonymousTokensRsaBssaServer& operator=(const AnonymousTokensRsaBssaServer&) =
+      delete;
+
+  // Signs every blinded token of 'request' with the key named by its use case
+  // and key version.
+  //
+  // Fails with InvalidArgument if the request is empty, names an unknown key,
+  // has an empty blinded token or asks to use the RSA public exponent with a
+  // public metadata key, and with FailedPrecondition if a key is not valid at
+  // the current time. If any token cannot be signed, e.g. because it is not
+  // a valid blinded message for its key, returns the error of the first such
+  // token in request order. No partial response is returned.
+  absl::StatusOr<AnonymousTokensSignResponse> ProcessRequest(
+      const AnonymousTokensSignRequest& request) const;
+
+ private:
+  // Use New to construct.
+  AnonymousTokensRsaBssaServer(const ReloadableIssuerKeyring* keyring,
+                               Options options);
+
+  const ReloadableIssuerKeyring* const keyring_;
+  const Options options_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_ANONYMOUS_TOKENS_RSA_BSSA_SERVER_H_
@@ -0,0 +1,267 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/anonymous_tokens_rsa_bssa_server.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/client/anonymous_tokens_rsa_bssa_client.h"
+#include "anonymous_tokens/cpp/crypto/rsa_key_cache.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+using ::testing::SizeIs;
+
+constexpr absl::string_view kUseCase = "TEST_USE_CASE";
+const absl::Time kNow = absl::FromUnixSeconds(1700000000);
+
+std::vector<PlaintextMessageWithPublicMetadata> MakeInputs(
+    int num_inputs, int num_public_metadata_values) {
+  std::vector<PlaintextMessageWithPublicMetadata> inputs(num_inputs);
+  for (int i = 0; i < num_inputs; ++i) {
+    inputs[i].set_plaintext_message(absl::StrCat("message ", i));
+    if (num_public_metadata_values > 0) {
+      inputs[i].set_public_metadata(
+          absl::StrCat("metadata ", i % num_public_metadata_values));
+    }
+  }
+  return inputs;
+}
+
+class AnonymousTokensRsaBssaServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_1, GetStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_2,
+                                     GetAnotherStrongRsaKeys2048());
+    // Version 1 signs without and version 2 with public metadata. Both are
+    // valid for an hour from kNow.
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        IssuerKeyConfig config_1,
+        MakeIssuerKeyConfig(keys_1, kUseCase, 1,
+                            /*public_metadata_support=*/false,
+                            AT_MESSAGE_MASK_CONCAT, kNow,
+                            kNow + absl::Hours(1)));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        IssuerKeyConfig config_2,
+        MakeIssuerKeyConfig(keys_2, kUseCase, 2,
+                            /*public_metadata_support=*/true,
+                            AT_MESSAGE_MASK_CONCAT, kNow,
+                            kNow + absl::Hours(1)));
+    public_key_1_ = config_1.public_key;
+    public_key_2_ = config_2.public_key;
+    std::vector<IssuerKeyConfig> configs = {std::move(config_1),
+                                            std::move(config_2)};
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keyring_,
+                                     ReloadableIssuerKeyring::New(configs));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(thread_pool_, ThreadPool::New(3));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(derived_key_cache_, RsaKeyCache::New(16));
+  }
+
+  std::unique_ptr<AnonymousTokensRsaBssaServer> NewServer(
+      bool parallel = false, absl::Time now = kNow) {
+    AnonymousTokensRsaBssaServer::Options options;
+    if (parallel) {
+      options.thread_pool = thread_pool_.get();
+      options.derived_key_cache = derived_key_cache_.get();
+    }
+    options.clock = [now] { return now; };
+    auto server =
+        AnonymousTokensRsaBssaServer::New(keyring_.get(), std::move(options));
+    EXPECT_TRUE(server.ok()) << server.status();
+    return server.ok() ? std::move(*server) : nullptr;
+  }
+
+  // Creates a client for 'public_key' and a request for 'inputs'.
+  absl::StatusOr<std::pair<std::unique_ptr<AnonymousTokensRsaBssaClient>,
+                           AnonymousTokensSignRequest>>
+  CreateRequest(const RSABlindSignaturePublicKey &public_key,
+                const std::vector<PlaintextMessageWithPublicMetadata> &inputs) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        std::unique_ptr<AnonymousTokensRsaBssaClient> client,
+        AnonymousTokensRsaBssaClient::Create(public_key));
+    ANON_TOKENS_ASSIGN_OR_RETURN(AnonymousTokensSignRequest request,
+                                 client->CreateRequest(inputs));
+    return std::make_pair(std::move(client), std::move(request));
+  }
+
+  RSABlindSignaturePublicKey public_key_1_;
+  RSABlindSignaturePublicKey public_key_2_;
+  std::unique_ptr<ReloadableIssuerKeyring> keyring_;
+  std::unique_ptr<ThreadPool> thread_pool_;
+  std::unique_ptr<RsaKeyCache> derived_key_cache_;
+};
+
+TEST_F(AnonymousTokensRsaBssaServerTest, ClientAcceptsResponseWithoutMetadata) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_1_, MakeInputs(5, 0)));
+  auto &[client, request] = client_and_request;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(AnonymousTokensSignResponse response,
+                                   NewServer()->ProcessRequest(request));
+  ASSERT_THAT(response.anonymous_tokens(), SizeIs(5));
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(response.anonymous_tokens(i).serialized_blinded_message(),
+              request.blinded_tokens(i).serialized_token());
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto tokens,
+                                   client->ProcessResponse(response));
+  EXPECT_THAT(tokens, SizeIs(5));
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, ClientAcceptsResponseWithMetadata) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_2_, MakeInputs(12, 3)));
+  auto &[client, request] = client_and_request;
+  for (const bool parallel : {false, true}) {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        AnonymousTokensSignResponse response,
+        NewServer(parallel)->ProcessRequest(request));
+    ASSERT_THAT(response.anonymous_tokens(), SizeIs(12));
+    for (int i = 0; i < 12; ++i) {
+      EXPECT_EQ(response.anonymous_tokens(i).public_metadata(),
+                absl::StrCat("metadata ", i % 3));
+    }
+    // Each client can only process one response.
+    if (!parallel) {
+      ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto tokens,
+                                       client->ProcessResponse(response));
+      EXPECT_THAT(tokens, SizeIs(12));
+    }
+  }
+  // One key was derived for each metadata value.
+  EXPECT_EQ(derived_key_cache_->GetStats().misses, 3);
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, ParallelSigningGivesTheSameResponse) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_2_, MakeInputs(40, 5)));
+  const AnonymousTokensSignRequest &request = client_and_request.second;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(AnonymousTokensSignResponse sequential,
+                                   NewServer()->ProcessRequest(request));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      AnonymousTokensSignResponse parallel,
+      NewServer(/*parallel=*/true)->ProcessRequest(request));
+  EXPECT_EQ(parallel.SerializeAsString(), sequential.SerializeAsString());
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, RequestMayMixKeys) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request_1,
+      CreateRequest(public_key_1_, MakeInputs(4, 0)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request_2,
+      CreateRequest(public_key_2_, MakeInputs(4, 2)));
+  // Interleaves the tokens of both requests.
+  AnonymousTokensSignRequest request;
+  for (int i = 0; i < 4; ++i) {
+    *request.add_blinded_tokens() =
+        client_and_request_1.second.blinded_tokens(i);
+    *request.add_blinded_tokens() =
+        client_and_request_2.second.blinded_tokens(i);
+  }
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      AnonymousTokensSignResponse response,
+      NewServer(/*parallel=*/true)->ProcessRequest(request));
+  ASSERT_THAT(response.anonymous_tokens(), SizeIs(8));
+  AnonymousTokensSignResponse response_1;
+  AnonymousTokensSignResponse response_2;
+  for (int i = 0; i < 8; ++i) {
+    *(i % 2 == 0 ? response_1 : response_2).add_anonymous_tokens() =
+        response.anonymous_tokens(i);
+  }
+  EXPECT_TRUE(client_and_request_1.first->ProcessResponse(response_1).ok());
+  EXPECT_TRUE(client_and_request_2.first->ProcessResponse(response_2).ok());
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, EmptyRequest) {
+  EXPECT_EQ(NewServer()->ProcessRequest({}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, UnknownKeyVersion) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_1_, MakeInputs(2, 0)));
+  AnonymousTokensSignRequest &request = client_and_request.second;
+  request.mutable_blinded_tokens(1)->set_key_version(3);
+  EXPECT_EQ(NewServer()->ProcessRequest(request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, ExpiredKey) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_1_, MakeInputs(2, 0)));
+  EXPECT_EQ(NewServer(/*parallel=*/false, kNow + absl::Hours(2))
+                ->ProcessRequest(client_and_request.second)
+                .status()
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, EmptyBlindedToken) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_1_, MakeInputs(2, 0)));
+  AnonymousTokensSignRequest &request = client_and_request.second;
+  request.mutable_blinded_tokens(0)->clear_serialized_token();
+  EXPECT_EQ(NewServer()->ProcessRequest(request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, RsaPublicExponentWithPublicMetadata) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_2_, MakeInputs(2, 1)));
+  AnonymousTokensSignRequest &request = client_and_request.second;
+  request.mutable_blinded_tokens(1)->set_do_not_use_rsa_public_exponent(false);
+  EXPECT_EQ(NewServer()->ProcessRequest(request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(AnonymousTokensRsaBssaServerTest, InvalidBlindedTokenFailsTheRequest) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      auto client_and_request, CreateRequest(public_key_2_, MakeInputs(8, 2)));
+  AnonymousTokensSignRequest &request = client_and_request.second;
+  // Too short for the modulus.
+  request.mutable_blinded_tokens(5)->set_serialized_token("short");
+  for (const bool parallel : {false, true}) {
+    EXPECT_EQ(NewServer(parallel)->ProcessRequest(request).status().code(),
+              absl::StatusCode::kInternal)
+        << parallel;
+  }
+}
+
+TEST(AnonymousTokensRsaBssaServerNewTest, NullKeyring) {
+  EXPECT_EQ(AnonymousTokensRsaBssaServer::New(nullptr, {}).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
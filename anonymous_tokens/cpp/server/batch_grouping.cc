@@ -0,0 +1,71 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/batch_grouping.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+
+namespace anonymous_tokens {
+
+BatchGrouping::BatchGrouping(size_t num_items)
+    : item_groups_(num_items, kNoGroup) {}
+
+size_t BatchGrouping::Add(size_t item, const IssuerKey* key,
+                          absl::string_view public_metadata) {
+  const auto [group_index, inserted] =
+      group_indices_.try_emplace({key, public_metadata}, groups_.size());
+  if (inserted) {
+    groups_.push_back({key, public_metadata});
+  }
+  item_groups_[item] = group_index->second;
+  ++groups_[group_index->second].end;
+  ++num_positions_;
+  return group_index->second;
+}
+
+void BatchGrouping::Order() {
+  size_t group_begin = 0;
+  for (Group& group : groups_) {
+    group.begin = group_begin;
+    group_begin += group.end;
+    group.end = group.begin;
+  }
+  items_.resize(num_positions_);
+  for (size_t item = 0; item < item_groups_.size(); ++item) {
+    if (item_groups_[item] != kNoGroup) {
+      items_[groups_[item_groups_[item]].end++] = item;
+    }
+  }
+}
+
+void BatchGrouping::ForEachGroupIn(
+    size_t begin, const size_t end,
+    absl::FunctionRef<void(size_t group, size_t part_begin, size_t part_end)>
+        fn) const {
+  if (begin >= end) {
+    return;
+  }
+  for (size_t group = item_groups_[items_[begin]]; begin < end; ++group) {
+    const size_t part_end = std::min(end, groups_[group].end);
+    fn(group, begin, part_end);
+    begin = part_end;
+  }
+}
+
+}  // namespace anonymous_tokens
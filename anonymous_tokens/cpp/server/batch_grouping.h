@@ -0,0 +1,104 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_BATCH_GROUPING_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_BATCH_GROUPING_H_
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+
+namespace anonymous_tokens {
+
+// Groups the items of a batch, e.g. the tokens of a request, by the key and
+// public metadata they are signed or verified with, so that each group can
+// share one signer or verifier.
+//
+// Items are assigned to groups with Add. Order then lays out the grouped items
+// by group, so that every group is a contiguous range of positions. Callers
+// keep their per-position inputs in that order, split the positions across
+// threads, and process the part of each group in a range as one batch with
+// ForEachGroupIn.
+class BatchGrouping {
+ public:
+  // 'num_items' is the size of the batch.
+  explicit BatchGrouping(size_t num_items);
+
+  BatchGrouping(const BatchGrouping&) = delete;
+  BatchGrouping& operator=(const BatchGrouping&) = delete;
+
+  // Assigns item 'item' to the group of 'key' and 'public_metadata', and
+  // returns the index of the group. Groups are numbered in the order in which
+  // their first item is added, from zero. Both 'key' and 'public_metadata'
+  // must outlive the grouping. Items that are never added belong to no group.
+  size_t Add(size_t item, const IssuerKey* key,
+             absl::string_view public_metadata);
+
+  // Assigns positions [0, num_positions()) to the added items, group by group.
+  // Must be called once, after all items have been added.
+  void Order();
+
+  size_t num_groups() const { return groups_.size(); }
+
+  // Number of items that were added.
+  size_t num_positions() const { return num_positions_; }
+
+  const IssuerKey& key(size_t group) const { return *groups_[group].key; }
+
+  absl::string_view public_metadata(size_t group) const {
+    return groups_[group].public_metadata;
+  }
+
+  // Returns the item at 'position'. Only valid after Order.
+  size_t item_at(size_t position) const { return items_[position]; }
+
+  // Splits the positions [begin, end) where the group changes and calls
+  // fn(group, part_begin, part_end) for each part, in order. Only valid after
+  // Order.
+  void ForEachGroupIn(size_t begin, size_t end,
+                      absl::FunctionRef<void(size_t group, size_t part_begin,
+                                             size_t part_end)>
+                          fn) const;
+
+ private:
+  static constexpr size_t kNoGroup = std::numeric_limits<size_t>::max();
+
+  struct Group {
+    const IssuerKey* key;
+    absl::string_view public_metadata;
+    // The group's items are at positions [begin, end). Until Order, 'end'
+    // counts them.
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  std::vector<Group> groups_;
+  absl::flat_hash_map<std::pair<const IssuerKey*, absl::string_view>, size_t>
+      group_indices_;
+  // The group of each item, or kNoGroup.
+  std::vector<size_t> item_groups_;
+  size_t num_positions_ = 0;
+  // The item at each position.
+  std::vector<size_t> items_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_BATCH_GROUPING_H_
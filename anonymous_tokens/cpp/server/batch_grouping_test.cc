@@ -0,0 +1,128 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/batch_grouping.h"
+
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+
+namespace anonymous_tokens {
+namespace {
+
+using ::testing::ElementsAre;
+using Part = std::tuple<size_t, size_t, size_t>;
+
+class BatchGroupingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_1, GetStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_2,
+                                     GetAnotherStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        IssuerKeyConfig config_1,
+        MakeIssuerKeyConfig(keys_1, "TEST_USE_CASE", 1,
+                            /*public_metadata_support=*/false));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        IssuerKeyConfig config_2,
+        MakeIssuerKeyConfig(keys_2, "TEST_USE_CASE", 2,
+                            /*public_metadata_support=*/true));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        key_1_, IssuerKey::New(config_1.public_key, config_1.private_key));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        key_2_, IssuerKey::New(config_2.public_key, config_2.private_key));
+  }
+
+  // Groups six items, of which item 5 is left out, into
+  // {0, 2}: (key_1_, ""), {1, 4}: (key_2_, "a") and {3}: (key_2_, "b").
+  void AddItems(BatchGrouping &groups) {
+    EXPECT_EQ(groups.Add(0, key_1_.get(), ""), 0);
+    EXPECT_EQ(groups.Add(1, key_2_.get(), "a"), 1);
+    EXPECT_EQ(groups.Add(2, key_1_.get(), ""), 0);
+    EXPECT_EQ(groups.Add(3, key_2_.get(), "b"), 2);
+    EXPECT_EQ(groups.Add(4, key_2_.get(), "a"), 1);
+  }
+
+  std::vector<Part> PartsIn(const BatchGrouping &groups, size_t begin,
+                            size_t end) {
+    std::vector<Part> parts;
+    groups.ForEachGroupIn(begin, end,
+                          [&parts](size_t group, size_t part_begin,
+                                   size_t part_end) {
+                            parts.emplace_back(group, part_begin, part_end);
+                          });
+    return parts;
+  }
+
+  std::unique_ptr<IssuerKey> key_1_;
+  std::unique_ptr<IssuerKey> key_2_;
+};
+
+TEST_F(BatchGroupingTest, NumbersGroupsInTheOrderTheyAreSeen) {
+  BatchGrouping groups(6);
+  AddItems(groups);
+
+  EXPECT_EQ(groups.num_groups(), 3);
+  EXPECT_EQ(groups.num_positions(), 5);
+  EXPECT_EQ(&groups.key(0), key_1_.get());
+  EXPECT_EQ(groups.public_metadata(0), "");
+  EXPECT_EQ(&groups.key(1), key_2_.get());
+  EXPECT_EQ(groups.public_metadata(1), "a");
+  EXPECT_EQ(&groups.key(2), key_2_.get());
+  EXPECT_EQ(groups.public_metadata(2), "b");
+}
+
+TEST_F(BatchGroupingTest, OrderMakesEveryGroupContiguous) {
+  BatchGrouping groups(6);
+  AddItems(groups);
+  groups.Order();
+
+  std::vector<size_t> items;
+  for (size_t position = 0; position < groups.num_positions(); ++position) {
+    items.push_back(groups.item_at(position));
+  }
+  EXPECT_THAT(items, ElementsAre(0, 2, 1, 4, 3));
+}
+
+TEST_F(BatchGroupingTest, ForEachGroupInSplitsAtGroupBoundaries) {
+  BatchGrouping groups(6);
+  AddItems(groups);
+  groups.Order();
+
+  EXPECT_THAT(PartsIn(groups, 0, 5),
+              ElementsAre(Part(0, 0, 2), Part(1, 2, 4), Part(2, 4, 5)));
+  EXPECT_THAT(PartsIn(groups, 1, 3), ElementsAre(Part(0, 1, 2), Part(1, 2, 3)));
+  EXPECT_THAT(PartsIn(groups, 4, 5), ElementsAre(Part(2, 4, 5)));
+  EXPECT_THAT(PartsIn(groups, 3, 3), ElementsAre());
+}
+
+TEST_F(BatchGroupingTest, EmptyBatchHasNoPositions) {
+  BatchGrouping groups(2);
+  groups.Order();
+
+  EXPECT_EQ(groups.num_groups(), 0);
+  EXPECT_EQ(groups.num_positions(), 0);
+  EXPECT_THAT(PartsIn(groups, 0, 0), ElementsAre());
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
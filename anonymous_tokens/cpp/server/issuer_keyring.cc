@@ -0,0 +1,232 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/cpp/shared/proto_utils.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/bn.h>
+#include <openssl/digest.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+
+namespace {
+
+// Returns whether the big-endian encodings 'a' and 'b' hold the same number.
+absl::StatusOr<bool> SameNumber(absl::string_view a, absl::string_view b) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> a_bn,
+                               StringToBignum(a));
+  ANON_TOKENS_ASSIGN_OR_RETURN(bssl::UniquePtr<BIGNUM> b_bn,
+                               StringToBignum(b));
+  return BN_cmp(a_bn.get(), b_bn.get()) == 0;
+}
+
+}  // namespace
+
+IssuerKey::IssuerKey(RSABlindSignaturePublicKey public_key,
+                     RSAPublicKey rsa_public_key, std::string der_public_key,
+                     std::string token_key_id, absl::Time validity_start,
+                     absl::Time expiration,
+                     std::unique_ptr<RsaBlindSigner> signer,
+                     std::unique_ptr<RsaSsaPssVerifier> verifier,
+                     std::unique_ptr<RsaPrivateKeyDeriver> key_deriver)
+    : public_key_(std::move(public_key)),
+      rsa_public_key_(std::move(rsa_public_key)),
+      der_public_key_(std::move(der_public_key)),
+      token_key_id_(std::move(token_key_id)),
+      validity_start_(validity_start),
+      expiration_(expiration),
+      signer_(std::move(signer)),
+      verifier_(std::move(verifier)),
+      key_deriver_(std::move(key_deriver)) {}
+
+absl::StatusOr<std::unique_ptr<IssuerKey>> IssuerKey::New(
+    const RSABlindSignaturePublicKey& public_key,
+    const RSAPrivateKey& private_key) {
+  if (!ParseUseCase(public_key.use_case()).ok()) {
+    return absl::InvalidArgumentError("Invalid use case for public key.");
+  } else if (public_key.key_version() <= 0) {
+    return absl::InvalidArgumentError(
+        "Key version cannot be zero or negative.");
+  }
+  // Owned by BoringSSL.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const EVP_MD* sig_hash,
+      ProtoHashTypeToEVPDigest(public_key.sig_hash_type()));
+  // Owned by BoringSSL.
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const EVP_MD* mgf1_hash,
+      ProtoMaskGenFunctionToEVPDigest(public_key.mask_gen_function()));
+
+  RSAPublicKey rsa_public_key;
+  if (!rsa_public_key.ParseFromString(public_key.serialized_public_key())) {
+    return absl::InvalidArgumentError("Public key is malformed.");
+  }
+  if (rsa_public_key.n().size() != static_cast<size_t>(public_key.key_size())) {
+    return absl::InvalidArgumentError(
+        "Public key size does not match key size.");
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(bool same_n,
+                               SameNumber(rsa_public_key.n(), private_key.n()));
+  ANON_TOKENS_ASSIGN_OR_RETURN(bool same_e,
+                               SameNumber(rsa_public_key.e(), private_key.e()));
+  if (!same_n || !same_e) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Private key does not match the public key of use case ",
+        public_key.use_case(), " version ", public_key.key_version(), "."));
+  }
+
+  absl::Time validity_start = absl::InfinitePast();
+  absl::Time expiration = absl::InfiniteFuture();
+  if (public_key.has_key_validity_start_time()) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        validity_start, TimeFromProto(public_key.key_validity_start_time()));
+  }
+  if (public_key.has_expiration_time()) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(expiration,
+                                 TimeFromProto(public_key.expiration_time()));
+  }
+  if (expiration <= validity_start) {
+    return absl::InvalidArgumentError(
+        "Key must expire after it becomes valid.");
+  }
+
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      bssl::UniquePtr<RSA> rsa,
+      CreatePublicKeyRSA(rsa_public_key.n(), rsa_public_key.e()));
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::string der_public_key,
+                               RsaSsaPssPublicKeyToDerEncoding(rsa.get()));
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::string token_key_id,
+                               ComputeHash(der_public_key, *EVP_sha256()));
+
+  std::unique_ptr<RsaBlindSigner> signer;
+  std::unique_ptr<RsaSsaPssVerifier> verifier;
+  std::unique_ptr<RsaPrivateKeyDeriver> key_deriver;
+  if (public_key.public_metadata_support()) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        key_deriver,
+        RsaPrivateKeyDeriver::New(private_key,
+                                  /*use_rsa_public_exponent=*/false));
+  } else {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        signer,
+        RsaBlindSigner::New(private_key, /*use_rsa_public_exponent=*/false));
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        verifier, RsaSsaPssVerifier::New(public_key.salt_length(), sig_hash,
+                                         mgf1_hash, rsa_public_key,
+                                         /*use_rsa_public_exponent=*/false));
+  }
+  return absl::WrapUnique(new IssuerKey(
+      public_key, std::move(rsa_public_key), std::move(der_public_key),
+      std::move(token_key_id), validity_start, expiration, std::move(signer),
+      std::move(verifier), std::move(key_deriver)));
+}
+
+absl::StatusOr<std::unique_ptr<IssuerKeyring>> IssuerKeyring::New(
+    absl::Span<const IssuerKeyConfig> keys) {
+  auto keyring = absl::WrapUnique(new IssuerKeyring());
+  keyring->keys_.reserve(keys.size());
+  keyring->key_pointers_.reserve(keys.size());
+  for (const IssuerKeyConfig& config : keys) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        std::unique_ptr<IssuerKey> key,
+        IssuerKey::New(config.public_key, config.private_key));
+    const IssuerKey* key_ptr = key.get();
+    if (!keyring->by_version_[key->use_case()]
+             .emplace(key->key_version(), key_ptr)
+             .second) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Duplicate key version ", key->key_version(),
+                       " for use case ", key->use_case(), "."));
+    }
+    if (!keyring->by_token_key_id_.emplace(key->token_key_id(), key_ptr)
+             .second) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Public key of use case ", key->use_case(), " version ",
+          key->key_version(), " is already in the keyring."));
+    }
+    keyring->by_use_case_[key->use_case()].push_back(key_ptr);
+    keyring->by_truncated_token_key_id_[key->truncated_token_key_id()]
+        .push_back(key_ptr);
+    keyring->key_pointers_.push_back(key_ptr);
+    keyring->keys_.push_back(std::move(key));
+  }
+
+  const auto by_decreasing_version = [](const IssuerKey* a,
+                                        const IssuerKey* b) {
+    return a->key_version() > b->key_version();
+  };
+  for (auto& [use_case, use_case_keys] : keyring->by_use_case_) {
+    std::sort(use_case_keys.begin(), use_case_keys.end(),
+              by_decreasing_version);
+  }
+  for (std::vector<const IssuerKey*>& candidates :
+       keyring->by_truncated_token_key_id_) {
+    std::sort(candidates.begin(), candidates.end(), by_decreasing_version);
+  }
+  return keyring;
+}
+
+const IssuerKey* IssuerKeyring::FindByVersion(absl::string_view use_case,
+                                              int64_t key_version) const {
+  const auto versions = by_version_.find(use_case);
+  if (versions == by_version_.end()) {
+    return nullptr;
+  }
+  const auto key = versions->second.find(key_version);
+  return key == versions->second.end() ? nullptr : key->second;
+}
+
+const IssuerKey* IssuerKeyring::FindByTokenKeyId(
+    absl::string_view token_key_id) const {
+  const auto key = by_token_key_id_.find(token_key_id);
+  return key == by_token_key_id_.end() ? nullptr : key->second;
+}
+
+const IssuerKey* IssuerKeyring::FindSigningKey(absl::string_view use_case,
+                                               absl::Time time) const {
+  const auto use_case_keys = by_use_case_.find(use_case);
+  if (use_case_keys == by_use_case_.end()) {
+    return nullptr;
+  }
+  for (const IssuerKey* key : use_case_keys->second) {
+    if (key->IsValidAt(time)) {
+      return key;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace anonymous_tokens
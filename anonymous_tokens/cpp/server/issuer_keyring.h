@@ -0,0 +1,175 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_ISSUER_KEYRING_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_ISSUER_KEYRING_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/crypto/rsa_blind_signer.h"
+#include "anonymous_tokens/cpp/crypto/rsa_private_key_deriver.h"
+#include "anonymous_tokens/cpp/crypto/rsa_ssa_pss_verifier.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+
+// A signing key of an issuer together with everything an issuer derives from
+// it: the Privacy Pass token key id, the DER encoding of the public key, the
+// validity window and the signer and verifier contexts.
+//
+// Immutable after construction and safe to use from multiple threads.
+class IssuerKey {
+ public:
+  // Validates that 'private_key' is the key of 'public_key' and precomputes
+  // the values above.
+  //
+  // If public_key.public_metadata_support() is true, the key gets an
+  // RsaPrivateKeyDeriver to build the signer for each public metadata value.
+  // Otherwise it gets a single RsaBlindSigner and RsaSsaPssVerifier without
+  // public metadata.
+  static absl::StatusOr<std::unique_ptr<IssuerKey>> New(
+      const RSABlindSignaturePublicKey& public_key,
+      const RSAPrivateKey& private_key);
+
+  IssuerKey(const IssuerKey&) = delete;
+  IssuerKey& operator=(const IssuerKey&) = delete;
+
+  // Returns whether the key may be used at 'time', i.e. whether 'time' lies in
+  // [key_validity_start_time, expiration_time). An unset start or expiration
+  // time leaves that side of the window open.
+  bool IsValidAt(absl::Time time) const {
+    return validity_start_ <= time && time < expiration_;
+  }
+
+  const RSABlindSignaturePublicKey& public_key() const { return public_key_; }
+  const RSAPublicKey& rsa_public_key() const { return rsa_public_key_; }
+  absl::string_view use_case() const { return public_key_.use_case(); }
+  int64_t key_version() const { return public_key_.key_version(); }
+
+  // The RSASSA-PSS SubjectPublicKeyInfo of the key as computed by
+  // RsaSsaPssPublicKeyToDerEncoding, and its SHA-256 hash, which Privacy Pass
+  // uses as token_key_id.
+  const std::string& der_public_key() const { return der_public_key_; }
+  const std::string& token_key_id() const { return token_key_id_; }
+  // The last byte of token_key_id, which a Privacy Pass TokenRequest carries.
+  uint8_t truncated_token_key_id() const {
+    return static_cast<uint8_t>(token_key_id_.back());
+  }
+
+  absl::Time validity_start() const { return validity_start_; }
+  absl::Time expiration() const { return expiration_; }
+
+  // The signer of a key without public metadata support, nullptr otherwise.
+  const RsaBlindSigner* signer() const { return signer_.get(); }
+  // The verifier of a key without public metadata support, nullptr otherwise.
+  // RsaSsaPssVerifier::Verify is thread-safe.
+  RsaSsaPssVerifier* verifier() const { return verifier_.get(); }
+  // The key deriver of a key with public metadata support, nullptr otherwise.
+  const RsaPrivateKeyDeriver* key_deriver() const { return key_deriver_.get(); }
+
+ private:
+  // Use New to construct.
+  IssuerKey(RSABlindSignaturePublicKey public_key, RSAPublicKey rsa_public_key,
+            std::string der_public_key, std::string token_key_id,
+            absl::Time validity_start, absl::Time expiration,
+            std::unique_ptr<RsaBlindSigner> signer,
+            std::unique_ptr<RsaSsaPssVerifier> verifier,
+            std::unique_ptr<RsaPrivateKeyDeriver> key_deriver);
+
+  const RSABlindSignaturePublicKey public_key_;
+  const RSAPublicKey rsa_public_key_;
+  const std::string der_public_key_;
+  const std::string token_key_id_;
+  const absl::Time validity_start_;
+  const absl::Time expiration_;
+  const std::unique_ptr<RsaBlindSigner> signer_;
+  const std::unique_ptr<RsaSsaPssVerifier> verifier_;
+  const std::unique_ptr<RsaPrivateKeyDeriver> key_deriver_;
+};
+
+// A signing key and its public key, as loaded by an issuer.
+struct IssuerKeyConfig {
+  RSABlindSignaturePublicKey public_key;
+  RSAPrivateKey private_key;
+};
+
+// The set of signing keys of an issuer, indexed for the lookups requests need.
+//
+// All per-key work happens in New. The lookups below do not allocate and take
+// constant time, except FindSigningKey, which is linear in the number of
+// versions of one use case.
+//
+// Immutable after construction and safe to use from multiple threads.
+class IssuerKeyring {
+ public:
+  // Builds the IssuerKey of every entry of 'keys'. Fails if any key is invalid,
+  // if two keys share a (use_case, key_version) pair, or if two entries hold
+  // the same public key.
+  static absl::StatusOr<std::unique_ptr<IssuerKeyring>> New(
+      absl::Span<const IssuerKeyConfig> keys);
+
+  IssuerKeyring(const IssuerKeyring&) = delete;
+  IssuerKeyring& operator=(const IssuerKeyring&) = delete;
+
+  // Returns the key with the given use case and version, or nullptr.
+  const IssuerKey* FindByVersion(absl::string_view use_case,
+                                 int64_t key_version) const;
+
+  // Returns the key whose token_key_id is 'token_key_id', or nullptr.
+  const IssuerKey* FindByTokenKeyId(absl::string_view token_key_id) const;
+
+  // Returns all keys whose token_key_id ends in 'truncated_token_key_id'.
+  // Distinct keys may share the truncated id, so callers must be prepared for
+  // more than one candidate. The keys are ordered by decreasing key version.
+  absl::Span<const IssuerKey* const> FindByTruncatedTokenKeyId(
+      uint8_t truncated_token_key_id) const {
+    return by_truncated_token_key_id_[truncated_token_key_id];
+  }
+
+  // Returns the key with the highest version for 'use_case' that is valid at
+  // 'time', or nullptr if there is none.
+  const IssuerKey* FindSigningKey(absl::string_view use_case,
+                                  absl::Time time) const;
+
+  // All keys, in the order they were passed to New.
+  absl::Span<const IssuerKey* const> keys() const { return key_pointers_; }
+
+ private:
+  // Use New to construct.
+  IssuerKeyring() = default;
+
+  std::vector<std::unique_ptr<const IssuerKey>> keys_;
+  std::vector<const IssuerKey*> key_pointers_;
+  // Keys of each use case, keyed by version.
+  absl::flat_hash_map<std::string,
+                      absl::flat_hash_map<int64_t, const IssuerKey*>>
+      by_version_;
+  // Keys of each use case, ordered by decreasing version.
+  absl::flat_hash_map<std::string, std::vector<const IssuerKey*>> by_use_case_;
+  absl::flat_hash_map<std::string, const IssuerKey*> by_token_key_id_;
+  std::array<std::vector<const IssuerKey*>, 256> by_truncated_token_key_id_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_ISSUER_KEYRING_H_
@@ -0,0 +1,300 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/crypto/anonymous_tokens_pb_openssl_converters.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include <openssl/digest.h>
+#include <openssl/rsa.h>
+
+namespace anonymous_tokens {
+namespace {
+
+using ::testing::ElementsAre;
+
+const absl::Time kNow = absl::FromUnixSeconds(1700000000);
+
+class IssuerKeyringTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keys_1_, GetStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keys_2_, GetAnotherStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(keys_3_, GetStrongRsaKeys3072());
+  }
+
+  std::pair<RSAPublicKey, RSAPrivateKey> keys_1_;
+  std::pair<RSAPublicKey, RSAPrivateKey> keys_2_;
+  std::pair<RSAPublicKey, RSAPrivateKey> keys_3_;
+};
+
+TEST_F(IssuerKeyringTest, PrecomputesTokenKeyIds) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      IssuerKeyConfig config,
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IssuerKey> key,
+      IssuerKey::New(config.public_key, config.private_key));
+
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      bssl::UniquePtr<RSA> rsa,
+      CreatePublicKeyRSA(keys_1_.first.n(), keys_1_.first.e()));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string der,
+                                   RsaSsaPssPublicKeyToDerEncoding(rsa.get()));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string token_key_id,
+                                   ComputeHash(der, *EVP_sha256()));
+  EXPECT_EQ(key->der_public_key(), der);
+  EXPECT_EQ(key->token_key_id(), token_key_id);
+  EXPECT_EQ(key->truncated_token_key_id(),
+            static_cast<uint8_t>(token_key_id.back()));
+  EXPECT_EQ(key->rsa_public_key().n(), keys_1_.first.n());
+  EXPECT_EQ(key->use_case(), "TEST_USE_CASE");
+  EXPECT_EQ(key->key_version(), 1);
+}
+
+TEST_F(IssuerKeyringTest, SignerContextFollowsPublicMetadataSupport) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      IssuerKeyConfig with_metadata,
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      IssuerKeyConfig without_metadata,
+      MakeIssuerKeyConfig(keys_2_, "TEST_USE_CASE", 2,
+                          /*public_metadata_support=*/false));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IssuerKey> key_with_metadata,
+      IssuerKey::New(with_metadata.public_key, with_metadata.private_key));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IssuerKey> key_without_metadata,
+      IssuerKey::New(without_metadata.public_key,
+                     without_metadata.private_key));
+
+  ASSERT_NE(key_with_metadata->key_deriver(), nullptr);
+  EXPECT_EQ(key_with_metadata->signer(), nullptr);
+  EXPECT_EQ(key_with_metadata->key_deriver()->modulus(), keys_1_.first.n());
+  EXPECT_EQ(key_with_metadata->verifier(), nullptr);
+  ASSERT_NE(key_without_metadata->signer(), nullptr);
+  ASSERT_NE(key_without_metadata->verifier(), nullptr);
+  EXPECT_EQ(key_without_metadata->key_deriver(), nullptr);
+
+  std::string blinded_message(keys_2_.first.n().size(), '\x11');
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string signature,
+      key_without_metadata->signer()->Sign(blinded_message));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      bssl::UniquePtr<RSA> rsa_private_key,
+      AnonymousTokensRSAPrivateKeyToRSA(keys_2_.second));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string expected, TestSign(blinded_message, rsa_private_key.get()));
+  EXPECT_EQ(signature, expected);
+
+  // A signature on the encoded message is a token the verifier accepts.
+  const std::string message = "message";
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string encoded_message,
+      EncodeMessageForTests(message, keys_2_.first, EVP_sha384(), EVP_sha384(),
+                            kSaltLengthInBytes48));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::string token,
+      key_without_metadata->signer()->Sign(encoded_message));
+  EXPECT_TRUE(key_without_metadata->verifier()->Verify(token, message).ok());
+  EXPECT_FALSE(
+      key_without_metadata->verifier()->Verify(token, "other message").ok());
+}
+
+TEST_F(IssuerKeyringTest, FindsKeysByEveryIndex) {
+  std::vector<IssuerKeyConfig> configs(3);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[0],
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[1],
+      MakeIssuerKeyConfig(keys_2_, "TEST_USE_CASE", 2,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[2], MakeIssuerKeyConfig(keys_3_, "TEST_USE_CASE_2", 1,
+                                      /*public_metadata_support=*/false));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IssuerKeyring> keyring,
+                                   IssuerKeyring::New(configs));
+  ASSERT_EQ(keyring->keys().size(), 3);
+
+  for (const IssuerKey *key : keyring->keys()) {
+    EXPECT_EQ(keyring->FindByVersion(key->use_case(), key->key_version()), key);
+    EXPECT_EQ(keyring->FindByTokenKeyId(key->token_key_id()), key);
+    EXPECT_THAT(keyring->FindByTruncatedTokenKeyId(
+                    key->truncated_token_key_id()),
+                ::testing::Contains(key));
+  }
+  EXPECT_EQ(keyring->keys()[0]->rsa_public_key().n(), keys_1_.first.n());
+  EXPECT_EQ(keyring->keys()[2]->rsa_public_key().n(), keys_3_.first.n());
+
+  EXPECT_EQ(keyring->FindByVersion("TEST_USE_CASE", 3), nullptr);
+  EXPECT_EQ(keyring->FindByVersion("TEST_USE_CASE_3", 1), nullptr);
+  EXPECT_EQ(keyring->FindByTokenKeyId(std::string(32, 'x')), nullptr);
+  EXPECT_EQ(keyring->FindByTokenKeyId(""), nullptr);
+
+  size_t num_candidates = 0;
+  for (int truncated_id = 0; truncated_id < 256; ++truncated_id) {
+    num_candidates += keyring->FindByTruncatedTokenKeyId(truncated_id).size();
+  }
+  EXPECT_EQ(num_candidates, 3);
+}
+
+TEST_F(IssuerKeyringTest, FindSigningKeyUsesValidityWindows) {
+  std::vector<IssuerKeyConfig> configs(3);
+  // Version 1 expires in an hour, version 2 became valid a minute ago and
+  // version 3 only becomes valid in a day.
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[0], MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                                      /*public_metadata_support=*/true,
+                                      AT_MESSAGE_MASK_CONCAT,
+                                      absl::InfinitePast(),
+                                      kNow + absl::Hours(1)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[1], MakeIssuerKeyConfig(keys_2_, "TEST_USE_CASE", 2,
+                                      /*public_metadata_support=*/true,
+                                      AT_MESSAGE_MASK_CONCAT,
+                                      kNow - absl::Minutes(1),
+                                      kNow + absl::Hours(48)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[2], MakeIssuerKeyConfig(keys_3_, "TEST_USE_CASE", 3,
+                                      /*public_metadata_support=*/true,
+                                      AT_MESSAGE_MASK_CONCAT,
+                                      kNow + absl::Hours(24)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IssuerKeyring> keyring,
+                                   IssuerKeyring::New(configs));
+
+  const IssuerKey *version_1 = keyring->FindByVersion("TEST_USE_CASE", 1);
+  const IssuerKey *version_2 = keyring->FindByVersion("TEST_USE_CASE", 2);
+  const IssuerKey *version_3 = keyring->FindByVersion("TEST_USE_CASE", 3);
+  EXPECT_EQ(keyring->FindSigningKey("TEST_USE_CASE", kNow - absl::Hours(1)),
+            version_1);
+  EXPECT_EQ(keyring->FindSigningKey("TEST_USE_CASE", kNow), version_2);
+  EXPECT_EQ(keyring->FindSigningKey("TEST_USE_CASE", kNow + absl::Hours(24)),
+            version_3);
+  EXPECT_EQ(keyring->FindSigningKey("TEST_USE_CASE_2", kNow), nullptr);
+
+  EXPECT_TRUE(version_1->IsValidAt(kNow));
+  EXPECT_FALSE(version_1->IsValidAt(kNow + absl::Hours(1)));
+  EXPECT_FALSE(version_2->IsValidAt(kNow - absl::Minutes(2)));
+  EXPECT_EQ(version_3->expiration(), absl::InfiniteFuture());
+}
+
+TEST_F(IssuerKeyringTest, TruncatedIdCandidatesAreOrderedByVersion) {
+  std::vector<IssuerKeyConfig> configs(2);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[0],
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[1], MakeIssuerKeyConfig(keys_2_, "TEST_USE_CASE_2", 7,
+                                      /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IssuerKeyring> keyring,
+                                   IssuerKeyring::New(configs));
+  const IssuerKey *version_1 = keyring->keys()[0];
+  const IssuerKey *version_7 = keyring->keys()[1];
+  if (version_1->truncated_token_key_id() ==
+      version_7->truncated_token_key_id()) {
+    EXPECT_THAT(keyring->FindByTruncatedTokenKeyId(
+                    version_1->truncated_token_key_id()),
+                ElementsAre(version_7, version_1));
+  } else {
+    EXPECT_THAT(keyring->FindByTruncatedTokenKeyId(
+                    version_1->truncated_token_key_id()),
+                ElementsAre(version_1));
+    EXPECT_THAT(keyring->FindByTruncatedTokenKeyId(
+                    version_7->truncated_token_key_id()),
+                ElementsAre(version_7));
+  }
+}
+
+TEST_F(IssuerKeyringTest, RejectsDuplicateVersions) {
+  std::vector<IssuerKeyConfig> configs(2);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[0],
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[1],
+      MakeIssuerKeyConfig(keys_2_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  EXPECT_EQ(IssuerKeyring::New(configs).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(IssuerKeyringTest, RejectsDuplicatePublicKeys) {
+  std::vector<IssuerKeyConfig> configs(2);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[0],
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      configs[1],
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 2,
+                          /*public_metadata_support=*/true));
+  EXPECT_EQ(IssuerKeyring::New(configs).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST_F(IssuerKeyringTest, RejectsInvalidKeys) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      IssuerKeyConfig config,
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true));
+
+  IssuerKeyConfig mismatched_private_key = config;
+  mismatched_private_key.private_key = keys_2_.second;
+  IssuerKeyConfig invalid_use_case = config;
+  invalid_use_case.public_key.set_use_case("NOT_A_USE_CASE");
+  IssuerKeyConfig invalid_version = config;
+  invalid_version.public_key.set_key_version(0);
+  IssuerKeyConfig malformed_public_key = config;
+  malformed_public_key.public_key.set_serialized_public_key("\xff\xff");
+  IssuerKeyConfig wrong_key_size = config;
+  wrong_key_size.public_key.set_key_size(384);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      IssuerKeyConfig expires_before_start,
+      MakeIssuerKeyConfig(keys_1_, "TEST_USE_CASE", 1,
+                          /*public_metadata_support=*/true,
+                          AT_MESSAGE_MASK_CONCAT, kNow, kNow));
+
+  for (const IssuerKeyConfig &invalid :
+       {mismatched_private_key, invalid_use_case, invalid_version,
+        malformed_public_key, wrong_key_size, expires_before_start}) {
+    EXPECT_EQ(IssuerKey::New(invalid.public_key, invalid.private_key)
+                  .status()
+                  .code(),
+              absl::StatusCode::kInvalidArgument)
+        << invalid.public_key.DebugString();
+  }
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
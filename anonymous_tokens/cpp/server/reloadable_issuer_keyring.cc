@@ -0,0 +1,53 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+
+#include <memory>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+
+namespace anonymous_tokens {
+
+ReloadableIssuerKeyring::ReloadableIssuerKeyring(
+    std::unique_ptr<const IssuerKeyring> keyring)
+    : keyring_(std::move(keyring)) {}
+
+absl::StatusOr<std::unique_ptr<ReloadableIssuerKeyring>>
+ReloadableIssuerKeyring::New(absl::Span<const IssuerKeyConfig> keys) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::unique_ptr<IssuerKeyring> keyring,
+                               IssuerKeyring::New(keys));
+  return absl::WrapUnique(new ReloadableIssuerKeyring(std::move(keyring)));
+}
+
+absl::Status ReloadableIssuerKeyring::Reload(
+    absl::Span<const IssuerKeyConfig> keys) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::unique_ptr<IssuerKeyring> keyring,
+                               IssuerKeyring::New(keys));
+  Publish(std::move(keyring));
+  return absl::OkStatus();
+}
+
+void ReloadableIssuerKeyring::Publish(
+    std::unique_ptr<const IssuerKeyring> keyring) {
+  keyring_.Publish(std::move(keyring));
+}
+
+}  // namespace anonymous_tokens
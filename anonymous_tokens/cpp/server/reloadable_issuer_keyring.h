@@ -0,0 +1,77 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_RELOADABLE_ISSUER_KEYRING_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_RELOADABLE_ISSUER_KEYRING_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/rcu_pointer.h"
+
+namespace anonymous_tokens {
+
+// An IssuerKeyring whose keys can be rotated while requests are served.
+//
+// Requests take a snapshot of the current keyring with Acquire, which never
+// blocks and costs a few uncontended atomic operations, and use its signers
+// and verifiers for as long as they hold it. Reload builds and validates the
+// new keyring on the calling thread, publishes it atomically, and destroys the
+// previous keyring once the requests that were using it have finished, so
+// requests neither wait for a rotation nor see a half-loaded key set.
+//
+// Thread-safe.
+class ReloadableIssuerKeyring {
+ public:
+  using Snapshot = RcuPointer<IssuerKeyring>::ReadLock;
+
+  // Creates the keyring with the keys in 'keys'. See IssuerKeyring::New.
+  static absl::StatusOr<std::unique_ptr<ReloadableIssuerKeyring>> New(
+      absl::Span<const IssuerKeyConfig> keys);
+
+  ReloadableIssuerKeyring(const ReloadableIssuerKeyring&) = delete;
+  ReloadableIssuerKeyring& operator=(const ReloadableIssuerKeyring&) = delete;
+
+  // Returns the current keyring. Keys found in the snapshot stay valid until
+  // the snapshot is destroyed, which should happen at the end of the request;
+  // holding on to it delays the next Reload.
+  Snapshot Acquire() const { return keyring_.Read(); }
+
+  // Replaces the keyring with one holding the keys in 'keys'. If building the
+  // new keyring fails, the current one stays in place and the error is
+  // returned. Returns once the previous keyring has been destroyed, so it must
+  // not be called while the calling thread holds a Snapshot.
+  absl::Status Reload(absl::Span<const IssuerKeyConfig> keys);
+
+  // Same as Reload with a keyring that the caller has already built.
+  void Publish(std::unique_ptr<const IssuerKeyring> keyring);
+
+  // Returns the number of completed reloads.
+  uint64_t num_reloads() const { return keyring_.num_publishes(); }
+
+ private:
+  // Use New to construct.
+  explicit ReloadableIssuerKeyring(
+      std::unique_ptr<const IssuerKeyring> keyring);
+
+  RcuPointer<IssuerKeyring> keyring_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_RELOADABLE_ISSUER_KEYRING_H_
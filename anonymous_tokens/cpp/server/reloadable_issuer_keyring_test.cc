@@ -0,0 +1,159 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/reloadable_issuer_keyring.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/testing/proto_utils.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+
+namespace anonymous_tokens {
+namespace {
+
+class ReloadableIssuerKeyringTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_1, GetStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(auto keys_2,
+                                     GetAnotherStrongRsaKeys2048());
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        version_1_,
+        MakeIssuerKeyConfig(keys_1, "TEST_USE_CASE", 1,
+                            /*public_metadata_support=*/false));
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        version_2_,
+        MakeIssuerKeyConfig(keys_2, "TEST_USE_CASE", 2,
+                            /*public_metadata_support=*/false));
+    blinded_message_ = std::string(keys_1.first.n().size(), '\x11');
+  }
+
+  IssuerKeyConfig version_1_;
+  IssuerKeyConfig version_2_;
+  std::string blinded_message_;
+};
+
+TEST_F(ReloadableIssuerKeyringTest, ReloadReplacesTheKeys) {
+  std::vector<IssuerKeyConfig> initial_keys = {version_1_};
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ReloadableIssuerKeyring> keyring,
+      ReloadableIssuerKeyring::New(initial_keys));
+  {
+    ReloadableIssuerKeyring::Snapshot snapshot = keyring->Acquire();
+    EXPECT_NE(snapshot->FindByVersion("TEST_USE_CASE", 1), nullptr);
+    EXPECT_EQ(snapshot->FindByVersion("TEST_USE_CASE", 2), nullptr);
+  }
+
+  std::vector<IssuerKeyConfig> rotated_keys = {version_1_, version_2_};
+  ASSERT_TRUE(keyring->Reload(rotated_keys).ok());
+  EXPECT_EQ(keyring->num_reloads(), 1);
+  ReloadableIssuerKeyring::Snapshot snapshot = keyring->Acquire();
+  EXPECT_EQ(snapshot->FindSigningKey("TEST_USE_CASE", absl::Now())
+                ->key_version(),
+            2);
+}
+
+TEST_F(ReloadableIssuerKeyringTest, FailedReloadKeepsTheCurrentKeys) {
+  std::vector<IssuerKeyConfig> initial_keys = {version_1_};
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ReloadableIssuerKeyring> keyring,
+      ReloadableIssuerKeyring::New(initial_keys));
+  IssuerKeyConfig invalid = version_2_;
+  invalid.private_key = version_1_.private_key;
+  std::vector<IssuerKeyConfig> invalid_keys = {invalid};
+
+  EXPECT_EQ(keyring->Reload(invalid_keys).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(keyring->num_reloads(), 0);
+  EXPECT_NE(keyring->Acquire()->FindByVersion("TEST_USE_CASE", 1), nullptr);
+}
+
+TEST_F(ReloadableIssuerKeyringTest, SnapshotKeepsItsKeysAcrossReloads) {
+  std::vector<IssuerKeyConfig> initial_keys = {version_1_};
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ReloadableIssuerKeyring> keyring,
+      ReloadableIssuerKeyring::New(initial_keys));
+  ReloadableIssuerKeyring::Snapshot snapshot = keyring->Acquire();
+  const IssuerKey *key = snapshot->FindByVersion("TEST_USE_CASE", 1);
+  ASSERT_NE(key, nullptr);
+
+  absl::Notification reloaded;
+  std::thread reloader([&] {
+    std::vector<IssuerKeyConfig> rotated_keys = {version_2_};
+    EXPECT_TRUE(keyring->Reload(rotated_keys).ok());
+    reloaded.Notify();
+  });
+  // New snapshots see the new keys as soon as they are published...
+  while (keyring->Acquire()->FindByVersion("TEST_USE_CASE", 2) == nullptr) {
+    std::this_thread::yield();
+  }
+  // ...while the old keys stay usable until this snapshot goes away.
+  EXPECT_FALSE(reloaded.HasBeenNotified());
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::string signature,
+                                   key->signer()->Sign(blinded_message_));
+  EXPECT_EQ(signature.size(), blinded_message_.size());
+
+  { ReloadableIssuerKeyring::Snapshot released = std::move(snapshot); }
+  reloader.join();
+  EXPECT_TRUE(reloaded.HasBeenNotified());
+  EXPECT_EQ(keyring->Acquire()->FindByVersion("TEST_USE_CASE", 1), nullptr);
+}
+
+TEST_F(ReloadableIssuerKeyringTest, SignsAndVerifiesWhileKeysRotate) {
+  std::vector<IssuerKeyConfig> keys = {version_1_, version_2_};
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ReloadableIssuerKeyring> keyring,
+      ReloadableIssuerKeyring::New(keys));
+  std::atomic<bool> stop{false};
+  std::atomic<int> num_signatures{0};
+  std::vector<std::thread> signers;
+  for (int i = 0; i < 3; ++i) {
+    signers.emplace_back([&] {
+      while (!stop.load()) {
+        ReloadableIssuerKeyring::Snapshot snapshot = keyring->Acquire();
+        const IssuerKey *key =
+            snapshot->FindSigningKey("TEST_USE_CASE", absl::Now());
+        ASSERT_NE(key, nullptr);
+        EXPECT_TRUE(key->signer()->Sign(blinded_message_).ok());
+        num_signatures.fetch_add(1);
+      }
+    });
+  }
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(keyring->Reload(keys).ok());
+  }
+  while (num_signatures.load() < 10) {
+    std::this_thread::yield();
+  }
+  stop = true;
+  for (std::thread &signer : signers) {
+    signer.join();
+  }
+  EXPECT_EQ(keyring->num_reloads(), 5);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
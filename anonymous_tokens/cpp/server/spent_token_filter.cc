@@ -0,0 +1,149 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/spent_token_filter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/numeric/int128.h"
+#include "absl/synchronization/mutex.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+namespace anonymous_tokens {
+
+namespace {
+
+// Odd multipliers that pick the bit of each word, from the split block Bloom
+// filters of Apache Parquet.
+constexpr uint32_t kSalts[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+                                0xa2b7289dU, 0x705495c7U, 0x2df1424bU,
+                                0x9efc4947U, 0x5c6bfb31U};
+
+// Returns the bit of word 'i' for a fingerprint. Fingerprints are uniformly
+// distributed, so their bits are used directly: the low half picks the block
+// and the high half the bits within it.
+uint64_t BitInWord(const SpentTokenHash& hash, int i) {
+  return uint64_t{1} << ((static_cast<uint32_t>(hash.high) * kSalts[i]) >> 26);
+}
+
+}  // namespace
+
+BlockedBloomFilter::BlockedBloomFilter(int64_t expected_tokens,
+                                       int bits_per_token)
+    : num_blocks_(std::max<size_t>(
+          1, (static_cast<size_t>(expected_tokens) * bits_per_token +
+              8 * sizeof(Block) - 1) /
+                 (8 * sizeof(Block)))),
+      blocks_(std::make_unique<Block[]>(num_blocks_)) {}
+
+BlockedBloomFilter::Block& BlockedBloomFilter::BlockFor(
+    const SpentTokenHash& hash) const {
+  // Maps the low half of the fingerprint to [0, num_blocks_) without a
+  // division.
+  return blocks_[absl::Uint128High64(absl::uint128(hash.low) * num_blocks_)];
+}
+
+void BlockedBloomFilter::Insert(const SpentTokenHash& hash) {
+  Block& block = BlockFor(hash);
+  for (int i = 0; i < 8; ++i) {
+    const uint64_t bit = BitInWord(hash, i);
+    // Skips the write if the bit is set, to keep the cache line shared.
+    if ((block.words[i].load(std::memory_order_relaxed) & bit) == 0) {
+      block.words[i].fetch_or(bit, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool BlockedBloomFilter::MayContain(const SpentTokenHash& hash) const {
+  const Block& block = BlockFor(hash);
+  for (int i = 0; i < 8; ++i) {
+    if ((block.words[i].load(std::memory_order_relaxed) &
+         BitInWord(hash, i)) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+SpentTokenFilter::SpentTokenFilter(int64_t expected_tokens_per_key_version,
+                                   int bits_per_token)
+    : expected_tokens_per_key_version_(expected_tokens_per_key_version),
+      bits_per_token_(bits_per_token),
+      filters_(std::make_unique<FilterMap>()) {}
+
+void SpentTokenFilter::Insert(int64_t key_version,
+                              const SpentTokenHash& hash) {
+  {
+    auto filters = filters_.Read();
+    const auto filter = filters->find(key_version);
+    if (filter != filters->end()) {
+      filter->second->Insert(hash);
+      return;
+    }
+  }
+  // The first token of a key version.
+  absl::MutexLock lock(&mutex_);
+  std::unique_ptr<FilterMap> updated;
+  {
+    auto filters = filters_.Read();
+    const auto filter = filters->find(key_version);
+    if (filter != filters->end()) {
+      filter->second->Insert(hash);
+      return;
+    }
+    updated = std::make_unique<FilterMap>(*filters);
+  }
+  auto filter = std::make_shared<BlockedBloomFilter>(
+      expected_tokens_per_key_version_, bits_per_token_);
+  filter->Insert(hash);
+  updated->emplace(key_version, std::move(filter));
+  filters_.Publish(std::move(updated));
+}
+
+bool SpentTokenFilter::MayContain(int64_t key_version,
+                                  const SpentTokenHash& hash) const {
+  auto filters = filters_.Read();
+  const auto filter = filters->find(key_version);
+  return filter != filters->end() && filter->second->MayContain(hash);
+}
+
+void SpentTokenFilter::ExpireKeyVersion(int64_t key_version) {
+  absl::MutexLock lock(&mutex_);
+  std::unique_ptr<FilterMap> updated;
+  {
+    auto filters = filters_.Read();
+    if (!filters->contains(key_version)) {
+      return;
+    }
+    updated = std::make_unique<FilterMap>(*filters);
+  }
+  updated->erase(key_version);
+  filters_.Publish(std::move(updated));
+}
+
+size_t SpentTokenFilter::memory_usage() const {
+  auto filters = filters_.Read();
+  size_t memory_usage = 0;
+  for (const auto& [key_version, filter] : *filters) {
+    memory_usage += filter->memory_usage();
+  }
+  return memory_usage;
+}
+
+}  // namespace anonymous_tokens
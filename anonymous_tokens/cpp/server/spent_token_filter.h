@@ -0,0 +1,107 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_FILTER_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_FILTER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/shared/rcu_pointer.h"
+
+namespace anonymous_tokens {
+
+// A split block Bloom filter of token fingerprints. Each fingerprint sets one
+// bit in each of the eight words of a single 64-byte block, so both Insert and
+// MayContain touch one cache line. At 16 bits per token, about 0.1% of the
+// tokens that were never inserted are reported as possibly present.
+//
+// Lock-free and thread-safe. A fingerprint is reported as possibly present by
+// every MayContain that happens after its Insert.
+class BlockedBloomFilter {
+ public:
+  // Sizes the filter for 'expected_tokens' at 'bits_per_token' bits each,
+  // rounded up to whole blocks. Both must be positive.
+  BlockedBloomFilter(int64_t expected_tokens, int bits_per_token);
+
+  BlockedBloomFilter(const BlockedBloomFilter&) = delete;
+  BlockedBloomFilter& operator=(const BlockedBloomFilter&) = delete;
+
+  void Insert(const SpentTokenHash& hash);
+
+  // Returns false only if 'hash' was never inserted.
+  bool MayContain(const SpentTokenHash& hash) const;
+
+  size_t memory_usage() const { return num_blocks_ * sizeof(Block); }
+
+ private:
+  struct alignas(64) Block {
+    std::atomic<uint64_t> words[8];
+  };
+
+  Block& BlockFor(const SpentTokenHash& hash) const;
+
+  const size_t num_blocks_;
+  std::unique_ptr<Block[]> blocks_;
+};
+
+// A BlockedBloomFilter per key version, so that the filter of a key epoch is
+// sized for the tokens of that epoch and dropped when the key is retired,
+// instead of filling up with tokens that can no longer be redeemed.
+//
+// Lookups read the set of filters without locks; adding the filter of a new
+// key version or expiring one copies the set. Thread-safe.
+class SpentTokenFilter {
+ public:
+  // Filters of new key versions hold 'expected_tokens_per_key_version' tokens
+  // at 'bits_per_token' bits each. Both must be positive.
+  SpentTokenFilter(int64_t expected_tokens_per_key_version,
+                   int bits_per_token);
+
+  SpentTokenFilter(const SpentTokenFilter&) = delete;
+  SpentTokenFilter& operator=(const SpentTokenFilter&) = delete;
+
+  // Adds 'hash' to the filter of 'key_version', creating it if needed.
+  void Insert(int64_t key_version, const SpentTokenHash& hash);
+
+  // Returns false only if 'hash' was not inserted for 'key_version' since
+  // the key version last expired.
+  bool MayContain(int64_t key_version, const SpentTokenHash& hash) const;
+
+  // Drops the filter of 'key_version'.
+  void ExpireKeyVersion(int64_t key_version);
+
+  // Returns the number of bytes held by the filters.
+  size_t memory_usage() const;
+
+ private:
+  using FilterMap =
+      absl::flat_hash_map<int64_t, std::shared_ptr<BlockedBloomFilter>>;
+
+  const int64_t expected_tokens_per_key_version_;
+  const int bits_per_token_;
+  RcuPointer<FilterMap> filters_;
+  // Serializes changes to 'filters_'.
+  absl::Mutex mutex_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_FILTER_H_
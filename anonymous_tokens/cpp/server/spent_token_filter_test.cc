@@ -0,0 +1,120 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/spent_token_filter.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+namespace anonymous_tokens {
+namespace {
+
+SpentTokenHash Token(int i) {
+  return HashSpentToken(absl::StrCat("token ", i));
+}
+
+TEST(BlockedBloomFilterTest, HasNoFalseNegatives) {
+  BlockedBloomFilter filter(/*expected_tokens=*/10000, /*bits_per_token=*/16);
+  for (int i = 0; i < 10000; ++i) {
+    filter.Insert(Token(i));
+  }
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_TRUE(filter.MayContain(Token(i))) << i;
+  }
+}
+
+TEST(BlockedBloomFilterTest, FalsePositiveRateMatchesItsSize) {
+  BlockedBloomFilter filter(/*expected_tokens=*/10000, /*bits_per_token=*/16);
+  // Rounded up to whole 64-byte blocks.
+  EXPECT_EQ(filter.memory_usage(), 313 * 64);
+  for (int i = 0; i < 10000; ++i) {
+    filter.Insert(Token(i));
+  }
+  int false_positives = 0;
+  for (int i = 10000; i < 110000; ++i) {
+    false_positives += filter.MayContain(Token(i));
+  }
+  // About 0.1% at 16 bits per token.
+  EXPECT_LT(false_positives, 300);
+}
+
+TEST(BlockedBloomFilterTest, OverfullFilterStillHasNoFalseNegatives) {
+  BlockedBloomFilter filter(/*expected_tokens=*/1, /*bits_per_token=*/1);
+  EXPECT_EQ(filter.memory_usage(), 64);
+  for (int i = 0; i < 100; ++i) {
+    filter.Insert(Token(i));
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(filter.MayContain(Token(i))) << i;
+  }
+}
+
+TEST(SpentTokenFilterTest, KeyVersionsAreSeparate) {
+  SpentTokenFilter filter(/*expected_tokens_per_key_version=*/1024,
+                          /*bits_per_token=*/16);
+  EXPECT_EQ(filter.memory_usage(), 0);
+  filter.Insert(1, Token(1));
+  EXPECT_EQ(filter.memory_usage(), 2048);
+  filter.Insert(2, Token(2));
+  EXPECT_EQ(filter.memory_usage(), 4096);
+  EXPECT_TRUE(filter.MayContain(1, Token(1)));
+  EXPECT_TRUE(filter.MayContain(2, Token(2)));
+  EXPECT_FALSE(filter.MayContain(3, Token(1)));
+}
+
+TEST(SpentTokenFilterTest, ExpireKeyVersionDropsItsFilter) {
+  SpentTokenFilter filter(/*expected_tokens_per_key_version=*/1024,
+                          /*bits_per_token=*/16);
+  filter.Insert(1, Token(1));
+  filter.Insert(2, Token(2));
+  filter.ExpireKeyVersion(1);
+  EXPECT_FALSE(filter.MayContain(1, Token(1)));
+  EXPECT_TRUE(filter.MayContain(2, Token(2)));
+  EXPECT_EQ(filter.memory_usage(), 2048);
+  // Expiring a key version without a filter does nothing.
+  filter.ExpireKeyVersion(3);
+  EXPECT_EQ(filter.memory_usage(), 2048);
+}
+
+TEST(SpentTokenFilterTest, ConcurrentInsertsAreAllFound) {
+  SpentTokenFilter filter(/*expected_tokens_per_key_version=*/1 << 12,
+                          /*bits_per_token=*/16);
+  constexpr int kNumThreads = 4;
+  constexpr int kNumTokens = 1 << 12;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      // Every thread creates the filters of some key versions.
+      for (int i = t; i < kNumTokens; i += kNumThreads) {
+        filter.Insert(i % 8, Token(i));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < kNumTokens; ++i) {
+    EXPECT_TRUE(filter.MayContain(i % 8, Token(i))) << i;
+  }
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,627 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/spent_token_log.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+
+namespace anonymous_tokens {
+
+namespace {
+
+constexpr uint32_t kFormatVersion = 2;
+constexpr char kLogMagic[8] = {'A', 'T', 'S', 'P', 'L', 'O', 'G', '1'};
+constexpr char kIndexMagic[8] = {'A', 'T', 'S', 'P', 'I', 'D', 'X', '1'};
+
+// Index slots hold the record index plus one in their low bits, so that zero
+// marks an empty slot, and the leading bits of the token's fingerprint above,
+// so that most mismatches are rejected without reading the record.
+constexpr int kRecordBits = 40;
+constexpr uint64_t kRecordMask = (uint64_t{1} << kRecordBits) - 1;
+constexpr uint64_t kMaxCapacity = kRecordMask;
+
+// The slots start on their own page, after the index header.
+constexpr size_t kIndexSlotsOffset = 4096;
+
+// Fields are in host byte order.
+struct Record {
+  uint64_t hash_high;
+  uint64_t hash_low;
+  int64_t key_version;
+  int64_t expiration_unix_seconds;
+  // Index of the record in the log, so that stale records are not mistaken
+  // for valid ones.
+  uint64_t sequence;
+  uint64_t checksum;
+};
+static_assert(sizeof(Record) == SpentTokenLog::kRecordSize,
+              "Records must match the on-disk layout.");
+
+struct LogHeader {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t record_size;
+  uint64_t capacity;
+  uint64_t checksum;
+  // Random, drawn when the log is created, so that an index is only used
+  // with the log it was built for.
+  uint64_t log_id;
+  char reserved[SpentTokenLog::kHeaderSize - 40];
+};
+static_assert(sizeof(LogHeader) == SpentTokenLog::kHeaderSize,
+              "Log header must match the on-disk layout.");
+
+struct IndexHeader {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t reserved;
+  uint64_t num_slots;
+  uint64_t log_capacity;
+  // Number of leading records of the log that are known to be in the index.
+  uint64_t indexed_records;
+  uint64_t checksum;
+  // log_id of the log that the index was built for.
+  uint64_t log_id;
+  // Checksum of record indexed_records - 1, or zero if indexed_records is.
+  uint64_t last_record_checksum;
+};
+
+uint64_t Mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+uint64_t Checksum(std::initializer_list<uint64_t> words) {
+  uint64_t checksum = 0x9e3779b97f4a7c15ULL;
+  for (uint64_t word : words) {
+    checksum = Mix(checksum ^ word) + 0x9e3779b97f4a7c15ULL;
+  }
+  return checksum;
+}
+
+uint64_t MagicWord(const char (&magic)[8]) {
+  uint64_t word;
+  std::memcpy(&word, magic, sizeof(word));
+  return word;
+}
+
+uint64_t RecordChecksum(const Record& record) {
+  return Checksum({record.hash_high, record.hash_low,
+                   static_cast<uint64_t>(record.key_version),
+                   static_cast<uint64_t>(record.expiration_unix_seconds),
+                   record.sequence});
+}
+
+uint64_t LogHeaderChecksum(const LogHeader& header) {
+  return Checksum({MagicWord(header.magic), header.format_version,
+                   header.record_size, header.capacity, header.log_id});
+}
+
+uint64_t IndexHeaderChecksum(const IndexHeader& header) {
+  return Checksum({MagicWord(header.magic), header.format_version,
+                   header.num_slots, header.log_capacity,
+                   header.indexed_records, header.log_id,
+                   header.last_record_checksum});
+}
+
+bool IsValidRecord(const Record& record, uint64_t sequence) {
+  return record.sequence == sequence &&
+         record.checksum == RecordChecksum(record);
+}
+
+size_t LogFileSize(uint64_t num_records) {
+  return SpentTokenLog::kHeaderSize + num_records * SpentTokenLog::kRecordSize;
+}
+
+size_t IndexFileSize(uint64_t num_slots) {
+  return kIndexSlotsOffset + num_slots * sizeof(uint64_t);
+}
+
+// Keeps the index at most half full.
+uint64_t SlotsFor(uint64_t capacity) {
+  uint64_t num_slots = 2;
+  while (num_slots < 2 * capacity) {
+    num_slots *= 2;
+  }
+  return num_slots;
+}
+
+uint64_t MakeSlot(const SpentTokenHash& hash, uint64_t record_index) {
+  return (hash.high >> kRecordBits << kRecordBits) | (record_index + 1);
+}
+
+Record* Records(char* log_map) {
+  return reinterpret_cast<Record*>(log_map + SpentTokenLog::kHeaderSize);
+}
+
+uint64_t* Slots(char* index_map) {
+  return reinterpret_cast<uint64_t*>(index_map + kIndexSlotsOffset);
+}
+
+absl::Status ErrnoError(absl::string_view operation, absl::string_view path) {
+  const int error = errno;
+  return absl::ErrnoToStatus(error, absl::StrCat(operation, " ", path));
+}
+
+// Allocates disk space for the first 'size' bytes of 'fd', growing it as
+// needed. Both files are written through shared mappings, where running out of
+// space raises SIGBUS instead of returning an error, so their space is
+// reserved whenever they are created or grown.
+absl::Status Reserve(int fd, size_t size, absl::string_view path) {
+  const int error = posix_fallocate(fd, 0, size);
+  if (error != 0) {
+    return absl::ErrnoToStatus(error,
+                               absl::StrCat("Failed to allocate ", path));
+  }
+  return absl::OkStatus();
+}
+
+// Closes the file descriptor unless it was released.
+class ScopedFd {
+ public:
+  explicit ScopedFd(int fd) : fd_(fd) {}
+  ~ScopedFd() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  ScopedFd(const ScopedFd&) = delete;
+  ScopedFd& operator=(const ScopedFd&) = delete;
+
+  int get() const { return fd_; }
+  int release() { return std::exchange(fd_, -1); }
+
+ private:
+  int fd_;
+};
+
+// Makes the creation of a file at 'path' durable.
+absl::Status SyncParentDirectory(absl::string_view path) {
+  const size_t slash = path.rfind('/');
+  const std::string directory =
+      slash == absl::string_view::npos
+          ? "."
+          : std::string(path.substr(0, std::max<size_t>(slash, 1)));
+  ScopedFd fd(open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  if (fd.get() < 0) {
+    return ErrnoError("Failed to open", directory);
+  }
+  if (fsync(fd.get()) != 0) {
+    return ErrnoError("Failed to sync", directory);
+  }
+  return absl::OkStatus();
+}
+
+// Returns the header of the log in 'fd', after writing one with 'new_capacity'
+// and a new log id if the file is empty.
+absl::StatusOr<LogHeader> ReadOrCreateLogHeader(int fd, absl::string_view path,
+                                                uint64_t new_capacity) {
+  struct stat stat_buffer;
+  if (fstat(fd, &stat_buffer) != 0) {
+    return ErrnoError("Failed to stat", path);
+  }
+  LogHeader header = {};
+  if (stat_buffer.st_size == 0) {
+    std::memcpy(header.magic, kLogMagic, sizeof(header.magic));
+    header.format_version = kFormatVersion;
+    header.record_size = SpentTokenLog::kRecordSize;
+    header.capacity = new_capacity;
+    absl::BitGen bit_gen;
+    header.log_id = absl::Uniform<uint64_t>(bit_gen);
+    header.checksum = LogHeaderChecksum(header);
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      return ErrnoError("Failed to write", path);
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(Reserve(fd, LogFileSize(new_capacity), path));
+    if (fdatasync(fd) != 0) {
+      return ErrnoError("Failed to sync", path);
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(SyncParentDirectory(path));
+    return header;
+  }
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      std::memcmp(header.magic, kLogMagic, sizeof(header.magic)) != 0 ||
+      header.checksum != LogHeaderChecksum(header)) {
+    return absl::DataLossError(
+        absl::StrCat("Spent token log ", path, " has no valid header."));
+  } else if (header.format_version != kFormatVersion ||
+             header.record_size != SpentTokenLog::kRecordSize ||
+             header.capacity == 0 || header.capacity > kMaxCapacity) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Spent token log ", path, " has an unsupported format."));
+  }
+  // A crash while creating the log may have left it shorter.
+  if (static_cast<size_t>(stat_buffer.st_size) !=
+      LogFileSize(header.capacity)) {
+    if (ftruncate(fd, LogFileSize(header.capacity)) != 0) {
+      return ErrnoError("Failed to resize", path);
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(
+        Reserve(fd, LogFileSize(header.capacity), path));
+  }
+  return header;
+}
+
+// Returns whether the index in 'fd' was built for the log with 'log_header'.
+// If not, replaces it with an empty index for that log.
+absl::StatusOr<bool> ReadOrResetIndex(int fd, absl::string_view path,
+                                      const LogHeader& log_header) {
+  const uint64_t capacity = log_header.capacity;
+  const uint64_t num_slots = SlotsFor(capacity);
+  struct stat stat_buffer;
+  if (fstat(fd, &stat_buffer) != 0) {
+    return ErrnoError("Failed to stat", path);
+  }
+  IndexHeader header = {};
+  if (static_cast<size_t>(stat_buffer.st_size) == IndexFileSize(num_slots) &&
+      pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      std::memcmp(header.magic, kIndexMagic, sizeof(header.magic)) == 0 &&
+      header.checksum == IndexHeaderChecksum(header) &&
+      header.format_version == kFormatVersion &&
+      header.num_slots == num_slots && header.log_capacity == capacity &&
+      header.log_id == log_header.log_id &&
+      header.indexed_records <= capacity) {
+    return true;
+  }
+  header = {};
+  std::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+  header.format_version = kFormatVersion;
+  header.num_slots = num_slots;
+  header.log_capacity = capacity;
+  header.indexed_records = 0;
+  header.log_id = log_header.log_id;
+  header.last_record_checksum = 0;
+  header.checksum = IndexHeaderChecksum(header);
+  // Truncating first zeroes all slots.
+  if (ftruncate(fd, 0) != 0) {
+    return ErrnoError("Failed to resize", path);
+  }
+  ANON_TOKENS_RETURN_IF_ERROR(Reserve(fd, IndexFileSize(num_slots), path));
+  if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    return ErrnoError("Failed to write", path);
+  }
+  return false;
+}
+
+}  // namespace
+
+SpentTokenLog::SpentTokenLog(bool sync_on_insert, int log_fd, int index_fd,
+                             uint64_t capacity)
+    : sync_on_insert_(sync_on_insert),
+      log_fd_(log_fd),
+      index_fd_(index_fd),
+      capacity_(capacity),
+      num_slots_(SlotsFor(capacity)) {}
+
+absl::StatusOr<std::unique_ptr<SpentTokenLog>> SpentTokenLog::Open(
+    absl::string_view path, const Options& options) {
+  if (options.capacity <= 0 ||
+      static_cast<uint64_t>(options.capacity) > kMaxCapacity) {
+    return absl::InvalidArgumentError(
+        "Capacity must be positive and less than 2^40.");
+  }
+  const std::string log_path(path);
+  const std::string index_path = absl::StrCat(path, ".index");
+  ScopedFd log_fd(open(log_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+  if (log_fd.get() < 0) {
+    return ErrnoError("Failed to open", log_path);
+  }
+  // Held until the descriptor is closed, which the kernel also does if the
+  // process dies.
+  if (flock(log_fd.get(), LOCK_EX | LOCK_NB) != 0) {
+    if (errno == EWOULDBLOCK) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Spent token log ", log_path, " is already open."));
+    }
+    return ErrnoError("Failed to lock", log_path);
+  }
+  ScopedFd index_fd(
+      open(index_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+  if (index_fd.get() < 0) {
+    return ErrnoError("Failed to open", index_path);
+  }
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      const LogHeader log_header,
+      ReadOrCreateLogHeader(log_fd.get(), log_path, options.capacity));
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      bool index_is_valid,
+      ReadOrResetIndex(index_fd.get(), index_path, log_header));
+
+  auto log = absl::WrapUnique(
+      new SpentTokenLog(options.sync_on_insert, log_fd.release(),
+                        index_fd.release(), log_header.capacity));
+  ANON_TOKENS_RETURN_IF_ERROR(log->Map());
+  ANON_TOKENS_RETURN_IF_ERROR(log->Recover(index_is_valid));
+  return log;
+}
+
+absl::Status SpentTokenLog::Map() {
+  void* log_map = mmap(nullptr, LogFileSize(capacity_), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, log_fd_, 0);
+  if (log_map == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "Failed to map the spent token log");
+  }
+  log_map_ = static_cast<char*>(log_map);
+  void* index_map = mmap(nullptr, IndexFileSize(num_slots_),
+                         PROT_READ | PROT_WRITE, MAP_SHARED, index_fd_, 0);
+  if (index_map == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "Failed to map the spent token index");
+  }
+  index_map_ = static_cast<char*>(index_map);
+  return absl::OkStatus();
+}
+
+absl::Status SpentTokenLog::Recover(bool index_is_valid) {
+  Record* const records = Records(log_map_);
+  IndexHeader* header = reinterpret_cast<IndexHeader*>(index_map_);
+  uint64_t indexed_records = index_is_valid ? header->indexed_records : 0;
+  if (indexed_records > 0 &&
+      (!IsValidRecord(records[indexed_records - 1], indexed_records - 1) ||
+       records[indexed_records - 1].checksum !=
+           header->last_record_checksum)) {
+    // The log lost or replaced records that the index covers, so the index
+    // may refer to records that are gone.
+    header->indexed_records = 0;
+    header->last_record_checksum = 0;
+    header->checksum = IndexHeaderChecksum(*header);
+    if (msync(index_map_, kIndexSlotsOffset, MS_SYNC) != 0 ||
+        ftruncate(index_fd_, kIndexSlotsOffset) != 0) {
+      return absl::ErrnoToStatus(errno, "Failed to reset the index");
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(Reserve(index_fd_, IndexFileSize(num_slots_),
+                                        "the spent token index"));
+    index_is_valid = false;
+    indexed_records = 0;
+  }
+  recovery_stats_.rebuilt_index = !index_is_valid;
+
+  absl::MutexLock lock(&mutex_);
+  num_records_ = indexed_records;
+  while (num_records_ < capacity_ &&
+         IsValidRecord(records[num_records_], num_records_)) {
+    const Record& record = records[num_records_];
+    const SpentTokenHash hash = {record.hash_high, record.hash_low};
+    // The index may already have a slot for this record if the kernel wrote
+    // it back before the crash.
+    ++num_records_;
+    uint64_t* slot = FindSlot(hash);
+    if (slot == nullptr) {
+      return absl::InternalError("Spent token index is full.");
+    }
+    if (*slot == 0) {
+      *slot = MakeSlot(hash, num_records_ - 1);
+    }
+  }
+  recovery_stats_.reindexed_records = num_records_ - indexed_records;
+
+  if (num_records_ < capacity_) {
+    static constexpr Record kEmptyRecord = {};
+    recovery_stats_.truncated_tail =
+        std::memcmp(&records[num_records_], &kEmptyRecord, sizeof(Record)) != 0;
+    // Zeroes everything after the last valid record, so that records that
+    // were written after a lost one cannot reappear after the next crash.
+    if (ftruncate(log_fd_, LogFileSize(num_records_)) != 0) {
+      return absl::ErrnoToStatus(errno, "Failed to truncate the log");
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(Reserve(log_fd_, LogFileSize(capacity_),
+                                        "the spent token log"));
+  }
+  if (fdatasync(log_fd_) != 0) {
+    return absl::ErrnoToStatus(errno, "Failed to sync the log");
+  }
+  num_durable_records_ = num_records_;
+  return absl::OkStatus();
+}
+
+SpentTokenLog::~SpentTokenLog() {
+  if (log_map_ != nullptr && index_map_ != nullptr) {
+    // A failed checkpoint loses nothing, the next Open reindexes more records.
+    Checkpoint().IgnoreError();
+  }
+  if (log_map_ != nullptr) {
+    munmap(log_map_, LogFileSize(capacity_));
+  }
+  if (index_map_ != nullptr) {
+    munmap(index_map_, IndexFileSize(num_slots_));
+  }
+  close(log_fd_);
+  close(index_fd_);
+}
+
+uint64_t* SpentTokenLog::FindSlot(const SpentTokenHash& hash) const {
+  const uint64_t tag = hash.high >> kRecordBits;
+  const uint64_t mask = num_slots_ - 1;
+  uint64_t* const slots = Slots(index_map_);
+  uint64_t i = hash.low & mask;
+  for (uint64_t probes = 0; probes < num_slots_; ++probes, i = (i + 1) & mask) {
+    const uint64_t slot = slots[i];
+    if (slot == 0) {
+      return &slots[i];
+    }
+    // Slots may refer to records that a crash discarded; those are skipped.
+    const uint64_t record_index = (slot & kRecordMask) - 1;
+    if (slot >> kRecordBits == tag && record_index < num_records_) {
+      const Record& record = Records(log_map_)[record_index];
+      if (record.hash_high == hash.high && record.hash_low == hash.low) {
+        return &slots[i];
+      }
+    }
+  }
+  return nullptr;
+}
+
+absl::StatusOr<bool> SpentTokenLog::CheckAndInsert(const SpentTokenHash& hash,
+                                                   int64_t key_version,
+                                                   absl::Time expiration) {
+  uint64_t num_records;
+  {
+    absl::MutexLock lock(&mutex_);
+    ANON_TOKENS_RETURN_IF_ERROR(sync_error_);
+    uint64_t* slot = FindSlot(hash);
+    if (slot != nullptr && *slot != 0) {
+      return false;
+    }
+    if (slot == nullptr || num_records_ == capacity_) {
+      return absl::ResourceExhaustedError("Spent token log is full.");
+    }
+    Record& record = Records(log_map_)[num_records_];
+    record.hash_high = hash.high;
+    record.hash_low = hash.low;
+    record.key_version = key_version;
+    record.expiration_unix_seconds = absl::ToUnixSeconds(expiration);
+    record.sequence = num_records_;
+    record.checksum = RecordChecksum(record);
+    num_records = ++num_records_;
+    *slot = MakeSlot(hash, num_records - 1);
+  }
+  if (sync_on_insert_) {
+    ANON_TOKENS_RETURN_IF_ERROR(SyncThrough(num_records));
+  }
+  return true;
+}
+
+bool SpentTokenLog::Contains(const SpentTokenHash& hash) const {
+  absl::ReaderMutexLock lock(&mutex_);
+  const uint64_t* slot = FindSlot(hash);
+  return slot != nullptr && *slot != 0;
+}
+
+absl::Status SpentTokenLog::SyncThrough(uint64_t num_records) {
+  absl::MutexLock lock(&mutex_);
+  while (sync_error_.ok() && num_durable_records_ < num_records) {
+    if (syncing_) {
+      sync_done_.Wait(&mutex_);
+      continue;
+    }
+    // Becomes the leader of a group commit that covers every record appended
+    // so far, including those of the threads that wait meanwhile.
+    syncing_ = true;
+    const uint64_t target = num_records_;
+    mutex_.Unlock();
+    const int result = fdatasync(log_fd_);
+    const int error = errno;
+    mutex_.Lock();
+    syncing_ = false;
+    sync_done_.SignalAll();
+    if (result != 0) {
+      sync_error_ =
+          absl::ErrnoToStatus(error, "Failed to sync the spent token log");
+      break;
+    }
+    num_durable_records_ = std::max(num_durable_records_, target);
+  }
+  return sync_error_;
+}
+
+absl::Status SpentTokenLog::Sync() {
+  uint64_t num_records;
+  {
+    absl::MutexLock lock(&mutex_);
+    num_records = num_records_;
+  }
+  return SyncThrough(num_records);
+}
+
+absl::Status SpentTokenLog::Checkpoint() {
+  absl::MutexLock lock(&mutex_);
+  ANON_TOKENS_RETURN_IF_ERROR(sync_error_);
+  // The log must be durable before the index claims to cover it.
+  if (fdatasync(log_fd_) != 0) {
+    sync_error_ =
+        absl::ErrnoToStatus(errno, "Failed to sync the spent token log");
+    return sync_error_;
+  }
+  num_durable_records_ = std::max(num_durable_records_, num_records_);
+  if (msync(index_map_, IndexFileSize(num_slots_), MS_SYNC) != 0) {
+    sync_error_ =
+        absl::ErrnoToStatus(errno, "Failed to sync the spent token index");
+    return sync_error_;
+  }
+  IndexHeader* header = reinterpret_cast<IndexHeader*>(index_map_);
+  header->indexed_records = num_records_;
+  header->last_record_checksum =
+      num_records_ > 0 ? Records(log_map_)[num_records_ - 1].checksum : 0;
+  header->checksum = IndexHeaderChecksum(*header);
+  if (msync(index_map_, kIndexSlotsOffset, MS_SYNC) != 0) {
+    sync_error_ =
+        absl::ErrnoToStatus(errno, "Failed to sync the spent token index");
+    return sync_error_;
+  }
+  return absl::OkStatus();
+}
+
+int64_t SpentTokenLog::size() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return static_cast<int64_t>(num_records_);
+}
+
+absl::Status SpentTokenLog::Compact(absl::string_view path,
+                                    absl::string_view compacted_path,
+                                    absl::Time now, const Options& options) {
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::unique_ptr<SpentTokenLog> log,
+                               Open(path, options));
+  Options compacted_options = options;
+  compacted_options.sync_on_insert = false;
+  ANON_TOKENS_ASSIGN_OR_RETURN(std::unique_ptr<SpentTokenLog> compacted,
+                               Open(compacted_path, compacted_options));
+  if (compacted->size() != 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Compacted log ", compacted_path, " is not empty."));
+  }
+  const int64_t now_unix_seconds = absl::ToUnixSeconds(now);
+  absl::MutexLock lock(&log->mutex_);
+  for (uint64_t i = 0; i < log->num_records_; ++i) {
+    const Record& record = Records(log->log_map_)[i];
+    if (record.expiration_unix_seconds <= now_unix_seconds) {
+      continue;
+    }
+    ANON_TOKENS_RETURN_IF_ERROR(
+        compacted
+            ->CheckAndInsert({record.hash_high, record.hash_low},
+                             record.key_version,
+                             absl::FromUnixSeconds(
+                                 record.expiration_unix_seconds))
+            .status());
+  }
+  return compacted->Checkpoint();
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,188 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_LOG_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_LOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+namespace anonymous_tokens {
+
+// A persistent set of spent tokens that survives restarts and crashes of the
+// redemption server, as the durable counterpart of SpentTokenStore.
+//
+// The log is an append-only file of fixed-size records, each holding the
+// fingerprint of a token, the version of the key it was signed with, its
+// expiration and a checksum. Next to it, '<path>.index' holds an
+// open-addressing table that maps fingerprints to records. Both files are
+// sized for the capacity of the log when it is created and mapped into
+// memory, so opening a log maps the two files instead of reading the records.
+// Their disk space is allocated up front, so a full disk fails Open rather
+// than a later write through the mapping.
+//
+// The index is a cache of the log. Checkpoint records in the index how many
+// records it covers. Open validates only the records after that with their
+// checksums, indexes them, and drops the log from the first invalid record on,
+// which is where a crash interrupted writing. An index that is missing or
+// does not match the log is rebuilt from all records: each log has a random
+// id that its index must carry, along with the checksum of the last record it
+// covers.
+//
+// With sync_on_insert, CheckAndInsert returns once its record is durable, and
+// inserts that wait at the same time share one fdatasync (group commit), so
+// the sync rate stays at one per device round trip however many requests are
+// in flight.
+//
+// A failed fdatasync or msync may have dropped the dirty pages it was meant to
+// write, so a later sync could succeed without writing them. The log therefore
+// does not retry: once making records or the index durable fails, every later
+// CheckAndInsert, Sync and Checkpoint returns that first error, until the log
+// is reopened and recovered from what reached the disk.
+//
+// Thread-safe. Open takes an exclusive flock on the log, so a log is only
+// opened by one SpentTokenLog at a time, in this process or any other.
+class SpentTokenLog {
+ public:
+  struct Options {
+    // Maximum number of records of a new log, at most 2^40 - 1. Existing logs
+    // keep the capacity they were created with. Space on disk for all records
+    // is allocated when the log is opened: kRecordSize bytes per record in the
+    // log and 16 to 32 bytes per record in the index, i.e. 48 MiB and 16 MiB
+    // for the default.
+    int64_t capacity = int64_t{1} << 20;
+    // Whether CheckAndInsert waits for its record to be durable. If false,
+    // records are durable after Sync, Checkpoint or destruction.
+    bool sync_on_insert = true;
+  };
+
+  // What Open did to bring the index up to date with the log.
+  struct RecoveryStats {
+    // The index was missing or did not match the log, and was rebuilt.
+    bool rebuilt_index = false;
+    // Number of records that were checked and indexed, i.e. those written
+    // after the last checkpoint, or all records if the index was rebuilt.
+    int64_t reindexed_records = 0;
+    // Whether the record after the last valid one held data, e.g. because a
+    // crash interrupted writing it, which was dropped.
+    bool truncated_tail = false;
+  };
+
+  // On-disk layout of the log: a header, followed by record i at
+  // kHeaderSize + i * kRecordSize.
+  static constexpr size_t kHeaderSize = 64;
+  static constexpr size_t kRecordSize = 48;
+
+  // Opens the log at 'path' and its index, creating them if they do not
+  // exist, and recovers the index as described above. Fails with
+  // FailedPrecondition if another SpentTokenLog has the log open.
+  static absl::StatusOr<std::unique_ptr<SpentTokenLog>> Open(
+      absl::string_view path, const Options& options);
+
+  // Writes the records of the log at 'path' that expire after 'now' to a new
+  // log at 'compacted_path' with 'options' and checkpoints it. Opens both
+  // logs, so neither may be open elsewhere. The caller then renames the
+  // compacted log and index over the old ones while neither is open.
+  static absl::Status Compact(absl::string_view path,
+                              absl::string_view compacted_path, absl::Time now,
+                              const Options& options);
+
+  // Checkpoints the log and closes it.
+  ~SpentTokenLog();
+
+  SpentTokenLog(const SpentTokenLog&) = delete;
+  SpentTokenLog& operator=(const SpentTokenLog&) = delete;
+
+  // Appends a record of the token if it is not in the log yet. Returns true
+  // if the record was appended, and false if this is a double spend. Of
+  // concurrent calls for the same token, exactly one returns true. Fails if
+  // the log is full or the record could not be made durable.
+  //
+  // The record is visible to Contains and to other calls as soon as it is
+  // appended, before it is durable. So if this fails after appending, later
+  // calls for the token return false, and whether the record survives a
+  // restart is unknown. The caller must treat a token whose insert failed as
+  // spent and never accept it.
+  absl::StatusOr<bool> CheckAndInsert(const SpentTokenHash& hash,
+                                      int64_t key_version,
+                                      absl::Time expiration);
+
+  // Returns whether the token is in the log.
+  bool Contains(const SpentTokenHash& hash) const;
+
+  // Makes all records appended so far durable.
+  absl::Status Sync();
+
+  // Makes all records and the index durable and marks the index as covering
+  // them, so the next Open need not check them. Blocks inserts meanwhile.
+  absl::Status Checkpoint();
+
+  // Returns the number of records.
+  int64_t size() const;
+
+  int64_t capacity() const { return static_cast<int64_t>(capacity_); }
+
+  const RecoveryStats& recovery_stats() const { return recovery_stats_; }
+
+ private:
+  // Use Open to construct.
+  SpentTokenLog(bool sync_on_insert, int log_fd, int index_fd,
+                uint64_t capacity);
+
+  absl::Status Map();
+  absl::Status Recover(bool index_is_valid);
+
+  // Returns the index slot that refers to the record of 'hash' or, if there
+  // is none, the first empty slot of its probe sequence, or null if the index
+  // has no empty slot left.
+  uint64_t* FindSlot(const SpentTokenHash& hash) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Waits until the first 'num_records' records are durable, syncing the log
+  // unless another thread already is.
+  absl::Status SyncThrough(uint64_t num_records);
+
+  const bool sync_on_insert_;
+  const int log_fd_;
+  const int index_fd_;
+  const uint64_t capacity_;
+  // A power of two of at least twice the capacity.
+  const uint64_t num_slots_;
+  char* log_map_ = nullptr;
+  char* index_map_ = nullptr;
+  RecoveryStats recovery_stats_;
+
+  mutable absl::Mutex mutex_;
+  uint64_t num_records_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t num_durable_records_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool syncing_ ABSL_GUARDED_BY(mutex_) = false;
+  // The first failure to make the log or the index durable. Sticky, see the
+  // class comment.
+  absl::Status sync_error_ ABSL_GUARDED_BY(mutex_);
+  absl::CondVar sync_done_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_LOG_H_
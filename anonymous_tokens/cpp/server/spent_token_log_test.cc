@@ -0,0 +1,339 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/spent_token_log.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+
+namespace anonymous_tokens {
+namespace {
+
+constexpr int64_t kCapacity = 1024;
+const absl::Time kExpiration = absl::FromUnixSeconds(2000000000);
+
+SpentTokenHash Token(int i) {
+  return HashSpentToken(absl::StrCat("token ", i));
+}
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+void WriteFile(const std::string &path, const std::string &contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+}
+
+class SpentTokenLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = absl::StrCat(::testing::TempDir(), "/",
+                         ::testing::UnitTest::GetInstance()
+                             ->current_test_info()
+                             ->name(),
+                         ".log");
+    std::remove(path_.c_str());
+    std::remove(IndexPath(path_).c_str());
+    options_.capacity = kCapacity;
+  }
+
+  static std::string IndexPath(const std::string &path) {
+    return absl::StrCat(path, ".index");
+  }
+
+  std::unique_ptr<SpentTokenLog> OpenLog(const std::string &path) {
+    auto log = SpentTokenLog::Open(path, options_);
+    EXPECT_TRUE(log.ok()) << log.status();
+    return log.ok() ? std::move(*log) : nullptr;
+  }
+
+  // Copies the files of an open log to 'copy', which is what a crash of the
+  // process would leave on disk: everything written to the mappings, but no
+  // checkpoint.
+  void CopyOpenLog(const std::string &copy) {
+    WriteFile(copy, ReadFile(path_));
+    WriteFile(IndexPath(copy), ReadFile(IndexPath(path_)));
+  }
+
+  std::string path_;
+  SpentTokenLog::Options options_;
+};
+
+TEST_F(SpentTokenLogTest, SecondSpendIsADoubleSpend) {
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  EXPECT_FALSE(log->Contains(Token(1)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(bool inserted,
+                                   log->CheckAndInsert(Token(1), 1,
+                                                       kExpiration));
+  EXPECT_TRUE(inserted);
+  EXPECT_TRUE(log->Contains(Token(1)));
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      inserted, log->CheckAndInsert(Token(1), 1, kExpiration));
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(log->size(), 1);
+}
+
+TEST_F(SpentTokenLogTest, ReopeningACheckpointedLogReadsNoRecords) {
+  {
+    std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+    }
+  }
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  EXPECT_EQ(log->size(), 100);
+  EXPECT_FALSE(log->recovery_stats().rebuilt_index);
+  EXPECT_EQ(log->recovery_stats().reindexed_records, 0);
+  EXPECT_FALSE(log->recovery_stats().truncated_tail);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(log->Contains(Token(i)));
+  }
+  EXPECT_FALSE(log->Contains(Token(100)));
+}
+
+TEST_F(SpentTokenLogTest, RecordsAfterTheLastCheckpointAreReindexed) {
+  const std::string copy = path_ + ".copy";
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+  }
+  ASSERT_TRUE(log->Checkpoint().ok());
+  for (int i = 50; i < 80; ++i) {
+    ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+  }
+  CopyOpenLog(copy);
+
+  std::unique_ptr<SpentTokenLog> recovered = OpenLog(copy);
+  EXPECT_EQ(recovered->size(), 80);
+  EXPECT_FALSE(recovered->recovery_stats().rebuilt_index);
+  EXPECT_EQ(recovered->recovery_stats().reindexed_records, 30);
+  for (int i = 0; i < 80; ++i) {
+    EXPECT_TRUE(recovered->Contains(Token(i)));
+  }
+}
+
+TEST_F(SpentTokenLogTest, TornRecordAndEverythingAfterItAreDropped) {
+  const std::string copy = path_ + ".copy";
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+  }
+  CopyOpenLog(copy);
+  // Tears record 7.
+  std::string contents = ReadFile(copy);
+  contents[SpentTokenLog::kHeaderSize + 7 * SpentTokenLog::kRecordSize + 3] ^=
+      1;
+  WriteFile(copy, contents);
+
+  {
+    std::unique_ptr<SpentTokenLog> recovered = OpenLog(copy);
+    EXPECT_EQ(recovered->size(), 7);
+    EXPECT_TRUE(recovered->recovery_stats().truncated_tail);
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(recovered->Contains(Token(i)), i < 7) << i;
+    }
+    // The dropped tokens can be spent again, and take the place of the
+    // dropped records.
+    ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+        bool inserted, recovered->CheckAndInsert(Token(9), 1, kExpiration));
+    EXPECT_TRUE(inserted);
+  }
+  // Records 8 and 9 of the original log were zeroed, so they do not come back
+  // either.
+  std::unique_ptr<SpentTokenLog> reopened = OpenLog(copy);
+  EXPECT_EQ(reopened->size(), 8);
+  EXPECT_FALSE(reopened->recovery_stats().truncated_tail);
+  EXPECT_FALSE(reopened->Contains(Token(7)));
+  EXPECT_FALSE(reopened->Contains(Token(8)));
+  EXPECT_TRUE(reopened->Contains(Token(9)));
+}
+
+TEST_F(SpentTokenLogTest, MissingIndexIsRebuilt) {
+  {
+    std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+    for (int i = 0; i < 20; ++i) {
+      ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+    }
+  }
+  ASSERT_EQ(std::remove(IndexPath(path_).c_str()), 0);
+
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  EXPECT_TRUE(log->recovery_stats().rebuilt_index);
+  EXPECT_EQ(log->recovery_stats().reindexed_records, 20);
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_TRUE(log->Contains(Token(i)));
+  }
+}
+
+TEST_F(SpentTokenLogTest, FullLogRejectsNewTokens) {
+  options_.capacity = 4;
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+  }
+  EXPECT_EQ(log->CheckAndInsert(Token(4), 1, kExpiration).status().code(),
+            absl::StatusCode::kResourceExhausted);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      bool inserted, log->CheckAndInsert(Token(0), 1, kExpiration));
+  EXPECT_FALSE(inserted);
+}
+
+TEST_F(SpentTokenLogTest, ExistingLogKeepsItsCapacity) {
+  OpenLog(path_);
+  options_.capacity = 2 * kCapacity;
+  EXPECT_EQ(OpenLog(path_)->capacity(), kCapacity);
+}
+
+TEST_F(SpentTokenLogTest, ConcurrentSpendsOfATokenSucceedOnce) {
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  constexpr int kNumThreads = 8;
+  constexpr int kNumTokens = 256;
+  std::atomic<int> num_inserted{0};
+  std::atomic<int> num_errors{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kNumTokens; ++i) {
+        auto inserted = log->CheckAndInsert(
+            Token((i * (2 * t + 1)) % kNumTokens), 1, kExpiration);
+        if (!inserted.ok()) {
+          num_errors.fetch_add(1);
+        } else if (*inserted) {
+          num_inserted.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_errors.load(), 0);
+  EXPECT_EQ(num_inserted.load(), kNumTokens);
+  EXPECT_EQ(log->size(), kNumTokens);
+}
+
+TEST_F(SpentTokenLogTest, CompactDropsExpiredRecords) {
+  const std::string compacted = path_ + ".compacted";
+  std::remove(compacted.c_str());
+  std::remove(IndexPath(compacted).c_str());
+  {
+    std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+    for (int i = 0; i < 10; ++i) {
+      ASSERT_TRUE(log->CheckAndInsert(Token(i), i,
+                                      absl::FromUnixSeconds(1000 + i * 100))
+                      .ok());
+    }
+  }
+  ASSERT_TRUE(SpentTokenLog::Compact(path_, compacted,
+                                     absl::FromUnixSeconds(1450), options_)
+                  .ok());
+
+  std::unique_ptr<SpentTokenLog> log = OpenLog(compacted);
+  EXPECT_EQ(log->size(), 5);
+  EXPECT_EQ(log->recovery_stats().reindexed_records, 0);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(log->Contains(Token(i)), i >= 5) << i;
+  }
+  // Compacting into a log that has records fails.
+  log.reset();
+  EXPECT_EQ(SpentTokenLog::Compact(path_, compacted,
+                                   absl::FromUnixSeconds(1450), options_)
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(SpentTokenLogTest, IndexOfAnotherLogIsRebuilt) {
+  const std::string compacted = path_ + ".compacted";
+  std::remove(compacted.c_str());
+  std::remove(IndexPath(compacted).c_str());
+  {
+    std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+    ASSERT_TRUE(
+        log->CheckAndInsert(Token(0), 1, absl::FromUnixSeconds(1000)).ok());
+    for (int i = 1; i < 4; ++i) {
+      ASSERT_TRUE(log->CheckAndInsert(Token(i), 1, kExpiration).ok());
+    }
+  }
+  ASSERT_TRUE(SpentTokenLog::Compact(path_, compacted,
+                                     absl::FromUnixSeconds(1500), options_)
+                  .ok());
+  // A crash between the renames that replace the log with the compacted one
+  // leaves the compacted index next to the old log.
+  ASSERT_EQ(std::rename(IndexPath(compacted).c_str(), IndexPath(path_).c_str()),
+            0);
+
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  EXPECT_TRUE(log->recovery_stats().rebuilt_index);
+  EXPECT_EQ(log->recovery_stats().reindexed_records, 4);
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(
+      bool inserted, log->CheckAndInsert(Token(1), 1, kExpiration));
+  EXPECT_FALSE(inserted);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(log->Contains(Token(i))) << i;
+  }
+}
+
+TEST_F(SpentTokenLogTest, OpenLogCannotBeOpenedAgain) {
+  std::unique_ptr<SpentTokenLog> log = OpenLog(path_);
+  EXPECT_EQ(SpentTokenLog::Open(path_, options_).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+  const std::string compacted = path_ + ".compacted";
+  std::remove(compacted.c_str());
+  std::remove(IndexPath(compacted).c_str());
+  EXPECT_EQ(SpentTokenLog::Compact(path_, compacted,
+                                   absl::FromUnixSeconds(1000), options_)
+                .code(),
+            absl::StatusCode::kFailedPrecondition);
+
+  log.reset();
+  EXPECT_NE(OpenLog(path_), nullptr);
+}
+
+TEST_F(SpentTokenLogTest, CorruptHeaderIsDataLoss) {
+  OpenLog(path_);
+  std::string contents = ReadFile(path_);
+  contents[20] ^= 1;
+  WriteFile(path_, contents);
+  EXPECT_EQ(SpentTokenLog::Open(path_, options_).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST_F(SpentTokenLogTest, InvalidCapacity) {
+  options_.capacity = 0;
+  EXPECT_EQ(SpentTokenLog::Open(path_, options_).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options_.capacity = int64_t{1} << 40;
+  EXPECT_EQ(SpentTokenLog::Open(path_, options_).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
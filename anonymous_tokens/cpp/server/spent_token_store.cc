@@ -0,0 +1,308 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "anonymous_tokens/cpp/server/spent_token_filter.h"
+#include <openssl/sha.h>
+
+namespace anonymous_tokens {
+
+namespace {
+
+constexpr int kMaxShardsLog2 = 16;
+constexpr int kMaxFilterBitsPerToken = 64;
+constexpr size_t kSlotsPerBucket = 4;
+constexpr size_t kMinBuckets = 4;
+
+// One cache line of fingerprints.
+struct alignas(64) Bucket {
+  SpentTokenHash slots[kSlotsPerBucket];
+};
+static_assert(sizeof(Bucket) == 64, "Buckets must fill one cache line.");
+
+// The all-zero fingerprint marks empty slots.
+bool IsEmpty(const SpentTokenHash& slot) {
+  return slot.high == 0 && slot.low == 0;
+}
+
+// Moves the fingerprint that marks empty slots to another one, which makes
+// the two collide with probability 2^-127.
+SpentTokenHash Normalize(SpentTokenHash hash) {
+  if (IsEmpty(hash)) {
+    hash.low = 1;
+  }
+  return hash;
+}
+
+// Tables grow once more than 7/8 of their slots are used.
+bool ExceedsMaxLoad(size_t num_tokens, size_t num_buckets) {
+  return num_tokens * 8 > num_buckets * kSlotsPerBucket * 7;
+}
+
+// Returns the smallest power of two number of buckets that holds 'num_tokens'
+// tokens without growing.
+size_t BucketsFor(size_t num_tokens) {
+  size_t num_buckets = kMinBuckets;
+  while (ExceedsMaxLoad(num_tokens, num_buckets)) {
+    num_buckets *= 2;
+  }
+  return num_buckets;
+}
+
+// Open-addressing set of the fingerprints of one key version in one shard.
+// Tokens are never removed individually, so a probe that reaches an empty
+// slot proves that the fingerprint is absent. Not thread-safe.
+class Table {
+ public:
+  explicit Table(size_t num_buckets)
+      : buckets_(std::make_unique<Bucket[]>(num_buckets)),
+        mask_(num_buckets - 1) {}
+
+  bool Contains(const SpentTokenHash& hash) const {
+    return !IsEmpty(*Find(hash));
+  }
+
+  // Returns false if 'hash' is already in the table.
+  bool Insert(const SpentTokenHash& hash) {
+    SpentTokenHash* slot = Find(hash);
+    if (!IsEmpty(*slot)) {
+      return false;
+    }
+    if (ExceedsMaxLoad(size_ + 1, mask_ + 1)) {
+      Grow();
+      slot = Find(hash);
+    }
+    *slot = hash;
+    ++size_;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+  size_t memory_usage() const { return (mask_ + 1) * sizeof(Bucket); }
+
+ private:
+  // Returns the slot that holds 'hash' or, if there is none, the first empty
+  // slot of its probe sequence. The load limit guarantees that there is one.
+  SpentTokenHash* Find(const SpentTokenHash& hash) const {
+    for (size_t i = hash.low & mask_;; i = (i + 1) & mask_) {
+      for (SpentTokenHash& slot : buckets_[i].slots) {
+        if (slot == hash || IsEmpty(slot)) {
+          return &slot;
+        }
+      }
+    }
+  }
+
+  void Grow() {
+    Table grown(2 * (mask_ + 1));
+    for (size_t i = 0; i <= mask_; ++i) {
+      for (const SpentTokenHash& slot : buckets_[i].slots) {
+        if (!IsEmpty(slot)) {
+          *grown.Find(slot) = slot;
+        }
+      }
+    }
+    grown.size_ = size_;
+    *this = std::move(grown);
+  }
+
+  std::unique_ptr<Bucket[]> buckets_;
+  size_t mask_;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+class alignas(64) SpentTokenStore::Shard {
+ public:
+  bool CheckAndInsert(int64_t key_version, const SpentTokenHash& hash,
+                      size_t initial_buckets) {
+    absl::MutexLock lock(&mutex_);
+    auto table = tables_.find(key_version);
+    if (table == tables_.end()) {
+      table = tables_.emplace(key_version, Table(initial_buckets)).first;
+    }
+    return table->second.Insert(hash);
+  }
+
+  bool Contains(int64_t key_version, const SpentTokenHash& hash) const {
+    absl::MutexLock lock(&mutex_);
+    const auto table = tables_.find(key_version);
+    return table != tables_.end() && table->second.Contains(hash);
+  }
+
+  void Expire(int64_t key_version) {
+    decltype(tables_)::node_type expired;
+    absl::MutexLock lock(&mutex_);
+    expired = tables_.extract(key_version);
+    // 'lock' is released before 'expired' is destroyed.
+  }
+
+  int64_t size() const {
+    absl::MutexLock lock(&mutex_);
+    int64_t size = 0;
+    for (const auto& [key_version, table] : tables_) {
+      size += table.size();
+    }
+    return size;
+  }
+
+  size_t memory_usage() const {
+    absl::MutexLock lock(&mutex_);
+    size_t memory_usage = 0;
+    for (const auto& [key_version, table] : tables_) {
+      memory_usage += table.memory_usage();
+    }
+    return memory_usage;
+  }
+
+ private:
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<int64_t, Table> tables_ ABSL_GUARDED_BY(mutex_);
+};
+
+SpentTokenHash HashSpentToken(absl::string_view serialized_unblinded_token) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const uint8_t*>(serialized_unblinded_token.data()),
+         serialized_unblinded_token.size(), digest);
+  SpentTokenHash hash;
+  for (int i = 0; i < 8; ++i) {
+    hash.high = (hash.high << 8) | digest[i];
+    hash.low = (hash.low << 8) | digest[8 + i];
+  }
+  return hash;
+}
+
+SpentTokenStore::SpentTokenStore(int num_shards_log2, size_t initial_buckets,
+                                 std::unique_ptr<SpentTokenFilter> filter)
+    : num_shards_log2_(num_shards_log2),
+      initial_buckets_(initial_buckets),
+      shards_(std::make_unique<Shard[]>(size_t{1} << num_shards_log2)),
+      filter_(std::move(filter)) {}
+
+SpentTokenStore::~SpentTokenStore() = default;
+
+absl::StatusOr<std::unique_ptr<SpentTokenStore>> SpentTokenStore::New(
+    const Options& options) {
+  if (options.num_shards_log2 < 0 || options.num_shards_log2 > kMaxShardsLog2) {
+    return absl::InvalidArgumentError(
+        "Number of shards must be between 2^0 and 2^16.");
+  } else if (options.expected_tokens_per_key_version < 0) {
+    return absl::InvalidArgumentError(
+        "Expected number of tokens cannot be negative.");
+  } else if (options.filter_bits_per_token < 0 ||
+             options.filter_bits_per_token > kMaxFilterBitsPerToken) {
+    return absl::InvalidArgumentError(
+        "Filter bits per token must be between 0 and 64.");
+  } else if (options.filter_bits_per_token > 0 &&
+             options.expected_tokens_per_key_version == 0) {
+    return absl::InvalidArgumentError(
+        "Filters need the expected number of tokens per key version.");
+  }
+  std::unique_ptr<SpentTokenFilter> filter;
+  if (options.filter_bits_per_token > 0) {
+    filter = std::make_unique<SpentTokenFilter>(
+        options.expected_tokens_per_key_version,
+        options.filter_bits_per_token);
+  }
+  const size_t tokens_per_shard =
+      static_cast<size_t>(options.expected_tokens_per_key_version) >>
+      options.num_shards_log2;
+  // Shards fill unevenly, so leave room for 1/16 more than the average.
+  return absl::WrapUnique(new SpentTokenStore(
+      options.num_shards_log2,
+      BucketsFor(tokens_per_shard + tokens_per_shard / 16), std::move(filter)));
+}
+
+SpentTokenStore::Shard& SpentTokenStore::ShardFor(
+    const SpentTokenHash& hash) const {
+  return shards_[num_shards_log2_ == 0
+                     ? 0
+                     : hash.high >> (64 - num_shards_log2_)];
+}
+
+bool SpentTokenStore::CheckAndInsert(
+    int64_t key_version, absl::string_view serialized_unblinded_token) {
+  return CheckAndInsert(key_version,
+                        HashSpentToken(serialized_unblinded_token));
+}
+
+bool SpentTokenStore::CheckAndInsert(int64_t key_version,
+                                     const SpentTokenHash& hash) {
+  const SpentTokenHash normalized = Normalize(hash);
+  // Filters the token before it can be found in the table, so Contains never
+  // misses it in the filter after it found it in the table.
+  if (filter_ != nullptr) {
+    filter_->Insert(key_version, normalized);
+  }
+  return ShardFor(normalized)
+      .CheckAndInsert(key_version, normalized, initial_buckets_);
+}
+
+bool SpentTokenStore::Contains(
+    int64_t key_version, absl::string_view serialized_unblinded_token) const {
+  return Contains(key_version, HashSpentToken(serialized_unblinded_token));
+}
+
+bool SpentTokenStore::Contains(int64_t key_version,
+                               const SpentTokenHash& hash) const {
+  const SpentTokenHash normalized = Normalize(hash);
+  if (filter_ != nullptr && !filter_->MayContain(key_version, normalized)) {
+    return false;
+  }
+  return ShardFor(normalized).Contains(key_version, normalized);
+}
+
+void SpentTokenStore::ExpireKeyVersion(int64_t key_version) {
+  if (filter_ != nullptr) {
+    filter_->ExpireKeyVersion(key_version);
+  }
+  for (size_t i = 0; i < (size_t{1} << num_shards_log2_); ++i) {
+    shards_[i].Expire(key_version);
+  }
+}
+
+int64_t SpentTokenStore::size() const {
+  int64_t size = 0;
+  for (size_t i = 0; i < (size_t{1} << num_shards_log2_); ++i) {
+    size += shards_[i].size();
+  }
+  return size;
+}
+
+size_t SpentTokenStore::memory_usage() const {
+  size_t memory_usage = 0;
+  for (size_t i = 0; i < (size_t{1} << num_shards_log2_); ++i) {
+    memory_usage += shards_[i].memory_usage();
+  }
+  if (filter_ != nullptr) {
+    memory_usage += filter_->memory_usage();
+  }
+  return memory_usage;
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,131 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_STORE_H_
+#define ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace anonymous_tokens {
+
+class SpentTokenFilter;
+
+// 128-bit fingerprint of a redeemed token.
+struct SpentTokenHash {
+  uint64_t high = 0;
+  uint64_t low = 0;
+
+  friend bool operator==(const SpentTokenHash& a, const SpentTokenHash& b) {
+    return a.high == b.high && a.low == b.low;
+  }
+};
+
+// Returns the first 128 bits of the SHA-256 digest of
+// 'serialized_unblinded_token'. Tokens are chosen by clients, so the hash is
+// cryptographic to keep them from provoking collisions, i.e. false double
+// spends of other clients' tokens.
+SpentTokenHash HashSpentToken(absl::string_view serialized_unblinded_token);
+
+// The set of tokens that have been redeemed, used to answer the double_spent
+// field of redemption results.
+//
+// Tokens are kept per key version, as the fingerprints of their serialized
+// unblinded tokens. The set is split into shards by the leading bits of the
+// fingerprint, each with its own lock, so threads redeeming different tokens
+// rarely contend. Within a shard, each key version has an open-addressing
+// table of 64-byte buckets that hold four fingerprints each, probed linearly
+// from the bucket picked by the low bits of the fingerprint, so a lookup
+// usually touches a single cache line. When a key is retired, its tokens can
+// no longer be verified and ExpireKeyVersion drops them.
+//
+// Optionally, a SpentTokenFilter per key version sits in front of the tables.
+// Most redeemed tokens are fresh, and the filter answers Contains for them
+// from a much smaller array, so only possible hits look up the tables.
+//
+// A store serves one use case; key versions of different use cases must use
+// different stores. Thread-safe.
+class SpentTokenStore {
+ public:
+  struct Options {
+    // The store has 2^num_shards_log2 shards, for num_shards_log2 in [0, 16].
+    int num_shards_log2 = 8;
+    // Number of tokens per key version that the tables are sized for when a
+    // key version is first used, so that they need not grow while tokens are
+    // redeemed. If zero, tables start small and double as they fill.
+    int64_t expected_tokens_per_key_version = 0;
+    // If positive, tokens are also added to a Bloom filter per key version
+    // with this many bits per expected token, at most 64. Requires
+    // expected_tokens_per_key_version, as filters cannot grow; filters that
+    // receive more tokens report more false positives. Filters make Contains
+    // of unspent tokens cheaper and CheckAndInsert more expensive, so they
+    // pay off where most tokens are checked well before they are spent.
+    int filter_bits_per_token = 0;
+  };
+
+  static absl::StatusOr<std::unique_ptr<SpentTokenStore>> New(
+      const Options& options);
+
+  ~SpentTokenStore();
+
+  SpentTokenStore(const SpentTokenStore&) = delete;
+  SpentTokenStore& operator=(const SpentTokenStore&) = delete;
+
+  // Marks the token as spent under 'key_version'. Returns true if it had not
+  // been spent before, and false if this is a double spend. Of concurrent
+  // calls for the same token, exactly one returns true.
+  bool CheckAndInsert(int64_t key_version,
+                      absl::string_view serialized_unblinded_token);
+  bool CheckAndInsert(int64_t key_version, const SpentTokenHash& hash);
+
+  // Returns whether the token has been spent under 'key_version'. With a
+  // filter, tokens that were not spent usually only take a filter lookup.
+  bool Contains(int64_t key_version,
+                absl::string_view serialized_unblinded_token) const;
+  bool Contains(int64_t key_version, const SpentTokenHash& hash) const;
+
+  // Forgets all tokens spent under 'key_version'. The tables are freed outside
+  // of the shard locks.
+  void ExpireKeyVersion(int64_t key_version);
+
+  // Returns the number of spent tokens over all key versions.
+  int64_t size() const;
+
+  // Returns the number of bytes held by the tables and filters.
+  size_t memory_usage() const;
+
+ private:
+  class Shard;
+
+  // Use New to construct.
+  SpentTokenStore(int num_shards_log2, size_t initial_buckets,
+                  std::unique_ptr<SpentTokenFilter> filter);
+
+  Shard& ShardFor(const SpentTokenHash& hash) const;
+
+  const int num_shards_log2_;
+  // Size of the table of a key version when it is first used in a shard.
+  const size_t initial_buckets_;
+  std::unique_ptr<Shard[]> shards_;
+  // Null if the store has no filter.
+  const std::unique_ptr<SpentTokenFilter> filter_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SERVER_SPENT_TOKEN_STORE_H_
@@ -0,0 +1,200 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/server/spent_token_store.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+
+namespace anonymous_tokens {
+namespace {
+
+std::unique_ptr<SpentTokenStore> NewStore(
+    int num_shards_log2 = 8, int64_t expected_tokens_per_key_version = 0) {
+  SpentTokenStore::Options options;
+  options.num_shards_log2 = num_shards_log2;
+  options.expected_tokens_per_key_version = expected_tokens_per_key_version;
+  auto store = SpentTokenStore::New(options);
+  EXPECT_TRUE(store.ok()) << store.status();
+  return store.ok() ? std::move(*store) : nullptr;
+}
+
+TEST(SpentTokenStoreTest, HashIsTheTruncatedSha256Digest) {
+  // SHA-256("abc") = ba7816bf8f01cfea414140de5dae2223b00361a396177a9c...
+  const SpentTokenHash hash = HashSpentToken("abc");
+  EXPECT_EQ(hash.high, 0xba7816bf8f01cfeaULL);
+  EXPECT_EQ(hash.low, 0x414140de5dae2223ULL);
+}
+
+TEST(SpentTokenStoreTest, SecondSpendIsADoubleSpend) {
+  std::unique_ptr<SpentTokenStore> store = NewStore();
+  EXPECT_FALSE(store->Contains(1, "token"));
+  EXPECT_TRUE(store->CheckAndInsert(1, "token"));
+  EXPECT_TRUE(store->Contains(1, "token"));
+  EXPECT_FALSE(store->CheckAndInsert(1, "token"));
+  EXPECT_TRUE(store->CheckAndInsert(1, "another token"));
+  EXPECT_EQ(store->size(), 2);
+}
+
+TEST(SpentTokenStoreTest, KeyVersionsAreSeparate) {
+  std::unique_ptr<SpentTokenStore> store = NewStore();
+  EXPECT_TRUE(store->CheckAndInsert(1, "token"));
+  EXPECT_FALSE(store->Contains(2, "token"));
+  EXPECT_TRUE(store->CheckAndInsert(2, "token"));
+  EXPECT_FALSE(store->CheckAndInsert(2, "token"));
+}
+
+TEST(SpentTokenStoreTest, ExpireKeyVersionForgetsOnlyItsTokens) {
+  std::unique_ptr<SpentTokenStore> store = NewStore();
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(store->CheckAndInsert(1, absl::StrCat("token ", i)));
+    ASSERT_TRUE(store->CheckAndInsert(2, absl::StrCat("token ", i)));
+  }
+  const size_t memory_usage = store->memory_usage();
+
+  store->ExpireKeyVersion(1);
+
+  EXPECT_EQ(store->size(), 1000);
+  EXPECT_LT(store->memory_usage(), memory_usage);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(store->Contains(1, absl::StrCat("token ", i)));
+    EXPECT_TRUE(store->Contains(2, absl::StrCat("token ", i)));
+  }
+  // Expiring an unknown key version is a no-op.
+  store->ExpireKeyVersion(3);
+  EXPECT_EQ(store->size(), 1000);
+}
+
+TEST(SpentTokenStoreTest, TablesGrowBeyondTheirInitialSize) {
+  std::unique_ptr<SpentTokenStore> store = NewStore(/*num_shards_log2=*/0);
+  const size_t initial_memory_usage = [&] {
+    EXPECT_TRUE(store->CheckAndInsert(1, "first"));
+    return store->memory_usage();
+  }();
+  constexpr int kNumTokens = 100000;
+  for (int i = 0; i < kNumTokens; ++i) {
+    ASSERT_TRUE(store->CheckAndInsert(1, absl::StrCat("token ", i)));
+  }
+  EXPECT_EQ(store->size(), kNumTokens + 1);
+  EXPECT_GT(store->memory_usage(), initial_memory_usage);
+  for (int i = 0; i < kNumTokens; ++i) {
+    EXPECT_FALSE(store->CheckAndInsert(1, absl::StrCat("token ", i)));
+  }
+  EXPECT_TRUE(store->Contains(1, "first"));
+}
+
+TEST(SpentTokenStoreTest, PresizedTablesDoNotGrow) {
+  std::unique_ptr<SpentTokenStore> store = NewStore(
+      /*num_shards_log2=*/4, /*expected_tokens_per_key_version=*/10000);
+  EXPECT_TRUE(store->CheckAndInsert(1, "first"));
+  const size_t memory_usage_of_one_shard = store->memory_usage();
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(store->CheckAndInsert(1, absl::StrCat("token ", i)));
+  }
+  EXPECT_EQ(store->memory_usage(), 16 * memory_usage_of_one_shard);
+}
+
+TEST(SpentTokenStoreTest, AllZeroHashIsStored) {
+  std::unique_ptr<SpentTokenStore> store = NewStore();
+  EXPECT_FALSE(store->Contains(1, SpentTokenHash{}));
+  EXPECT_TRUE(store->CheckAndInsert(1, SpentTokenHash{}));
+  EXPECT_TRUE(store->Contains(1, SpentTokenHash{}));
+  EXPECT_FALSE(store->CheckAndInsert(1, SpentTokenHash{}));
+}
+
+TEST(SpentTokenStoreTest, ConcurrentSpendsOfATokenSucceedOnce) {
+  std::unique_ptr<SpentTokenStore> store = NewStore();
+  constexpr int kNumThreads = 4;
+  // A power of two, so that every odd stride visits all tokens.
+  constexpr int kNumTokens = 1 << 14;
+  std::atomic<int> num_spent{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t] {
+      // Threads spend the same tokens in different orders.
+      for (int i = 0; i < kNumTokens; ++i) {
+        const int token = (i * (2 * t + 1)) % kNumTokens;
+        if (store->CheckAndInsert(7, absl::StrCat("token ", token))) {
+          num_spent.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_spent.load(), kNumTokens);
+  EXPECT_EQ(store->size(), kNumTokens);
+}
+
+TEST(SpentTokenStoreTest, FilteredStoreFindsEverySpentToken) {
+  SpentTokenStore::Options options;
+  options.expected_tokens_per_key_version = 1000;
+  options.filter_bits_per_token = 16;
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<SpentTokenStore> store,
+                                   SpentTokenStore::New(options));
+  const size_t memory_usage_without_tokens = store->memory_usage();
+  for (int i = 0; i < 2000; i += 2) {
+    ASSERT_TRUE(store->CheckAndInsert(1, absl::StrCat("token ", i)));
+  }
+  // The filter of key version 1 holds 1000 tokens at 16 bits each.
+  EXPECT_GE(store->memory_usage(), memory_usage_without_tokens + 2000);
+  for (int i = 0; i < 2000; ++i) {
+    EXPECT_EQ(store->Contains(1, absl::StrCat("token ", i)), i % 2 == 0) << i;
+    EXPECT_FALSE(store->Contains(2, absl::StrCat("token ", i))) << i;
+  }
+  store->ExpireKeyVersion(1);
+  EXPECT_EQ(store->memory_usage(), memory_usage_without_tokens);
+  EXPECT_FALSE(store->Contains(1, "token 0"));
+  EXPECT_TRUE(store->CheckAndInsert(1, "token 0"));
+}
+
+TEST(SpentTokenStoreTest, InvalidOptions) {
+  SpentTokenStore::Options options;
+  options.num_shards_log2 = -1;
+  EXPECT_EQ(SpentTokenStore::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options.num_shards_log2 = 17;
+  EXPECT_EQ(SpentTokenStore::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options.num_shards_log2 = 8;
+  options.expected_tokens_per_key_version = -1;
+  EXPECT_EQ(SpentTokenStore::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  // Filters are sized from the expected number of tokens.
+  options.expected_tokens_per_key_version = 0;
+  options.filter_bits_per_token = 16;
+  EXPECT_EQ(SpentTokenStore::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options.expected_tokens_per_key_version = 1000;
+  options.filter_bits_per_token = 65;
+  EXPECT_EQ(SpentTokenStore::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options.filter_bits_per_token = -1;
+  EXPECT_EQ(SpentTokenStore::New(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
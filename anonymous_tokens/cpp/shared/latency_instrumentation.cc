@@ -0,0 +1,177 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace anonymous_tokens {
+
+namespace internal {
+
+ABSL_CONST_INIT std::atomic<LatencySink*> latency_sink{nullptr};
+
+}  // namespace internal
+
+namespace {
+
+// Samples below this many nanoseconds get a bucket of their own.
+constexpr int kNumExactBuckets = 4;
+// Number of bits following the leading one that select the sub-bucket.
+constexpr int kSubBucketBits = 2;
+
+uint64_t ToNanos(absl::Duration duration) {
+  const int64_t nanos = absl::ToInt64Nanoseconds(duration);
+  return nanos < 0 ? 0 : static_cast<uint64_t>(nanos);
+}
+
+}  // namespace
+
+absl::string_view LatencyStageName(LatencyStage stage) {
+  switch (stage) {
+    case LatencyStage::kHashMessage:
+      return "hash_message";
+    case LatencyStage::kPssEncode:
+      return "pss_encode";
+    case LatencyStage::kDeriveExponent:
+      return "derive_exponent";
+    case LatencyStage::kDerivePrivateKey:
+      return "derive_private_key";
+    case LatencyStage::kBlindModExp:
+      return "blind_mod_exp";
+    case LatencyStage::kSignModExp:
+      return "sign_mod_exp";
+    case LatencyStage::kUnblindModMul:
+      return "unblind_mod_mul";
+    case LatencyStage::kVerifyModExp:
+      return "verify_mod_exp";
+    case LatencyStage::kPssVerify:
+      return "pss_verify";
+    case LatencyStage::kSerialize:
+      return "serialize";
+  }
+  return "unknown";
+}
+
+void SetLatencySink(LatencySink* sink) {
+  internal::latency_sink.store(sink, std::memory_order_release);
+}
+
+int LatencyHistogram::BucketIndex(uint64_t nanos) {
+  if (nanos < kNumExactBuckets) {
+    return static_cast<int>(nanos);
+  }
+  const int msb = absl::bit_width(nanos) - 1;
+  const int sub_bucket =
+      (nanos >> (msb - kSubBucketBits)) & ((1 << kSubBucketBits) - 1);
+  return kNumExactBuckets + ((msb - kSubBucketBits) << kSubBucketBits) +
+         sub_bucket;
+}
+
+uint64_t LatencyHistogram::BucketLowerBound(int index) {
+  if (index < kNumExactBuckets) {
+    return index;
+  }
+  const int shift = (index - kNumExactBuckets) >> kSubBucketBits;
+  const uint64_t sub_bucket =
+      (index - kNumExactBuckets) & ((1 << kSubBucketBits) - 1);
+  return ((uint64_t{1} << kSubBucketBits) + sub_bucket) << shift;
+}
+
+void LatencyHistogram::Record(absl::Duration duration) {
+  const uint64_t nanos = ToNanos(duration);
+  buckets_[BucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+  sum_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+  uint64_t max = max_nanos_.load(std::memory_order_relaxed);
+  while (nanos > max && !max_nanos_.compare_exchange_weak(
+                            max, nanos, std::memory_order_relaxed)) {
+  }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const {
+  Snapshot snapshot;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    // The count is derived from the buckets so that it is consistent with
+    // them even while samples are being recorded.
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum =
+      absl::Nanoseconds(sum_nanos_.load(std::memory_order_relaxed));
+  snapshot.max =
+      absl::Nanoseconds(max_nanos_.load(std::memory_order_relaxed));
+  return snapshot;
+}
+
+absl::Duration LatencyHistogram::Snapshot::Quantile(double q) const {
+  if (count == 0) {
+    return absl::ZeroDuration();
+  }
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count)));
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      if (i + 1 == kNumBuckets) {
+        return max;
+      }
+      return std::min(max, absl::Nanoseconds(BucketLowerBound(i + 1) - 1));
+    }
+  }
+  return max;
+}
+
+std::string LatencySnapshot::ToString() const {
+  std::string out;
+  for (int i = 0; i < kNumLatencyStages; ++i) {
+    const LatencyHistogram::Snapshot& stage = stages[i];
+    if (stage.count == 0) {
+      continue;
+    }
+    absl::StrAppend(&out,
+                    LatencyStageName(static_cast<LatencyStage>(i)),
+                    ": count=", stage.count,
+                    " mean=", absl::FormatDuration(stage.sum / stage.count),
+                    " p50=", absl::FormatDuration(stage.Quantile(0.5)),
+                    " p90=", absl::FormatDuration(stage.Quantile(0.9)),
+                    " p99=", absl::FormatDuration(stage.Quantile(0.99)),
+                    " max=", absl::FormatDuration(stage.max), "\n");
+  }
+  return out;
+}
+
+void HistogramLatencySink::Record(LatencyStage stage,
+                                  absl::Duration duration) {
+  histograms_[static_cast<int>(stage)].Record(duration);
+}
+
+LatencySnapshot HistogramLatencySink::GetSnapshot() const {
+  LatencySnapshot snapshot;
+  for (int i = 0; i < kNumLatencyStages; ++i) {
+    snapshot.stages[i] = histograms_[i].GetSnapshot();
+  }
+  return snapshot;
+}
+
+}  // namespace anonymous_tokens
@@ -0,0 +1,181 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SHARED_LATENCY_INSTRUMENTATION_H_
+#define ANONYMOUS_TOKENS_CPP_SHARED_LATENCY_INSTRUMENTATION_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/base/attributes.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace anonymous_tokens {
+
+// Stages of blinding, signing, unblinding and verification whose latency is
+// reported to the installed LatencySink. Stages may nest, e.g.
+// kDerivePrivateKey includes a kDeriveExponent stage.
+enum class LatencyStage : int {
+  // Hashing a message, with its public metadata encoding if any.
+  kHashMessage = 0,
+  // EMSA-PSS encoding of a message digest.
+  kPssEncode,
+  // Deriving the public exponent for a public metadata value with HKDF.
+  kDeriveExponent,
+  // Deriving the private key for a public metadata value.
+  kDerivePrivateKey,
+  // Multiplying the encoded message with r^e, including computing r^e if it
+  // was not precomputed.
+  kBlindModExp,
+  // The RSA private key operation on a blinded message.
+  kSignModExp,
+  // Multiplying a blind signature with r^-1.
+  kUnblindModMul,
+  // Recovering the encoded message from a signature with the public key.
+  kVerifyModExp,
+  // Checking the EMSA-PSS encoding of a recovered message.
+  kPssVerify,
+  // Converting the result of a blind, sign or unblind step to bytes.
+  kSerialize,
+};
+
+inline constexpr int kNumLatencyStages =
+    static_cast<int>(LatencyStage::kSerialize) + 1;
+
+// Returns a short name of 'stage', e.g. "sign_mod_exp".
+absl::string_view LatencyStageName(LatencyStage stage);
+
+// Receives the duration of every instrumented stage. Record may be called
+// concurrently from any thread, so implementations must be thread-safe, and
+// it is called on the hot path, so it should be cheap.
+class LatencySink {
+ public:
+  virtual ~LatencySink() = default;
+
+  virtual void Record(LatencyStage stage, absl::Duration duration) = 0;
+};
+
+namespace internal {
+
+ABSL_CONST_INIT extern std::atomic<LatencySink*> latency_sink;
+
+}  // namespace internal
+
+// Installs 'sink' as the process-wide latency sink, or disables
+// instrumentation if it is null. The sink is not owned and must outlive every
+// operation that may still report to it.
+void SetLatencySink(LatencySink* sink);
+
+// Returns the installed sink or null.
+inline LatencySink* GetLatencySink() {
+  return internal::latency_sink.load(std::memory_order_acquire);
+}
+
+// Reports the time from its construction to Stop() or its destruction,
+// whichever comes first, to the sink that was installed at construction.
+//
+// When no sink is installed, a timer costs a single atomic load and never
+// reads the clock.
+class ScopedLatencyTimer {
+ public:
+  explicit ScopedLatencyTimer(LatencyStage stage)
+      : sink_(GetLatencySink()), stage_(stage) {
+    if (sink_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ScopedLatencyTimer(const ScopedLatencyTimer&) = delete;
+  ScopedLatencyTimer& operator=(const ScopedLatencyTimer&) = delete;
+
+  ~ScopedLatencyTimer() { Stop(); }
+
+  // Reports the stage now. Later calls have no effect.
+  void Stop() {
+    if (sink_ != nullptr) {
+      sink_->Record(stage_, absl::FromChrono(std::chrono::steady_clock::now() -
+                                             start_));
+      sink_ = nullptr;
+    }
+  }
+
+ private:
+  LatencySink* sink_;
+  const LatencyStage stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Latency distribution of one stage. Buckets are spaced logarithmically with
+// four buckets per power of two, so quantiles are accurate to within 25%.
+class LatencyHistogram {
+ public:
+  static constexpr int kNumBuckets = 252;
+
+  struct Snapshot {
+    // Returns an upper bound of the q-quantile for q in [0, 1], or zero if
+    // there are no samples.
+    absl::Duration Quantile(double q) const;
+
+    uint64_t count = 0;
+    absl::Duration sum;
+    absl::Duration max;
+    std::array<uint64_t, kNumBuckets> buckets = {};
+  };
+
+  // Records one sample. Lock-free.
+  void Record(absl::Duration duration);
+
+  // Returns the samples recorded so far. Samples recorded concurrently may or
+  // may not be included.
+  Snapshot GetSnapshot() const;
+
+  // Returns the bucket of a sample of 'nanos' nanoseconds.
+  static int BucketIndex(uint64_t nanos);
+  // Returns the smallest sample in bucket 'index' in nanoseconds.
+  static uint64_t BucketLowerBound(int index);
+
+ private:
+  std::atomic<uint64_t> sum_nanos_{0};
+  std::atomic<uint64_t> max_nanos_{0};
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_ = {};
+};
+
+// Per-stage latency distributions at one point in time.
+struct LatencySnapshot {
+  // Returns one line per stage that has samples, with its count, mean and
+  // quantiles.
+  std::string ToString() const;
+
+  std::array<LatencyHistogram::Snapshot, kNumLatencyStages> stages;
+};
+
+// LatencySink that keeps a LatencyHistogram per stage.
+class HistogramLatencySink : public LatencySink {
+ public:
+  void Record(LatencyStage stage, absl::Duration duration) override;
+
+  LatencySnapshot GetSnapshot() const;
+
+ private:
+  std::array<LatencyHistogram, kNumLatencyStages> histograms_;
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SHARED_LATENCY_INSTRUMENTATION_H_
@@ -0,0 +1,130 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/shared/latency_instrumentation.h"
+
+#include <cstdint>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/time/time.h"
+
+namespace anonymous_tokens {
+namespace {
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+class RecordingSink : public LatencySink {
+ public:
+  void Record(LatencyStage stage, absl::Duration duration) override {
+    records.emplace_back(stage, duration);
+  }
+
+  std::vector<std::pair<LatencyStage, absl::Duration>> records;
+};
+
+TEST(LatencyHistogramTest, BucketsContainTheirSamples) {
+  for (uint64_t nanos :
+       {uint64_t{0}, uint64_t{1}, uint64_t{3}, uint64_t{4}, uint64_t{7},
+        uint64_t{8}, uint64_t{1000}, uint64_t{123456789},
+        uint64_t{1} << 40, ~uint64_t{0}}) {
+    const int index = LatencyHistogram::BucketIndex(nanos);
+    ASSERT_GE(index, 0);
+    ASSERT_LT(index, LatencyHistogram::kNumBuckets);
+    EXPECT_LE(LatencyHistogram::BucketLowerBound(index), nanos) << nanos;
+    if (index + 1 < LatencyHistogram::kNumBuckets) {
+      EXPECT_GT(LatencyHistogram::BucketLowerBound(index + 1), nanos)
+          << nanos;
+    }
+  }
+}
+
+TEST(LatencyHistogramTest, QuantilesAreWithinBucketPrecision) {
+  LatencyHistogram histogram;
+  for (int i = 1; i <= 1000; ++i) {
+    histogram.Record(absl::Microseconds(i));
+  }
+  const LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+  EXPECT_EQ(snapshot.count, 1000);
+  EXPECT_EQ(snapshot.sum, absl::Microseconds(500500));
+  EXPECT_EQ(snapshot.max, absl::Microseconds(1000));
+  for (double q : {0.5, 0.9, 0.99}) {
+    const absl::Duration exact = absl::Microseconds(1000 * q);
+    EXPECT_GE(snapshot.Quantile(q), exact) << q;
+    EXPECT_LE(snapshot.Quantile(q), exact * 1.25) << q;
+  }
+  EXPECT_EQ(snapshot.Quantile(1), absl::Microseconds(1000));
+  EXPECT_EQ(LatencyHistogram().GetSnapshot().Quantile(0.5),
+            absl::ZeroDuration());
+}
+
+TEST(LatencyHistogramTest, ConcurrentRecordsAreAllCounted) {
+  constexpr int kNumThreads = 4;
+  constexpr int kRecordsPerThread = 10000;
+  LatencyHistogram histogram;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&histogram, t] {
+      for (int i = 0; i < kRecordsPerThread; ++i) {
+        histogram.Record(absl::Nanoseconds(t * kRecordsPerThread + i));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+  EXPECT_EQ(snapshot.count, kNumThreads * kRecordsPerThread);
+  EXPECT_EQ(snapshot.max,
+            absl::Nanoseconds(kNumThreads * kRecordsPerThread - 1));
+}
+
+TEST(ScopedLatencyTimerTest, ReportsToInstalledSinkOnce) {
+  RecordingSink sink;
+  SetLatencySink(&sink);
+  {
+    ScopedLatencyTimer timer(LatencyStage::kSignModExp);
+    timer.Stop();
+    timer.Stop();
+  }
+  { ScopedLatencyTimer timer(LatencyStage::kPssEncode); }
+  SetLatencySink(nullptr);
+  { ScopedLatencyTimer timer(LatencyStage::kPssVerify); }
+
+  ASSERT_EQ(sink.records.size(), 2);
+  EXPECT_EQ(sink.records[0].first, LatencyStage::kSignModExp);
+  EXPECT_EQ(sink.records[1].first, LatencyStage::kPssEncode);
+  EXPECT_GE(sink.records[0].second, absl::ZeroDuration());
+}
+
+TEST(HistogramLatencySinkTest, SnapshotListsStagesWithSamples) {
+  HistogramLatencySink sink;
+  sink.Record(LatencyStage::kVerifyModExp, absl::Microseconds(40));
+  sink.Record(LatencyStage::kVerifyModExp, absl::Microseconds(60));
+  const LatencySnapshot snapshot = sink.GetSnapshot();
+  EXPECT_EQ(
+      snapshot.stages[static_cast<int>(LatencyStage::kVerifyModExp)].count, 2);
+  EXPECT_EQ(
+      snapshot.stages[static_cast<int>(LatencyStage::kSignModExp)].count, 0);
+  EXPECT_THAT(snapshot.ToString(),
+              HasSubstr("verify_mod_exp: count=2 mean=50us"));
+  EXPECT_THAT(snapshot.ToString(), Not(HasSubstr("sign_mod_exp")));
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -0,0 +1,164 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SHARED_RCU_POINTER_H_
+#define ANONYMOUS_TOKENS_CPP_SHARED_RCU_POINTER_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace anonymous_tokens {
+
+namespace internal {
+
+inline constexpr size_t kRcuNumReaderSlots = 64;
+
+// Returns the reader slot of the calling thread. Threads get consecutive
+// slots in the order in which they first read, so the first
+// kRcuNumReaderSlots threads to read never share one.
+size_t RcuReaderSlot();
+
+}  // namespace internal
+
+// Owns an immutable T that is read without locks and replaced in the style of
+// read-copy-update.
+//
+// Read pins the current value: it increments a reader counter of the current
+// generation in a cache line of its own for the calling thread, loads the
+// pointer, and decrements the counter again when the returned ReadLock goes
+// away. Readers never wait, and as long as at most kRcuNumReaderSlots threads
+// read, they never write to a cache line that another thread writes to.
+//
+// Publish swaps in a new value, which all later readers see, moves new readers
+// to the other generation, and then waits until it has observed each counter
+// of the previous generation at zero before destroying the previous value.
+// Readers that could have loaded the previous value are counted in that
+// generation, or in an older one that an earlier Publish already drained, so
+// the previous value is only destroyed once the readers that were in flight
+// when it was replaced are done. As new readers never join the generation that
+// Publish waits for, a steady stream of readers cannot starve it, but a thread
+// that holds a ReadLock forever blocks Publish.
+template <typename T>
+class RcuPointer {
+ public:
+  // Pins the value that was current when it was created.
+  class ReadLock {
+   public:
+    ReadLock(ReadLock&& other) noexcept
+        : counter_(std::exchange(other.counter_, nullptr)),
+          value_(other.value_) {}
+    ReadLock& operator=(ReadLock&&) = delete;
+    ReadLock(const ReadLock&) = delete;
+    ReadLock& operator=(const ReadLock&) = delete;
+
+    ~ReadLock() {
+      if (counter_ != nullptr) {
+        counter_->fetch_sub(1, std::memory_order_release);
+      }
+    }
+
+    const T* get() const { return value_; }
+    const T& operator*() const { return *value_; }
+    const T* operator->() const { return value_; }
+
+   private:
+    friend class RcuPointer;
+
+    ReadLock(std::atomic<uint64_t>* counter, const T* value)
+        : counter_(counter), value_(value) {}
+
+    std::atomic<uint64_t>* counter_;
+    const T* value_;
+  };
+
+  explicit RcuPointer(std::unique_ptr<const T> value)
+      : value_(value.release()) {}
+
+  // There must be no readers left.
+  ~RcuPointer() { delete value_.load(std::memory_order_acquire); }
+
+  RcuPointer(const RcuPointer&) = delete;
+  RcuPointer& operator=(const RcuPointer&) = delete;
+
+  // Returns a lock on the current value. Lock-free, and only retries if a
+  // Publish switches generations concurrently.
+  ReadLock Read() const {
+    const size_t slot = internal::RcuReaderSlot();
+    // All operations on generation_, value_ and the counters are sequentially
+    // consistent, so that Publish either sees a reader's increment or the
+    // reader sees the new generation and value.
+    for (;;) {
+      const uint64_t generation = generation_.load(std::memory_order_seq_cst);
+      std::atomic<uint64_t>& counter = counters_[generation % 2][slot].count;
+      counter.fetch_add(1, std::memory_order_seq_cst);
+      if (generation_.load(std::memory_order_seq_cst) == generation) {
+        return ReadLock(&counter, value_.load(std::memory_order_seq_cst));
+      }
+      // A Publish may already be waiting for this generation to drain.
+      counter.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  // Replaces the value and destroys the previous one once no reader uses it.
+  // Concurrent calls are serialized. Must not be called while the calling
+  // thread holds a ReadLock on this pointer.
+  void Publish(std::unique_ptr<const T> value) {
+    absl::MutexLock lock(&publish_mutex_);
+    std::unique_ptr<const T> previous(
+        value_.exchange(value.release(), std::memory_order_seq_cst));
+    const uint64_t generation = generation_.load(std::memory_order_relaxed);
+    generation_.store(generation + 1, std::memory_order_seq_cst);
+    for (const ReaderCounter& counter : counters_[generation % 2]) {
+      while (counter.count.load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+      }
+    }
+    num_publishes_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Returns the number of completed calls to Publish. Never blocks, so it may
+  // be called while holding a ReadLock.
+  uint64_t num_publishes() const {
+    return num_publishes_.load(std::memory_order_acquire);
+  }
+
+ private:
+  struct alignas(64) ReaderCounter {
+    std::atomic<uint64_t> count{0};
+  };
+
+  std::atomic<const T*> value_;
+  // Only changed by Publish.
+  std::atomic<uint64_t> generation_{0};
+  // Reader counters of even and odd generations.
+  mutable std::array<std::array<ReaderCounter, internal::kRcuNumReaderSlots>,
+                     2>
+      counters_;
+
+  mutable absl::Mutex publish_mutex_;
+  // Only changed by Publish.
+  std::atomic<uint64_t> num_publishes_{0};
+};
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SHARED_RCU_POINTER_H_
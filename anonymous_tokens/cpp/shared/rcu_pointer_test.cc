@@ -0,0 +1,142 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/shared/rcu_pointer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace anonymous_tokens {
+namespace {
+
+// A value that records its destruction and whose two fields are always equal
+// while it is alive.
+struct Value {
+  Value(int64_t value, std::atomic<int>* num_destroyed)
+      : a(value), b(value), num_destroyed(num_destroyed) {}
+
+  ~Value() {
+    a = -1;
+    b = -2;
+    num_destroyed->fetch_add(1);
+  }
+
+  int64_t a;
+  int64_t b;
+  std::atomic<int>* num_destroyed;
+};
+
+TEST(RcuPointerTest, ReadersSeeTheLatestPublishedValue) {
+  std::atomic<int> num_destroyed{0};
+  {
+    RcuPointer<Value> pointer(std::make_unique<Value>(1, &num_destroyed));
+    EXPECT_EQ(pointer.Read()->a, 1);
+    EXPECT_EQ(pointer.num_publishes(), 0);
+
+    pointer.Publish(std::make_unique<Value>(2, &num_destroyed));
+    EXPECT_EQ(num_destroyed.load(), 1);
+    auto lock = pointer.Read();
+    EXPECT_EQ(lock->a, 2);
+    EXPECT_EQ((*lock).b, 2);
+    EXPECT_EQ(pointer.num_publishes(), 1);
+
+    auto moved_lock = std::move(lock);
+    EXPECT_EQ(moved_lock.get()->a, 2);
+  }
+  EXPECT_EQ(num_destroyed.load(), 2);
+}
+
+TEST(RcuPointerTest, PublishWaitsForReadersOfThePreviousValue) {
+  std::atomic<int> num_destroyed{0};
+  RcuPointer<Value> pointer(std::make_unique<Value>(1, &num_destroyed));
+  absl::Notification reading;
+  absl::Notification release;
+  std::thread reader([&] {
+    auto lock = pointer.Read();
+    reading.Notify();
+    release.WaitForNotification();
+    // The value stays alive while the lock is held.
+    EXPECT_EQ(lock->a, 1);
+    EXPECT_EQ(num_destroyed.load(), 0);
+  });
+  reading.WaitForNotification();
+
+  absl::Notification published;
+  std::thread writer([&] {
+    pointer.Publish(std::make_unique<Value>(2, &num_destroyed));
+    published.Notify();
+  });
+  // New readers see the new value while the old one is still pinned.
+  while (pointer.Read()->a != 2) {
+    std::this_thread::yield();
+  }
+  EXPECT_FALSE(published.WaitForNotificationWithTimeout(absl::Seconds(0.1)));
+  EXPECT_EQ(num_destroyed.load(), 0);
+
+  release.Notify();
+  reader.join();
+  writer.join();
+  EXPECT_TRUE(published.HasBeenNotified());
+  EXPECT_EQ(num_destroyed.load(), 1);
+}
+
+TEST(RcuPointerTest, ConcurrentReadersNeverSeeDestroyedValues) {
+  constexpr int kNumReaders = 4;
+  constexpr int kNumPublishes = 200;
+  constexpr int kMinReads = 2000;
+  std::atomic<int> num_destroyed{0};
+  RcuPointer<Value> pointer(std::make_unique<Value>(0, &num_destroyed));
+  std::atomic<bool> stop{false};
+  std::atomic<int64_t> num_reads{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kNumReaders; ++i) {
+    readers.emplace_back([&] {
+      int64_t last_seen = 0;
+      while (!stop.load()) {
+        auto lock = pointer.Read();
+        const int64_t a = lock->a;
+        // Values only move forward and are never torn or destroyed.
+        EXPECT_GE(a, last_seen);
+        EXPECT_EQ(lock->b, a);
+        last_seen = a;
+        num_reads.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  // Keeps publishing until the readers have overlapped with many publishes,
+  // which takes a while on machines with few cores.
+  int64_t num_publishes = 0;
+  while (num_publishes < kNumPublishes || num_reads.load() < kMinReads) {
+    pointer.Publish(std::make_unique<Value>(++num_publishes, &num_destroyed));
+    std::this_thread::yield();
+  }
+  stop = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(num_destroyed.load(), num_publishes);
+  EXPECT_EQ(pointer.Read()->a, num_publishes);
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
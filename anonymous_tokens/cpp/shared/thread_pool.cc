@@ -0,0 +1,127 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "absl/functional/function_ref.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+
+namespace anonymous_tokens {
+
+absl::StatusOr<std::unique_ptr<ThreadPool>> ThreadPool::New(
+    const int num_threads) {
+  if (num_threads <= 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Number of threads must be positive, got ", num_threads, "."));
+  }
+  return absl::WrapUnique(new ThreadPool(num_threads));
+}
+
+ThreadPool::ThreadPool(const int num_threads) {
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+  absl::MutexLock lock(&mutex_);
+  tasks_.push_back(std::move(task));
+}
+
+bool ThreadPool::HasTaskOrStopping() const {
+  return stopping_ || !tasks_.empty();
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &ThreadPool::HasTaskOrStopping));
+      // Drain the queue before honoring a stop request so that no scheduled
+      // task is silently dropped.
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(
+    const size_t num_items,
+    absl::FunctionRef<void(size_t begin, size_t end)> fn) {
+  if (num_items == 0) {
+    return;
+  }
+  // The calling thread takes one share of the work.
+  const size_t num_ranges =
+      std::min(num_items, static_cast<size_t>(num_threads()) + 1);
+  const size_t range_size = num_items / num_ranges;
+  const size_t remainder = num_items % num_ranges;
+
+  absl::BlockingCounter pending(static_cast<int>(num_ranges - 1));
+  size_t begin = 0;
+  size_t first_end = 0;
+  for (size_t i = 0; i < num_ranges; ++i) {
+    // Spread the remainder over the first ranges so sizes differ by at most 1.
+    const size_t end = begin + range_size + (i < remainder ? 1 : 0);
+    if (i == 0) {
+      first_end = end;
+    } else {
+      Schedule([fn, begin, end, &pending] {
+        fn(begin, end);
+        pending.DecrementCount();
+      });
+    }
+    begin = end;
+  }
+  fn(0, first_end);
+  pending.Wait();
+}
+
+void ParallelFor(ThreadPool* thread_pool, const size_t num_items,
+                 absl::FunctionRef<void(size_t begin, size_t end)> fn) {
+  if (thread_pool != nullptr) {
+    thread_pool->ParallelFor(num_items, fn);
+  } else if (num_items > 0) {
+    fn(0, num_items);
+  }
+}
+
+}  // namespace anonymous_tokens
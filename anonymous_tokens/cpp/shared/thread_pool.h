@@ -0,0 +1,84 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ANONYMOUS_TOKENS_CPP_SHARED_THREAD_POOL_H_
+#define ANONYMOUS_TOKENS_CPP_SHARED_THREAD_POOL_H_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+
+namespace anonymous_tokens {
+
+// A fixed-size pool of worker threads used to fan out independent
+// cryptographic operations, e.g. signing or verifying a batch of tokens.
+//
+// ThreadPool is thread-safe. It is intended to be created once and shared by
+// all batch operations of a process.
+class ThreadPool {
+ public:
+  // Creates a pool with 'num_threads' worker threads. 'num_threads' must be
+  // positive.
+  static absl::StatusOr<std::unique_ptr<ThreadPool>> New(int num_threads);
+
+  // Waits for all scheduled tasks to finish and joins the worker threads.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+  // Runs 'task' on one of the worker threads at some point in the future.
+  void Schedule(std::function<void()> task);
+
+  // Splits [0, num_items) into contiguous ranges and calls fn(begin, end) once
+  // per range, concurrently. The calling thread processes one of the ranges
+  // itself and returns once every range has been processed.
+  //
+  // Ranges are disjoint, so 'fn' may write to per-item output slots without
+  // synchronization. Must not be called from a task running on this pool.
+  void ParallelFor(size_t num_items,
+                   absl::FunctionRef<void(size_t begin, size_t end)> fn);
+
+ private:
+  // Use New to construct.
+  explicit ThreadPool(int num_threads);
+
+  bool HasTaskOrStopping() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void WorkerLoop();
+
+  absl::Mutex mutex_;
+  std::deque<std::function<void()>> tasks_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  std::vector<std::thread> workers_;
+};
+
+// Same as thread_pool->ParallelFor if 'thread_pool' is not null. Otherwise
+// calls fn(0, num_items) on the calling thread, unless 'num_items' is zero.
+void ParallelFor(ThreadPool* thread_pool, size_t num_items,
+                 absl::FunctionRef<void(size_t begin, size_t end)> fn);
+
+}  // namespace anonymous_tokens
+
+#endif  // ANONYMOUS_TOKENS_CPP_SHARED_THREAD_POOL_H_
@@ -0,0 +1,84 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "anonymous_tokens/cpp/testing/utils.h"
+
+namespace anonymous_tokens {
+namespace {
+
+TEST(ThreadPoolTest, RejectsNonPositiveThreadCount) {
+  EXPECT_EQ(ThreadPool::New(0).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(ThreadPool::New(-3).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(ThreadPoolTest, ScheduleRunsAllTasks) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> pool,
+                                   ThreadPool::New(3));
+  constexpr int kNumTasks = 100;
+  std::atomic<int> runs{0};
+  absl::BlockingCounter done(kNumTasks);
+  for (int i = 0; i < kNumTasks; ++i) {
+    pool->Schedule([&runs, &done] {
+      runs.fetch_add(1);
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+  EXPECT_EQ(runs.load(), kNumTasks);
+}
+
+TEST(ThreadPoolTest, ParallelForCoversEveryItemExactlyOnce) {
+  ANON_TOKENS_ASSERT_OK_AND_ASSIGN(std::unique_ptr<ThreadPool> pool,
+                                   ThreadPool::New(4));
+  for (size_t num_items : {0, 1, 3, 5, 17, 1000}) {
+    std::vector<int> visits(num_items, 0);
+    pool->ParallelFor(num_items, [&visits](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        ++visits[i];
+      }
+    });
+    for (size_t i = 0; i < num_items; ++i) {
+      EXPECT_EQ(visits[i], 1) << "num_items = " << num_items << ", i = " << i;
+    }
+  }
+}
+
+TEST(ThreadPoolTest, ParallelForWithoutPoolRunsOnTheCallingThread) {
+  std::vector<std::pair<size_t, size_t>> ranges;
+  ParallelFor(nullptr, 0, [&ranges](size_t begin, size_t end) {
+    ranges.emplace_back(begin, end);
+  });
+  EXPECT_TRUE(ranges.empty());
+  ParallelFor(nullptr, 5, [&ranges](size_t begin, size_t end) {
+    ranges.emplace_back(begin, end);
+  });
+  EXPECT_EQ(ranges, (std::vector<std::pair<size_t, size_t>>{{0, 5}}));
+}
+
+}  // namespace
+}  // namespace anonymous_tokens
@@ -25,8 +25,11 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
 #include "anonymous_tokens/cpp/crypto/crypto_utils.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
+#include "anonymous_tokens/cpp/shared/proto_utils.h"
 #include "anonymous_tokens/cpp/shared/status_utils.h"
 #include "anonymous_tokens/cpp/testing/testdata_utils.h"
 #include "anonymous_tokens/cpp/testing/utils.h"
@@ -272,6 +275,22 @@ absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GetStrongRsaKeys4096() {
   return std::make_pair(std::move(key_pair.first), std::move(key_pair.second));
 }
 
+absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GetStrongRsaKeys(
+    int modulus_size_in_bits) {
+  switch (modulus_size_in_bits) {
+    case 2048:
+      return GetStrongRsaKeys2048();
+    case 3072:
+      return GetStrongRsaKeys3072();
+    case 4096:
+      return GetStrongRsaKeys4096();
+    default:
+      return absl::InvalidArgumentError(absl::StrCat(
+          "No strong RSA test key with a ", modulus_size_in_bits,
+          "-bit modulus."));
+  }
+}
+
 absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>>
 GetIetfStandardRsaBlindSignatureTestKeys() {
   IetfStandardRsaBlindSignatureTestVector test_vector =
@@ -288,4 +307,35 @@ GetIetfRsaBlindSignatureWithPublicMetadataTestKeys() {
                                 test_vectors[0].q);
 }
 
+absl::StatusOr<IssuerKeyConfig> MakeIssuerKeyConfig(
+    const std::pair<RSAPublicKey, RSAPrivateKey>& keys,
+    absl::string_view use_case, int64_t key_version,
+    bool public_metadata_support, MessageMaskType message_mask_type,
+    absl::Time start, absl::Time expiration) {
+  IssuerKeyConfig config;
+  config.private_key = keys.second;
+  RSABlindSignaturePublicKey& public_key = config.public_key;
+  public_key.set_use_case(std::string(use_case));
+  public_key.set_key_version(key_version);
+  public_key.set_serialized_public_key(keys.first.SerializeAsString());
+  public_key.set_sig_hash_type(AT_HASH_TYPE_SHA384);
+  public_key.set_mask_gen_function(AT_MGF_SHA384);
+  public_key.set_salt_length(kSaltLengthInBytes48);
+  public_key.set_key_size(keys.first.n().size());
+  public_key.set_message_mask_type(message_mask_type);
+  public_key.set_message_mask_size(message_mask_type == AT_MESSAGE_MASK_CONCAT
+                                       ? kRsaMessageMaskSizeInBytes32
+                                       : 0);
+  public_key.set_public_metadata_support(public_metadata_support);
+  if (start != absl::InfinitePast()) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(*public_key.mutable_key_validity_start_time(),
+                                 TimeToProto(start));
+  }
+  if (expiration != absl::InfiniteFuture()) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(*public_key.mutable_expiration_time(),
+                                 TimeToProto(expiration));
+  }
+  return config;
+}
+
 }  // namespace anonymous_tokens
@@ -21,7 +21,9 @@
 
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/server/issuer_keyring.h"
 #include "anonymous_tokens/proto/anonymous_tokens.pb.h"
 #include <openssl/base.h>
 
@@ -70,6 +72,11 @@ absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GetStrongRsaKeys3072();
 // Method returns fixed 4096-bit strong RSA modulus for testing.
 absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GetStrongRsaKeys4096();
 
+// Method returns the fixed strong RSA key pair above whose modulus has
+// 'modulus_size_in_bits' bits, which must be 2048, 3072 or 4096.
+absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>> GetStrongRsaKeys(
+    int modulus_size_in_bits);
+
 // This method returns a RSA key pair as described in the IETF test example
 // above.
 absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>>
@@ -81,6 +88,18 @@ GetIetfStandardRsaBlindSignatureTestKeys();
 absl::StatusOr<std::pair<RSAPublicKey, RSAPrivateKey>>
 GetIetfRsaBlindSignatureWithPublicMetadataTestKeys();
 
+// Returns the IssuerKeyConfig for 'keys' with the given use case and version,
+// SHA384 for the signature and MGF1 hashes and a 48 byte salt. Messages are
+// masked with a 32 byte mask if 'message_mask_type' is AT_MESSAGE_MASK_CONCAT.
+// The key is valid from 'start' until 'expiration' unless they are infinite.
+absl::StatusOr<IssuerKeyConfig> MakeIssuerKeyConfig(
+    const std::pair<RSAPublicKey, RSAPrivateKey>& keys,
+    absl::string_view use_case, int64_t key_version,
+    bool public_metadata_support,
+    MessageMaskType message_mask_type = AT_MESSAGE_MASK_CONCAT,
+    absl::Time start = absl::InfinitePast(),
+    absl::Time expiration = absl::InfiniteFuture());
+
 }  // namespace anonymous_tokens
 
 #endif  // ANONYMOUS_TOKENS_CPP_TESTING_PROTO_UTILS_H_
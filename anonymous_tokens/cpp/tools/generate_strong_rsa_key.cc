@@ -0,0 +1,161 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generates an RSA key whose primes are safe primes, as required for RSA blind
+// signatures with public metadata, and writes it out in the formats used by
+// anonymous_tokens/testdata.
+//
+// To run this binary from this directory use:
+// bazel run -c opt :generate_strong_rsa_key --cxxopt='-std=c++17' --
+// <modulus_size_in_bits> <output_prefix> [num_threads]
+//
+// This writes <output_prefix>.binarypb and <output_prefix>.textproto holding
+// the RSAPrivateKey, and <output_prefix>_public.binarypb holding the matching
+// RSABlindSignaturePublicKey. Existing files are never overwritten, and the
+// private key files are only readable by their owner.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "anonymous_tokens/cpp/crypto/constants.h"
+#include "anonymous_tokens/cpp/crypto/strong_rsa_key_generator.h"
+#include "anonymous_tokens/cpp/shared/status_utils.h"
+#include "anonymous_tokens/cpp/shared/thread_pool.h"
+#include "anonymous_tokens/proto/anonymous_tokens.pb.h"
+#include "google/protobuf/text_format.h"
+
+namespace {
+
+constexpr absl::string_view kTextprotoHeader =
+    "# WARNING: This key was generated on a single machine without any key "
+    "ceremony.\n"
+    "# Review how it is stored before using it in production.\n"
+    "# proto-file: third_party/anonymous_tokens/proto/anonymous_tokens.proto\n"
+    "# proto-message: RSAPrivateKey\n\n";
+
+// Permissions of the files holding the private and the public key, before
+// the umask is applied.
+constexpr mode_t kPrivateKeyFileMode = 0600;
+constexpr mode_t kPublicKeyFileMode = 0644;
+
+// Writes 'contents' to the new file 'path' with permissions 'mode'. Fails if
+// 'path' already exists.
+absl::Status WriteFile(const std::string& path, absl::string_view contents,
+                       mode_t mode) {
+  const int fd =
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_EXCL, mode);
+  if (fd < 0) {
+    return absl::InternalError(absl::StrCat("Failed to create ", path, ": ",
+                                            std::strerror(errno)));
+  }
+  while (!contents.empty()) {
+    const ssize_t written = write(fd, contents.data(), contents.size());
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      const int error = errno;
+      close(fd);
+      return absl::InternalError(absl::StrCat("Failed to write ", path, ": ",
+                                              std::strerror(error)));
+    }
+    contents.remove_prefix(written);
+  }
+  if (close(fd) != 0) {
+    return absl::InternalError(absl::StrCat("Failed to write ", path, ": ",
+                                            std::strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Run(int modulus_size_in_bits, const std::string& output_prefix,
+                 int num_threads) {
+  std::unique_ptr<anonymous_tokens::ThreadPool> thread_pool;
+  if (num_threads > 1) {
+    ANON_TOKENS_ASSIGN_OR_RETURN(
+        thread_pool, anonymous_tokens::ThreadPool::New(num_threads - 1));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  ANON_TOKENS_ASSIGN_OR_RETURN(
+      auto keys, anonymous_tokens::GenerateStrongRsaKeys(modulus_size_in_bits,
+                                                         thread_pool.get()));
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cerr << "Generated a " << modulus_size_in_bits << "-bit key with "
+            << num_threads << " thread(s) in " << elapsed.count() << "s."
+            << std::endl;
+
+  const anonymous_tokens::RSAPrivateKey& private_key = keys.second;
+  std::string textproto;
+  if (!google::protobuf::TextFormat::PrintToString(private_key, &textproto)) {
+    return absl::InternalError("Failed to print the private key.");
+  }
+  ANON_TOKENS_RETURN_IF_ERROR(
+      WriteFile(absl::StrCat(output_prefix, ".binarypb"),
+                private_key.SerializeAsString(), kPrivateKeyFileMode));
+  ANON_TOKENS_RETURN_IF_ERROR(
+      WriteFile(absl::StrCat(output_prefix, ".textproto"),
+                absl::StrCat(kTextprotoHeader, textproto),
+                kPrivateKeyFileMode));
+
+  anonymous_tokens::RSABlindSignaturePublicKey public_key;
+  public_key.set_serialized_public_key(keys.first.SerializeAsString());
+  public_key.set_sig_hash_type(anonymous_tokens::AT_HASH_TYPE_SHA384);
+  public_key.set_mask_gen_function(anonymous_tokens::AT_MGF_SHA384);
+  public_key.set_salt_length(anonymous_tokens::kSaltLengthInBytes48);
+  public_key.set_key_size(modulus_size_in_bits / 8);
+  public_key.set_message_mask_type(anonymous_tokens::AT_MESSAGE_MASK_NO_MASK);
+  public_key.set_message_mask_size(0);
+  public_key.set_public_metadata_support(true);
+  return WriteFile(absl::StrCat(output_prefix, "_public.binarypb"),
+                   public_key.SerializeAsString(), kPublicKeyFileMode);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int modulus_size_in_bits = 0;
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  if ((argc != 3 && argc != 4) ||
+      !absl::SimpleAtoi(argv[1], &modulus_size_in_bits) ||
+      (argc == 4 && (!absl::SimpleAtoi(argv[3], &num_threads) ||
+                     num_threads < 1))) {
+    std::cerr << "Usage: " << argv[0]
+              << " <modulus_size_in_bits> <output_prefix> [num_threads]"
+              << std::endl;
+    return 1;
+  }
+  absl::Status status = Run(modulus_size_in_bits, argv[2], num_threads);
+  if (!status.ok()) {
+    std::cerr << status << std::endl;
+    return 1;
+  }
+  return 0;
+}
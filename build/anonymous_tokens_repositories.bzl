@@ -20,6 +20,7 @@ load("//build/tink_base:repo.bzl", "tink_base_repo")
 load("//build/tink_cc:repo.bzl", "tink_cc_repo")
 load("//build/rules_cc:repo.bzl", "rules_cc_repo")
 load("//build/rules_proto:repo.bzl", "rules_proto_repo")
+load("//build/com_github_google_benchmark:repo.bzl", "com_github_google_benchmark_repo")
 load("//build/com_github_google_googletest:repo.bzl", "com_github_google_googletest_repo")
 load("//build/com_google_absl:repo.bzl", "com_google_absl_repo")
 load("//build/boringssl:repo.bzl", "boringssl_repo")
@@ -32,6 +33,7 @@ def anonymous_tokens_repositories():
     tink_cc_repo()
     rules_cc_repo()
     rules_proto_repo()
+    com_github_google_benchmark_repo()
     com_github_google_googletest_repo()
     com_google_absl_repo()
     boringssl_repo()